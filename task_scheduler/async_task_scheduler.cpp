@@ -0,0 +1,224 @@
+#include "async_task_scheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "task_scheduler_util.h"
+
+AsyncTaskScheduler::AsyncTaskScheduler(const SchedulerFactory& factory,
+    size_t num_connections)
+    : factory_(factory),
+      connection_operations_(std::max<size_t>(1, num_connections))
+{
+    for (size_t i = 0; i < connection_operations_.size(); ++i)
+        threads_.emplace_back(&AsyncTaskScheduler::ServeOperations, this, i);
+}
+
+AsyncTaskScheduler::~AsyncTaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    operations_available_.notify_all();
+    for (std::thread& thread : threads_)
+        thread.join();
+}
+
+void AsyncTaskScheduler::Post(const Operation& operation)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        operations_.push_back(operation);
+    }
+    operations_available_.notify_one();
+}
+
+void AsyncTaskScheduler::PostFor(const wchar_t* task_name,
+    const Operation& operation)
+{
+    PostTo(GetConnection(task_name), operation);
+}
+
+size_t AsyncTaskScheduler::GetConnection(const wchar_t* task_name) const
+{
+    // Folded, so that the names of a task all land on the same connection.
+    return static_cast<size_t>(
+        HashTaskName(task_name) % connection_operations_.size());
+}
+
+void AsyncTaskScheduler::PostTo(size_t connection, const Operation& operation)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_operations_[connection].push_back(operation);
+    }
+    // The waiting threads may not include the one of |connection|.
+    operations_available_.notify_all();
+}
+
+std::future<bool> AsyncTaskScheduler::DeleteTask(const wchar_t* task_name)
+{
+    CStringW name(task_name);
+    return RunFor<bool>(name, [name](TaskScheduler* scheduler) {
+        return scheduler->DeleteTask(name);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::IsTaskRegistered(
+    const wchar_t* task_name)
+{
+    CStringW name(task_name);
+    return RunFor<bool>(name, [name](TaskScheduler* scheduler) {
+        return scheduler->IsTaskRegistered(name);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::SetTaskEnabled(const wchar_t* task_name,
+    bool enabled)
+{
+    CStringW name(task_name);
+    return RunFor<bool>(name, [name, enabled](TaskScheduler* scheduler) {
+        return scheduler->SetTaskEnabled(name, enabled);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::IsTaskEnabled(const wchar_t* task_name)
+{
+    CStringW name(task_name);
+    return RunFor<bool>(name, [name](TaskScheduler* scheduler) {
+        return scheduler->IsTaskEnabled(name);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::RegisterTask(
+    const TaskScheduler::TaskSpec& spec)
+{
+    return RunFor<bool>(spec.name, [spec](TaskScheduler* scheduler) {
+        // RegisterTask() has no schedule to take.
+        if (spec.trigger_type == TaskScheduler::TRIGGER_TYPE_SCHEDULE) {
+            std::vector<TaskScheduler::RegisterResult> results;
+            return scheduler->RegisterTasks(
+                std::vector<TaskScheduler::TaskSpec>(1, spec), &results);
+        }
+        return scheduler->RegisterTask(spec.name, spec.description,
+            spec.application_path, spec.application_arguments,
+            spec.trigger_type, spec.hidden);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::GetTaskInfo(const wchar_t* task_name,
+    TaskScheduler::TaskInfo* info)
+{
+    CStringW name(task_name);
+    return RunFor<bool>(name, [name, info](TaskScheduler* scheduler) {
+        return scheduler->GetTaskInfo(name, info);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::GetAllTaskInfo(
+    std::vector<TaskScheduler::TaskInfo>* infos)
+{
+    // A single enumeration of the folder on whichever connection frees up
+    // first. It reads the folder as the service has it, so it doesn't matter
+    // which connection the tasks are assigned to.
+    return Run<bool>([infos](TaskScheduler* scheduler) {
+        return scheduler->GetAllTaskInfo(infos);
+    });
+}
+
+std::future<bool> AsyncTaskScheduler::RegisterTasks(
+    const std::vector<TaskScheduler::TaskSpec>& specs,
+    std::vector<TaskScheduler::RegisterResult>* results)
+{
+    // The batch is split among the connections the tasks are assigned to,
+    // each registering its part as a batch of its own.
+    std::vector<std::vector<size_t>> assigned(num_connections());
+    for (size_t i = 0; i < specs.size(); ++i)
+        assigned[GetConnection(specs[i].name)].push_back(i);
+    results->assign(specs.size(), TaskScheduler::REGISTER_FAILED);
+
+    struct Registration {
+        std::mutex mutex;
+        size_t num_pending;
+        bool success;
+        std::promise<bool> promise;
+    };
+    std::shared_ptr<Registration> registration =
+        std::make_shared<Registration>();
+    registration->num_pending = 0;
+    registration->success = true;
+    std::future<bool> future = registration->promise.get_future();
+    for (const std::vector<size_t>& indices : assigned)
+        registration->num_pending += indices.empty() ? 0 : 1;
+    if (!registration->num_pending) {
+        registration->promise.set_value(true);
+        return future;
+    }
+
+    for (size_t i = 0; i < num_connections(); ++i) {
+        if (assigned[i].empty())
+            continue;
+        std::vector<TaskScheduler::TaskSpec> part;
+        part.reserve(assigned[i].size());
+        for (size_t index : assigned[i])
+            part.push_back(specs[index]);
+        std::vector<size_t> indices(assigned[i]);
+        PostTo(i, [part, indices, results, registration](
+            TaskScheduler* scheduler) {
+            std::vector<TaskScheduler::RegisterResult> part_results;
+            bool success = scheduler &&
+                scheduler->RegisterTasks(part, &part_results);
+            // Each part writes its own elements of |results|.
+            for (size_t j = 0; j < indices.size() && j < part_results.size();
+                ++j) {
+                (*results)[indices[j]] = part_results[j];
+            }
+
+            std::lock_guard<std::mutex> lock(registration->mutex);
+            registration->success = registration->success && success;
+            if (!--registration->num_pending)
+                registration->promise.set_value(registration->success);
+        });
+    }
+    return future;
+}
+
+void AsyncTaskScheduler::ServeOperations(size_t connection)
+{
+    // COM and the scheduler have to be initialized on the thread that uses
+    // them. If either fails, operations are still taken off the queue so that
+    // their futures become ready.
+    HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    std::unique_ptr<TaskScheduler> scheduler;
+    if (SUCCEEDED(hr)) {
+        scheduler.reset(factory_ ? factory_() : nullptr);
+        if (scheduler && !scheduler->Initilize())
+            scheduler.reset();
+    }
+
+    std::deque<Operation>& assigned = connection_operations_[connection];
+    for (;;) {
+        Operation operation;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            operations_available_.wait(lock, [this, &assigned] {
+                return stopping_ || !assigned.empty() || !operations_.empty();
+            });
+            std::deque<Operation>& queue =
+                assigned.empty() ? operations_ : assigned;
+            if (queue.empty())
+                break;
+            operation = std::move(queue.front());
+            queue.pop_front();
+        }
+        operation(scheduler.get());
+    }
+
+    if (scheduler) {
+        scheduler->UnInitilize();
+        scheduler.reset();
+    }
+    if (SUCCEEDED(hr))
+        ::CoUninitialize();
+}
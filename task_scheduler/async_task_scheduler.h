@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "task_scheduler.h"
+
+// Runs TaskScheduler operations on a pool of threads that each own a
+// connection to the backend, so that callers don't block on COM round-trips
+// or on the retries of DeleteTask(). Up to one operation per connection is in
+// flight at a time, so many outstanding operations are pipelined over the
+// pool.
+//
+// Each connection keeps its own view of the folder, which only catches up
+// with the changes made through the others when it is refreshed. So that
+// results stay consistent, every task name is assigned to one connection:
+// the operations on a task all run there, in the order they are issued, and
+// RegisterTasks() is split among the connections by the same assignment.
+// GetAllTaskInfo() enumerates the folder as the service has it, on a single
+// connection.
+//
+// Every method returns immediately. The std::future it returns becomes ready
+// with what the TaskScheduler method of the same name returned, or false if
+// the connection couldn't be set up. Callers that don't want to wait on a
+// future can Post() an operation that does the call and then notifies them.
+class AsyncTaskScheduler
+{
+public:
+    // Return a new, not yet initialized scheduler, as CraateTaskScheduler()
+    // does. Called once on each thread of the pool.
+    typedef std::function<TaskScheduler*()> SchedulerFactory;
+
+    // Work to run on a thread of the pool with that thread's scheduler, which
+    // is null if it couldn't be created or initialized.
+    typedef std::function<void(TaskScheduler* scheduler)> Operation;
+
+    // Start |num_connections| threads, at least one, that each initialize COM
+    // for the multithreaded apartment and a scheduler from |factory|.
+    AsyncTaskScheduler(const SchedulerFactory& factory,
+        size_t num_connections);
+
+    // Finish every operation already issued, then shut the connections down.
+    ~AsyncTaskScheduler();
+
+    // Queue |operation|. It is run on whichever connection frees up first,
+    // which may not have seen the changes made through the others yet.
+    void Post(const Operation& operation);
+
+    // Queue |operation| on the connection |task_name| is assigned to, behind
+    // the operations on that task issued before it.
+    void PostFor(const wchar_t* task_name, const Operation& operation);
+
+    // Queue |operation| and return a future for its result. |operation| isn't
+    // run if the connection couldn't be set up, and the future holds a
+    // value-initialized Result instead.
+    template <typename Result>
+    std::future<Result> Run(
+        const std::function<Result(TaskScheduler* scheduler)>& operation);
+
+    // Same as Run(), but on the connection |task_name| is assigned to, as
+    // PostFor() does.
+    template <typename Result>
+    std::future<Result> RunFor(const wchar_t* task_name,
+        const std::function<Result(TaskScheduler* scheduler)>& operation);
+
+    std::future<bool> DeleteTask(const wchar_t* task_name);
+    std::future<bool> IsTaskRegistered(const wchar_t* task_name);
+    std::future<bool> SetTaskEnabled(const wchar_t* task_name, bool enabled);
+    std::future<bool> IsTaskEnabled(const wchar_t* task_name);
+    std::future<bool> RegisterTask(const TaskScheduler::TaskSpec& spec);
+
+    // The out parameters of these are written on threads of the pool and
+    // must stay valid until the future is ready.
+    std::future<bool> GetTaskInfo(const wchar_t* task_name,
+        TaskScheduler::TaskInfo* info);
+    std::future<bool> GetAllTaskInfo(
+        std::vector<TaskScheduler::TaskInfo>* infos);
+    std::future<bool> RegisterTasks(
+        const std::vector<TaskScheduler::TaskSpec>& specs,
+        std::vector<TaskScheduler::RegisterResult>* results);
+
+    size_t num_connections() const { return connection_operations_.size(); }
+
+private:
+    AsyncTaskScheduler(const AsyncTaskScheduler&) = delete;
+    AsyncTaskScheduler& operator=(const AsyncTaskScheduler&) = delete;
+
+    // Return the connection |task_name| is assigned to.
+    size_t GetConnection(const wchar_t* task_name) const;
+
+    // Queue |operation| on |connection|.
+    void PostTo(size_t connection, const Operation& operation);
+
+    // Wrap |operation| to fulfill a new future with its result.
+    template <typename Result>
+    static Operation MakeOperation(
+        const std::function<Result(TaskScheduler* scheduler)>& operation,
+        std::future<Result>* future);
+
+    // Body of the thread of |connection|.
+    void ServeOperations(size_t connection);
+
+    SchedulerFactory factory_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable operations_available_;
+    // Operations for any connection.
+    std::deque<Operation> operations_;
+    // Operations for each connection in particular, which it runs first.
+    std::vector<std::deque<Operation>> connection_operations_;
+    bool stopping_ = false;
+};
+
+template <typename Result>
+std::future<Result> AsyncTaskScheduler::Run(
+    const std::function<Result(TaskScheduler* scheduler)>& operation)
+{
+    std::future<Result> future;
+    Post(MakeOperation(operation, &future));
+    return future;
+}
+
+template <typename Result>
+std::future<Result> AsyncTaskScheduler::RunFor(const wchar_t* task_name,
+    const std::function<Result(TaskScheduler* scheduler)>& operation)
+{
+    std::future<Result> future;
+    PostFor(task_name, MakeOperation(operation, &future));
+    return future;
+}
+
+template <typename Result>
+AsyncTaskScheduler::Operation AsyncTaskScheduler::MakeOperation(
+    const std::function<Result(TaskScheduler* scheduler)>& operation,
+    std::future<Result>* future)
+{
+    // std::function needs a copyable target, so the promise is shared.
+    std::shared_ptr<std::promise<Result>> promise =
+        std::make_shared<std::promise<Result>>();
+    *future = promise->get_future();
+    return [promise, operation](TaskScheduler* scheduler) {
+        promise->set_value(scheduler ? operation(scheduler) : Result());
+    };
+}
@@ -0,0 +1,422 @@
+#include "catalog_snapshot.h"
+
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "task_info_table.h"
+#include "task_scheduler_util.h"
+
+// The first bytes of an image. All of its integers are little endian.
+struct CatalogSnapshotHeader {
+    uint8_t magic[4];
+    uint32_t version;
+    // FNV-1a of everything after the header, see ComputeChecksum().
+    uint64_t checksum;
+    uint64_t created_at;
+    uint32_t num_tasks;
+    uint32_t num_exec_actions;
+    uint32_t num_slots;
+    uint32_t num_characters;
+};
+
+namespace {
+
+const uint8_t kSnapshotMagic[4] = { 'T', 'S', 'C', 'S' };
+
+// The records are read in place, so their layout is the file format.
+static_assert(sizeof(CatalogSnapshotHeader) == 40, "Header layout changed");
+static_assert(sizeof(CatalogSnapshot::Task) == 40, "Task layout changed");
+static_assert(sizeof(CatalogSnapshot::ExecAction) == 24,
+    "ExecAction layout changed");
+static_assert(sizeof(wchar_t) == 2, "Characters are stored as UTF-16");
+
+const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+// Where the sections of an image are, for the counts of a header.
+struct SnapshotLayout {
+    uint64_t tasks;
+    uint64_t exec_actions;
+    uint64_t slots;
+    uint64_t characters;
+    uint64_t size;
+};
+
+SnapshotLayout GetLayout(const CatalogSnapshotHeader& header) {
+    SnapshotLayout layout;
+    layout.tasks = sizeof(CatalogSnapshotHeader);
+    layout.exec_actions = layout.tasks +
+        static_cast<uint64_t>(header.num_tasks) * sizeof(CatalogSnapshot::Task);
+    layout.slots = layout.exec_actions +
+        static_cast<uint64_t>(header.num_exec_actions) *
+        sizeof(CatalogSnapshot::ExecAction);
+    layout.characters = layout.slots +
+        static_cast<uint64_t>(header.num_slots) * sizeof(uint32_t);
+    layout.size = layout.characters +
+        static_cast<uint64_t>(header.num_characters) * sizeof(wchar_t);
+    return layout;
+}
+
+// FNV-1a over 64-bit words rather than bytes, so that checking a large
+// image at load time only takes a fraction of reading it. The last word is
+// padded with zeros.
+uint64_t ComputeChecksum(const uint8_t* data, size_t size) {
+    uint64_t hash = kFnvOffsetBasis;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash ^= word;
+        hash *= kFnvPrime;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        hash ^= word;
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+void HashBytes(const void* data, size_t size, uint64_t* hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        *hash ^= bytes[i];
+        *hash *= kFnvPrime;
+    }
+}
+
+// Hash the length first so that adjacent fields can't run into each other.
+void HashString(const wchar_t* value, uint32_t length, uint64_t* hash) {
+    HashBytes(&length, sizeof(length), hash);
+    HashBytes(value, length * sizeof(wchar_t), hash);
+}
+
+// Lays out the strings of an image, storing the strings of a TaskInfoTable
+// once each like the table does.
+class CharacterWriter
+{
+public:
+    explicit CharacterWriter(std::vector<wchar_t>* characters)
+        : characters_(characters) {}
+
+    CatalogSnapshot::StringRef Copy(const TaskInfoTable& table,
+        TaskInfoTable::StringRef string) {
+        auto it = copied_.find(string.offset);
+        if (it != copied_.end() && it->second.length == string.length)
+            return it->second;
+        CatalogSnapshot::StringRef copy = {
+            static_cast<uint32_t>(characters_->size()), string.length };
+        const wchar_t* value = table.GetString(string);
+        characters_->insert(characters_->end(), value, value + string.length);
+        characters_->push_back(L'\0');
+        copied_[string.offset] = copy;
+        return copy;
+    }
+
+private:
+    std::vector<wchar_t>* characters_;
+    // Offset in the table -> the copy in the image.
+    std::unordered_map<uint32_t, CatalogSnapshot::StringRef> copied_;
+};
+
+}  // namespace
+
+CatalogSnapshot::CatalogSnapshot()
+{
+
+}
+
+CatalogSnapshot::~CatalogSnapshot()
+{
+    Close();
+}
+
+bool CatalogSnapshot::Open(const wchar_t* path)
+{
+    Close();
+
+    HANDLE file = ::CreateFileW(path, GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if (!::GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0 ||
+        static_cast<uint64_t>(file_size.QuadPart) > SIZE_MAX) {
+        ::CloseHandle(file);
+        return false;
+    }
+    // The mapping keeps the file open.
+    HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0,
+        nullptr);
+    ::CloseHandle(file);
+    if (!mapping)
+        return false;
+    const void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        ::CloseHandle(mapping);
+        return false;
+    }
+
+    mapping_ = mapping;
+    view_ = view;
+    if (!Check(view, static_cast<size_t>(file_size.QuadPart))) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool CatalogSnapshot::Attach(const void* data, size_t size)
+{
+    Close();
+    return Check(data, size);
+}
+
+void CatalogSnapshot::Close()
+{
+    if (view_)
+        ::UnmapViewOfFile(view_);
+    if (mapping_)
+        ::CloseHandle(mapping_);
+    mapping_ = nullptr;
+    view_ = nullptr;
+    header_ = nullptr;
+    tasks_ = nullptr;
+    exec_actions_ = nullptr;
+    slots_ = nullptr;
+    characters_ = nullptr;
+}
+
+uint64_t CatalogSnapshot::created_at() const
+{
+    return header_ ? header_->created_at : 0;
+}
+
+size_t CatalogSnapshot::size() const
+{
+    return header_ ? header_->num_tasks : 0;
+}
+
+size_t CatalogSnapshot::FindTask(const wchar_t* task_name) const
+{
+    if (!header_)
+        return kNotFound;
+    if (!task_name)
+        task_name = L"";
+
+    size_t mask = header_->num_slots - 1;
+    size_t slot = static_cast<size_t>(HashTaskName(task_name)) & mask;
+    // Bounded by the number of slots in case the table has no free slot.
+    for (uint32_t probes = 0; probes < header_->num_slots; ++probes) {
+        uint32_t entry = slots_[slot];
+        if (!entry)
+            break;
+        if (TaskNamesEqual(GetString(tasks_[entry - 1].name), task_name))
+            return entry - 1;
+        slot = (slot + 1) & mask;
+    }
+    return kNotFound;
+}
+
+void CatalogSnapshot::GetTaskInfo(size_t index,
+    TaskScheduler::TaskInfo* info) const
+{
+    const Task& task = tasks_[index];
+    info->name = GetString(task.name);
+    info->description = GetString(task.description);
+    info->logon_type = task.logon_type;
+    info->exec_actions.resize(task.num_exec_actions);
+    for (uint32_t i = 0; i < task.num_exec_actions; ++i) {
+        const ExecAction& action = exec_actions_[task.first_exec_action + i];
+        info->exec_actions[i].application_path =
+            GetString(action.application_path);
+        info->exec_actions[i].working_dir = GetString(action.working_dir);
+        info->exec_actions[i].arguments = GetString(action.arguments);
+    }
+}
+
+bool CatalogSnapshot::Check(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (size < sizeof(CatalogSnapshotHeader))
+        return false;
+    const CatalogSnapshotHeader* header =
+        reinterpret_cast<const CatalogSnapshotHeader*>(bytes);
+    if (memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+        header->version != kVersion) {
+        return false;
+    }
+    SnapshotLayout layout = GetLayout(*header);
+    if (layout.size != size)
+        return false;
+    if (ComputeChecksum(bytes + sizeof(CatalogSnapshotHeader),
+            size - sizeof(CatalogSnapshotHeader)) != header->checksum) {
+        return false;
+    }
+    // There must be a free slot for lookups of unknown names to end.
+    uint32_t num_slots = header->num_slots;
+    if (num_slots <= header->num_tasks || (num_slots & (num_slots - 1)))
+        return false;
+
+    header_ = header;
+    tasks_ = reinterpret_cast<const Task*>(bytes + layout.tasks);
+    exec_actions_ = reinterpret_cast<const ExecAction*>(
+        bytes + layout.exec_actions);
+    slots_ = reinterpret_cast<const uint32_t*>(bytes + layout.slots);
+    characters_ = reinterpret_cast<const wchar_t*>(bytes + layout.characters);
+
+    // The checksum only catches accidents. Check that every reference stays
+    // within the image so that queries can trust them.
+    bool valid = true;
+    for (uint32_t i = 0; valid && i < header->num_tasks; ++i) {
+        const Task& task = tasks_[i];
+        valid = IsValidString(task.name) && IsValidString(task.description) &&
+            static_cast<uint64_t>(task.first_exec_action) +
+            task.num_exec_actions <= header->num_exec_actions;
+    }
+    for (uint32_t i = 0; valid && i < header->num_exec_actions; ++i) {
+        const ExecAction& action = exec_actions_[i];
+        valid = IsValidString(action.application_path) &&
+            IsValidString(action.working_dir) &&
+            IsValidString(action.arguments);
+    }
+    for (uint32_t i = 0; valid && i < num_slots; ++i)
+        valid = slots_[i] <= header->num_tasks;
+    if (!valid) {
+        header_ = nullptr;
+        tasks_ = nullptr;
+        exec_actions_ = nullptr;
+        slots_ = nullptr;
+        characters_ = nullptr;
+    }
+    return valid;
+}
+
+bool CatalogSnapshot::IsValidString(StringRef string) const
+{
+    uint64_t end = static_cast<uint64_t>(string.offset) + string.length;
+    return end < header_->num_characters && characters_[end] == L'\0';
+}
+
+void BuildCatalogSnapshot(const TaskInfoTable& table,
+    const std::vector<TaskScheduler::TaskSummary>& summaries,
+    std::vector<uint8_t>* image)
+{
+    std::unordered_map<std::wstring, const TaskScheduler::TaskSummary*>
+        summaries_by_name;
+    for (const TaskScheduler::TaskSummary& summary : summaries)
+        summaries_by_name[FoldTaskName(summary.name)] = &summary;
+
+    std::vector<CatalogSnapshot::Task> tasks(table.size());
+    std::vector<CatalogSnapshot::ExecAction> exec_actions;
+    std::vector<wchar_t> characters;
+    CharacterWriter writer(&characters);
+    for (size_t i = 0; i < table.size(); ++i) {
+        const TaskInfoTable::Task& source = table.task(i);
+        CatalogSnapshot::Task& task = tasks[i];
+        task.name = writer.Copy(table, source.name);
+        task.description = writer.Copy(table, source.description);
+        task.first_exec_action = static_cast<uint32_t>(exec_actions.size());
+        task.num_exec_actions = source.num_exec_actions;
+        task.logon_type = source.logon_type;
+
+        uint64_t hash = kFnvOffsetBasis;
+        HashString(table.GetString(source.description),
+            source.description.length, &hash);
+        for (uint32_t j = 0; j < source.num_exec_actions; ++j) {
+            const TaskInfoTable::ExecAction& action =
+                table.exec_action(source.first_exec_action + j);
+            CatalogSnapshot::ExecAction copy;
+            copy.application_path = writer.Copy(table, action.application_path);
+            copy.working_dir = writer.Copy(table, action.working_dir);
+            copy.arguments = writer.Copy(table, action.arguments);
+            exec_actions.push_back(copy);
+            HashString(table.GetString(action.application_path),
+                action.application_path.length, &hash);
+            HashString(table.GetString(action.working_dir),
+                action.working_dir.length, &hash);
+            HashString(table.GetString(action.arguments),
+                action.arguments.length, &hash);
+        }
+        HashBytes(&source.logon_type, sizeof(source.logon_type), &hash);
+
+        auto it = summaries_by_name.find(
+            FoldTaskName(table.GetString(source.name)));
+        task.enabled = 0;
+        if (it != summaries_by_name.end()) {
+            const TaskScheduler::TaskSummary& summary = *it->second;
+            task.enabled = summary.enabled ? 1 : 0;
+            HashString(summary.fingerprint,
+                static_cast<uint32_t>(summary.fingerprint.GetLength()), &hash);
+        }
+        task.definition_hash = hash;
+    }
+    // An empty image still needs a character for IsValidString() to accept
+    // nothing, and a free slot.
+    if (characters.empty())
+        characters.push_back(L'\0');
+
+    // At most half full, which also leaves a free slot.
+    uint32_t num_slots = 1;
+    while (num_slots < tasks.size() * 2)
+        num_slots *= 2;
+    std::vector<uint32_t> slots(num_slots, 0);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        size_t slot = static_cast<size_t>(HashTaskName(
+            &characters[tasks[i].name.offset])) & (num_slots - 1);
+        while (slots[slot])
+            slot = (slot + 1) & (num_slots - 1);
+        slots[slot] = static_cast<uint32_t>(i + 1);
+    }
+
+    CatalogSnapshotHeader header = {};
+    memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+    header.version = CatalogSnapshot::kVersion;
+    FILETIME now;
+    ::GetSystemTimeAsFileTime(&now);
+    header.created_at =
+        (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+    header.num_tasks = static_cast<uint32_t>(tasks.size());
+    header.num_exec_actions = static_cast<uint32_t>(exec_actions.size());
+    header.num_slots = num_slots;
+    header.num_characters = static_cast<uint32_t>(characters.size());
+    SnapshotLayout layout = GetLayout(header);
+
+    std::vector<uint8_t> image_storage(static_cast<size_t>(layout.size));
+    uint8_t* bytes = &image_storage[0];
+    if (!tasks.empty()) {
+        memcpy(bytes + layout.tasks, &tasks[0],
+            tasks.size() * sizeof(CatalogSnapshot::Task));
+    }
+    if (!exec_actions.empty()) {
+        memcpy(bytes + layout.exec_actions, &exec_actions[0],
+            exec_actions.size() * sizeof(CatalogSnapshot::ExecAction));
+    }
+    memcpy(bytes + layout.slots, &slots[0], slots.size() * sizeof(uint32_t));
+    memcpy(bytes + layout.characters, &characters[0],
+        characters.size() * sizeof(wchar_t));
+    header.checksum = ComputeChecksum(bytes + sizeof(header),
+        image_storage.size() - sizeof(header));
+    memcpy(bytes, &header, sizeof(header));
+    image->swap(image_storage);
+}
+
+bool ReadCatalogSnapshot(TaskScheduler* scheduler, std::vector<uint8_t>* image)
+{
+    TaskInfoTable table;
+    std::vector<TaskScheduler::TaskSummary> summaries;
+    if (!scheduler->GetTaskCatalog(&table, &summaries))
+        return false;
+    BuildCatalogSnapshot(table, summaries, image);
+    return true;
+}
+
+bool WriteCatalogSnapshot(const wchar_t* path,
+    const std::vector<uint8_t>& image)
+{
+    return WriteFileAtomically(path, image.data(), image.size());
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <windows.h>
+#include <vector>
+
+#include "task_scheduler.h"
+
+class TaskInfoTable;
+struct CatalogSnapshotHeader;
+
+// An image of the tasks of a folder that is queried where it lies, in a
+// mapped file or a buffer, without being deserialized. A process saves one
+// with WriteCatalogSnapshot() so that the next run can answer queries as soon
+// as it starts, rather than after enumerating the folder.
+//
+// The image is a header holding a magic, the format version, the counts and
+// a checksum of the rest, followed by fixed size records for the tasks and
+// their exec actions, an open addressing hash table of the tasks by case
+// folded name, and the characters of every string, each null terminated.
+class CatalogSnapshot
+{
+public:
+    // Bump whenever the layout changes. Images of another version are
+    // rejected.
+    static const uint32_t kVersion = 1;
+
+    // Returned by FindTask() for unknown names.
+    static const size_t kNotFound = static_cast<size_t>(-1);
+
+    // |length| characters at |offset| in the characters of the image,
+    // followed by a terminating null.
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct ExecAction {
+        StringRef application_path;
+        StringRef working_dir;
+        StringRef arguments;
+    };
+
+    struct Task {
+        StringRef name;
+        StringRef description;
+        // The range of the task's exec actions in exec_action().
+        uint32_t first_exec_action;
+        uint32_t num_exec_actions;
+        uint32_t logon_type;
+        uint32_t enabled;
+        // Hash of the description, exec actions, logon type and fingerprint
+        // of the task, to tell cheaply whether its definition changed.
+        uint64_t definition_hash;
+    };
+
+    CatalogSnapshot();
+    // Close() the snapshot.
+    ~CatalogSnapshot();
+
+    // Map the snapshot file at |path| and check it. Return false if it can't
+    // be read, is of another version or is corrupt. The file can't be
+    // replaced while it is mapped.
+    bool Open(const wchar_t* path);
+
+    // Check and use the image of |size| bytes at |data|, which must stay
+    // valid and unmodified until the snapshot is closed.
+    bool Attach(const void* data, size_t size);
+
+    void Close();
+
+    bool is_open() const { return header_ != nullptr; }
+
+    // When the image was built, as a FILETIME.
+    uint64_t created_at() const;
+
+    size_t size() const;
+    const Task& task(size_t index) const { return tasks_[index]; }
+    const ExecAction& exec_action(size_t index) const {
+        return exec_actions_[index];
+    }
+
+    // Return the null terminated string |string| refers to.
+    const wchar_t* GetString(StringRef string) const {
+        return characters_ + string.offset;
+    }
+
+    // Return the index of the task named |task_name|, compared as
+    // FoldTaskName() does, or kNotFound. Doesn't allocate.
+    size_t FindTask(const wchar_t* task_name) const;
+
+    // Copy the task at |index| out as a TaskInfo.
+    void GetTaskInfo(size_t index, TaskScheduler::TaskInfo* info) const;
+
+private:
+    CatalogSnapshot(const CatalogSnapshot&) = delete;
+    CatalogSnapshot& operator=(const CatalogSnapshot&) = delete;
+
+    // Point at the image of |size| bytes at |data| if it is valid.
+    bool Check(const void* data, size_t size);
+    bool IsValidString(StringRef string) const;
+
+    // The mapping of the file opened by Open(), null for attached images.
+    HANDLE mapping_ = nullptr;
+    const void* view_ = nullptr;
+
+    const CatalogSnapshotHeader* header_ = nullptr;
+    const Task* tasks_ = nullptr;
+    const ExecAction* exec_actions_ = nullptr;
+    // Index of the task plus one, 0 marking free slots. The number of slots
+    // is a power of two.
+    const uint32_t* slots_ = nullptr;
+    const wchar_t* characters_ = nullptr;
+};
+
+// Build the snapshot image of the tasks of |table|, taking whether they are
+// enabled and their fingerprint from the entry of |summaries| with the same
+// name. Tasks without one are recorded as disabled.
+void BuildCatalogSnapshot(const TaskInfoTable& table,
+    const std::vector<TaskScheduler::TaskSummary>& summaries,
+    std::vector<uint8_t>* image);
+
+// Read every task of |scheduler| into a snapshot image, in a single
+// enumeration where the backend can. On error, |image| is left unmodified.
+bool ReadCatalogSnapshot(TaskScheduler* scheduler, std::vector<uint8_t>* image);
+
+// Write |image| to |path| atomically: it is written to a temporary file next
+// to |path|, flushed, then moved over |path|, so that a reader finds either
+// the previous snapshot or the new one in full.
+bool WriteCatalogSnapshot(const wchar_t* path,
+    const std::vector<uint8_t>& image);
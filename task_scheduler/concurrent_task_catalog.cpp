@@ -0,0 +1,254 @@
+#include "concurrent_task_catalog.h"
+
+#include "task_scheduler_util.h"
+
+namespace {
+
+// The catalog is split into 1 << kShardBits shards, by the top bits of the
+// hash of task names. The bottom bits pick the slot within a shard.
+const int kShardBits = 6;
+const size_t kNumShards = 1 << kShardBits;
+
+const size_t kNotFound = static_cast<size_t>(-1);
+
+// Task::enabled_ of a task not read yet.
+const int kEnabledUnknown = -1;
+
+size_t GetShardIndex(uint64_t hash) {
+    return static_cast<size_t>(hash >> (64 - kShardBits));
+}
+
+void CopyString(const CStringW& from, CStringW* to) {
+    to->SetString(from.GetString(), from.GetLength());
+}
+
+}  // namespace
+
+ConcurrentTaskCatalog::Task::Task(const wchar_t* task_name)
+    : name(task_name), enabled_(kEnabledUnknown), has_info_(false)
+{
+
+}
+
+bool ConcurrentTaskCatalog::Task::GetEnabled(bool* enabled) const
+{
+    int state = enabled_.load(std::memory_order_relaxed);
+    if (state == kEnabledUnknown)
+        return false;
+    *enabled = state != 0;
+    return true;
+}
+
+const std::shared_ptr<const TaskScheduler::TaskInfo>&
+ConcurrentTaskCatalog::Task::info() const
+{
+    static const std::shared_ptr<const TaskScheduler::TaskInfo> kNoInfo;
+    // Acquire, pairing with the release in SetTaskInfo(), so that |info_|
+    // is seen as it was set.
+    return has_info_.load(std::memory_order_acquire) ? info_ : kNoInfo;
+}
+
+const ConcurrentTaskCatalog::Task* ConcurrentTaskCatalog::Version::FindTask(
+    const wchar_t* task_name) const
+{
+    if (!task_name)
+        task_name = L"";
+    uint64_t hash = HashTaskName(task_name);
+    const Shard& shard = *shards_[GetShardIndex(hash)];
+    size_t index = FindInShard(shard, task_name, hash);
+    return index == kNotFound ? nullptr : shard.tasks[index].get();
+}
+
+size_t ConcurrentTaskCatalog::Version::FindInShard(const Shard& shard,
+    const wchar_t* task_name, uint64_t hash)
+{
+    if (shard.slots.empty())
+        return kNotFound;
+    size_t mask = shard.slots.size() - 1;
+    for (size_t slot = static_cast<size_t>(hash) & mask;;
+        slot = (slot + 1) & mask) {
+        uint32_t entry = shard.slots[slot];
+        if (!entry)
+            return kNotFound;
+        if (TaskNamesEqual(shard.tasks[entry - 1]->name, task_name))
+            return entry - 1;
+    }
+}
+
+ConcurrentTaskCatalog::Reader::Reader(const ConcurrentTaskCatalog& catalog)
+    : section_(&catalog.rcu_),
+      version_(catalog.current_.load(std::memory_order_seq_cst))
+{
+
+}
+
+ConcurrentTaskCatalog::ConcurrentTaskCatalog()
+    : current_(nullptr)
+{
+
+}
+
+ConcurrentTaskCatalog::~ConcurrentTaskCatalog()
+{
+    delete current_.load(std::memory_order_relaxed);
+    for (const RetiredVersion& retired : retired_)
+        delete retired.version;
+}
+
+void ConcurrentTaskCatalog::Reset(const std::vector<CStringW>& task_names,
+    ULONGLONG listed_at)
+{
+    std::vector<std::vector<std::shared_ptr<const Task>>> shard_tasks(
+        kNumShards);
+    for (const CStringW& task_name : task_names) {
+        shard_tasks[GetShardIndex(HashTaskName(task_name))].push_back(
+            std::make_shared<const Task>(task_name));
+    }
+
+    std::unique_ptr<Version> version(new Version());
+    version->shards_.reserve(kNumShards);
+    for (auto& shard : shard_tasks)
+        version->shards_.push_back(BuildShard(&shard));
+    version->listed_at_ = listed_at;
+    Publish(version.release());
+}
+
+void ConcurrentTaskCatalog::Clear()
+{
+    Publish(nullptr);
+}
+
+void ConcurrentTaskCatalog::SetTask(const wchar_t* task_name)
+{
+    // Only writers change |current_|, so they read it without a Reader.
+    const Version* current = current_.load(std::memory_order_relaxed);
+    if (!current)
+        return;
+
+    uint64_t hash = HashTaskName(task_name);
+    size_t shard_index = GetShardIndex(hash);
+    const Version::Shard& shard = *current->shards_[shard_index];
+    std::vector<std::shared_ptr<const Task>> tasks(shard.tasks);
+    std::shared_ptr<const Task> new_task =
+        std::make_shared<const Task>(task_name);
+    size_t index = Version::FindInShard(shard, task_name, hash);
+    if (index == kNotFound)
+        tasks.push_back(new_task);
+    else
+        tasks[index] = new_task;
+    ReplaceShard(shard_index, &tasks);
+}
+
+void ConcurrentTaskCatalog::RemoveTask(const wchar_t* task_name)
+{
+    const Version* current = current_.load(std::memory_order_relaxed);
+    if (!current)
+        return;
+
+    uint64_t hash = HashTaskName(task_name);
+    size_t shard_index = GetShardIndex(hash);
+    const Version::Shard& shard = *current->shards_[shard_index];
+    size_t index = Version::FindInShard(shard, task_name, hash);
+    if (index == kNotFound)
+        return;
+    std::vector<std::shared_ptr<const Task>> tasks(shard.tasks);
+    tasks.erase(tasks.begin() + index);
+    ReplaceShard(shard_index, &tasks);
+}
+
+void ConcurrentTaskCatalog::SetTaskEnabled(const wchar_t* task_name,
+    bool enabled)
+{
+    const Version* current = current_.load(std::memory_order_relaxed);
+    const Task* task = current ? current->FindTask(task_name) : nullptr;
+    if (task)
+        task->enabled_.store(enabled ? 1 : 0, std::memory_order_relaxed);
+}
+
+void ConcurrentTaskCatalog::SetTaskInfo(const wchar_t* task_name,
+    const TaskScheduler::TaskInfo& info)
+{
+    const Version* current = current_.load(std::memory_order_relaxed);
+    const Task* task = current ? current->FindTask(task_name) : nullptr;
+    // Readers may be copying the TaskInfo already set, so it stays. Changes
+    // are serialized, so nobody else sets it meanwhile.
+    if (!task || task->has_info_.load(std::memory_order_relaxed))
+        return;
+    task->info_ = std::make_shared<const TaskScheduler::TaskInfo>(info);
+    task->has_info_.store(true, std::memory_order_release);
+}
+
+std::shared_ptr<const ConcurrentTaskCatalog::Version::Shard>
+ConcurrentTaskCatalog::BuildShard(
+    std::vector<std::shared_ptr<const Task>>* tasks)
+{
+    std::shared_ptr<Version::Shard> shard =
+        std::make_shared<Version::Shard>();
+    shard->tasks.swap(*tasks);
+    if (shard->tasks.empty())
+        return shard;
+
+    // At most half full, so that probe sequences stay short.
+    size_t num_slots = 1;
+    while (num_slots < shard->tasks.size() * 2)
+        num_slots *= 2;
+    shard->slots.assign(num_slots, 0);
+    size_t mask = num_slots - 1;
+    for (size_t i = 0; i < shard->tasks.size(); ++i) {
+        size_t slot =
+            static_cast<size_t>(HashTaskName(shard->tasks[i]->name)) & mask;
+        while (shard->slots[slot])
+            slot = (slot + 1) & mask;
+        shard->slots[slot] = static_cast<uint32_t>(i + 1);
+    }
+    return shard;
+}
+
+void ConcurrentTaskCatalog::ReplaceShard(size_t index,
+    std::vector<std::shared_ptr<const Task>>* tasks)
+{
+    const Version* current = current_.load(std::memory_order_relaxed);
+    std::unique_ptr<Version> version(new Version(*current));
+    version->shards_[index] = BuildShard(tasks);
+    Publish(version.release());
+}
+
+void ConcurrentTaskCatalog::Publish(const Version* version)
+{
+    const Version* replaced =
+        current_.exchange(version, std::memory_order_seq_cst);
+    if (replaced) {
+        RetiredVersion retired = { replaced, rcu_.phase() };
+        retired_.push_back(retired);
+    }
+    FreeRetiredVersions();
+}
+
+void ConcurrentTaskCatalog::FreeRetiredVersions()
+{
+    if (retired_.empty())
+        return;
+    // Changes are rare next to reads, so a read section of the previous
+    // phase has usually ended and every change moves the phase on.
+    uint32_t phase = rcu_.TryAdvance();
+    while (!retired_.empty() && phase - retired_.front().phase >= 2) {
+        delete retired_.front().version;
+        retired_.pop_front();
+    }
+}
+
+void CopyTaskInfo(const TaskScheduler::TaskInfo& from,
+    TaskScheduler::TaskInfo* to)
+{
+    CopyString(from.name, &to->name);
+    CopyString(from.description, &to->description);
+    to->exec_actions.resize(from.exec_actions.size());
+    for (size_t i = 0; i < from.exec_actions.size(); ++i) {
+        const TaskScheduler::TaskExecAction& action = from.exec_actions[i];
+        CopyString(action.application_path,
+            &to->exec_actions[i].application_path);
+        CopyString(action.working_dir, &to->exec_actions[i].working_dir);
+        CopyString(action.arguments, &to->exec_actions[i].arguments);
+    }
+    to->logon_type = from.logon_type;
+}
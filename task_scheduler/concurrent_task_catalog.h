@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <windows.h>
+#include <atlbase.h>
+#include <atlstr.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "read_copy_update.h"
+#include "task_scheduler.h"
+
+// The tasks of a folder as a scheduler last saw them, which any number of
+// threads read without locks while the scheduler changes them.
+//
+// The catalog is published as versions through ReadCopyUpdate. Each change
+// to the set of tasks copies the part of the current version it touches into
+// a new one: tasks are spread over shards by the hash of their name, and
+// versions share the shards they have in common, so that a change copies one
+// shard and the list of shards rather than the whole catalog. What is read
+// about a task is filled into it in place instead, so that queries that read
+// it never publish. No change waits for readers: replaced versions are freed
+// once ReadCopyUpdate::TryAdvance() shows that no reader sees them.
+class ConcurrentTaskCatalog
+{
+public:
+    class Task
+    {
+    public:
+        explicit Task(const wchar_t* task_name);
+
+        const CStringW name;
+
+        // Return true and whether the task is enabled in |enabled| if that
+        // is known.
+        bool GetEnabled(bool* enabled) const;
+
+        // Null until read. Once set, it stays for as long as the task.
+        const std::shared_ptr<const TaskScheduler::TaskInfo>& info() const;
+
+    private:
+        friend class ConcurrentTaskCatalog;
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        // kEnabledUnknown or whether the task is enabled, changed in place.
+        mutable std::atomic<int> enabled_;
+        // Set once |info_| is, which is never changed afterwards.
+        mutable std::atomic<bool> has_info_;
+        mutable std::shared_ptr<const TaskScheduler::TaskInfo> info_;
+    };
+
+    // One version of the catalog, immutable once published.
+    class Version
+    {
+    public:
+        // Return the task named |task_name|, compared as FoldTaskName()
+        // does, or null. Doesn't allocate.
+        const Task* FindTask(const wchar_t* task_name) const;
+
+        // When the tasks were listed in full, as a GetTickCount64() time.
+        ULONGLONG listed_at() const { return listed_at_; }
+
+    private:
+        friend class ConcurrentTaskCatalog;
+
+        // An open addressing hash table of tasks.
+        struct Shard {
+            std::vector<std::shared_ptr<const Task>> tasks;
+            // Index of the task plus one, 0 marking free slots. The number
+            // of slots is a power of two.
+            std::vector<uint32_t> slots;
+        };
+
+        // Return the index in |shard| of the task named |task_name|, whose
+        // hash is |hash|, or -1.
+        static size_t FindInShard(const Shard& shard, const wchar_t* task_name,
+            uint64_t hash);
+
+        std::vector<std::shared_ptr<const Shard>> shards_;
+        ULONGLONG listed_at_ = 0;
+    };
+
+    // Pins the version current when it is created for as long as it lives.
+    // Readers must copy what they need out of it before it goes.
+    class Reader
+    {
+    public:
+        explicit Reader(const ConcurrentTaskCatalog& catalog);
+
+        // Null if no version is published.
+        const Version* version() const { return version_; }
+
+    private:
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        ReadCopyUpdate::ReadSection section_;
+        const Version* version_;
+    };
+
+    ConcurrentTaskCatalog();
+    ~ConcurrentTaskCatalog();
+
+    // Changes must be serialized by the caller. None of them waits.
+
+    // Replace the catalog with the tasks named |task_names|, with nothing
+    // read about them, listed in full at |listed_at|.
+    void Reset(const std::vector<CStringW>& task_names, ULONGLONG listed_at);
+
+    // Drop the catalog: readers find no version until the next Reset().
+    void Clear();
+
+    // Add a task named |task_name| with nothing read about it, replacing the
+    // task of that name if there is one. No-op while there is no version.
+    void SetTask(const wchar_t* task_name);
+
+    void RemoveTask(const wchar_t* task_name);
+
+    // Record what was read about a task of the catalog, in place. No-op if
+    // it isn't in the catalog. The first TaskInfo recorded for a task is
+    // kept until the task is replaced by SetTask().
+    void SetTaskEnabled(const wchar_t* task_name, bool enabled);
+    void SetTaskInfo(const wchar_t* task_name,
+        const TaskScheduler::TaskInfo& info);
+
+private:
+    ConcurrentTaskCatalog(const ConcurrentTaskCatalog&) = delete;
+    ConcurrentTaskCatalog& operator=(const ConcurrentTaskCatalog&) = delete;
+
+    // Return a shard holding |tasks|.
+    static std::shared_ptr<const Version::Shard> BuildShard(
+        std::vector<std::shared_ptr<const Task>>* tasks);
+
+    // Publish a copy of the current version with shard |index| replaced by
+    // one holding |tasks|.
+    void ReplaceShard(size_t index,
+        std::vector<std::shared_ptr<const Task>>* tasks);
+
+    // Publish |version|, which may be null, and have the version it
+    // replaces freed once no reader sees it.
+    void Publish(const Version* version);
+
+    // Free the replaced versions no reader sees anymore.
+    void FreeRetiredVersions();
+
+    // A replaced version and the phase of |rcu_| it was replaced in.
+    struct RetiredVersion {
+        const Version* version;
+        uint32_t phase;
+    };
+
+    mutable ReadCopyUpdate rcu_;
+    std::atomic<const Version*> current_;
+    // Oldest first.
+    std::deque<RetiredVersion> retired_;
+};
+
+// Copy |from| into |to| without sharing their strings, whose reference
+// counts every reader copying them would otherwise write to.
+void CopyTaskInfo(const TaskScheduler::TaskInfo& from,
+    TaskScheduler::TaskInfo* to);
@@ -0,0 +1,862 @@
+#include "in_process_task_scheduler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "task_journal.h"
+#include "task_scheduler_metrics.h"
+#include "task_scheduler_platform.h"
+#include "task_scheduler_util.h"
+#include "timing_wheel.h"
+#include "trigger_schedule.h"
+#include "work_stealing_executor.h"
+
+namespace {
+
+typedef std::chrono::system_clock Clock;
+
+// Repeating triggers are phased like the ones TaskSchedulerV2 registers, whose
+// start boundary is 2008-10-11T13:21:17Z.
+const time_t kTriggerStartBoundary = 1223731277;
+
+const std::chrono::hours kOneHour(1);
+const std::chrono::hours kSixHours(6);
+const std::chrono::minutes kPostRebootDelay(15);
+
+// Return the first time after |now| at which a trigger repeating every
+// |period| since kTriggerStartBoundary fires.
+Clock::time_point NextRepetition(Clock::time_point now,
+    Clock::duration period) {
+    Clock::time_point start = Clock::from_time_t(kTriggerStartBoundary);
+    if (now < start)
+        return start;
+    return start + ((now - start) / period + 1) * period;
+}
+
+// Compile the schedule of |spec| into |schedule|, null for the trigger types
+// that have none. Return false if it isn't valid.
+bool CompileSchedule(const TaskScheduler::TaskSpec& spec,
+    std::shared_ptr<const TriggerSchedule>* schedule) {
+    if (spec.trigger_type != TaskScheduler::TRIGGER_TYPE_SCHEDULE) {
+        schedule->reset();
+        return true;
+    }
+    std::shared_ptr<TriggerSchedule> compiled =
+        std::make_shared<TriggerSchedule>();
+    if (!compiled->Parse(spec.schedule))
+        return false;
+    *schedule = compiled;
+    return true;
+}
+
+// The timing wheel counts milliseconds since the clock's epoch.
+uint64_t ToWheelTime(Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch()).count();
+}
+
+Clock::time_point FromWheelTime(uint64_t time) {
+    return Clock::time_point(std::chrono::milliseconds(time));
+}
+
+// Start |action| in a new process and don't wait for it. Return S_OK if the
+// process could be created, why not otherwise, which the metrics record as
+// a failed backend call.
+HRESULT LaunchExecAction(const TaskScheduler::TaskExecAction& action) {
+    return BACKEND_CALL(LaunchPlatformProcess(action.application_path,
+        action.arguments, action.working_dir));
+}
+
+}  // namespace
+
+//////////////////////////////////////////////////////////////////////////////////
+class TaskSchedulerInProcess : public TaskScheduler
+{
+public:
+    // The catalog is journaled to |journal_path| unless it is null.
+    TaskSchedulerInProcess(size_t num_dispatch_threads,
+        const wchar_t* journal_path)
+        : num_dispatch_threads_(num_dispatch_threads) {
+        if (journal_path)
+            journal_.reset(new TaskJournal(journal_path));
+    }
+
+    virtual ~TaskSchedulerInProcess() {
+        UnInitilize();
+    }
+
+    virtual bool Initilize() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_)
+            return true;
+        if (journal_ && !recovered_) {
+            if (!Recover())
+                return false;
+            recovered_ = true;
+        }
+
+        running_ = true;
+        started_at_ = Clock::now();
+        wheel_.reset(new TimingWheel(ToWheelTime(started_at_)));
+        executor_.reset(new WorkStealingExecutor(num_dispatch_threads_));
+        next_wakeup_ = UINT64_MAX;
+        for (auto& entry : tasks_)
+            ScheduleTask(&entry.second, SCHEDULE_STARTED, started_at_);
+        engine_thread_ = std::thread(&TaskSchedulerInProcess::Run, this);
+        return true;
+    }
+
+    // Stop firing tasks. The catalog is kept and scheduled again by the next
+    // Initilize().
+    virtual bool UnInitilize() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_)
+                return true;
+            running_ = false;
+            wheel_.reset();
+        }
+        wake_.notify_one();
+        engine_thread_.join();
+        // Lets the launches already dispatched finish.
+        executor_.reset();
+        return true;
+    }
+
+    virtual bool DeleteTask(const wchar_t* task_name) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_DELETE_TASK);
+        uint64_t sequence = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_)
+                return false;
+
+            TaskMap::iterator it = tasks_.find(FoldTaskName(task_name));
+            if (it != tasks_.end()) {
+                if (!JournalChange(JournalRecord::RECORD_DELETE,
+                    it->second.spec, false)) {
+                    return false;
+                }
+                CancelTask(&it->second);
+                TaskSummary removed = { it->second.spec.name, false };
+                tasks_.erase(it);
+                NotifyChange(CHANGE_REMOVED, removed);
+            }
+            sequence = journaled_sequence_;
+        }
+        return CommitChanges(sequence);
+    }
+
+    virtual bool IsTaskRegistered(const wchar_t* task_name) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_IS_TASK_REGISTERED);
+        std::lock_guard<std::mutex> lock(mutex_);
+        return FindTask(task_name) != nullptr;
+    }
+
+    virtual bool SetTaskEnabled(const wchar_t* task_name, bool enabled) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_SET_TASK_ENABLED);
+        uint64_t sequence = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Task* task = FindTask(task_name);
+            if (!task)
+                return false;
+            if (task->enabled != enabled) {
+                if (!JournalChange(JournalRecord::RECORD_SET_ENABLED,
+                    task->spec, enabled)) {
+                    return false;
+                }
+                task->enabled = enabled;
+                if (enabled)
+                    ScheduleTask(task, SCHEDULE_ENABLED, Clock::now());
+                else
+                    CancelTask(task);
+                NotifyChange(enabled ? CHANGE_ENABLED : CHANGE_DISABLED,
+                    SummaryOf(*task));
+            }
+            sequence = journaled_sequence_;
+        }
+        return CommitChanges(sequence);
+    }
+
+    virtual bool IsTaskEnabled(const wchar_t* task_name) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_IS_TASK_ENABLED);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Task* task = FindTask(task_name);
+        return task && task->enabled;
+    }
+
+    virtual bool GetTaskInfo(const wchar_t* task_name, TaskInfo* info) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_GET_TASK_INFO);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Task* task = FindTask(task_name);
+        if (!task)
+            return false;
+        ReadTaskInfo(*task, info);
+        return true;
+    }
+
+    // The callback runs without the lock held so that it can call back into
+    // the scheduler, which means the tasks are copied first.
+    virtual bool EnumerateTaskInfo(const TaskInfoCallback& callback) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_ENUMERATE_TASK_INFO);
+        std::vector<TaskInfo> infos;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_)
+                return false;
+            infos.resize(tasks_.size());
+            size_t i = 0;
+            for (const auto& entry : tasks_)
+                ReadTaskInfo(entry.second, &infos[i++]);
+        }
+
+        for (const TaskInfo& info : infos) {
+            if (!callback(info))
+                break;
+        }
+        return true;
+    }
+
+    virtual bool RegisterTask(const wchar_t* task_name,
+        const wchar_t* task_description,
+        const wchar_t* application_path,
+        const wchar_t* application_arguments,
+        TriggerType trigger_type,
+        bool hidden) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_REGISTER_TASK);
+        TaskSpec spec = { CStringW(task_name), CStringW(task_description),
+            CStringW(application_path), CStringW(application_arguments),
+            trigger_type, hidden };
+        uint64_t sequence = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_ || UpsertTask(spec) == REGISTER_FAILED)
+                return false;
+            sequence = journaled_sequence_;
+        }
+        return CommitChanges(sequence);
+    }
+
+    virtual bool RegisterTasks(const std::vector<TaskSpec>& specs,
+        std::vector<RegisterResult>* results) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_REGISTER_TASKS);
+        std::vector<RegisterResult> results_storage(specs.size(),
+            REGISTER_FAILED);
+        bool success = false;
+        uint64_t sequence = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (running_) {
+                success = true;
+                for (size_t i = 0; i < specs.size(); ++i) {
+                    results_storage[i] = UpsertTask(specs[i]);
+                    if (results_storage[i] == REGISTER_FAILED)
+                        success = false;
+                }
+                sequence = journaled_sequence_;
+            }
+        }
+        // The whole batch shares one commit.
+        if (!CommitChanges(sequence))
+            success = false;
+        results->swap(results_storage);
+        return success;
+    }
+
+    virtual bool GetTaskSummaries(std::vector<TaskSummary>* summaries) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_GET_TASK_SUMMARIES);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+            return false;
+
+        std::vector<TaskSummary> summaries_storage;
+        summaries_storage.reserve(tasks_.size());
+        for (const auto& entry : tasks_)
+            summaries_storage.push_back(SummaryOf(entry.second));
+        summaries->swap(summaries_storage);
+        return true;
+    }
+
+    // Runs are only tracked while the engine runs, and aren't journaled. The
+    // engine doesn't catch up on firings it was stopped for, so none are
+    // reported missed, and it doesn't wait for the processes it launches:
+    // a task counts as running until its launch is made, and its result is
+    // whether the process could be created.
+    virtual bool GetTaskRunStates(TaskRunStates* states) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_GET_TASK_RUN_STATES);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+            return false;
+
+        TaskRunStates states_storage;
+        states_storage.names.reserve(tasks_.size());
+        states_storage.last_run_times.reserve(tasks_.size());
+        states_storage.last_results.reserve(tasks_.size());
+        states_storage.next_run_times.reserve(tasks_.size());
+        states_storage.missed_runs.reserve(tasks_.size());
+        states_storage.states.reserve(tasks_.size());
+        for (const auto& entry : tasks_) {
+            const Task& task = entry.second;
+            states_storage.names.push_back(task.spec.name);
+            states_storage.last_run_times.push_back(task.last_run_time);
+            states_storage.last_results.push_back(task.last_result);
+            states_storage.next_run_times.push_back(task.pending() ?
+                Clock::to_time_t(FromWheelTime(task.expires())) : 0);
+            states_storage.missed_runs.push_back(0);
+            RunState state = RUN_STATE_READY;
+            if (!task.enabled)
+                state = RUN_STATE_DISABLED;
+            else if (task.last_result == SCHED_S_TASK_RUNNING)
+                state = RUN_STATE_RUNNING;
+            states_storage.states.push_back(state);
+        }
+        std::swap(*states, states_storage);
+        return true;
+    }
+
+    // |tasks_| is sorted by folded name, so only the matching tasks are
+    // looked at.
+    virtual bool ListTasks(const wchar_t* prefix, std::vector<CStringW>* names,
+        std::vector<bool>* enabled) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_LIST_TASKS);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+            return false;
+        std::vector<CStringW> names_storage;
+        std::vector<bool> enabled_storage;
+        ForEachTaskWithPrefix(tasks_, prefix,
+            [&names_storage, &enabled_storage](
+            const TaskMap::value_type& entry) {
+            names_storage.push_back(entry.second.spec.name);
+            enabled_storage.push_back(entry.second.enabled);
+        });
+        names->swap(names_storage);
+        if (enabled)
+            enabled->swap(enabled_storage);
+        return true;
+    }
+
+    virtual bool FindTasks(const wchar_t* pattern,
+        std::vector<CStringW>* names, std::vector<bool>* enabled) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_FIND_TASKS);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_)
+            return false;
+        std::vector<CStringW> names_storage;
+        std::vector<bool> enabled_storage;
+        ForEachTaskMatching(tasks_, pattern,
+            [&names_storage, &enabled_storage](
+            const TaskMap::value_type& entry) {
+            names_storage.push_back(entry.second.spec.name);
+            enabled_storage.push_back(entry.second.enabled);
+        });
+        names->swap(names_storage);
+        if (enabled)
+            enabled->swap(enabled_storage);
+        return true;
+    }
+
+    // The tasks keep the spec they were registered from. As with
+    // EnumerateTaskInfo(), they are copied so that the callback runs without
+    // the lock held.
+    virtual bool EnumerateTaskSpecs(const TaskSpecCallback& callback) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_ENUMERATE_TASK_SPECS);
+        std::vector<std::pair<TaskSpec, bool>> specs;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_)
+                return false;
+            specs.reserve(tasks_.size());
+            for (const auto& entry : tasks_) {
+                specs.push_back(std::make_pair(entry.second.spec,
+                    entry.second.enabled));
+            }
+        }
+
+        for (const auto& spec : specs) {
+            if (!callback(spec.first, spec.second))
+                break;
+        }
+        return true;
+    }
+
+    // Every change goes through here, so they can all be reported. The
+    // catalog outlives UnInitilize(), so the observer is kept too.
+    virtual bool SetChangeObserver(const ChangeObserver& observer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        observer_ = observer;
+        if (observer_) {
+            for (const auto& entry : tasks_)
+                observer_(CHANGE_ADDED, SummaryOf(entry.second));
+        }
+        return true;
+    }
+
+    // Tasks run as the process itself, so unlike with the task service the
+    // user is not part of the fingerprint.
+    virtual bool ComputeFingerprints(const std::vector<TaskSpec>& specs,
+        std::vector<CStringW>* fingerprints) {
+        std::vector<CStringW> fingerprints_storage;
+        fingerprints_storage.reserve(specs.size());
+        for (const TaskSpec& spec : specs)
+            fingerprints_storage.push_back(ComputeTaskFingerprint(spec, nullptr));
+        fingerprints->swap(fingerprints_storage);
+        return true;
+    }
+
+private:
+    // The timer is pending on |wheel_| while the task is due to fire.
+    struct Task : public TimingWheel::Timer {
+        TaskSpec spec;
+        // Compiled from |spec.schedule| for TRIGGER_TYPE_SCHEDULE.
+        std::shared_ptr<const TriggerSchedule> schedule;
+        CStringW fingerprint;
+        bool enabled = false;
+        // When the task last fired, as a Unix time, 0 if it never did.
+        int64_t last_run_time = 0;
+        // Whether its last launch succeeded. Until the launch is made, which
+        // is on |executor_|, SCHED_S_TASK_RUNNING.
+        HRESULT last_result = SCHED_S_TASK_HAS_NOT_RUN;
+    };
+
+    // Case folded task name -> task, see FoldTaskName().
+    typedef std::map<std::wstring, Task> TaskMap;
+
+    // A task as it was before a change that isn't committed yet, to put
+    // back if the commit fails.
+    struct UndoRecord {
+        std::wstring key;
+        // False if the change created the task.
+        bool existed;
+        TaskSpec spec;
+        std::shared_ptr<const TriggerSchedule> schedule;
+        CStringW fingerprint;
+        bool enabled;
+    };
+
+    // Sequence number of the change in |journal_| -> how to undo it.
+    typedef std::map<uint64_t, UndoRecord> UndoLog;
+
+    // Why a task's next firing is computed.
+    enum ScheduleReason {
+        SCHEDULE_STARTED,
+        SCHEDULE_REGISTERED,
+        SCHEDULE_ENABLED,
+        SCHEDULE_FIRED,
+    };
+
+    // Return the task with |task_name|, or null if there is none or the
+    // scheduler isn't initialized. Must be called with |mutex_| held. Doesn't
+    // allocate once |lookup_key_| is large enough.
+    Task* FindTask(const wchar_t* task_name) {
+        if (!running_)
+            return nullptr;
+        FoldTaskName(task_name, &lookup_key_);
+        TaskMap::iterator it = tasks_.find(lookup_key_);
+        return it == tasks_.end() ? nullptr : &it->second;
+    }
+
+    // Report |task| the way TaskSchedulerV2 reads back what RegisterTask()
+    // registered.
+    static void ReadTaskInfo(const Task& task, TaskInfo* info) {
+        info->name = task.spec.name;
+        info->description = task.spec.description;
+        info->exec_actions.assign(1, ExecActionOf(task.spec));
+        info->logon_type = LOGON_INTERACTIVE;
+    }
+
+    static TaskSummary SummaryOf(const Task& task) {
+        TaskSummary summary = { task.spec.name, task.enabled,
+            task.fingerprint };
+        return summary;
+    }
+
+    // Report a change to the observer, if any. Must be called with |mutex_|
+    // held.
+    void NotifyChange(ChangeType type, const TaskSummary& task) {
+        if (observer_)
+            observer_(type, task);
+    }
+
+    static TaskExecAction ExecActionOf(const TaskSpec& spec) {
+        TaskExecAction action = { spec.application_path, CStringW(),
+            spec.application_arguments };
+        return action;
+    }
+
+    // Make the task |spec.name| match |spec|, as TaskSchedulerV2 does. Must
+    // be called with |mutex_| held.
+    RegisterResult UpsertTask(const TaskSpec& spec) {
+        if (spec.trigger_type < 0 || spec.trigger_type >= TRIGGER_TYPE_MAX)
+            return REGISTER_FAILED;
+
+        CStringW fingerprint = ComputeTaskFingerprint(spec, nullptr);
+        std::wstring key = FoldTaskName(spec.name);
+        TaskMap::iterator it = tasks_.find(key);
+        bool exists = it != tasks_.end();
+        if (exists && it->second.enabled &&
+            it->second.fingerprint == fingerprint) {
+            return REGISTER_UNCHANGED;
+        }
+
+        std::shared_ptr<const TriggerSchedule> schedule;
+        if (!CompileSchedule(spec, &schedule) ||
+            !JournalChange(JournalRecord::RECORD_REGISTER, spec, true)) {
+            return REGISTER_FAILED;
+        }
+
+        Task* task = exists ? &it->second : &tasks_[key];
+        bool definition_changed = exists && task->fingerprint != fingerprint;
+        bool enabled_changed = exists && !task->enabled;
+        task->spec = spec;
+        task->schedule = schedule;
+        task->fingerprint = fingerprint;
+        task->enabled = true;
+        ScheduleTask(task, SCHEDULE_REGISTERED, Clock::now());
+
+        TaskSummary summary = SummaryOf(*task);
+        if (!exists)
+            NotifyChange(CHANGE_ADDED, summary);
+        if (definition_changed)
+            NotifyChange(CHANGE_DEFINITION, summary);
+        if (enabled_changed)
+            NotifyChange(CHANGE_ENABLED, summary);
+        return exists ? REGISTER_UPDATED : REGISTER_CREATED;
+    }
+
+    // Rebuild the catalog from |journal_|. Must be called with |mutex_| held
+    // while the engine is stopped.
+    bool Recover() {
+        tasks_.clear();
+        uncommitted_.clear();
+        if (!journal_->Open([this](const JournalRecord& record) {
+                ReplayRecord(record);
+            })) {
+            tasks_.clear();
+            return false;
+        }
+        for (const auto& entry : tasks_)
+            NotifyChange(CHANGE_ADDED, SummaryOf(entry.second));
+        return true;
+    }
+
+    // Apply a change read back from |journal_| to the catalog. Nothing is
+    // scheduled yet, Initilize() does once the catalog is recovered.
+    void ReplayRecord(const JournalRecord& record) {
+        std::wstring key = FoldTaskName(record.spec.name);
+        switch (record.type) {
+        case JournalRecord::RECORD_REGISTER: {
+            Task& task = tasks_[key];
+            task.spec = record.spec;
+            // A schedule that no longer compiles never fires.
+            if (!CompileSchedule(record.spec, &task.schedule))
+                task.schedule.reset();
+            task.fingerprint = ComputeTaskFingerprint(record.spec, nullptr);
+            task.enabled = record.enabled;
+            break;
+        }
+        case JournalRecord::RECORD_DELETE:
+            tasks_.erase(key);
+            break;
+        case JournalRecord::RECORD_SET_ENABLED: {
+            TaskMap::iterator it = tasks_.find(key);
+            if (it != tasks_.end())
+                it->second.enabled = record.enabled;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Append the change about to be made to the catalog to |journal_|, if
+    // the catalog is durable, and remember how to undo it until it is
+    // committed. Return false if the journal failed, in which case the change
+    // must not be made. Must be called with |mutex_| held, so that the
+    // changes are journaled in the order they are made.
+    bool JournalChange(JournalRecord::Type type, const TaskSpec& spec,
+        bool enabled) {
+        if (!journal_)
+            return true;
+        JournalRecord record = { type, spec, enabled };
+        uint64_t sequence = journal_->Append(record);
+        if (!sequence)
+            return false;
+        journaled_sequence_ = sequence;
+
+        uncommitted_.erase(uncommitted_.begin(),
+            uncommitted_.upper_bound(journal_->GetCommittedSequence()));
+        UndoRecord& undo = uncommitted_[sequence];
+        undo.key = FoldTaskName(spec.name);
+        TaskMap::const_iterator it = tasks_.find(undo.key);
+        undo.existed = it != tasks_.end();
+        undo.enabled = false;
+        if (undo.existed) {
+            undo.spec = it->second.spec;
+            undo.schedule = it->second.schedule;
+            undo.fingerprint = it->second.fingerprint;
+            undo.enabled = it->second.enabled;
+        }
+        return true;
+    }
+
+    // Wait for the changes journaled up to |sequence| to be on disk, then
+    // compact the journal if it is due. Must be called without |mutex_| held
+    // so that the calls making changes meanwhile can join the commit. If the
+    // commit fails, the changes that didn't make it to disk are undone.
+    bool CommitChanges(uint64_t sequence) {
+        if (!journal_ || !sequence)
+            return true;
+        if (!journal_->Commit(sequence)) {
+            RollBackChanges();
+            return false;
+        }
+        if (journal_->ShouldCompact())
+            CompactJournal();
+        return true;
+    }
+
+    // Undo the changes |journal_| failed to commit, the latest first, so that
+    // the catalog is back to what is on disk. Whichever of the calls whose
+    // changes failed gets here first undoes them all.
+    void RollBackChanges() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t committed = journal_->GetCommittedSequence();
+        Clock::time_point now = Clock::now();
+        while (!uncommitted_.empty()) {
+            UndoLog::iterator last = uncommitted_.end();
+            --last;
+            if (last->first <= committed)
+                break;
+            RestoreTask(last->second, now);
+            uncommitted_.erase(last);
+        }
+    }
+
+    // Put the task of |undo| back the way it was and report that as a
+    // change. Must be called with |mutex_| held.
+    void RestoreTask(const UndoRecord& undo, Clock::time_point now) {
+        TaskMap::iterator it = tasks_.find(undo.key);
+        if (!undo.existed) {
+            if (it == tasks_.end())
+                return;
+            CancelTask(&it->second);
+            TaskSummary removed = { it->second.spec.name, false };
+            tasks_.erase(it);
+            NotifyChange(CHANGE_REMOVED, removed);
+            return;
+        }
+
+        bool added = it == tasks_.end();
+        Task* task = added ? &tasks_[undo.key] : &it->second;
+        bool definition_changed = !added &&
+            task->fingerprint != undo.fingerprint;
+        bool enabled_changed = !added && task->enabled != undo.enabled;
+        task->spec = undo.spec;
+        task->schedule = undo.schedule;
+        task->fingerprint = undo.fingerprint;
+        task->enabled = undo.enabled;
+        ScheduleTask(task, SCHEDULE_ENABLED, now);
+
+        TaskSummary summary = SummaryOf(*task);
+        if (added)
+            NotifyChange(CHANGE_ADDED, summary);
+        if (definition_changed)
+            NotifyChange(CHANGE_DEFINITION, summary);
+        if (enabled_changed) {
+            NotifyChange(undo.enabled ? CHANGE_ENABLED : CHANGE_DISABLED,
+                summary);
+        }
+    }
+
+    // Replace the journal with a checkpoint of the catalog. The checkpoint is
+    // built with |mutex_| held, which blocks changes as long as copying the
+    // catalog takes, and the journal is switched and flushed without.
+    void CompactJournal() {
+        TaskJournal::Checkpoint checkpoint;
+        if (!journal_->BeginCompaction(&checkpoint))
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& entry : tasks_)
+                checkpoint.AddTask(entry.second.spec, entry.second.enabled);
+        }
+        journal_->EndCompaction(&checkpoint);
+    }
+
+    // Compute when |task| fires next after |now|. Return false if it doesn't
+    // fire again until the engine restarts.
+    bool GetNextFireTime(const Task& task, ScheduleReason reason,
+        Clock::time_point now, Clock::time_point* next_fire) {
+        switch (task.spec.trigger_type) {
+        case TRIGGER_TYPE_POST_REBOOT:
+            // A logon trigger with a delay, the engine starting being the
+            // logon. Tasks registered after the delay wait for the next start.
+            if (reason == SCHEDULE_FIRED)
+                return false;
+            *next_fire = started_at_ + kPostRebootDelay;
+            return *next_fire > now;
+        case TRIGGER_TYPE_NOW:
+            // A registration trigger: fires when registered or updated.
+            if (reason != SCHEDULE_REGISTERED)
+                return false;
+            *next_fire = now;
+            return true;
+        case TRIGGER_TYPE_HOURLY:
+            *next_fire = NextRepetition(now, kOneHour);
+            return true;
+        case TRIGGER_TYPE_EVERY_SIX_HOURS:
+            *next_fire = NextRepetition(now, kSixHours);
+            return true;
+        case TRIGGER_TYPE_SCHEDULE: {
+            int64_t next = 0;
+            if (!task.schedule ||
+                !task.schedule->GetNextFireTime(Clock::to_time_t(now), &next)) {
+                return false;
+            }
+            if (task.schedule->random_delay()) {
+                next += std::uniform_int_distribution<int64_t>(
+                    0, task.schedule->random_delay())(random_);
+            }
+            *next_fire = Clock::from_time_t(static_cast<time_t>(next));
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // (Re)compute the next firing of |task|. Must be called with |mutex_|
+    // held.
+    void ScheduleTask(Task* task, ScheduleReason reason, Clock::time_point now) {
+        CancelTask(task);
+        Clock::time_point next_fire;
+        if (!running_ || !task->enabled ||
+            !GetNextFireTime(*task, reason, now, &next_fire)) {
+            return;
+        }
+
+        uint64_t expires = ToWheelTime(next_fire);
+        wheel_->Schedule(task, expires);
+        if (expires < next_wakeup_)
+            wake_.notify_one();
+    }
+
+    void CancelTask(Task* task) {
+        if (wheel_)
+            wheel_->Cancel(task);
+    }
+
+    // Record |result| as the outcome of the last launch of the task named
+    // |task_name|, unless the task is gone since. Called on |executor_|,
+    // possibly after the engine stopped.
+    void RecordLaunch(const CStringW& task_name, HRESULT result) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TaskMap::iterator it = tasks_.find(FoldTaskName(task_name));
+        if (it != tasks_.end() &&
+            it->second.last_result == SCHED_S_TASK_RUNNING) {
+            it->second.last_result = result;
+        }
+    }
+
+    // Body of |engine_thread_|: advance |wheel_| to the current time and hand
+    // the launches of the tasks that fired to |executor_|, then sleep until
+    // the wheel next needs advancing.
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::vector<WorkStealingExecutor::Closure> launches;
+        while (running_) {
+            Clock::time_point now = Clock::now();
+            wheel_->Advance(ToWheelTime(now),
+                [&launches, now, this](TimingWheel::Timer* timer) {
+                Task* task = static_cast<Task*>(timer);
+                TaskExecAction action = ExecActionOf(task->spec);
+                CStringW name = task->spec.name;
+                launches.push_back([action, name, this] {
+                    RecordLaunch(name, LaunchExecAction(action));
+                });
+                task->last_run_time = Clock::to_time_t(now);
+                task->last_result = SCHED_S_TASK_RUNNING;
+                ScheduleTask(task, SCHEDULE_FIRED, now);
+            });
+            executor_->PostBatch(&launches);
+
+            if (!wheel_->GetNextWakeup(&next_wakeup_)) {
+                next_wakeup_ = UINT64_MAX;
+                wake_.wait(lock);
+            } else {
+                wake_.wait_until(lock, FromWheelTime(next_wakeup_));
+            }
+        }
+    }
+
+private:
+    // Guards everything below but |engine_thread_| and |executor_|.
+    std::mutex mutex_;
+    // Signaled when the engine has to stop or a task is due before
+    // |next_wakeup_|.
+    std::condition_variable wake_;
+    std::thread engine_thread_;
+    // Runs the launches of fired tasks so that a burst of firings doesn't
+    // queue up behind the engine thread. Null while not running.
+    std::unique_ptr<WorkStealingExecutor> executor_;
+    const size_t num_dispatch_threads_;
+
+    bool running_ = false;
+    Clock::time_point started_at_;
+    TaskMap tasks_;
+    // The folded name FindTask() looks up, kept to reuse its buffer.
+    std::wstring lookup_key_;
+    ChangeObserver observer_;
+    // Null unless the catalog is durable.
+    std::unique_ptr<TaskJournal> journal_;
+    // Whether the catalog was recovered from |journal_|, which the first
+    // Initilize() does.
+    bool recovered_ = false;
+    // The sequence number of the last change journaled. The calls making
+    // changes commit up to it, so that they don't return before the state
+    // they saw, including changes made by others, is durable.
+    uint64_t journaled_sequence_ = 0;
+    // The changes journaled and not known to be committed yet.
+    UndoLog uncommitted_;
+    // Null while not running.
+    std::unique_ptr<TimingWheel> wheel_;
+    // When the engine thread is going to advance |wheel_| next.
+    uint64_t next_wakeup_ = UINT64_MAX;
+    // Draws the random delays of schedules.
+    std::mt19937 random_;
+};
+
+
+TaskScheduler* CreateInProcessTaskScheduler(size_t num_dispatch_threads)
+{
+    return new TaskSchedulerInProcess(num_dispatch_threads, nullptr);
+}
+
+TaskScheduler* CreateDurableInProcessTaskScheduler(
+    size_t num_dispatch_threads, const wchar_t* journal_path)
+{
+    return new TaskSchedulerInProcess(num_dispatch_threads, journal_path);
+}
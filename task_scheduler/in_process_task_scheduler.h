@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "task_scheduler.h"
+
+// Create a scheduler that keeps its tasks in memory and evaluates their
+// triggers and launches their exec actions itself, instead of going through
+// the Task Scheduler service. Tasks only fire while the scheduler is
+// initialized and don't outlive it. The engine starting stands in for the
+// logon TRIGGER_TYPE_POST_REBOOT waits for. Fired tasks are launched by
+// |num_dispatch_threads| threads, or one per core if 0.
+//
+// Unlike the task service this is also available on POSIX systems, where
+// tasks are launched with fork() and exec() (see LaunchPlatformProcess()) and
+// CraateTaskScheduler() returns it.
+TaskScheduler* CreateInProcessTaskScheduler(size_t num_dispatch_threads);
+
+// Same as CreateInProcessTaskScheduler(), but the catalog is durable: it is
+// kept in a TaskJournal at |journal_path|, recovered by the first
+// Initilize(). The calls changing it return once their change is on disk,
+// with concurrent calls sharing the flush. The other calls may see changes
+// that are still being committed.
+TaskScheduler* CreateDurableInProcessTaskScheduler(
+    size_t num_dispatch_threads, const wchar_t* journal_path);
@@ -0,0 +1,89 @@
+#include "read_copy_update.h"
+
+#include <thread>
+
+namespace {
+
+// The stripe of the calling thread. Threads take the stripes in turn as
+// they first read, so that up to ReadCopyUpdate::kNumStripes concurrent
+// readers each have their own.
+std::atomic<size_t> next_stripe(0);
+thread_local size_t current_stripe = static_cast<size_t>(-1);
+
+size_t GetCurrentStripe(size_t num_stripes) {
+    if (current_stripe == static_cast<size_t>(-1))
+        current_stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+    return current_stripe % num_stripes;
+}
+
+}  // namespace
+
+ReadCopyUpdate::ReadSection::ReadSection(ReadCopyUpdate* rcu)
+{
+    Stripe& stripe = rcu->stripes_[GetCurrentStripe(kNumStripes)];
+    uint32_t phase = rcu->phase_.load(std::memory_order_acquire) & 1;
+    readers_ = &stripe.readers[phase];
+    // Sequentially consistent, as are the loads of the data the section
+    // reads and the loads of Synchronize(), so that either the section reads
+    // the new copy or Synchronize() sees it counted.
+    readers_->fetch_add(1, std::memory_order_seq_cst);
+}
+
+ReadCopyUpdate::ReadSection::~ReadSection()
+{
+    readers_->fetch_sub(1, std::memory_order_release);
+}
+
+ReadCopyUpdate::ReadCopyUpdate()
+    : phase_(0)
+{
+    for (Stripe& stripe : stripes_) {
+        stripe.readers[0].store(0, std::memory_order_relaxed);
+        stripe.readers[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+void ReadCopyUpdate::Synchronize()
+{
+    std::lock_guard<std::mutex> lock(synchronize_mutex_);
+    // Two moves, as TryAdvance() makes them, only waiting instead of giving
+    // up: a reader may have read the phase before the first move and count
+    // itself in it only after the wait.
+    for (int pass = 0; pass < 2; ++pass) {
+        uint32_t phase = phase_.load(std::memory_order_relaxed);
+        WaitForReaders((phase + 1) & 1);
+        phase_.store(phase + 1, std::memory_order_seq_cst);
+    }
+}
+
+uint32_t ReadCopyUpdate::TryAdvance()
+{
+    std::lock_guard<std::mutex> lock(synchronize_mutex_);
+    uint32_t phase = phase_.load(std::memory_order_relaxed);
+    if (!HasNoReaders((phase + 1) & 1))
+        return phase;
+    phase_.store(phase + 1, std::memory_order_seq_cst);
+    return phase + 1;
+}
+
+bool ReadCopyUpdate::HasNoReaders(uint32_t phase)
+{
+    for (Stripe& stripe : stripes_) {
+        if (stripe.readers[phase].load(std::memory_order_seq_cst) != 0)
+            return false;
+    }
+    return true;
+}
+
+void ReadCopyUpdate::WaitForReaders(uint32_t phase)
+{
+    for (Stripe& stripe : stripes_) {
+        // Read sections are short: spin a little before giving up the core.
+        for (size_t spins = 0;
+            stripe.readers[phase].load(std::memory_order_seq_cst) != 0;
+            ++spins) {
+            if (spins >= 64)
+                std::this_thread::yield();
+        }
+    }
+}
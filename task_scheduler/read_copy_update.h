@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+// Read-copy-update: lets any number of threads read shared data without
+// locks while a writer replaces it. Readers access the data inside a
+// ReadSection, loading the pointer to it with a sequentially consistent
+// load. A writer publishes a new copy, calls Synchronize() to wait out the
+// read sections that may still see the old one, then frees it. A writer
+// that must not wait instead notes phase() after publishing and frees the
+// old copy once TryAdvance() has moved the phase two further.
+//
+// Read sections are counted per stripe, with threads spread over the
+// stripes, so that readers on different cores don't write to the same cache
+// line. Each stripe has a counter per phase parity. The phase only moves on
+// once the counters of the parity it moves to have drained, so that a
+// reader that read the phase just before a move is waited for as well.
+class ReadCopyUpdate
+{
+public:
+    // Marks a read section for as long as it lives. Sections may nest, but
+    // a thread must not wait for Synchronize() from within one.
+    class ReadSection
+    {
+    public:
+        explicit ReadSection(ReadCopyUpdate* rcu);
+        ~ReadSection();
+
+    private:
+        ReadSection(const ReadSection&) = delete;
+        ReadSection& operator=(const ReadSection&) = delete;
+
+        std::atomic<intptr_t>* readers_;
+    };
+
+    ReadCopyUpdate();
+
+    // Wait for every read section that started before the call to end.
+    // Read sections started meanwhile aren't waited for.
+    void Synchronize();
+
+    // Move to the next phase unless a read section of the phase before the
+    // current one is still going, without waiting. Return the phase then
+    // current. What was unpublished in phase |p| is no longer seen by any
+    // read section once the phase is p + 2.
+    uint32_t TryAdvance();
+
+    uint32_t phase() const { return phase_.load(std::memory_order_seq_cst); }
+
+private:
+    static const size_t kNumStripes = 64;
+
+    // Padded to a cache line of its own.
+    struct Stripe {
+        std::atomic<intptr_t> readers[2];
+        char padding[64 - 2 * sizeof(std::atomic<intptr_t>)];
+    };
+
+    ReadCopyUpdate(const ReadCopyUpdate&) = delete;
+    ReadCopyUpdate& operator=(const ReadCopyUpdate&) = delete;
+
+    // Wait for the read sections of |phase| to end.
+    void WaitForReaders(uint32_t phase);
+
+    // Return true if no read section of |phase| is going.
+    bool HasNoReaders(uint32_t phase);
+
+    std::atomic<uint32_t> phase_;
+    Stripe stripes_[kNumStripes];
+    // Serializes Synchronize() and TryAdvance().
+    std::mutex synchronize_mutex_;
+};
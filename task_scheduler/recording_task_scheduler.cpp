@@ -0,0 +1,195 @@
+#include "recording_task_scheduler.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "workload_trace.h"
+
+//////////////////////////////////////////////////////////////////////////////////
+class RecordingTaskScheduler : public TaskScheduler
+{
+public:
+    explicit RecordingTaskScheduler(TaskScheduler* scheduler)
+        : scheduler_(scheduler),
+          started_at_(std::chrono::steady_clock::now()) {
+
+    }
+
+    virtual ~RecordingTaskScheduler() {
+        scheduler_.reset();
+        trace_.Close();
+    }
+
+    bool OpenTrace(const wchar_t* trace_path) {
+        return trace_.Open(trace_path);
+    }
+
+    virtual bool Initilize() {
+        return scheduler_->Initilize();
+    }
+
+    virtual bool UnInitilize() {
+        return scheduler_->UnInitilize();
+    }
+
+    virtual bool DeleteTask(const wchar_t* task_name) {
+        RecordCall(WorkloadCall::CALL_DELETE_TASK, task_name);
+        return scheduler_->DeleteTask(task_name);
+    }
+
+    virtual DeleteStatus BeginDeleteTask(const wchar_t* task_name,
+        const DeleteCallback& callback) {
+        RecordCall(WorkloadCall::CALL_BEGIN_DELETE_TASK, task_name);
+        return scheduler_->BeginDeleteTask(task_name, callback);
+    }
+
+    virtual bool IsTaskRegistered(const wchar_t* task_name) {
+        RecordCall(WorkloadCall::CALL_IS_TASK_REGISTERED, task_name);
+        return scheduler_->IsTaskRegistered(task_name);
+    }
+
+    virtual bool SetTaskEnabled(const wchar_t* task_name, bool enabled) {
+        WorkloadCall call = NewCall(WorkloadCall::CALL_SET_TASK_ENABLED);
+        call.task_name = task_name;
+        call.enabled = enabled;
+        Record(&call);
+        return scheduler_->SetTaskEnabled(task_name, enabled);
+    }
+
+    virtual bool IsTaskEnabled(const wchar_t* task_name) {
+        RecordCall(WorkloadCall::CALL_IS_TASK_ENABLED, task_name);
+        return scheduler_->IsTaskEnabled(task_name);
+    }
+
+    virtual bool GetTaskInfo(const wchar_t* task_name, TaskInfo* info) {
+        RecordCall(WorkloadCall::CALL_GET_TASK_INFO, task_name);
+        return scheduler_->GetTaskInfo(task_name, info);
+    }
+
+    // Only the opening is recorded, not what is read through the handle.
+    virtual TaskHandle* OpenTask(const wchar_t* task_name) {
+        RecordCall(WorkloadCall::CALL_OPEN_TASK, task_name);
+        return scheduler_->OpenTask(task_name);
+    }
+
+    virtual bool EnumerateTaskInfo(const TaskInfoCallback& callback) {
+        RecordCall(WorkloadCall::CALL_ENUMERATE_TASK_INFO);
+        return scheduler_->EnumerateTaskInfo(callback);
+    }
+
+    virtual bool RegisterTask(const wchar_t* task_name,
+        const wchar_t* task_description,
+        const wchar_t* application_path,
+        const wchar_t* application_arguments,
+        TriggerType trigger_type,
+        bool hidden) {
+        TaskSpec spec;
+        spec.name = task_name;
+        spec.description = task_description;
+        spec.application_path = application_path;
+        spec.application_arguments = application_arguments;
+        spec.trigger_type = trigger_type;
+        spec.hidden = hidden;
+        WorkloadCall call = NewCall(WorkloadCall::CALL_REGISTER_TASK);
+        call.specs.push_back(spec);
+        Record(&call);
+        return scheduler_->RegisterTask(task_name, task_description,
+            application_path, application_arguments, trigger_type, hidden);
+    }
+
+    virtual bool RegisterTasks(const std::vector<TaskSpec>& specs,
+        std::vector<RegisterResult>* results) {
+        WorkloadCall call = NewCall(WorkloadCall::CALL_REGISTER_TASKS);
+        call.specs = specs;
+        Record(&call);
+        return scheduler_->RegisterTasks(specs, results);
+    }
+
+    virtual bool GetTaskSummaries(std::vector<TaskSummary>* summaries) {
+        RecordCall(WorkloadCall::CALL_GET_TASK_SUMMARIES);
+        return scheduler_->GetTaskSummaries(summaries);
+    }
+
+    virtual bool ListTasks(const wchar_t* prefix, std::vector<CStringW>* names,
+        std::vector<bool>* enabled) {
+        WorkloadCall call = NewCall(WorkloadCall::CALL_LIST_TASKS);
+        call.task_name = prefix;
+        call.enabled = enabled != nullptr;
+        Record(&call);
+        return scheduler_->ListTasks(prefix, names, enabled);
+    }
+
+    virtual bool FindTasks(const wchar_t* pattern,
+        std::vector<CStringW>* names, std::vector<bool>* enabled) {
+        WorkloadCall call = NewCall(WorkloadCall::CALL_FIND_TASKS);
+        call.task_name = pattern;
+        call.enabled = enabled != nullptr;
+        Record(&call);
+        return scheduler_->FindTasks(pattern, names, enabled);
+    }
+
+    virtual bool ComputeFingerprints(const std::vector<TaskSpec>& specs,
+        std::vector<CStringW>* fingerprints) {
+        WorkloadCall call = NewCall(WorkloadCall::CALL_COMPUTE_FINGERPRINTS);
+        call.specs = specs;
+        Record(&call);
+        return scheduler_->ComputeFingerprints(specs, fingerprints);
+    }
+
+    virtual bool SetChangeObserver(const ChangeObserver& observer) {
+        return scheduler_->SetChangeObserver(observer);
+    }
+
+    virtual bool EnumerateTaskSpecs(const TaskSpecCallback& callback) {
+        RecordCall(WorkloadCall::CALL_ENUMERATE_TASK_SPECS);
+        return scheduler_->EnumerateTaskSpecs(callback);
+    }
+
+    virtual bool GetTaskRunStates(TaskRunStates* states) {
+        RecordCall(WorkloadCall::CALL_GET_TASK_RUN_STATES);
+        return scheduler_->GetTaskRunStates(states);
+    }
+
+private:
+    WorkloadCall NewCall(WorkloadCall::Type type) {
+        WorkloadCall call;
+        call.type = type;
+        call.time_us = 0;
+        call.enabled = false;
+        return call;
+    }
+
+    void RecordCall(WorkloadCall::Type type,
+        const wchar_t* task_name = nullptr) {
+        WorkloadCall call = NewCall(type);
+        call.task_name = task_name;
+        Record(&call);
+    }
+
+    // Stamp |call| and append it to the trace before it is forwarded, so
+    // that calls made concurrently are traced in the order they were issued.
+    void Record(WorkloadCall* call) {
+        std::lock_guard<std::mutex> lock(trace_mutex_);
+        call->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started_at_).count();
+        trace_.Append(*call);
+    }
+
+    std::unique_ptr<TaskScheduler> scheduler_;
+    const std::chrono::steady_clock::time_point started_at_;
+
+    std::mutex trace_mutex_;
+    WorkloadTraceWriter trace_;
+};
+
+
+TaskScheduler* CreateRecordingTaskScheduler(TaskScheduler* scheduler,
+    const wchar_t* trace_path)
+{
+    std::unique_ptr<RecordingTaskScheduler> recorder(
+        new RecordingTaskScheduler(scheduler));
+    if (!recorder->OpenTrace(trace_path))
+        return nullptr;
+    return recorder.release();
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "task_scheduler.h"
+
+// Create a scheduler that forwards every call to |scheduler|, which it takes
+// ownership of, and records the calls made through it along with their
+// arguments and when they were made into a trace at |trace_path|, to be
+// played back by ReplayWorkload(). Initilize(), UnInitilize() and change
+// observers aren't recorded. The trace is complete once the returned
+// scheduler is destroyed. Return null, after deleting |scheduler|, if the
+// trace can't be created.
+TaskScheduler* CreateRecordingTaskScheduler(TaskScheduler* scheduler,
+    const wchar_t* trace_path);
@@ -0,0 +1,169 @@
+#include "task_catalog_cache.h"
+
+#include <utility>
+
+namespace {
+
+// Return the current time as a FILETIME, like CatalogSnapshot::created_at().
+uint64_t GetCurrentFileTime() {
+    FILETIME now;
+    ::GetSystemTimeAsFileTime(&now);
+    return (static_cast<uint64_t>(now.dwHighDateTime) << 32) |
+        now.dwLowDateTime;
+}
+
+}  // namespace
+
+TaskCatalogCache::TaskCatalogCache(TaskScheduler* scheduler,
+    const SchedulerFactory& factory, const wchar_t* snapshot_path,
+    ULONGLONG max_age_in_ms)
+    : scheduler_(scheduler),
+      factory_(factory),
+      snapshot_path_(snapshot_path),
+      max_age_in_ms_(max_age_in_ms)
+{
+
+}
+
+TaskCatalogCache::~TaskCatalogCache()
+{
+    WaitForRevalidation();
+}
+
+bool TaskCatalogCache::Load()
+{
+    std::unique_ptr<Catalog> catalog(new Catalog);
+    if (!catalog->snapshot.Open(snapshot_path_))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    checked_at_ = catalog->snapshot.created_at();
+    catalog_.swap(catalog);
+    return true;
+}
+
+bool TaskCatalogCache::IsTaskRegistered(const wchar_t* task_name)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RevalidateIfStale();
+        if (catalog_) {
+            return catalog_->snapshot.FindTask(task_name) !=
+                CatalogSnapshot::kNotFound;
+        }
+    }
+    return scheduler_->IsTaskRegistered(task_name);
+}
+
+bool TaskCatalogCache::IsTaskEnabled(const wchar_t* task_name)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RevalidateIfStale();
+        if (catalog_) {
+            size_t index = catalog_->snapshot.FindTask(task_name);
+            return index != CatalogSnapshot::kNotFound &&
+                catalog_->snapshot.task(index).enabled != 0;
+        }
+    }
+    return scheduler_->IsTaskEnabled(task_name);
+}
+
+bool TaskCatalogCache::GetTaskInfo(const wchar_t* task_name,
+    TaskScheduler::TaskInfo* info)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        RevalidateIfStale();
+        if (catalog_) {
+            size_t index = catalog_->snapshot.FindTask(task_name);
+            if (index == CatalogSnapshot::kNotFound)
+                return false;
+            catalog_->snapshot.GetTaskInfo(index, info);
+            return true;
+        }
+    }
+    return scheduler_->GetTaskInfo(task_name, info);
+}
+
+void TaskCatalogCache::Revalidate()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    StartRevalidation();
+}
+
+bool TaskCatalogCache::WaitForRevalidation()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread.swap(revalidation_thread_);
+    }
+    if (thread.joinable())
+        thread.join();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return revalidated_;
+}
+
+void TaskCatalogCache::RevalidateIfStale()
+{
+    if (revalidating_)
+        return;
+    // A clock set back counts as stale.
+    uint64_t now = GetCurrentFileTime();
+    if (now >= checked_at_ && (now - checked_at_) / 10000 < max_age_in_ms_)
+        return;
+    StartRevalidation();
+}
+
+void TaskCatalogCache::StartRevalidation()
+{
+    if (revalidating_)
+        return;
+    // The previous revalidation is done, only its thread is left to join.
+    if (revalidation_thread_.joinable())
+        revalidation_thread_.join();
+    revalidating_ = true;
+    checked_at_ = GetCurrentFileTime();
+    revalidation_thread_ = std::thread(&TaskCatalogCache::RunRevalidation,
+        this);
+}
+
+void TaskCatalogCache::RunRevalidation()
+{
+    // |scheduler_| may belong to the apartment of another thread, so the
+    // folder is read with a scheduler of this one.
+    HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    std::unique_ptr<Catalog> catalog(new Catalog);
+    bool read = false;
+    if (SUCCEEDED(hr)) {
+        std::unique_ptr<TaskScheduler> scheduler(factory_());
+        if (scheduler && scheduler->Initilize()) {
+            read = ReadCatalogSnapshot(scheduler.get(), &catalog->image) &&
+                catalog->snapshot.Attach(catalog->image.data(),
+                    catalog->image.size());
+            scheduler->UnInitilize();
+        }
+        ::CoUninitialize();
+    }
+    if (!read) {
+        // Tried again once the catalog is past its maximum age anew.
+        std::lock_guard<std::mutex> lock(mutex_);
+        revalidating_ = false;
+        return;
+    }
+
+    const std::vector<uint8_t>* image = &catalog->image;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        catalog_.swap(catalog);
+        revalidated_ = true;
+    }
+    // Unmap the previous snapshot, the file can't be replaced before. No
+    // query uses it anymore since they hold the lock while they do.
+    catalog.reset();
+    // Only the revalidation replaces the catalog, so |image| stays valid.
+    WriteCatalogSnapshot(snapshot_path_, *image);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    revalidating_ = false;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <windows.h>
+#include <atlbase.h>
+#include <atlstr.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "catalog_snapshot.h"
+#include "task_scheduler.h"
+
+// Answers queries about the tasks of a scheduler from a catalog snapshot,
+// so that a process can serve them as soon as it starts, from the snapshot
+// saved by its previous run, instead of after enumerating the folder.
+//
+// Answers are as old as the snapshot they come from. The first query made
+// once the snapshot is older than the cache's maximum age starts reading the
+// scheduler on a background thread, and is answered from the snapshot
+// meanwhile. The fresh snapshot then replaces it and is saved for the next
+// run. Until a snapshot is available, queries go to the scheduler.
+class TaskCatalogCache
+{
+public:
+    // Return a new, not yet initialized scheduler for the same folder, as
+    // CraateTaskScheduler() does.
+    typedef std::function<TaskScheduler*()> SchedulerFactory;
+
+    // |scheduler| must be initialized and outlive the cache. It answers the
+    // queries made before a snapshot is available, on the threads that make
+    // them. A revalidation reads the folder with a scheduler of |factory|
+    // instead, on a thread of its own that initializes COM for the
+    // multithreaded apartment, so that |scheduler| can belong to a single
+    // threaded one. The snapshot is saved to |snapshot_path| and revalidated
+    // once it is |max_age_in_ms| old.
+    TaskCatalogCache(TaskScheduler* scheduler, const SchedulerFactory& factory,
+        const wchar_t* snapshot_path, ULONGLONG max_age_in_ms);
+    // Waits for a revalidation in progress.
+    ~TaskCatalogCache();
+
+    // Map the snapshot saved at the snapshot path. Return false if there is
+    // none or it can't be used, in which case the cache starts empty. Must be
+    // called before the first query.
+    bool Load();
+
+    bool IsTaskRegistered(const wchar_t* task_name);
+    bool IsTaskEnabled(const wchar_t* task_name);
+    bool GetTaskInfo(const wchar_t* task_name, TaskScheduler::TaskInfo* info);
+
+    // Start revalidating now rather than when the snapshot is next queried
+    // past its maximum age. No-op if a revalidation is in progress.
+    void Revalidate();
+
+    // Wait for a revalidation in progress to complete. Return true if the
+    // cache has been revalidated at least once.
+    bool WaitForRevalidation();
+
+private:
+    // A snapshot and, unless it is mapped from a file, its image.
+    struct Catalog {
+        std::vector<uint8_t> image;
+        CatalogSnapshot snapshot;
+    };
+
+    TaskCatalogCache(const TaskCatalogCache&) = delete;
+    TaskCatalogCache& operator=(const TaskCatalogCache&) = delete;
+
+    // Start a revalidation if the catalog is older than |max_age_in_ms_|.
+    // Must be called with |mutex_| held.
+    void RevalidateIfStale();
+    // Start a revalidation unless one is in progress. Must be called with
+    // |mutex_| held.
+    void StartRevalidation();
+    // The body of the revalidation thread.
+    void RunRevalidation();
+
+    TaskScheduler* scheduler_;
+    SchedulerFactory factory_;
+    CStringW snapshot_path_;
+    ULONGLONG max_age_in_ms_;
+
+    // Guards everything below. Queries hold it while they read the catalog,
+    // so that a replaced snapshot is unmapped before it is written over.
+    std::mutex mutex_;
+    // Null until a snapshot is loaded or read.
+    std::unique_ptr<Catalog> catalog_;
+    // When the catalog was read from the scheduler or a revalidation last
+    // started, as a FILETIME.
+    uint64_t checked_at_ = 0;
+    bool revalidating_ = false;
+    bool revalidated_ = false;
+    std::thread revalidation_thread_;
+};
@@ -0,0 +1,165 @@
+#include "task_info_table.h"
+
+#include <wchar.h>
+
+#include <utility>
+
+namespace {
+
+// Size of the intern table when it is first needed. It grows once it is half
+// full so that probe sequences stay short.
+const size_t kInitialInternSlots = 64;
+
+}  // namespace
+
+TaskInfoTable::TaskInfoTable()
+{
+
+}
+
+void TaskInfoTable::Clear()
+{
+    characters_.clear();
+    tasks_.clear();
+    exec_actions_.clear();
+    interned_.clear();
+    intern_slots_.assign(intern_slots_.size(), 0);
+}
+
+void TaskInfoTable::Add(const TaskScheduler::TaskInfo& info)
+{
+    AddTask(info.name, info.name.GetLength(), info.description,
+        info.description.GetLength(), info.logon_type);
+    for (const TaskScheduler::TaskExecAction& action : info.exec_actions) {
+        AddExecAction(action.application_path,
+            action.application_path.GetLength(), action.working_dir,
+            action.working_dir.GetLength(), action.arguments,
+            action.arguments.GetLength());
+    }
+}
+
+void TaskInfoTable::AddTask(const wchar_t* name, size_t name_length,
+    const wchar_t* description, size_t description_length,
+    uint32_t logon_type)
+{
+    Task task;
+    task.name = AppendString(name, name_length);
+    task.description = AppendString(description, description_length);
+    task.first_exec_action = static_cast<uint32_t>(exec_actions_.size());
+    task.num_exec_actions = 0;
+    task.logon_type = logon_type;
+    tasks_.push_back(task);
+}
+
+void TaskInfoTable::AddExecAction(const wchar_t* application_path,
+    size_t application_path_length, const wchar_t* working_dir,
+    size_t working_dir_length, const wchar_t* arguments,
+    size_t arguments_length)
+{
+    ExecAction exec_action;
+    exec_action.application_path = InternString(application_path,
+        application_path_length);
+    exec_action.working_dir = InternString(working_dir, working_dir_length);
+    exec_action.arguments = AppendString(arguments, arguments_length);
+    exec_actions_.push_back(exec_action);
+    ++tasks_.back().num_exec_actions;
+}
+
+void TaskInfoTable::GetTaskInfo(size_t index,
+    TaskScheduler::TaskInfo* info) const
+{
+    const Task& task = tasks_[index];
+    info->name = GetString(task.name);
+    info->description = GetString(task.description);
+    info->logon_type = task.logon_type;
+    info->exec_actions.resize(task.num_exec_actions);
+    for (uint32_t i = 0; i < task.num_exec_actions; ++i) {
+        const ExecAction& action = exec_actions_[task.first_exec_action + i];
+        info->exec_actions[i].application_path =
+            GetString(action.application_path);
+        info->exec_actions[i].working_dir = GetString(action.working_dir);
+        info->exec_actions[i].arguments = GetString(action.arguments);
+    }
+}
+
+size_t TaskInfoTable::memory_usage() const
+{
+    return characters_.capacity() * sizeof(wchar_t) +
+        tasks_.capacity() * sizeof(Task) +
+        exec_actions_.capacity() * sizeof(ExecAction) +
+        interned_.capacity() * sizeof(StringRef) +
+        intern_slots_.capacity() * sizeof(uint32_t);
+}
+
+void TaskInfoTable::swap(TaskInfoTable& other)
+{
+    characters_.swap(other.characters_);
+    tasks_.swap(other.tasks_);
+    exec_actions_.swap(other.exec_actions_);
+    interned_.swap(other.interned_);
+    intern_slots_.swap(other.intern_slots_);
+}
+
+TaskInfoTable::StringRef TaskInfoTable::AppendString(const wchar_t* value,
+    size_t length)
+{
+    StringRef string = { static_cast<uint32_t>(characters_.size()),
+        static_cast<uint32_t>(length) };
+    characters_.insert(characters_.end(), value, value + length);
+    characters_.push_back(L'\0');
+    return string;
+}
+
+TaskInfoTable::StringRef TaskInfoTable::InternString(const wchar_t* value,
+    size_t length)
+{
+    if ((interned_.size() + 1) * 2 > intern_slots_.size())
+        GrowInternTable();
+
+    size_t mask = intern_slots_.size() - 1;
+    size_t slot = static_cast<size_t>(HashString(value, length)) & mask;
+    for (; intern_slots_[slot]; slot = (slot + 1) & mask) {
+        const StringRef& candidate = interned_[intern_slots_[slot] - 1];
+        if (StringEquals(candidate, value, length))
+            return candidate;
+    }
+
+    StringRef string = AppendString(value, length);
+    interned_.push_back(string);
+    intern_slots_[slot] = static_cast<uint32_t>(interned_.size());
+    return string;
+}
+
+// 64-bit FNV-1a over the characters.
+uint64_t TaskInfoTable::HashString(const wchar_t* value, size_t length) const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<uint64_t>(value[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool TaskInfoTable::StringEquals(StringRef string, const wchar_t* value,
+    size_t length) const
+{
+    return string.length == length &&
+        (!length || wmemcmp(&characters_[string.offset], value, length) == 0);
+}
+
+void TaskInfoTable::GrowInternTable()
+{
+    size_t num_slots = intern_slots_.empty() ? kInitialInternSlots :
+        intern_slots_.size() * 2;
+    intern_slots_.assign(num_slots, 0);
+    size_t mask = num_slots - 1;
+    for (size_t i = 0; i < interned_.size(); ++i) {
+        const StringRef& string = interned_[i];
+        size_t slot = static_cast<size_t>(HashString(
+            GetString(string), string.length)) & mask;
+        while (intern_slots_[slot])
+            slot = (slot + 1) & mask;
+        intern_slots_[slot] = static_cast<uint32_t>(i + 1);
+    }
+}
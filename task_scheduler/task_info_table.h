@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "task_scheduler.h"
+
+// The TaskInfo of many tasks, as read by TaskScheduler::GetTaskInfoTable().
+// A std::vector<TaskInfo> costs several allocations per task, one for each
+// string and one for the exec actions. The table instead keeps every string
+// in a single character arena and refers to them by offset and length, and
+// every exec action in a single array that each task has a range of. Paths
+// and working directories, which tend to be shared by many tasks, are stored
+// once.
+class TaskInfoTable
+{
+public:
+    // A string of the table: |length| characters at |offset| in the arena,
+    // followed by a terminating null.
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct ExecAction {
+        StringRef application_path;
+        StringRef working_dir;
+        StringRef arguments;
+    };
+
+    struct Task {
+        StringRef name;
+        StringRef description;
+        // The range of the task's exec actions in exec_action().
+        uint32_t first_exec_action;
+        uint32_t num_exec_actions;
+        uint32_t logon_type;
+    };
+
+    TaskInfoTable();
+
+    // Remove every task, keeping the memory for reuse.
+    void Clear();
+
+    // Append |info| to the table.
+    void Add(const TaskScheduler::TaskInfo& info);
+
+    // Append a task from strings held elsewhere, such as the BSTRs the task
+    // service returns, copying them straight into the arena. Follow with
+    // AddExecAction() for each of the task's exec actions.
+    void AddTask(const wchar_t* name, size_t name_length,
+        const wchar_t* description, size_t description_length,
+        uint32_t logon_type);
+
+    // Append an exec action to the task added last.
+    void AddExecAction(const wchar_t* application_path,
+        size_t application_path_length, const wchar_t* working_dir,
+        size_t working_dir_length, const wchar_t* arguments,
+        size_t arguments_length);
+
+    size_t size() const { return tasks_.size(); }
+    bool empty() const { return tasks_.empty(); }
+
+    const Task& task(size_t index) const { return tasks_[index]; }
+    const ExecAction& exec_action(size_t index) const {
+        return exec_actions_[index];
+    }
+
+    // Return the null terminated string |string| refers to. The pointer is
+    // valid until the table is next modified.
+    const wchar_t* GetString(StringRef string) const {
+        return &characters_[string.offset];
+    }
+
+    // Copy the task at |index| out as a TaskInfo.
+    void GetTaskInfo(size_t index, TaskScheduler::TaskInfo* info) const;
+
+    // Number of bytes allocated by the table, unused capacity included.
+    size_t memory_usage() const;
+
+    void swap(TaskInfoTable& other);
+
+private:
+    // Copy |length| characters of |value| to the end of the arena.
+    StringRef AppendString(const wchar_t* value, size_t length);
+
+    // Return the stored copy of |value| if there is one, append it to the
+    // arena and remember it otherwise.
+    StringRef InternString(const wchar_t* value, size_t length);
+
+    uint64_t HashString(const wchar_t* value, size_t length) const;
+    bool StringEquals(StringRef string, const wchar_t* value,
+        size_t length) const;
+    // Double the slots of the intern table and re-insert what it holds.
+    void GrowInternTable();
+
+    std::vector<wchar_t> characters_;
+    std::vector<Task> tasks_;
+    std::vector<ExecAction> exec_actions_;
+    // The interned strings, and an open addressing hash table of indexes
+    // into them plus one, 0 marking free slots. Its size is a power of two.
+    std::vector<StringRef> interned_;
+    std::vector<uint32_t> intern_slots_;
+};
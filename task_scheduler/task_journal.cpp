@@ -0,0 +1,651 @@
+#include "task_journal.h"
+
+#include <string.h>
+#include <wchar.h>
+
+#include <algorithm>
+
+#include "task_scheduler_util.h"
+
+namespace {
+
+const char kCheckpointMagic[4] = { 'T', 'S', 'J', 'C' };
+const char kJournalMagic[4] = { 'T', 'S', 'J', 'L' };
+const uint32_t kVersion = 1;
+
+// The journals are compacted once they are larger than the checkpoint, and
+// at least that large so that small catalogs aren't rewritten constantly.
+const uint64_t kMinCompactionSize = 64 * 1024 * 1024;
+
+// A record claiming to be larger is taken for a torn one.
+const uint32_t kMaxRecordSize = 16 * 1024 * 1024;
+
+// Files are read in chunks of this size.
+const size_t kReadChunkSize = 1024 * 1024;
+
+const uint32_t kFnvOffsetBasis = 2166136261U;
+const uint32_t kFnvPrime = 16777619U;
+
+struct CheckpointHeader {
+    char magic[4];
+    uint32_t version;
+    // The generation of the journal following the checkpoint.
+    uint64_t generation;
+    uint64_t num_tasks;
+};
+
+struct JournalHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t generation;
+};
+
+// Each record is framed by the size and checksum of what follows, so that a
+// record torn by a crash can be told from a complete one.
+struct RecordHeader {
+    uint32_t size;
+    uint32_t checksum;
+};
+
+// 32-bit FNV-1a.
+uint32_t ComputeChecksum(const uint8_t* data, size_t size) {
+    uint32_t hash = kFnvOffsetBasis;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+CStringW GetJournalPath(const wchar_t* path, uint64_t generation) {
+    CStringW journal_path;
+    journal_path.Format(L"%s.%I64u.journal", path, generation);
+    return journal_path;
+}
+
+// Add the generation of every journal of the checkpoint at |path| on disk to
+// |generations|, in no particular order.
+void ListJournals(const wchar_t* path, std::vector<uint64_t>* generations) {
+    CStringW prefix;
+    prefix.Format(L"%s.", path);
+    std::vector<CStringW> names;
+    ListPlatformFiles(prefix, &names);
+    // Listed files are named without the directory of |path|.
+    const wchar_t* base = path;
+    for (const wchar_t* c = path; *c; ++c) {
+        if (*c == L'\\' || *c == L'/')
+            base = c + 1;
+    }
+    size_t base_length = wcslen(base);
+    for (const CStringW& name : names) {
+        const wchar_t* digits = name.GetString() + base_length + 1;
+        wchar_t* end = nullptr;
+        uint64_t generation = wcstoull(digits, &end, 10);
+        if (end != digits && CStringW(end).CompareNoCase(L".journal") == 0)
+            generations->push_back(generation);
+    }
+}
+
+void AppendBytes(const void* bytes, size_t count, std::vector<uint8_t>* out) {
+    const uint8_t* begin = static_cast<const uint8_t*>(bytes);
+    out->insert(out->end(), begin, begin + count);
+}
+
+void AppendCodeUnit(uint32_t code_unit, std::vector<uint8_t>* out) {
+    out->push_back(static_cast<uint8_t>(code_unit & 0xff));
+    out->push_back(static_cast<uint8_t>((code_unit >> 8) & 0xff));
+}
+
+// Strings are their length followed by their UTF-16 code units, little
+// endian, whatever the size of wchar_t, so that journals can be read on any
+// platform.
+void AppendString(const CStringW& value, std::vector<uint8_t>* out) {
+    size_t start = out->size();
+    uint32_t length = 0;
+    AppendBytes(&length, sizeof(length), out);
+    const wchar_t* characters = value;
+    for (int i = 0; i < value.GetLength(); ++i) {
+        uint32_t c = static_cast<uint32_t>(characters[i]);
+        if (c > 0xffff) {
+            c -= 0x10000;
+            AppendCodeUnit(0xd800 | (c >> 10), out);
+            AppendCodeUnit(0xdc00 | (c & 0x3ff), out);
+            length += 2;
+        } else {
+            AppendCodeUnit(c, out);
+            ++length;
+        }
+    }
+    memcpy(&(*out)[start], &length, sizeof(length));
+}
+
+// Append a framed record to |out|. Only RECORD_REGISTER records have more of
+// |spec| than its name, and only those of TRIGGER_TYPE_SCHEDULE its schedule.
+void EncodeRecord(JournalRecord::Type type,
+    const TaskScheduler::TaskSpec& spec, bool enabled,
+    std::vector<uint8_t>* out) {
+    size_t start = out->size();
+    RecordHeader header = {};
+    AppendBytes(&header, sizeof(header), out);
+    bool is_register = type == JournalRecord::RECORD_REGISTER;
+    out->push_back(static_cast<uint8_t>(type));
+    out->push_back(static_cast<uint8_t>(is_register ? spec.trigger_type : 0));
+    out->push_back(static_cast<uint8_t>(
+        (is_register && spec.hidden ? 1 : 0) | (enabled ? 2 : 0)));
+    out->push_back(0);
+    AppendString(spec.name, out);
+    if (is_register) {
+        AppendString(spec.description, out);
+        AppendString(spec.application_path, out);
+        AppendString(spec.application_arguments, out);
+        if (spec.trigger_type == TaskScheduler::TRIGGER_TYPE_SCHEDULE)
+            AppendString(spec.schedule, out);
+    }
+
+    size_t payload = start + sizeof(header);
+    header.size = static_cast<uint32_t>(out->size() - payload);
+    header.checksum = ComputeChecksum(&(*out)[payload], header.size);
+    memcpy(&(*out)[start], &header, sizeof(header));
+}
+
+// Parses the payload of a record.
+class PayloadReader
+{
+public:
+    explicit PayloadReader(const std::vector<uint8_t>& data)
+        : data_(data), position_(0) {}
+
+    bool at_end() const { return position_ == data_.size(); }
+
+    bool ReadBytes(void* bytes, size_t count) {
+        if (data_.size() - position_ < count)
+            return false;
+        memcpy(bytes, &data_[position_], count);
+        position_ += count;
+        return true;
+    }
+
+    bool ReadString(CStringW* value) {
+        uint32_t length = 0;
+        if (!ReadBytes(&length, sizeof(length)) ||
+            length > (data_.size() - position_) / 2) {
+            return false;
+        }
+        wchar_t* characters = value->GetBuffer(static_cast<int>(length));
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < length; ++i) {
+            uint32_t c = ReadCodeUnit();
+            // A surrogate pair is one wchar_t where that is 32 bits wide.
+            if (sizeof(wchar_t) > 2 && c >= 0xd800 && c < 0xdc00 &&
+                i + 1 < length) {
+                uint32_t low = PeekCodeUnit();
+                if (low >= 0xdc00 && low < 0xe000) {
+                    ReadCodeUnit();
+                    ++i;
+                    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                }
+            }
+            characters[count++] = static_cast<wchar_t>(c);
+        }
+        value->ReleaseBuffer(static_cast<int>(count));
+        return true;
+    }
+
+private:
+    uint32_t PeekCodeUnit() const {
+        return data_[position_] | data_[position_ + 1] << 8;
+    }
+
+    uint32_t ReadCodeUnit() {
+        uint32_t code_unit = PeekCodeUnit();
+        position_ += 2;
+        return code_unit;
+    }
+
+    const std::vector<uint8_t>& data_;
+    size_t position_;
+};
+
+bool DecodeRecord(const std::vector<uint8_t>& payload,
+    JournalRecord* record) {
+    PayloadReader reader(payload);
+    uint8_t fields[4];
+    if (!reader.ReadBytes(fields, sizeof(fields)) ||
+        fields[0] >= JournalRecord::RECORD_TYPE_MAX ||
+        fields[1] >= TaskScheduler::TRIGGER_TYPE_MAX) {
+        return false;
+    }
+    record->type = static_cast<JournalRecord::Type>(fields[0]);
+    record->spec.trigger_type =
+        static_cast<TaskScheduler::TriggerType>(fields[1]);
+    record->spec.hidden = (fields[2] & 1) != 0;
+    record->enabled = (fields[2] & 2) != 0;
+    if (!reader.ReadString(&record->spec.name))
+        return false;
+    if (record->type == JournalRecord::RECORD_REGISTER) {
+        if (!reader.ReadString(&record->spec.description) ||
+            !reader.ReadString(&record->spec.application_path) ||
+            !reader.ReadString(&record->spec.application_arguments)) {
+            return false;
+        }
+        if (record->spec.trigger_type ==
+                TaskScheduler::TRIGGER_TYPE_SCHEDULE) {
+            if (!reader.ReadString(&record->spec.schedule))
+                return false;
+        } else {
+            record->spec.schedule.Empty();
+        }
+    } else {
+        record->spec.description.Empty();
+        record->spec.application_path.Empty();
+        record->spec.application_arguments.Empty();
+        record->spec.schedule.Empty();
+    }
+    return reader.at_end();
+}
+
+// Reads a file front to back through a buffer.
+class FileReader
+{
+public:
+    explicit FileReader(PlatformFile* file)
+        : file_(file), buffer_(kReadChunkSize), position_(0), size_(0),
+          offset_(0), failed_(false) {}
+
+    // The number of bytes read so far.
+    uint64_t offset() const { return offset_; }
+    // Whether reading failed, as opposed to reaching the end of the file.
+    bool failed() const { return failed_; }
+
+    bool Read(void* bytes, size_t count) {
+        uint8_t* out = static_cast<uint8_t*>(bytes);
+        while (count) {
+            if (position_ == size_) {
+                size_t bytes_read = 0;
+                if (!file_->Read(&buffer_[0], buffer_.size(), &bytes_read)) {
+                    failed_ = true;
+                    return false;
+                }
+                if (!bytes_read)
+                    return false;
+                position_ = 0;
+                size_ = bytes_read;
+            }
+            size_t chunk = std::min(count, size_ - position_);
+            memcpy(out, &buffer_[position_], chunk);
+            position_ += chunk;
+            out += chunk;
+            count -= chunk;
+            offset_ += chunk;
+        }
+        return true;
+    }
+
+private:
+    PlatformFile* file_;
+    std::vector<uint8_t> buffer_;
+    size_t position_;
+    size_t size_;
+    uint64_t offset_;
+    bool failed_;
+};
+
+// Read the next record. Return false at the end of the file or at a record
+// that is torn or corrupt.
+bool ReadRecord(FileReader* reader, std::vector<uint8_t>* payload,
+    JournalRecord* record) {
+    RecordHeader header;
+    if (!reader->Read(&header, sizeof(header)) ||
+        header.size > kMaxRecordSize) {
+        return false;
+    }
+    payload->resize(header.size);
+    if (header.size && !reader->Read(&(*payload)[0], header.size))
+        return false;
+    if (ComputeChecksum(payload->data(), header.size) != header.checksum)
+        return false;
+    return DecodeRecord(*payload, record);
+}
+
+}  // namespace
+
+TaskJournal::Checkpoint::Checkpoint()
+{
+
+}
+
+void TaskJournal::Checkpoint::AddTask(const TaskScheduler::TaskSpec& spec,
+    bool enabled)
+{
+    EncodeRecord(JournalRecord::RECORD_REGISTER, spec, enabled, &image_);
+    ++num_tasks_;
+}
+
+TaskJournal::TaskJournal(const wchar_t* path)
+    : path_(path)
+{
+
+}
+
+TaskJournal::~TaskJournal()
+{
+    Close();
+}
+
+bool TaskJournal::Open(const RecordCallback& callback)
+{
+    Close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.clear();
+    appended_sequence_ = 0;
+    committed_sequence_ = 0;
+    failed_ = false;
+    compacting_ = false;
+    journal_size_ = 0;
+
+    uint64_t generation = 0;
+    if (!ReadCheckpoint(callback, &generation))
+        return false;
+    checkpoint_generation_ = generation;
+    // Left by a crash between writing a checkpoint and deleting the journals
+    // it replaces.
+    std::vector<uint64_t> generations;
+    ListJournals(path_, &generations);
+    for (uint64_t replaced : generations) {
+        if (replaced < generation)
+            DeletePlatformFile(GetJournalPath(path_, replaced));
+    }
+
+    // A compaction interrupted before its checkpoint was written leaves the
+    // journal it started after the one the checkpoint is followed by.
+    bool found_any = false;
+    uint64_t last_size = 0;
+    for (;; ++generation) {
+        bool found = false;
+        uint64_t size = 0;
+        if (!ReplayJournal(generation, callback, &found, &size))
+            return false;
+        if (!found)
+            break;
+        found_any = true;
+        generation_ = generation;
+        last_size = size;
+        journal_size_ += size;
+    }
+
+    if (!found_any || last_size < sizeof(JournalHeader)) {
+        return StartJournal(found_any ? generation_ :
+            checkpoint_generation_);
+    }
+
+    std::unique_ptr<PlatformFile> file(new PlatformFile);
+    // Drop the torn record, if any, so that the next one follows the last
+    // complete record.
+    if (!file->Open(GetJournalPath(path_, generation_),
+            PlatformFile::OPEN_WRITE, nullptr) ||
+        !file->Truncate(last_size)) {
+        return false;
+    }
+    file_ = std::move(file);
+    return true;
+}
+
+void TaskJournal::Close()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (write_in_progress_)
+        written_.wait(lock);
+    if (!file_)
+        return;
+    if (!pending_.empty() && !failed_)
+        WritePending(&lock, true);
+    file_.reset();
+}
+
+uint64_t TaskJournal::Append(const JournalRecord& record)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Nothing appended after a failed write would ever be written.
+    if (failed_ || !file_)
+        return 0;
+    size_t size = pending_.size();
+    EncodeRecord(record.type, record.spec, record.enabled, &pending_);
+    journal_size_ += pending_.size() - size;
+    return ++appended_sequence_;
+}
+
+bool TaskJournal::Commit(uint64_t sequence)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (committed_sequence_ >= sequence)
+            return true;
+        if (failed_ || !file_)
+            return false;
+        if (!write_in_progress_)
+            break;
+        written_.wait(lock);
+    }
+    // With no write in progress, this writer writes for all the ones that
+    // appended since the last write.
+    WritePending(&lock, false);
+    return committed_sequence_ >= sequence;
+}
+
+uint64_t TaskJournal::GetCommittedSequence()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return committed_sequence_;
+}
+
+bool TaskJournal::ShouldCompact()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !compacting_ && !failed_ && journal_size_ >= kMinCompactionSize &&
+        journal_size_ > checkpoint_size_;
+}
+
+bool TaskJournal::BeginCompaction(Checkpoint* checkpoint)
+{
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (compacting_ || failed_ || !file_)
+            return false;
+        compacting_ = true;
+        generation = generation_ + 1;
+    }
+    // Created without the lock, which Append() takes.
+    std::unique_ptr<PlatformFile> file(new PlatformFile);
+    bool created = CreateJournal(generation, file.get());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!created || failed_) {
+        compacting_ = false;
+        return false;
+    }
+    // The write in progress, if any, is to the current journal.
+    while (write_in_progress_)
+        written_.wait(lock);
+    // What is still pending is written to the new journal. Until the
+    // checkpoint is, it is replayed after the current one, in order.
+    uint64_t replaced_size = journal_size_ - pending_.size();
+    file_ = std::move(file);
+    generation_ = generation;
+    journal_size_ += sizeof(JournalHeader);
+
+    checkpoint->generation_ = generation_;
+    checkpoint->num_tasks_ = 0;
+    checkpoint->replaced_size_ = replaced_size;
+    checkpoint->image_.assign(sizeof(CheckpointHeader), 0);
+    return true;
+}
+
+bool TaskJournal::EndCompaction(Checkpoint* checkpoint)
+{
+    // The checkpoint may hold changes appended since BeginCompaction(),
+    // which it mustn't make durable before the journal does.
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sequence = appended_sequence_;
+    }
+    if (!Commit(sequence)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compacting_ = false;
+        return false;
+    }
+
+    CheckpointHeader header = {};
+    memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.generation = checkpoint->generation_;
+    header.num_tasks = checkpoint->num_tasks_;
+    memcpy(&checkpoint->image_[0], &header, sizeof(header));
+
+    // A crash leaves either the previous checkpoint or this one whole.
+    bool written = WriteFileAtomically(path_, checkpoint->image_.data(),
+        checkpoint->image_.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    compacting_ = false;
+    if (!written)
+        return false;
+    for (uint64_t generation = checkpoint_generation_;
+        generation < checkpoint->generation_; ++generation) {
+        DeletePlatformFile(GetJournalPath(path_, generation));
+    }
+    checkpoint_generation_ = checkpoint->generation_;
+    checkpoint_size_ = checkpoint->image_.size();
+    journal_size_ -= checkpoint->replaced_size_;
+    return true;
+}
+
+bool TaskJournal::ReadCheckpoint(const RecordCallback& callback,
+    uint64_t* generation)
+{
+    PlatformFile file;
+    bool not_found = false;
+    if (!file.Open(path_, PlatformFile::OPEN_READ, &not_found)) {
+        *generation = 0;
+        checkpoint_size_ = 0;
+        return not_found;
+    }
+
+    FileReader reader(&file);
+    CheckpointHeader header;
+    bool valid = reader.Read(&header, sizeof(header)) &&
+        memcmp(header.magic, kCheckpointMagic, sizeof(header.magic)) == 0 &&
+        header.version == kVersion;
+    std::vector<uint8_t> payload;
+    JournalRecord record;
+    for (uint64_t i = 0; valid && i < header.num_tasks; ++i) {
+        // A checkpoint is never torn, so every record must be complete.
+        valid = ReadRecord(&reader, &payload, &record) &&
+            record.type == JournalRecord::RECORD_REGISTER;
+        if (valid)
+            callback(record);
+    }
+    if (!valid)
+        return false;
+    *generation = header.generation;
+    checkpoint_size_ = reader.offset();
+    return true;
+}
+
+bool TaskJournal::ReplayJournal(uint64_t generation,
+    const RecordCallback& callback, bool* found, uint64_t* size)
+{
+    *found = false;
+    *size = 0;
+    PlatformFile file;
+    bool not_found = false;
+    if (!file.Open(GetJournalPath(path_, generation), PlatformFile::OPEN_READ,
+            &not_found)) {
+        return not_found;
+    }
+    *found = true;
+
+    FileReader reader(&file);
+    JournalHeader header;
+    if (!reader.Read(&header, sizeof(header))) {
+        // A journal torn while it was being created has no records yet.
+        return !reader.failed();
+    }
+    bool valid =
+        memcmp(header.magic, kJournalMagic, sizeof(header.magic)) == 0 &&
+        header.version == kVersion && header.generation == generation;
+    uint64_t valid_size = reader.offset();
+    std::vector<uint8_t> payload;
+    JournalRecord record;
+    while (valid && ReadRecord(&reader, &payload, &record)) {
+        callback(record);
+        valid_size = reader.offset();
+    }
+    valid = valid && !reader.failed();
+    *size = valid_size;
+    return valid;
+}
+
+bool TaskJournal::StartJournal(uint64_t generation)
+{
+    std::unique_ptr<PlatformFile> file(new PlatformFile);
+    if (!CreateJournal(generation, file.get())) {
+        failed_ = true;
+        return false;
+    }
+    file_ = std::move(file);
+    generation_ = generation;
+    journal_size_ += sizeof(JournalHeader);
+    return true;
+}
+
+bool TaskJournal::CreateJournal(uint64_t generation, PlatformFile* file)
+{
+    if (!file->Open(GetJournalPath(path_, generation),
+            PlatformFile::OPEN_CREATE, nullptr)) {
+        return false;
+    }
+    JournalHeader header = {};
+    memcpy(header.magic, kJournalMagic, sizeof(header.magic));
+    header.version = kVersion;
+    header.generation = generation;
+    if (!file->Write(&header, sizeof(header)) || !file->Flush()) {
+        file->Close();
+        return false;
+    }
+    return true;
+}
+
+void TaskJournal::WritePending(std::unique_lock<std::mutex>* lock,
+    bool keep_lock)
+{
+    write_in_progress_ = true;
+    // |writing_| is empty, its memory is reused for the next appends.
+    writing_.swap(pending_);
+    uint64_t sequence = appended_sequence_;
+    PlatformFile* file = file_.get();
+    if (!keep_lock)
+        lock->unlock();
+    bool written = file->Write(writing_.data(), writing_.size()) &&
+        file->Flush();
+    if (!keep_lock)
+        lock->lock();
+    writing_.clear();
+    write_in_progress_ = false;
+    if (written)
+        committed_sequence_ = sequence;
+    else
+        failed_ = true;
+    written_.notify_all();
+}
+
+void DeleteTaskJournal(const wchar_t* path)
+{
+    // Including those a crash left behind the checkpoint.
+    std::vector<uint64_t> generations;
+    ListJournals(path, &generations);
+    for (uint64_t generation : generations)
+        DeletePlatformFile(GetJournalPath(path, generation));
+    DeletePlatformFile(path);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "task_scheduler.h"
+#include "task_scheduler_platform.h"
+
+// A change to the catalog of a scheduler, as kept in a task journal.
+struct JournalRecord {
+    // The values are stored in journals: only ever add new ones at the end.
+    enum Type {
+        RECORD_REGISTER = 0,
+        RECORD_DELETE,
+        RECORD_SET_ENABLED,
+        RECORD_TYPE_MAX,
+    };
+
+    Type type;
+    // The task registered, or for the other types only its name.
+    TaskScheduler::TaskSpec spec;
+    // Whether the task is enabled, for RECORD_REGISTER and
+    // RECORD_SET_ENABLED.
+    bool enabled;
+};
+
+// Keeps the catalog of a scheduler durable as an append-only journal of its
+// changes, so that it survives crashes without being rewritten on every
+// change.
+//
+// The catalog is the checkpoint at |path| followed by the journals started
+// since, each at |path|.<generation>.journal. Records are appended in memory
+// and written out by Commit(), which concurrent writers share: each write
+// and flush covers whatever was appended meanwhile, so that the cost of the
+// flush is spread over the writers waiting for it. Compaction replaces the
+// journals with a new checkpoint once they are larger than the last one.
+class TaskJournal
+{
+public:
+    typedef std::function<void(const JournalRecord& record)> RecordCallback;
+
+    // The catalog at the start of a journal, built by the owner of the
+    // catalog between BeginCompaction() and EndCompaction().
+    class Checkpoint
+    {
+    public:
+        Checkpoint();
+
+        void AddTask(const TaskScheduler::TaskSpec& spec, bool enabled);
+
+    private:
+        friend class TaskJournal;
+
+        uint64_t generation_ = 0;
+        uint64_t num_tasks_ = 0;
+        // The size of the journals the checkpoint replaces.
+        uint64_t replaced_size_ = 0;
+        // The checkpoint file, whose header is filled by EndCompaction().
+        std::vector<uint8_t> image_;
+    };
+
+    explicit TaskJournal(const wchar_t* path);
+    // Close() the journal.
+    ~TaskJournal();
+
+    // Recover the catalog: call |callback| with a RECORD_REGISTER record per
+    // task of the checkpoint, then with the records of the journals in the
+    // order they were appended. A record torn by a crash while it was being
+    // written, which can only be at the end and was never committed, is
+    // dropped. Then open the last journal for appending, creating the files
+    // if there are none. Return false if they can't be read or are corrupt,
+    // in which case |callback| may have been called for part of them.
+    bool Open(const RecordCallback& callback);
+
+    // Commit what was appended and close the journal.
+    void Close();
+
+    // Append |record| in memory. Records must be appended in the order their
+    // changes are made to the catalog, which is simplest under the lock
+    // guarding it. Return the sequence number to Commit(), or 0 if the
+    // journal isn't open or couldn't be written, in which case |record| is
+    // dropped and its change must not be made.
+    uint64_t Append(const JournalRecord& record);
+
+    // Wait for the records up to |sequence| to be written and flushed to
+    // disk. Return false if the journal couldn't be written, after which
+    // nothing more is.
+    bool Commit(uint64_t sequence);
+
+    // Return the sequence number of the last record written and flushed.
+    // Once the journal failed, the records appended after it never are.
+    uint64_t GetCommittedSequence();
+
+    // Return true if the journals have grown large enough to be compacted.
+    bool ShouldCompact();
+
+    // Start a compaction: start a new journal for the records not written
+    // yet and the ones appended from now on. |checkpoint| must then be filled
+    // with every task of the catalog, whenever convenient: replaying records
+    // whose changes the checkpoint already holds leaves the catalog as it is.
+    // Appending goes on meanwhile, and never waits for the disk. Return false
+    // if a compaction is in progress, or if the journal failed or the new one
+    // can't be created.
+    bool BeginCompaction(Checkpoint* checkpoint);
+
+    // Commit what was appended, which |checkpoint| may hold, then write
+    // |checkpoint| and delete the journals it replaces. Appending and
+    // committing go on meanwhile. Return false if either couldn't be written,
+    // in which case the journals are kept.
+    bool EndCompaction(Checkpoint* checkpoint);
+
+private:
+    TaskJournal(const TaskJournal&) = delete;
+    TaskJournal& operator=(const TaskJournal&) = delete;
+
+    // Read the checkpoint into |callback| and |generation|. A missing
+    // checkpoint is an empty one of generation 0.
+    bool ReadCheckpoint(const RecordCallback& callback, uint64_t* generation);
+    // Replay the journal of |generation| into |callback|. |size| receives the
+    // size of its valid records. Return false if it can't be read or its
+    // header is corrupt; |found| tells if it exists.
+    bool ReplayJournal(uint64_t generation, const RecordCallback& callback,
+        bool* found, uint64_t* size);
+    // Create the journal of |generation| and make it the current one. Must
+    // be called with |mutex_| held.
+    bool StartJournal(uint64_t generation);
+    // Create the journal of |generation| into |file|.
+    bool CreateJournal(uint64_t generation, PlatformFile* file);
+    // Write and flush what was appended. Must be called with |lock| held on
+    // |mutex_|, which is released during the write unless |keep_lock|.
+    void WritePending(std::unique_lock<std::mutex>* lock, bool keep_lock);
+
+    const CStringW path_;
+
+    // Guards everything below.
+    std::mutex mutex_;
+    // Signaled when a write completes.
+    std::condition_variable written_;
+    // The current journal, open while the journal is.
+    std::unique_ptr<PlatformFile> file_;
+    // Records appended and not yet taken by a write.
+    std::vector<uint8_t> pending_;
+    // The buffer being written, kept to reuse its memory.
+    std::vector<uint8_t> writing_;
+    uint64_t appended_sequence_ = 0;
+    uint64_t committed_sequence_ = 0;
+    bool write_in_progress_ = false;
+    bool failed_ = false;
+
+    uint64_t generation_ = 0;
+    uint64_t checkpoint_generation_ = 0;
+    uint64_t checkpoint_size_ = 0;
+    // The size of the journals since the checkpoint, appended records
+    // included.
+    uint64_t journal_size_ = 0;
+    bool compacting_ = false;
+};
+
+// Delete the checkpoint at |path| and its journals.
+void DeleteTaskJournal(const wchar_t* path);
@@ -0,0 +1,229 @@
+#include "task_reconciler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "task_scheduler_util.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double MillisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+        Clock::now() - start).count();
+}
+
+// Everything Apply() does to one task. A change is made by a single thread,
+// which records the outcome in |succeeded|.
+struct TaskChange {
+    CStringW name;
+    // The task's manifest entry, null if the task is to be deleted.
+    const TaskReconciler::ManifestEntry* entry;
+    // True if the task exists in the folder.
+    bool exists;
+    // Register the task from |entry->spec|, which leaves it enabled.
+    bool register_spec;
+    // Enable or disable the task according to |entry->enabled|.
+    bool set_enabled;
+    bool succeeded;
+};
+
+// Make |changes| with |scheduler|: all registrations in a single batch, then
+// the enabled states, then the deletions.
+void ApplyChanges(TaskScheduler* scheduler,
+    const std::vector<TaskChange*>& changes) {
+    std::vector<TaskScheduler::TaskSpec> specs;
+    std::vector<TaskChange*> registrations;
+    for (TaskChange* change : changes) {
+        change->succeeded = true;
+        if (change->register_spec) {
+            specs.push_back(change->entry->spec);
+            registrations.push_back(change);
+        }
+    }
+
+    if (!specs.empty()) {
+        std::vector<TaskScheduler::RegisterResult> results;
+        scheduler->RegisterTasks(specs, &results);
+        for (size_t i = 0; i < registrations.size(); ++i) {
+            registrations[i]->succeeded =
+                results[i] != TaskScheduler::REGISTER_FAILED;
+        }
+    }
+
+    for (TaskChange* change : changes) {
+        if (!change->succeeded)
+            continue;
+        if (!change->entry) {
+            change->succeeded = scheduler->DeleteTask(change->name);
+        } else if (change->set_enabled) {
+            change->succeeded =
+                scheduler->SetTaskEnabled(change->name, change->entry->enabled);
+        }
+    }
+}
+
+// Thread procedure of the additional threads. COM and |scheduler| have to be
+// initialized on the thread that uses them.
+void ApplyChangesOnWorkerThread(TaskScheduler* scheduler,
+    const std::vector<TaskChange*>* changes) {
+    HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    if (FAILED(hr))
+        return;
+
+    if (scheduler->Initilize()) {
+        ApplyChanges(scheduler, *changes);
+        scheduler->UnInitilize();
+    }
+    ::CoUninitialize();
+}
+
+}  // namespace
+
+TaskReconciler::TaskReconciler(TaskScheduler* scheduler,
+    const SchedulerFactory& factory)
+    : scheduler_(scheduler), factory_(factory)
+{
+
+}
+
+bool TaskReconciler::Apply(const Manifest& manifest, const Options& options,
+    Report* report)
+{
+    *report = Report();
+    Report report_storage;
+
+    Clock::time_point start = Clock::now();
+    std::vector<TaskScheduler::TaskSummary> summaries;
+    if (!scheduler_->GetTaskSummaries(&summaries))
+        return false;
+    report_storage.enumerate_ms = MillisecondsSince(start);
+
+    start = Clock::now();
+    std::vector<TaskScheduler::TaskSpec> specs;
+    specs.reserve(manifest.size());
+    for (const ManifestEntry& entry : manifest)
+        specs.push_back(entry.spec);
+    std::vector<CStringW> fingerprints;
+    if (!scheduler_->ComputeFingerprints(specs, &fingerprints))
+        return false;
+
+    // Case folded name -> index in |summaries|.
+    std::unordered_map<std::wstring, size_t> existing_tasks;
+    for (size_t i = 0; i < summaries.size(); ++i)
+        existing_tasks[FoldTaskName(summaries[i].name)] = i;
+
+    std::vector<TaskChange> changes;
+    std::vector<CStringW> unreadable;
+    std::unordered_set<std::wstring> manifest_names;
+    std::vector<bool> listed(summaries.size(), false);
+    for (size_t i = 0; i < manifest.size(); ++i) {
+        const ManifestEntry& entry = manifest[i];
+        std::wstring folded_name = FoldTaskName(entry.spec.name);
+        if (!manifest_names.insert(folded_name).second)
+            return false;
+
+        auto it = existing_tasks.find(folded_name);
+        TaskChange change = { entry.spec.name, &entry,
+            it != existing_tasks.end(), false, false, false };
+        if (change.exists) {
+            const TaskScheduler::TaskSummary& summary = summaries[it->second];
+            listed[it->second] = true;
+            change.register_spec = summary.fingerprint != fingerprints[i];
+            change.set_enabled = change.register_spec ?
+                !entry.enabled : summary.enabled != entry.enabled;
+        } else if (scheduler_->IsTaskRegistered(entry.spec.name)) {
+            // GetTaskSummaries() skips the tasks it can't read. Registering
+            // over one could clobber a task that was never ours.
+            unreadable.push_back(entry.spec.name);
+            continue;
+        } else {
+            change.register_spec = true;
+            change.set_enabled = !entry.enabled;
+        }
+
+        if (change.register_spec || change.set_enabled)
+            changes.push_back(change);
+        else
+            ++report_storage.unchanged;
+    }
+
+    if (options.delete_unlisted) {
+        int prefix_length = options.owned_prefix.GetLength();
+        for (size_t i = 0; i < summaries.size(); ++i) {
+            const TaskScheduler::TaskSummary& summary = summaries[i];
+            if (listed[i] || summary.fingerprint.IsEmpty())
+                continue;
+            if (prefix_length && ::_wcsnicmp(summary.name,
+                options.owned_prefix, prefix_length) != 0) {
+                continue;
+            }
+            TaskChange change = { summary.name, nullptr, true, false, false,
+                false };
+            changes.push_back(change);
+        }
+    }
+    report_storage.diff_ms = MillisecondsSince(start);
+
+    // Changes to different tasks are independent, so deal them out to the
+    // threads. Every additional thread has its own scheduler, which lists
+    // the folder again if its changes need to look tasks up.
+    start = Clock::now();
+    size_t num_threads = 1;
+    if (factory_) {
+        num_threads = std::max<size_t>(1,
+            std::min(options.max_parallelism, changes.size()));
+    }
+    std::vector<std::vector<TaskChange*>> shares(num_threads);
+    for (size_t i = 0; i < changes.size(); ++i)
+        shares[i % num_threads].push_back(&changes[i]);
+
+    std::vector<std::unique_ptr<TaskScheduler>> schedulers;
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        schedulers.emplace_back(factory_());
+        if (!schedulers.back())
+            continue;
+        threads.emplace_back(ApplyChangesOnWorkerThread,
+            schedulers.back().get(), &shares[i]);
+    }
+    ApplyChanges(scheduler_, shares[0]);
+    for (std::thread& thread : threads)
+        thread.join();
+    report_storage.apply_ms = MillisecondsSince(start);
+
+    bool success = unreadable.empty();
+    report_storage.failed.swap(unreadable);
+    for (const TaskChange& change : changes) {
+        if (!change.succeeded) {
+            report_storage.failed.push_back(change.name);
+            success = false;
+            continue;
+        }
+        if (!change.entry) {
+            report_storage.deleted.push_back(change.name);
+            continue;
+        }
+        if (change.register_spec) {
+            if (change.exists)
+                report_storage.updated.push_back(change.name);
+            else
+                report_storage.created.push_back(change.name);
+        }
+        if (change.set_enabled) {
+            if (change.entry->enabled)
+                report_storage.enabled.push_back(change.name);
+            else
+                report_storage.disabled.push_back(change.name);
+        }
+    }
+
+    std::swap(*report, report_storage);
+    return success;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <functional>
+#include <vector>
+
+#include "task_scheduler.h"
+
+// Brings the tasks of a folder in line with a manifest, the declarative list
+// of tasks that should exist. The folder is enumerated once and diffed against
+// the manifest by name and definition, then only the differences are written.
+class TaskReconciler
+{
+public:
+    // A task of the manifest and whether it should be enabled.
+    struct ManifestEntry {
+        TaskScheduler::TaskSpec spec;
+        bool enabled;
+    };
+
+    typedef std::vector<ManifestEntry> Manifest;
+
+    struct Options {
+        Options() : max_parallelism(1), delete_unlisted(false) {}
+
+        // Number of threads the changes are spread over. All changes to one
+        // task are made by the same thread.
+        size_t max_parallelism;
+        // Delete tasks that RegisterTask() registered but which are not in
+        // the manifest, false by default. Tasks registered by other means are
+        // never deleted. As other programs may share the folder, set
+        // |owned_prefix| too where possible.
+        bool delete_unlisted;
+        // If not empty, only tasks whose name starts with |owned_prefix| (case
+        // insensitive) are deleted.
+        CStringW owned_prefix;
+    };
+
+    // What Apply() changed, by task name.
+    struct Report {
+        Report() : unchanged(0), enumerate_ms(0), diff_ms(0), apply_ms(0) {}
+
+        std::vector<CStringW> created;
+        std::vector<CStringW> updated;
+        std::vector<CStringW> enabled;
+        std::vector<CStringW> disabled;
+        std::vector<CStringW> deleted;
+        // Tasks for which a change failed, and tasks of the manifest that
+        // exist but couldn't be read, which are left untouched.
+        std::vector<CStringW> failed;
+        // Number of manifest entries that already matched.
+        size_t unchanged;
+
+        // Wall time spent in each phase, in milliseconds.
+        double enumerate_ms;
+        double diff_ms;
+        double apply_ms;
+    };
+
+    // Return a new, not yet initialized scheduler for the same folder, as
+    // CraateTaskScheduler() does.
+    typedef std::function<TaskScheduler*()> SchedulerFactory;
+
+    // |scheduler| must be initialized and outlive the reconciler. It is used
+    // on the calling thread to read the folder and make a share of the
+    // changes. |factory| provides a scheduler for every additional thread and
+    // can be empty to make all changes on the calling thread.
+    TaskReconciler(TaskScheduler* scheduler, const SchedulerFactory& factory);
+
+    // Make the folder match |manifest|. Return true if every change succeeded.
+    // |report| is filled in either way, but is empty if the folder couldn't be
+    // read or |manifest| names a task twice.
+    bool Apply(const Manifest& manifest, const Options& options,
+        Report* report);
+
+private:
+    TaskScheduler* scheduler_;
+    SchedulerFactory factory_;
+};
@@ -1,5 +1,7 @@
 #include "task_scheduler.h"
 
+// Only the in-process engine is available on other platforms.
+#if defined(_WIN32)
 #include <initguid.h>
 #include <mstask.h>
 #include <taskschd.h>
@@ -13,9 +15,71 @@
 #pragma comment(lib, "Secur32.lib")
 #pragma comment(lib, "Mstask.lib")
 #pragma comment(lib, "Taskschd.lib")
-
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "in_process_task_scheduler.h"
+#include "task_info_table.h"
+#include "task_scheduler_metrics.h"
+#include "task_scheduler_util.h"
+#include "trigger_schedule.h"
+#if defined(_WIN32)
+#include "concurrent_task_catalog.h"
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////
+// A handle on a task whose fields were all read already, shared with whoever
+// else holds them.
+class SharedTaskInfoHandle : public TaskScheduler::TaskHandle
+{
+public:
+    SharedTaskInfoHandle(const wchar_t* name,
+        const std::shared_ptr<const TaskScheduler::TaskInfo>& info)
+        : TaskHandle(name), info_(info) {
+
+    }
+
+    virtual bool GetDescription(CStringW* description) {
+        *description = info_->description;
+        return true;
+    }
+
+    virtual bool GetApplicationPath(CStringW* application_path) {
+        if (info_->exec_actions.empty())
+            return false;
+        *application_path = info_->exec_actions.front().application_path;
+        return true;
+    }
+
+    virtual bool GetExecActions(
+        std::vector<TaskScheduler::TaskExecAction>* actions) {
+        *actions = info_->exec_actions;
+        return true;
+    }
+
+    virtual bool GetLogonType(uint32_t* logon_type) {
+        *logon_type = info_->logon_type;
+        return true;
+    }
+
+private:
+    std::shared_ptr<const TaskScheduler::TaskInfo> info_;
+};
+
+#if defined(_WIN32)
+
 const wchar_t kV2Library[] = L"taskschd.dll";
 
 // Text for times used in the V2 API of the Task Scheduler.
@@ -24,21 +88,39 @@ const wchar_t kSixHoursText[] = L"PT6H";
 const wchar_t kZeroMinuteText[] = L"PT0M";
 const wchar_t kFifteenMinutesText[] = L"PT15M";
 const wchar_t kTwentyFourHoursText[] = L"PT24H";
+const wchar_t kStartBoundaryText[] = L"2008-10-11T13:21:17Z";
 
-const size_t kNumDeleteTaskRetry = 3;
 const size_t kDeleteRetryDelayInMs = 100;
 
+// Retries of deletions that collided with another transaction. The delay starts
+// at kDeleteRetryDelayInMs and doubles with each attempt up to the maximum, and
+// each actual delay is drawn from the upper half of that range so that
+// deletions that failed together don't all retry together.
+const size_t kNumDeleteTaskRetry = 8;
+const ULONGLONG kMaxDeleteRetryDelayInMs = 10 * 1000;
+
+// Maximum age of the task name index before it is rebuilt from the folder, so
+// that tasks registered or deleted by other processes are eventually seen.
+const ULONGLONG kTaskIndexMaxAgeInMs = 30 * 1000;
+
 const VARIANT kEmptyVariant = { { { VT_EMPTY } } };
 
+// Return true if |hr| is one of the transient errors the task service returns
+// when a deletion collides with another transaction.
+static bool IsTransactionError(HRESULT hr) {
+    return hr == HRESULT_FROM_WIN32(ERROR_TRANSACTION_NOT_ACTIVE) ||
+        hr == HRESULT_FROM_WIN32(ERROR_TRANSACTION_ALREADY_ABORTED);
+}
+
 static void PinModule(const wchar_t* module_name) {
     // Force the DLL to stay loaded until program termination. We have seen
     // cases where it gets unloaded even though we still have references to
     // the objects we just CoCreated.
     HMODULE module_handle = nullptr;
-    if (!::GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_PIN, module_name,
-        &module_handle)) {
-        // LOG(ERROR) << "Failed to pin '" << module_name << "'.";
-    }
+    BOOL pinned = ::GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_PIN,
+        module_name, &module_handle);
+    TrackBackendCall(pinned ? S_OK : HRESULT_FROM_WIN32(::GetLastError()),
+        __FUNCTION__, "GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_PIN)");
     if (module_handle) {
         FreeLibrary(module_handle);
     }
@@ -70,36 +152,144 @@ bool GetCurrentUser(CComBSTR& user_name) {
     return true;
 }
 
+// Return true if |hr| is what the task service returns for a missing folder.
+static bool IsFolderNotFound(HRESULT hr) {
+    return hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND) ||
+        hr == HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+}
+
+// Open the folder at |folder_path|, creating it and any missing parent
+// folder on the way down from the root.
+static HRESULT OpenTaskFolder(ITaskService* task_service,
+    const wchar_t* folder_path, ITaskFolder** task_folder) {
+    CComPtr<ITaskFolder> folder;
+    HRESULT hr = BACKEND_CALL(task_service->GetFolder(
+        CComBSTR(folder_path), &folder));
+    if (SUCCEEDED(hr))
+        return folder.CopyTo(task_folder);
+    if (!IsFolderNotFound(hr))
+        return hr;
+
+    folder.Release();
+    hr = BACKEND_CALL(task_service->GetFolder(CComBSTR(L"\\"), &folder));
+    if (FAILED(hr))
+        return hr;
+
+    CStringW path(folder_path);
+    int position = 0;
+    for (CStringW name = path.Tokenize(L"\\", position); position != -1;
+        name = path.Tokenize(L"\\", position)) {
+        CComPtr<ITaskFolder> child;
+        hr = BACKEND_CALL(folder->GetFolder(CComBSTR(name), &child));
+        if (IsFolderNotFound(hr)) {
+            hr = BACKEND_CALL(folder->CreateFolder(
+                CComBSTR(name), kEmptyVariant, &child));
+            // Lost a race with another process creating the same folder.
+            if (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS))
+                hr = BACKEND_CALL(folder->GetFolder(CComBSTR(name), &child));
+        }
+        if (FAILED(hr))
+            return hr;
+        folder = child;
+    }
+    return folder.CopyTo(task_folder);
+}
+
+// Connect a task service of the calling thread's own and open the folder at
+// |folder_path| from it.
+static HRESULT ConnectTaskFolder(const wchar_t* folder_path,
+    ITaskFolder** task_folder) {
+    CComPtr<ITaskService> task_service;
+    HRESULT hr = ::CoCreateInstance(CLSID_TaskScheduler, nullptr,
+        CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&task_service));
+    if (FAILED(hr))
+        return hr;
+    hr = BACKEND_CALL(task_service->Connect(kEmptyVariant, kEmptyVariant,
+        kEmptyVariant, kEmptyVariant));
+    if (FAILED(hr))
+        return hr;
+    return OpenTaskFolder(task_service, folder_path, task_folder);
+}
+
+// Convert |date|, a time as the task service reports them, in local time, to
+// a Unix time. 0, which the service reports for "never" run times, stays 0.
+static bool DateToUnixTime(DATE date, int64_t* time) {
+    if (date == 0) {
+        *time = 0;
+        return true;
+    }
+    SYSTEMTIME local_time;
+    SYSTEMTIME system_time;
+    FILETIME file_time;
+    if (!::VariantTimeToSystemTime(date, &local_time) ||
+        !::TzSpecificLocalTimeToSystemTime(nullptr, &local_time,
+            &system_time) ||
+        !::SystemTimeToFileTime(&system_time, &file_time)) {
+        return false;
+    }
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = file_time.dwLowDateTime;
+    ticks.HighPart = file_time.dwHighDateTime;
+    // FILETIME counts 100 ns ticks since 1601-01-01.
+    *time = static_cast<int64_t>(ticks.QuadPart / 10000000) - 11644473600LL;
+    return true;
+}
+
+static TaskScheduler::RunState RunStateOf(TASK_STATE state) {
+    switch (state) {
+    case TASK_STATE_DISABLED:
+        return TaskScheduler::RUN_STATE_DISABLED;
+    case TASK_STATE_QUEUED:
+        return TaskScheduler::RUN_STATE_QUEUED;
+    case TASK_STATE_READY:
+        return TaskScheduler::RUN_STATE_READY;
+    case TASK_STATE_RUNNING:
+        return TaskScheduler::RUN_STATE_RUNNING;
+    default:
+        return TaskScheduler::RUN_STATE_UNKNOWN;
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 class TaskSchedulerV2 : public TaskScheduler
 {
 public:
-    TaskSchedulerV2() {
+    explicit TaskSchedulerV2(const wchar_t* folder_path)
+        : folder_path_(folder_path) {
+
+    }
+
+    TaskSchedulerV2(ITaskService* task_service, const wchar_t* folder_path)
+        : task_service_(task_service), folder_path_(folder_path) {
 
     }
 
+    virtual ~TaskSchedulerV2() {
+        StopDeleteRetries();
+    }
+
     virtual bool Initilize() {
-        HRESULT hr = ::CoCreateInstance(CLSID_TaskScheduler, nullptr,
-            CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&task_service_));
-        if (FAILED(hr)) {
-            // LOG (ERROR) << "CreateInstance failed for CLSID_TaskScheduler."
-            //             << std::hex << hr;
-            return false;
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        HRESULT hr;
+        if (!task_service_) {
+            hr = BACKEND_CALL(::CoCreateInstance(CLSID_TaskScheduler,
+                nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&task_service_)));
+            if (FAILED(hr)) {
+                return false;
+            }
+            owns_task_service_ = true;
         }
 
 
-        hr = task_service_->Connect(kEmptyVariant,
-                                    kEmptyVariant,
-                                    kEmptyVariant,
-                                    kEmptyVariant);
+        hr = BACKEND_CALL(task_service_->Connect(kEmptyVariant,
+                                                 kEmptyVariant,
+                                                 kEmptyVariant,
+                                                 kEmptyVariant));
         if (FAILED(hr)) {
-            // LOG (ERROR) << "Failed to connect to task service."
-            //             << std::hex << hr;
             return false;
         }
-        hr = task_service_->GetFolder(CComBSTR(L"\\"), &root_task_folder_);
+        hr = OpenTaskFolder(task_service_, folder_path_, &task_folder_);
         if (FAILED(hr)) {
-            // LOG(ERROR) << "Can't get task service folder. " << std::hex << hr;
             return false;
         }
         PinModule(kV2Library);
@@ -108,38 +298,63 @@ public:
     }
 
     virtual bool UnInitilize() {
+        // Before taking the lock, which the retries need to finish.
+        StopDeleteRetries();
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        InvalidateTaskIndex();
         task_service_.Release();
-        root_task_folder_.Release();
+        owns_task_service_ = false;
+        task_folder_.Release();
         return true;
     }
     
+    // Deletions that collide with another transaction are retried by the
+    // same thread and backoff as those of BeginDeleteTask(), and waited for
+    // without holding |mutex_|. The wait keeps dispatching incoming COM calls,
+    // which a caller in a single-threaded apartment may be sent meanwhile.
     virtual bool DeleteTask(const wchar_t* task_name) {
-        if (!root_task_folder_)
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_DELETE_TASK);
+        HANDLE event = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!event)
             return false;
-        HRESULT hr = root_task_folder_->DeleteTask(CComBSTR(task_name), 0);
-
-        size_t num_retries_left = kNumDeleteTaskRetry;
-        if (FAILED(hr)) {
-            while ((hr == HRESULT_FROM_WIN32(ERROR_TRANSACTION_NOT_ACTIVE) ||
-                hr == HRESULT_FROM_WIN32(ERROR_TRANSACTION_ALREADY_ABORTED)) &&
-                --num_retries_left && IsTaskRegistered(task_name)) {
-                hr = root_task_folder_->DeleteTask(CComBSTR(task_name), 0);
-                ::Sleep(kDeleteRetryDelayInMs);
-            }
-            if (!IsTaskRegistered(task_name))
-                hr = S_OK;
-        }
-
-        if (FAILED(hr) && hr != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
-            // LOG(ERROR) << "Can't delete task. " << std::hex << hr;
+        // Shared with the callback, which outlives a failed wait.
+        std::shared_ptr<void> done(event, ::CloseHandle);
+        std::shared_ptr<bool> deleted = std::make_shared<bool>(false);
+        DeleteStatus status = StartDelete(task_name,
+            [done, deleted](bool result) {
+                *deleted = result;
+                ::SetEvent(done.get());
+            });
+        if (status != DELETE_PENDING)
+            return status == DELETE_DONE;
+
+        DWORD index = 0;
+        if (FAILED(::CoWaitForMultipleHandles(0, INFINITE, 1, &event,
+            &index))) {
             return false;
         }
+        return *deleted;
+    }
 
-        return true;
+    virtual DeleteStatus BeginDeleteTask(const wchar_t* task_name,
+        const DeleteCallback& callback) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_BEGIN_DELETE_TASK);
+        return StartDelete(task_name, callback);
     }
 
     virtual bool IsTaskRegistered(const wchar_t* task_name) {
-        if (!root_task_folder_)
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_IS_TASK_REGISTERED);
+        {
+            ConcurrentTaskCatalog::Reader reader(catalog_);
+            if (CanReadCatalog(reader.version()))
+                return reader.version()->FindTask(task_name) != nullptr;
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
             return false;
         return GetTask(task_name, nullptr);
     }
@@ -147,7 +362,10 @@ public:
     // Enable or disable task based on the value of |enabled|. Return true if the
     // task exists and the operation succeeded.
     virtual bool SetTaskEnabled(const wchar_t* task_name, bool enabled) {
-        if (!root_task_folder_)
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_SET_TASK_ENABLED);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
             return false;
 
         CComPtr<IRegisteredTask> registered_task;
@@ -156,16 +374,36 @@ public:
         }
 
         HRESULT hr;
-        hr = registered_task->put_Enabled(enabled ? VARIANT_TRUE : VARIANT_FALSE);
+        hr = BACKEND_CALL(registered_task->put_Enabled(
+            enabled ? VARIANT_TRUE : VARIANT_FALSE));
         if (FAILED(hr)) {
+            // The cached handle may refer to a task deleted behind our back.
+            InvalidateTaskIndex();
             return false;
         }
+        catalog_.SetTaskEnabled(task_name, enabled);
         return true;
     }
 
     // Return true if task exists and is enabled.
     virtual bool IsTaskEnabled(const wchar_t* task_name) {
-        if (!root_task_folder_)
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_IS_TASK_ENABLED);
+        {
+            ConcurrentTaskCatalog::Reader reader(catalog_);
+            if (CanReadCatalog(reader.version())) {
+                const ConcurrentTaskCatalog::Task* task =
+                    reader.version()->FindTask(task_name);
+                if (!task)
+                    return false;
+                bool enabled;
+                if (task->GetEnabled(&enabled))
+                    return enabled;
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
             return false;
 
         CComPtr<IRegisteredTask> registered_task;
@@ -174,17 +412,37 @@ public:
 
         HRESULT hr;
         VARIANT_BOOL is_enabled;
-        hr = registered_task->get_Enabled(&is_enabled);
+        hr = BACKEND_CALL(registered_task->get_Enabled(&is_enabled));
         if (FAILED(hr)) {
+            InvalidateTaskIndex();
             return false;
         }
-        return true;
+        catalog_.SetTaskEnabled(task_name, is_enabled == VARIANT_TRUE);
+        return is_enabled == VARIANT_TRUE;
     }
 
     // Return detailed information about a task. Return true if no errors were
     // encountered. On error, the struct is left unmodified.
     virtual bool GetTaskInfo(const wchar_t* task_name, TaskInfo* info) {
-        if (!root_task_folder_)
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_GET_TASK_INFO);
+        {
+            ConcurrentTaskCatalog::Reader reader(catalog_);
+            if (CanReadCatalog(reader.version())) {
+                const ConcurrentTaskCatalog::Task* task =
+                    reader.version()->FindTask(task_name);
+                if (!task)
+                    return false;
+                if (task->info()) {
+                    CopyTaskInfo(*task->info(), info);
+                    info->name = task_name;
+                    return true;
+                }
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
             return false;
 
         CComPtr<IRegisteredTask> registered_task;
@@ -195,52 +453,482 @@ public:
         // Collect information into internal storage to ensure that we start with
         // a clean slate and don't return partial results on error.
         TaskInfo info_storage;
-        HRESULT hr =
-            GetTaskDescription(registered_task, &info_storage.description);
+        if (!ReadTaskInfo(registered_task, &info_storage))
+            return false;
+        info_storage.name = task_name;
+        catalog_.SetTaskInfo(task_name, info_storage);
+        std::swap(*info, info_storage);
+        return true;
+    }
+
+    // A task already read in full by GetTaskInfo() shares what |catalog_|
+    // holds. Otherwise only the task's handle is looked up, and its
+    // definition is fetched once the first field is asked for.
+    virtual TaskHandle* OpenTask(const wchar_t* task_name) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_OPEN_TASK);
+        {
+            ConcurrentTaskCatalog::Reader reader(catalog_);
+            if (CanReadCatalog(reader.version())) {
+                const ConcurrentTaskCatalog::Task* task =
+                    reader.version()->FindTask(task_name);
+                if (!task)
+                    return nullptr;
+                if (task->info())
+                    return new SharedTaskInfoHandle(task_name, task->info());
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
+            return nullptr;
+
+        CComPtr<IRegisteredTask> registered_task;
+        if (!GetTask(task_name, &registered_task))
+            return nullptr;
+        return new LazyTaskHandle(task_name, registered_task);
+    }
+
+    virtual bool EnumerateTaskInfo(const TaskInfoCallback& callback) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_ENUMERATE_TASK_INFO);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        return ForEachTask([&callback, this](const wchar_t* name,
+            IRegisteredTask* task) {
+            TaskInfo info;
+            if (!ReadTaskInfo(task, &info))
+                return true;
+            info.name = name;
+            return callback(info);
+        });
+    }
+
+    virtual bool GetTaskInfoTable(TaskInfoTable* table) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_ENUMERATE_TASK_INFO);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        return ReadTaskCatalog(table, nullptr);
+    }
+
+    // The summary of each task is read from the definition its information
+    // is read from.
+    virtual bool GetTaskCatalog(TaskInfoTable* table,
+        std::vector<TaskSummary>* summaries) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_ENUMERATE_TASK_INFO);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        return ReadTaskCatalog(table, summaries);
+    }
+
+    virtual bool GetTaskSummaries(std::vector<TaskSummary>* summaries) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_GET_TASK_SUMMARIES);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        std::vector<TaskSummary> summaries_storage;
+        bool success = ForEachTask([&summaries_storage, this](
+            const wchar_t* name, IRegisteredTask* task) {
+            VARIANT_BOOL is_enabled;
+            if (FAILED(BACKEND_CALL(task->get_Enabled(&is_enabled))))
+                return true;
+            TaskSummary summary = { CStringW(name),
+                is_enabled == VARIANT_TRUE };
+            if (!ReadTaskFingerprint(task, &summary.fingerprint))
+                return true;
+            summaries_storage.push_back(summary);
+            return true;
+        });
+        if (!success)
+            return false;
+        summaries->swap(summaries_storage);
+        return true;
+    }
+
+    // The run state is read from the handles the enumeration returns, without
+    // looking tasks up by name or fetching their definitions.
+    virtual bool GetTaskRunStates(TaskRunStates* states) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_GET_TASK_RUN_STATES);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        TaskRunStates states_storage;
+        bool success = ForEachTask([&states_storage](const wchar_t* name,
+            IRegisteredTask* task) {
+            ReadTaskRunState(name, task, &states_storage);
+            return true;
+        });
+        if (!success)
+            return false;
+        std::swap(*states, states_storage);
+        return true;
+    }
+
+    // Served from the sorted |task_names_|, so that the tasks that don't
+    // match are never looked at. Only the matching ones are asked whether
+    // they are enabled.
+    virtual bool ListTasks(const wchar_t* prefix, std::vector<CStringW>* names,
+        std::vector<bool>* enabled) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_LIST_TASKS);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_ || !EnsureTaskIndex())
+            return false;
+        std::vector<CStringW> names_storage;
+        std::vector<bool> enabled_storage;
+        ForEachTaskWithPrefix(task_names_, prefix,
+            [&names_storage, &enabled_storage, enabled, this](
+            const TaskNames::value_type& entry) {
+            ListTask(entry, &names_storage,
+                enabled ? &enabled_storage : nullptr);
+        });
+        names->swap(names_storage);
+        if (enabled)
+            enabled->swap(enabled_storage);
+        return true;
+    }
+
+    virtual bool FindTasks(const wchar_t* pattern,
+        std::vector<CStringW>* names, std::vector<bool>* enabled) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_FIND_TASKS);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_ || !EnsureTaskIndex())
+            return false;
+        std::vector<CStringW> names_storage;
+        std::vector<bool> enabled_storage;
+        ForEachTaskMatching(task_names_, pattern,
+            [&names_storage, &enabled_storage, enabled, this](
+            const TaskNames::value_type& entry) {
+            ListTask(entry, &names_storage,
+                enabled ? &enabled_storage : nullptr);
+        });
+        names->swap(names_storage);
+        if (enabled)
+            enabled->swap(enabled_storage);
+        return true;
+    }
+
+    virtual bool ComputeFingerprints(const std::vector<TaskSpec>& specs,
+        std::vector<CStringW>* fingerprints) {
+        CComBSTR user_name;
+        if (!GetCurrentUser(user_name))
+            return false;
+
+        std::vector<CStringW> fingerprints_storage;
+        fingerprints_storage.reserve(specs.size());
+        for (const TaskSpec& spec : specs)
+            fingerprints_storage.push_back(ComputeTaskFingerprint(spec, user_name));
+        fingerprints->swap(fingerprints_storage);
+        return true;
+    }
+
+    // The spec is filled in place for each task, so that its strings reuse
+    // their buffers rather than being allocated per task.
+    virtual bool EnumerateTaskSpecs(const TaskSpecCallback& callback) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_ENUMERATE_TASK_SPECS);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        TaskSpec spec;
+        return ForEachTask([&callback, &spec, this](const wchar_t* name,
+            IRegisteredTask* task) {
+            VARIANT_BOOL is_enabled;
+            if (FAILED(BACKEND_CALL(task->get_Enabled(&is_enabled))))
+                return true;
+            if (!ReadTaskSpec(task, &spec))
+                return true;
+            spec.name = name;
+            return callback(spec, is_enabled == VARIANT_TRUE);
+        });
+    }
+
+    // Called by ForEachTask() with each task of the folder. Return false to
+    // stop the enumeration.
+    typedef std::function<bool(const wchar_t* name, IRegisteredTask* task)>
+        TaskCallback;
+
+    // Hand every task of the folder to |callback| in a single enumeration.
+    // Every task's handle passes through here anyway, so refresh the name
+    // index on the way unless the callback stops the enumeration early.
+    bool ForEachTask(const TaskCallback& callback) {
+        if (!task_folder_)
+            return false;
+
+        TaskIndex task_index;
+        TaskNames task_names;
+        TaskIterator it(task_folder_);
+        if (it.failed())
+            return false;
+        for (; !it.done(); it.Next()) {
+            if (!callback(it.name(), it.task()))
+                return true;
+            std::wstring key = FoldTaskName(it.name());
+            task_names[key] = it.name();
+            task_index[key].Attach(it.Detach());
+        }
+
+        task_index_.swap(task_index);
+        task_names_.swap(task_names);
+        task_index_valid_ = true;
+        task_index_built_at_ = ::GetTickCount64();
+        PublishCatalog();
+        return true;
+    }
+
+    // Append the run state of |task| to |states|, unless it can't be read.
+    static void ReadTaskRunState(const wchar_t* name, IRegisteredTask* task,
+        TaskRunStates* states) {
+        TASK_STATE state;
+        DATE last_run_date = 0;
+        LONG last_result = 0;
+        DATE next_run_date = 0;
+        LONG missed_runs = 0;
+        if (FAILED(BACKEND_CALL(task->get_State(&state))) ||
+            FAILED(BACKEND_CALL(task->get_LastRunTime(&last_run_date))) ||
+            FAILED(BACKEND_CALL(task->get_LastTaskResult(&last_result))) ||
+            FAILED(BACKEND_CALL(task->get_NextRunTime(&next_run_date))) ||
+            FAILED(BACKEND_CALL(task->get_NumberOfMissedRuns(&missed_runs)))) {
+            return;
+        }
+        // Tasks that never ran report a placeholder date, 1999-11-30 rather
+        // than 0, as their last run time. Their last result tells them apart.
+        if (last_result == SCHED_S_TASK_HAS_NOT_RUN)
+            last_run_date = 0;
+        int64_t last_run_time = 0;
+        int64_t next_run_time = 0;
+        if (!DateToUnixTime(last_run_date, &last_run_time) ||
+            !DateToUnixTime(next_run_date, &next_run_time)) {
+            return;
+        }
+
+        states->names.push_back(CStringW(name));
+        states->last_run_times.push_back(last_run_time);
+        states->last_results.push_back(last_result);
+        states->next_run_times.push_back(next_run_time);
+        states->missed_runs.push_back(
+            static_cast<uint32_t>(std::max<LONG>(missed_runs, 0)));
+        states->states.push_back(RunStateOf(state));
+    }
+
+    // Same as ReadTaskInfo() per task, but the strings are copied from the
+    // BSTRs the service returns straight into the table's arena, without a
+    // TaskInfo in between. A task is only added once all of it was read, so
+    // its strings are held until then. Unless |summaries| is null, it also
+    // receives the summary of each task, as GetTaskSummaries() reads it,
+    // from the same definition. Must be called with |mutex_| held.
+    bool ReadTaskCatalog(TaskInfoTable* table,
+        std::vector<TaskSummary>* summaries) {
+        TaskInfoTable table_storage;
+        std::vector<TaskSummary> summaries_storage;
+        // The application path, working directory and arguments of each exec
+        // action, reused from task to task.
+        std::vector<CComBSTR> action_strings;
+        bool success = ForEachTask([&table_storage, &summaries_storage,
+            &action_strings, summaries, this](
+            const wchar_t* name, IRegisteredTask* task) {
+            CComPtr<ITaskDefinition> task_definition;
+            if (FAILED(BACKEND_CALL(task->get_Definition(&task_definition))))
+                return true;
+            VARIANT_BOOL is_enabled;
+            TaskSummary summary = { CStringW(name), false };
+            if (summaries &&
+                SUCCEEDED(BACKEND_CALL(task->get_Enabled(&is_enabled))) &&
+                ReadDefinitionFingerprint(task_definition,
+                    &summary.fingerprint)) {
+                summary.enabled = is_enabled == VARIANT_TRUE;
+                summaries_storage.push_back(summary);
+            }
+
+            CComBSTR description;
+            uint32_t logon_type;
+            action_strings.clear();
+            if (FAILED(GetTaskDescription(task_definition, &description)) ||
+                !ForEachExecAction(task_definition, [&action_strings](
+                    CComBSTR& application_path, CComBSTR& working_dir,
+                    CComBSTR& parameters) {
+                    action_strings.emplace_back();
+                    action_strings.back().Attach(application_path.Detach());
+                    action_strings.emplace_back();
+                    action_strings.back().Attach(working_dir.Detach());
+                    action_strings.emplace_back();
+                    action_strings.back().Attach(parameters.Detach());
+                }) ||
+                FAILED(GetTaskLogonType(task_definition, &logon_type))) {
+                return true;
+            }
+
+            table_storage.AddTask(name, wcslen(name), description,
+                description.Length(), logon_type);
+            for (size_t i = 0; i < action_strings.size(); i += 3) {
+                table_storage.AddExecAction(
+                    action_strings[i], action_strings[i].Length(),
+                    action_strings[i + 1], action_strings[i + 1].Length(),
+                    action_strings[i + 2], action_strings[i + 2].Length());
+            }
+            return true;
+        });
+        if (!success)
+            return false;
+        table->swap(table_storage);
+        if (summaries)
+            summaries->swap(summaries_storage);
+        return true;
+    }
+
+    // Fill everything but the name of |info| from |task|, fetching the task's
+    // definition only once.
+    bool ReadTaskInfo(IRegisteredTask* task, TaskInfo* info) {
+        CComPtr<ITaskDefinition> task_definition;
+        HRESULT hr = BACKEND_CALL(task->get_Definition(&task_definition));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        hr = GetTaskDescription(task_definition, &info->description);
         if (FAILED(hr)) {
             return false;
         }
 
-        if (!GetTaskExecActions(registered_task,
-            &info_storage.exec_actions)) {
+        if (!GetTaskExecActions(task_definition, &info->exec_actions)) {
             return false;
         }
 
-        hr = GetTaskLogonType(registered_task, &info_storage.logon_type);
+        hr = GetTaskLogonType(task_definition, &info->logon_type);
         if (FAILED(hr)) {
             return false;
         }
-        info_storage.name = task_name;
-        std::swap(*info, info_storage);
         return true;
     }
 
-    // Return the description of the task.
-    HRESULT GetTaskDescription(IRegisteredTask* task,
-        CStringW* description) {
+    // Fill everything but the name of |spec| from |task|. Return false if
+    // the task can't be read or isn't what RegisterTaskSpec() registers for
+    // some spec: a single exec action and a single trigger of a type
+    // CreateTaskPrototype() creates.
+    bool ReadTaskSpec(IRegisteredTask* task, TaskSpec* spec) {
+        CComPtr<ITaskDefinition> task_definition;
+        HRESULT hr = BACKEND_CALL(task->get_Definition(&task_definition));
+        if (FAILED(hr)) {
+            return false;
+        }
 
-        CComBSTR task_name_bstr;
-        HRESULT hr = task->get_Name(&task_name_bstr);
+        hr = GetTaskDescription(task_definition, &spec->description);
         if (FAILED(hr)) {
             return false;
         }
 
-        CStringW task_name = CStringW(task_name_bstr ? task_name_bstr : L"");
+        CComPtr<IActionCollection> action_collection;
+        hr = BACKEND_CALL(task_definition->get_Actions(&action_collection));
+        if (FAILED(hr)) {
+            return false;
+        }
+        long actions_count = 0;  // NOLINT, API requires a long.
+        hr = BACKEND_CALL(action_collection->get_Count(&actions_count));
+        if (FAILED(hr) || actions_count != 1) {
+            return false;
+        }
+        CComPtr<IAction> action;
+        hr = BACKEND_CALL(action_collection->get_Item(1, &action));
+        if (FAILED(hr)) {
+            return false;
+        }
+        CComQIPtr<IExecAction> exec_action(action);
+        if (!exec_action) {
+            return false;
+        }
+        CComBSTR application_path;
+        hr = BACKEND_CALL(exec_action->get_Path(&application_path));
+        if (FAILED(hr)) {
+            return false;
+        }
+        CComBSTR application_arguments;
+        hr = BACKEND_CALL(exec_action->get_Arguments(&application_arguments));
+        if (FAILED(hr)) {
+            return false;
+        }
 
-        CComPtr<ITaskDefinition> task_info;
-        hr = task->get_Definition(&task_info);
+        CComPtr<ITriggerCollection> trigger_collection;
+        hr = BACKEND_CALL(task_definition->get_Triggers(&trigger_collection));
         if (FAILED(hr)) {
-            return hr;
+            return false;
+        }
+        long triggers_count = 0;  // NOLINT, API requires a long.
+        hr = BACKEND_CALL(trigger_collection->get_Count(&triggers_count));
+        if (FAILED(hr) || triggers_count != 1) {
+            return false;
+        }
+        CComPtr<ITrigger> trigger;
+        hr = BACKEND_CALL(trigger_collection->get_Item(1, &trigger));
+        if (FAILED(hr)) {
+            return false;
+        }
+        if (!GetTaskTriggerType(trigger, &spec->trigger_type)) {
+            return false;
         }
 
-        CComPtr<IRegistrationInfo> reg_info;
-        hr = task_info->get_RegistrationInfo(&reg_info);
+        CComPtr<ITaskSettings> task_settings;
+        hr = BACKEND_CALL(task_definition->get_Settings(&task_settings));
         if (FAILED(hr)) {
-            return hr;
+            return false;
+        }
+        VARIANT_BOOL hidden;
+        hr = BACKEND_CALL(task_settings->get_Hidden(&hidden));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        spec->application_path = application_path ? application_path : L"";
+        spec->application_arguments =
+            application_arguments ? application_arguments : L"";
+        spec->hidden = hidden == VARIANT_TRUE;
+        return true;
+    }
+
+    // Return the TriggerType CreateTaskPrototype() would have created
+    // |trigger| for, or false if there is none.
+    bool GetTaskTriggerType(ITrigger* trigger, TriggerType* trigger_type) {
+        ::TASK_TRIGGER_TYPE2 task_trigger_type;
+        HRESULT hr = BACKEND_CALL(trigger->get_Type(&task_trigger_type));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        switch (task_trigger_type) {
+        case TASK_TRIGGER_LOGON:
+            *trigger_type = TRIGGER_TYPE_POST_REBOOT;
+            return true;
+        case TASK_TRIGGER_REGISTRATION:
+            *trigger_type = TRIGGER_TYPE_NOW;
+            return true;
+        case TASK_TRIGGER_DAILY:
+            break;
+        default:
+            return false;
+        }
+
+        CComPtr<IRepetitionPattern> repetition_pattern;
+        hr = BACKEND_CALL(trigger->get_Repetition(&repetition_pattern));
+        if (FAILED(hr)) {
+            return false;
+        }
+        CComBSTR repetition_interval;
+        hr = BACKEND_CALL(repetition_pattern->get_Interval(
+            &repetition_interval));
+        if (FAILED(hr) || !repetition_interval) {
+            return false;
+        }
+        if (wcscmp(repetition_interval, kOneHourText) == 0) {
+            *trigger_type = TRIGGER_TYPE_HOURLY;
+            return true;
         }
+        if (wcscmp(repetition_interval, kSixHoursText) == 0) {
+            *trigger_type = TRIGGER_TYPE_EVERY_SIX_HOURS;
+            return true;
+        }
+        return false;
+    }
 
+    // Return the description of the task.
+    static HRESULT GetTaskDescription(ITaskDefinition* task_info,
+        CStringW* description) {
         CComBSTR raw_description;
-        hr = reg_info->get_Description(&raw_description);
+        HRESULT hr = GetTaskDescription(task_info, &raw_description);
         if (FAILED(hr)) {
             return hr;
         }
@@ -249,24 +937,46 @@ public:
         return ERROR_SUCCESS;
     }
 
+    // Same as above, as the service returns it.
+    static HRESULT GetTaskDescription(ITaskDefinition* task_info,
+        BSTR* description) {
+        CComPtr<IRegistrationInfo> reg_info;
+        HRESULT hr = BACKEND_CALL(task_info->get_RegistrationInfo(&reg_info));
+        if (FAILED(hr)) {
+            return hr;
+        }
+        return BACKEND_CALL(reg_info->get_Description(description));
+    }
+
     // Return all executable actions associated with the given task. Non-exec
     // actions are silently ignored.
-    bool GetTaskExecActions(IRegisteredTask* task,
+    static bool GetTaskExecActions(ITaskDefinition* task_definition,
         std::vector<TaskExecAction>* actions) {
-        CComPtr<ITaskDefinition> task_definition;
-        HRESULT hr = task->get_Definition(&task_definition);
-        if (FAILED(hr)) {
-            return false;
-        }
+        return ForEachExecAction(task_definition, [actions](
+            CComBSTR& application_path, CComBSTR& working_dir,
+            CComBSTR& parameters) {
+            actions->push_back(
+            { CStringW(application_path ? application_path : L""),
+                CStringW(working_dir ? working_dir : L""),
+                CStringW(parameters ? parameters : L"") });
+        });
+    }
 
+    // Call |visitor| with the application path, working directory and
+    // arguments of every exec action of the task, as the service returns
+    // them, for it to keep or copy. Non-exec actions are silently ignored.
+    template <typename Visitor>
+    static bool ForEachExecAction(ITaskDefinition* task_definition,
+        const Visitor& visitor) {
         CComPtr<IActionCollection> action_collection;
-        hr = task_definition->get_Actions(&action_collection);
+        HRESULT hr = BACKEND_CALL(task_definition->get_Actions(
+            &action_collection));
         if (FAILED(hr)) {
             return false;
         }
 
         long actions_count = 0;  // NOLINT, API requires a long.
-        hr = action_collection->get_Count(&actions_count);
+        hr = BACKEND_CALL(action_collection->get_Count(&actions_count));
         if (FAILED(hr)) {
             return false;
         }
@@ -278,14 +988,15 @@ public:
         for (long action_index = 1;  // NOLINT
             action_index <= actions_count; ++action_index) {
             CComPtr<IAction> action;
-            hr = action_collection->get_Item(action_index, &action);
+            hr = BACKEND_CALL(action_collection->get_Item(
+                action_index, &action));
             if (FAILED(hr)) {
                 success = false;
                 continue;
             }
 
             ::TASK_ACTION_TYPE action_type;
-            hr = action->get_Type(&action_type);
+            hr = BACKEND_CALL(action->get_Type(&action_type));
             if (FAILED(hr)) {
                 success = false;
                 continue;
@@ -305,51 +1016,92 @@ public:
             }
 
             CComBSTR application_path;
-            hr = exec_action->get_Path(&application_path);
+            hr = BACKEND_CALL(exec_action->get_Path(&application_path));
             if (FAILED(hr)) {
                 success = false;
                 continue;
             }
 
             CComBSTR working_dir;
-            hr = exec_action->get_WorkingDirectory(&working_dir);
+            hr = BACKEND_CALL(exec_action->get_WorkingDirectory(&working_dir));
             if (FAILED(hr)) {
                 success = false;
                 continue;
             }
 
             CComBSTR parameters;
-            hr = exec_action->get_Arguments(&parameters);
+            hr = BACKEND_CALL(exec_action->get_Arguments(&parameters));
             if (FAILED(hr)) {
                 success = false;
                 continue;
             }
 
-            actions->push_back(
-            { CStringW(application_path ? application_path : L""),
-                CStringW(working_dir ? working_dir : L""),
-                CStringW(parameters ? parameters : L"") });
+            visitor(application_path, working_dir, parameters);
         }
         return success;
     }
 
-    // Return the log-on type required for the task's actions to be run.
-    HRESULT GetTaskLogonType(IRegisteredTask* task, uint32_t* logon_type) {
-        CComPtr<ITaskDefinition> task_info;
-        HRESULT hr = task->get_Definition(&task_info);
+    // Return the application of the first exec action of the task, reading
+    // nothing of the other actions. Return false if there is none.
+    static bool GetTaskApplicationPath(ITaskDefinition* task_definition,
+        CStringW* application_path) {
+        CComPtr<IActionCollection> action_collection;
+        HRESULT hr = BACKEND_CALL(task_definition->get_Actions(
+            &action_collection));
         if (FAILED(hr)) {
-            return hr;
+            return false;
         }
 
-        CComPtr<IPrincipal> principal;
-        hr = task_info->get_Principal(&principal);
+        long actions_count = 0;  // NOLINT, API requires a long.
+        hr = BACKEND_CALL(action_collection->get_Count(&actions_count));
         if (FAILED(hr)) {
-            return hr;
+            return false;
         }
 
-        TASK_LOGON_TYPE raw_logon_type;
-        hr = principal->get_LogonType(&raw_logon_type);
-        if (FAILED(hr)) {
+        for (long action_index = 1;  // NOLINT
+            action_index <= actions_count; ++action_index) {
+            CComPtr<IAction> action;
+            hr = BACKEND_CALL(action_collection->get_Item(
+                action_index, &action));
+            if (FAILED(hr)) {
+                return false;
+            }
+
+            ::TASK_ACTION_TYPE action_type;
+            hr = BACKEND_CALL(action->get_Type(&action_type));
+            if (FAILED(hr)) {
+                return false;
+            }
+            if (action_type != ::TASK_ACTION_EXEC)
+                continue;
+
+            CComQIPtr<IExecAction> exec_action(action);
+            if (!exec_action) {
+                return false;
+            }
+            CComBSTR path;
+            hr = BACKEND_CALL(exec_action->get_Path(&path));
+            if (FAILED(hr)) {
+                return false;
+            }
+            *application_path = CStringW(path ? path : L"");
+            return true;
+        }
+        return false;
+    }
+
+    // Return the log-on type required for the task's actions to be run.
+    static HRESULT GetTaskLogonType(ITaskDefinition* task_info,
+        uint32_t* logon_type) {
+        CComPtr<IPrincipal> principal;
+        HRESULT hr = BACKEND_CALL(task_info->get_Principal(&principal));
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        TASK_LOGON_TYPE raw_logon_type;
+        hr = BACKEND_CALL(principal->get_LogonType(&raw_logon_type));
+        if (FAILED(hr)) {
             return hr;
         }
 
@@ -382,102 +1134,296 @@ public:
         const wchar_t* application_arguments,
         TriggerType trigger_type,
         bool hidden) {
-        if (!DeleteTask(task_name))
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_REGISTER_TASK);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
             return false;
 
-        // Create the task definition object to create the task.
-        CComPtr<ITaskDefinition> task;
-        HRESULT hr = task_service_->NewTask(0, &task);
-        if (FAILED(hr)) {
+        CComBSTR user_name;
+        if (!GetCurrentUser(user_name))
+            return false;
+
+        TaskSpec spec = { CStringW(task_name), CStringW(task_description),
+            CStringW(application_path), CStringW(application_arguments),
+            trigger_type, hidden };
+        CComPtr<ITaskDefinition> prototype;
+        return UpsertTask(spec, user_name, prototype) != REGISTER_FAILED;
+    }
+
+    virtual bool RegisterTasks(const std::vector<TaskSpec>& specs,
+        std::vector<RegisterResult>* results) {
+        ScopedOperationMetrics metrics(
+            TaskSchedulerMetrics::OPERATION_REGISTER_TASKS);
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        std::vector<RegisterResult> results_storage(specs.size(),
+            REGISTER_FAILED);
+        bool success = RegisterTasksInternal(specs, &results_storage);
+        results->swap(results_storage);
+        return success;
+    }
+
+private:
+    bool RegisterTasksInternal(const std::vector<TaskSpec>& specs,
+        std::vector<RegisterResult>* results) {
+        if (!task_folder_)
+            return false;
+
+        // Decide between create and update for the whole batch from a single
+        // enumeration of the folder.
+        if (!EnsureTaskIndex())
             return false;
-        }
 
         CComBSTR user_name;
         if (!GetCurrentUser(user_name))
             return false;
 
+        // Specs only differ from each other in the fields RegisterTaskSpec()
+        // sets, so build one definition per trigger type and reuse it. Each
+        // schedule gets its own.
+        CComPtr<ITaskDefinition> prototypes[TRIGGER_TYPE_MAX];
+        bool success = true;
+        for (size_t i = 0; i < specs.size(); ++i) {
+            const TaskSpec& spec = specs[i];
+            if (spec.trigger_type < 0 || spec.trigger_type >= TRIGGER_TYPE_MAX) {
+                success = false;
+                continue;
+            }
+
+            CComPtr<ITaskDefinition> schedule_prototype;
+            (*results)[i] = UpsertTask(spec, user_name,
+                spec.trigger_type == TRIGGER_TYPE_SCHEDULE ?
+                    schedule_prototype : prototypes[spec.trigger_type]);
+            if ((*results)[i] == REGISTER_FAILED)
+                success = false;
+        }
+        return success;
+    }
+
+    // Make the task |spec.name| match |spec|. A task registered from the same
+    // spec is left untouched, otherwise the task is created or updated in
+    // place. |prototype| holds the definition for |spec.trigger_type| and is
+    // created on first use, so that callers can share it between specs, but
+    // not between the specs of TRIGGER_TYPE_SCHEDULE.
+    RegisterResult UpsertTask(const TaskSpec& spec,
+        const CComBSTR& user_name,
+        CComPtr<ITaskDefinition>& prototype) {
+        if (spec.trigger_type < 0 || spec.trigger_type >= TRIGGER_TYPE_MAX)
+            return REGISTER_FAILED;
+
+        CStringW fingerprint = ComputeTaskFingerprint(spec, user_name);
+        CComPtr<IRegisteredTask> registered_task;
+        bool exists = GetTask(spec.name, &registered_task);
+        bool up_to_date = false;
+        if (exists &&
+            !IsTaskUpToDate(registered_task, fingerprint, &up_to_date)) {
+            // The indexed handle may be stale, the task having been changed
+            // or deleted by someone else since: read it from the folder.
+            registered_task.Release();
+            HRESULT hr = LookUpTask(spec.name, &registered_task);
+            if (FAILED(hr))
+                return REGISTER_FAILED;
+            exists = hr == S_OK;
+            if (exists &&
+                !IsTaskUpToDate(registered_task, fingerprint, &up_to_date)) {
+                return REGISTER_FAILED;
+            }
+        }
+        if (up_to_date)
+            return REGISTER_UNCHANGED;
+
+        TriggerSchedule schedule;
+        if (spec.trigger_type == TRIGGER_TYPE_SCHEDULE &&
+            !schedule.Parse(spec.schedule)) {
+            return REGISTER_FAILED;
+        }
+
+        if (!prototype &&
+            !CreateTaskPrototype(spec.trigger_type, &schedule, user_name,
+                &prototype)) {
+            return REGISTER_FAILED;
+        }
+
+        if (!RegisterTaskSpec(spec, fingerprint, prototype, user_name))
+            return REGISTER_FAILED;
+        return exists ? REGISTER_UPDATED : REGISTER_CREATED;
+    }
+
+    // Set |up_to_date| to whether |task| is enabled, as registration leaves
+    // it, and its stored fingerprint is |fingerprint|. Return false if |task|
+    // can't be read.
+    bool IsTaskUpToDate(IRegisteredTask* task, const CStringW& fingerprint,
+        bool* up_to_date) {
+        *up_to_date = false;
+        VARIANT_BOOL is_enabled;
+        HRESULT hr = BACKEND_CALL(task->get_Enabled(&is_enabled));
+        if (FAILED(hr)) {
+            return false;
+        }
+        if (is_enabled != VARIANT_TRUE)
+            return true;
+
+        CStringW stored_fingerprint;
+        if (!ReadTaskFingerprint(task, &stored_fingerprint))
+            return false;
+        *up_to_date = stored_fingerprint == fingerprint;
+        return true;
+    }
+
+    // Read the fingerprint RegisterTaskSpec() stored in |task|. |fingerprint|
+    // is set to an empty string if the task was registered by other means.
+    bool ReadTaskFingerprint(IRegisteredTask* task, CStringW* fingerprint) {
+        CComPtr<ITaskDefinition> task_definition;
+        HRESULT hr = BACKEND_CALL(task->get_Definition(&task_definition));
+        if (FAILED(hr)) {
+            return false;
+        }
+        return ReadDefinitionFingerprint(task_definition, fingerprint);
+    }
+
+    // Same as ReadTaskFingerprint() for the definition of a task.
+    bool ReadDefinitionFingerprint(ITaskDefinition* task_definition,
+        CStringW* fingerprint) {
+        CComPtr<IRegistrationInfo> registration_info;
+        HRESULT hr = BACKEND_CALL(task_definition->get_RegistrationInfo(
+            &registration_info));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        CComBSTR documentation;
+        hr = BACKEND_CALL(registration_info->get_Documentation(&documentation));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        CStringW stored(documentation ? documentation : L"");
+        if (stored.Find(kTaskFingerprintPrefix) != 0)
+            stored.Empty();
+        *fingerprint = stored;
+        return true;
+    }
+
+    // Create a definition with everything RegisterTask() sets up for
+    // |trigger_type| and a single exec action. The fields that vary between
+    // tasks (description, hidden flag, path and arguments) are filled in by
+    // RegisterTaskSpec(). The triggers of TRIGGER_TYPE_SCHEDULE are those of
+    // |schedule|.
+    bool CreateTaskPrototype(TriggerType trigger_type,
+        const TriggerSchedule* schedule,
+        const CComBSTR& user_name,
+        ITaskDefinition** prototype) {
+        // Create the task definition object to create the task.
+        CComPtr<ITaskDefinition> task;
+        HRESULT hr = BACKEND_CALL(task_service_->NewTask(0, &task));
+        if (FAILED(hr)) {
+            return false;
+        }
+
         if (trigger_type != TRIGGER_TYPE_NOW) {
             // Allow the task to run elevated on startup.
             CComPtr<IPrincipal> principal;
-            hr = task->get_Principal(&principal);
+            hr = BACKEND_CALL(task->get_Principal(&principal));
             if (FAILED(hr)) {
                 return false;
             }
 
-            hr = principal->put_RunLevel(TASK_RUNLEVEL_HIGHEST);
+            hr = BACKEND_CALL(principal->put_RunLevel(TASK_RUNLEVEL_HIGHEST));
             if (FAILED(hr)) {
                 return false;
             }
 
-            hr = principal->put_UserId(user_name);
+            hr = BACKEND_CALL(principal->put_UserId(user_name));
             if (FAILED(hr)) {
                 return false;
             }
 
-            hr = principal->put_LogonType(TASK_LOGON_INTERACTIVE_TOKEN);
+            hr = BACKEND_CALL(principal->put_LogonType(
+                TASK_LOGON_INTERACTIVE_TOKEN));
             if (FAILED(hr)) {
                 return false;
             }
         }
 
         CComPtr<IRegistrationInfo> registration_info;
-        hr = task->get_RegistrationInfo(&registration_info);
+        hr = BACKEND_CALL(task->get_RegistrationInfo(&registration_info));
         if (FAILED(hr)) {
             return false;
         }
 
-        hr = registration_info->put_Author(user_name);
+        hr = BACKEND_CALL(registration_info->put_Author(user_name));
         if (FAILED(hr)) {
             return false;
         }
 
-        CComBSTR description(task_description);
-        hr = registration_info->put_Description(description);
+       CComPtr<ITaskSettings> task_settings;
+        hr = BACKEND_CALL(task->get_Settings(&task_settings));
         if (FAILED(hr)) {
             return false;
         }
 
-       CComPtr<ITaskSettings> task_settings;
-        hr = task->get_Settings(&task_settings);
+        hr = BACKEND_CALL(task_settings->put_StartWhenAvailable(VARIANT_TRUE));
         if (FAILED(hr)) {
             return false;
         }
 
-        hr = task_settings->put_StartWhenAvailable(VARIANT_TRUE);
+        // TODO(csharp): Find a way to only set this for log upload retry.
+        hr = BACKEND_CALL(task_settings->put_DeleteExpiredTaskAfter(
+            CComBSTR(kZeroMinuteText)));
         if (FAILED(hr)) {
             return false;
         }
 
-        // TODO(csharp): Find a way to only set this for log upload retry.
-        hr = task_settings->put_DeleteExpiredTaskAfter(
-            CComBSTR(kZeroMinuteText));
+        hr = BACKEND_CALL(task_settings->put_DisallowStartIfOnBatteries(
+            VARIANT_FALSE));
         if (FAILED(hr)) {
             return false;
         }
 
-        hr = task_settings->put_DisallowStartIfOnBatteries(VARIANT_FALSE);
+        hr = BACKEND_CALL(task_settings->put_StopIfGoingOnBatteries(
+            VARIANT_FALSE));
         if (FAILED(hr)) {
             return false;
         }
 
-        hr = task_settings->put_StopIfGoingOnBatteries(VARIANT_FALSE);
+        CComPtr<ITriggerCollection> trigger_collection;
+        hr = BACKEND_CALL(task->get_Triggers(&trigger_collection));
         if (FAILED(hr)) {
             return false;
         }
 
-        if (hidden) {
-            hr = task_settings->put_Hidden(VARIANT_TRUE);
-            if (FAILED(hr)) {
+        if (trigger_type == TRIGGER_TYPE_SCHEDULE) {
+            std::vector<ScheduleTrigger> schedule_triggers;
+            if (!schedule || !schedule->GetTaskTriggers(&schedule_triggers))
                 return false;
+            for (const ScheduleTrigger& schedule_trigger : schedule_triggers) {
+                if (!AddScheduleTrigger(trigger_collection, schedule_trigger))
+                    return false;
             }
+        } else if (!AddTrigger(trigger_collection, trigger_type)) {
+            return false;
         }
 
-        CComPtr<ITriggerCollection> trigger_collection;
-        hr = task->get_Triggers(&trigger_collection);
+        CComPtr<IActionCollection> actions;
+        hr = BACKEND_CALL(task->get_Actions(&actions));
         if (FAILED(hr)) {
             return false;
         }
 
+        CComPtr<IAction> action;
+        hr = BACKEND_CALL(actions->Create(TASK_ACTION_EXEC, &action));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        *prototype = task.Detach();
+        return true;
+    }
+
+    // Add the trigger RegisterTask() sets up for |trigger_type| to
+    // |trigger_collection|.
+    bool AddTrigger(ITriggerCollection* trigger_collection,
+        TriggerType trigger_type) {
         TASK_TRIGGER_TYPE2 task_trigger_type = TASK_TRIGGER_EVENT;
         switch (trigger_type) {
         case TRIGGER_TYPE_POST_REBOOT:
@@ -489,13 +1435,12 @@ public:
         case TRIGGER_TYPE_HOURLY:
         case TRIGGER_TYPE_EVERY_SIX_HOURS:
             task_trigger_type = TASK_TRIGGER_DAILY;
-            // repetition_interval.Reset(::SysAllocString(kSixHoursText));
-            // repetition_interval.Reset(::SysAllocString(kOneHourText));
             break;
         }
 
         CComPtr<ITrigger> trigger;
-        hr = trigger_collection->Create(task_trigger_type, &trigger);
+        HRESULT hr = BACKEND_CALL(trigger_collection->Create(
+            task_trigger_type, &trigger));
         if (FAILED(hr)) {
             return false;
         }
@@ -507,26 +1452,30 @@ public:
                 return false;
             }
 
-            hr = daily_trigger->put_DaysInterval(1);
+            hr = BACKEND_CALL(daily_trigger->put_DaysInterval(1));
             if (FAILED(hr)) {
                 return false;
             }
 
             CComPtr<IRepetitionPattern> repetition_pattern;
-            hr = trigger->get_Repetition(&repetition_pattern);
+            hr = BACKEND_CALL(trigger->get_Repetition(&repetition_pattern));
             if (FAILED(hr)) {
                 return false;
             }
 
             // The duration is the time to keep repeating until the next daily
             // trigger.
-            hr = repetition_pattern->put_Duration(CComBSTR(kTwentyFourHoursText));
+            hr = BACKEND_CALL(repetition_pattern->put_Duration(
+                CComBSTR(kTwentyFourHoursText)));
             if (FAILED(hr)) {
                 return false;
             }
 
-            CComBSTR repetition_interval = kOneHourText;
-            hr = repetition_pattern->put_Interval(repetition_interval);
+            CComBSTR repetition_interval =
+                trigger_type == TRIGGER_TYPE_HOURLY ? kOneHourText :
+                kSixHoursText;
+            hr = BACKEND_CALL(repetition_pattern->put_Interval(
+                repetition_interval));
             if (FAILED(hr)) {
                 return false;
             }
@@ -538,22 +1487,233 @@ public:
                 return false;
             }
 
-            hr = logon_trigger->put_Delay(CComBSTR(kFifteenMinutesText));
+            hr = BACKEND_CALL(logon_trigger->put_Delay(
+                CComBSTR(kFifteenMinutesText)));
+            if (FAILED(hr)) {
+                return false;
+            }
+        }
+
+        // Without an end boundary, so that the task never expires.
+        hr = BACKEND_CALL(trigger->put_StartBoundary(
+            CComBSTR(kStartBoundaryText)));
+        if (FAILED(hr)) {
+            return false;
+        }
+        return true;
+    }
+
+    // Add |schedule_trigger|, one of the triggers of a TriggerSchedule, to
+    // |trigger_collection|.
+    bool AddScheduleTrigger(ITriggerCollection* trigger_collection,
+        const ScheduleTrigger& schedule_trigger) {
+        TASK_TRIGGER_TYPE2 task_trigger_type = TASK_TRIGGER_TIME;
+        switch (schedule_trigger.type) {
+        case ScheduleTrigger::TYPE_TIME:
+            task_trigger_type = TASK_TRIGGER_TIME;
+            break;
+        case ScheduleTrigger::TYPE_DAILY:
+            task_trigger_type = TASK_TRIGGER_DAILY;
+            break;
+        case ScheduleTrigger::TYPE_WEEKLY:
+            task_trigger_type = TASK_TRIGGER_WEEKLY;
+            break;
+        case ScheduleTrigger::TYPE_MONTHLY:
+            task_trigger_type = TASK_TRIGGER_MONTHLY;
+            break;
+        case ScheduleTrigger::TYPE_MONTHLY_DAY_OF_WEEK:
+            task_trigger_type = TASK_TRIGGER_MONTHLYDOW;
+            break;
+        }
+
+        CComPtr<ITrigger> trigger;
+        HRESULT hr = BACKEND_CALL(trigger_collection->Create(
+            task_trigger_type, &trigger));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        hr = BACKEND_CALL(trigger->put_StartBoundary(
+            CComBSTR(schedule_trigger.start_boundary)));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        if (!schedule_trigger.end_boundary.IsEmpty()) {
+            hr = BACKEND_CALL(trigger->put_EndBoundary(
+                CComBSTR(schedule_trigger.end_boundary)));
+            if (FAILED(hr)) {
+                return false;
+            }
+        }
+
+        if (!schedule_trigger.repetition_interval.IsEmpty()) {
+            CComPtr<IRepetitionPattern> repetition_pattern;
+            hr = BACKEND_CALL(trigger->get_Repetition(&repetition_pattern));
+            if (FAILED(hr)) {
+                return false;
+            }
+
+            hr = BACKEND_CALL(repetition_pattern->put_Interval(
+                CComBSTR(schedule_trigger.repetition_interval)));
             if (FAILED(hr)) {
                 return false;
             }
+
+            if (!schedule_trigger.repetition_duration.IsEmpty()) {
+                hr = BACKEND_CALL(repetition_pattern->put_Duration(
+                    CComBSTR(schedule_trigger.repetition_duration)));
+                if (FAILED(hr)) {
+                    return false;
+                }
+            }
+        }
+
+        CComBSTR random_delay;
+        if (!schedule_trigger.random_delay.IsEmpty())
+            random_delay = schedule_trigger.random_delay;
+
+        switch (schedule_trigger.type) {
+        case ScheduleTrigger::TYPE_TIME: {
+            CComQIPtr<ITimeTrigger> time_trigger(trigger);
+            if (!time_trigger) {
+                return false;
+            }
+
+            if (random_delay) {
+                hr = BACKEND_CALL(time_trigger->put_RandomDelay(random_delay));
+            }
+            break;
+        }
+        case ScheduleTrigger::TYPE_DAILY: {
+            CComQIPtr<IDailyTrigger> daily_trigger(trigger);
+            if (!daily_trigger) {
+                return false;
+            }
+
+            hr = BACKEND_CALL(daily_trigger->put_DaysInterval(
+                schedule_trigger.days_interval));
+            if (SUCCEEDED(hr) && random_delay) {
+                hr = BACKEND_CALL(daily_trigger->put_RandomDelay(random_delay));
+            }
+            break;
+        }
+        case ScheduleTrigger::TYPE_WEEKLY: {
+            CComQIPtr<IWeeklyTrigger> weekly_trigger(trigger);
+            if (!weekly_trigger) {
+                return false;
+            }
+
+            hr = BACKEND_CALL(weekly_trigger->put_DaysOfWeek(
+                schedule_trigger.days_of_week));
+            if (SUCCEEDED(hr)) {
+                hr = BACKEND_CALL(weekly_trigger->put_WeeksInterval(1));
+            }
+            if (SUCCEEDED(hr) && random_delay) {
+                hr = BACKEND_CALL(weekly_trigger->put_RandomDelay(
+                    random_delay));
+            }
+            break;
+        }
+        case ScheduleTrigger::TYPE_MONTHLY: {
+            CComQIPtr<IMonthlyTrigger> monthly_trigger(trigger);
+            if (!monthly_trigger) {
+                return false;
+            }
+
+            hr = BACKEND_CALL(monthly_trigger->put_DaysOfMonth(
+                schedule_trigger.days_of_month));
+            if (SUCCEEDED(hr)) {
+                hr = BACKEND_CALL(monthly_trigger->put_MonthsOfYear(
+                    schedule_trigger.months_of_year));
+            }
+            if (SUCCEEDED(hr) && random_delay) {
+                hr = BACKEND_CALL(monthly_trigger->put_RandomDelay(
+                    random_delay));
+            }
+            break;
+        }
+        case ScheduleTrigger::TYPE_MONTHLY_DAY_OF_WEEK: {
+            CComQIPtr<IMonthlyDOWTrigger> monthly_trigger(trigger);
+            if (!monthly_trigger) {
+                return false;
+            }
+
+            // Every week of the month, the last one included.
+            hr = BACKEND_CALL(monthly_trigger->put_DaysOfWeek(
+                schedule_trigger.days_of_week));
+            if (SUCCEEDED(hr)) {
+                hr = BACKEND_CALL(monthly_trigger->put_WeeksOfMonth(0xF));
+            }
+            if (SUCCEEDED(hr)) {
+                hr = BACKEND_CALL(monthly_trigger->put_RunOnLastWeekOfMonth(
+                    VARIANT_TRUE));
+            }
+            if (SUCCEEDED(hr)) {
+                hr = BACKEND_CALL(monthly_trigger->put_MonthsOfYear(
+                    schedule_trigger.months_of_year));
+            }
+            if (SUCCEEDED(hr) && random_delay) {
+                hr = BACKEND_CALL(monthly_trigger->put_RandomDelay(
+                    random_delay));
+            }
+            break;
+        }
+        }
+        if (FAILED(hr)) {
+            return false;
+        }
+        return true;
+    }
+
+    // Fill the per-task fields of |spec| and its |fingerprint| into |task|, a
+    // definition created by CreateTaskPrototype() for |spec.trigger_type|, and
+    // register it, replacing the definition of an existing task in place.
+    bool RegisterTaskSpec(const TaskSpec& spec,
+        const CStringW& fingerprint,
+        ITaskDefinition* task,
+        const CComBSTR& user_name) {
+        CComPtr<IRegistrationInfo> registration_info;
+        HRESULT hr = BACKEND_CALL(task->get_RegistrationInfo(
+            &registration_info));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        CComBSTR description(spec.description);
+        hr = BACKEND_CALL(registration_info->put_Description(description));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        hr = BACKEND_CALL(registration_info->put_Documentation(
+            CComBSTR(fingerprint)));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        CComPtr<ITaskSettings> task_settings;
+        hr = BACKEND_CALL(task->get_Settings(&task_settings));
+        if (FAILED(hr)) {
+            return false;
+        }
+
+        // Set explicitly, the definition may have been used for a hidden task.
+        hr = BACKEND_CALL(task_settings->put_Hidden(
+            spec.hidden ? VARIANT_TRUE : VARIANT_FALSE));
+        if (FAILED(hr)) {
+            return false;
         }
 
-        hr = trigger->put_StartBoundary(L"2008-10-11T13:21:17Z");
-        hr = trigger->put_EndBoundary(L"2028-10-11T13:21:17Z");
         CComPtr<IActionCollection> actions;
-        hr = task->get_Actions(&actions);
+        hr = BACKEND_CALL(task->get_Actions(&actions));
         if (FAILED(hr)) {
             return false;
         }
 
+        // Note: get_Item uses 1 based indices.
         CComPtr<IAction> action;
-        hr = actions->Create(TASK_ACTION_EXEC, &action);
+        hr = BACKEND_CALL(actions->get_Item(1, &action));
         if (FAILED(hr)) {
             return false;
         }
@@ -563,60 +1723,198 @@ public:
             return false;
         }
 
-        
-        hr = exec_action->put_Path(CComBSTR(application_path));
+        hr = BACKEND_CALL(exec_action->put_Path(
+            CComBSTR(spec.application_path)));
         if (FAILED(hr)) {
             return false;
         }
 
-        hr = exec_action->put_Arguments(CComBSTR(application_arguments));
+        hr = BACKEND_CALL(exec_action->put_Arguments(
+            CComBSTR(spec.application_arguments)));
         if (FAILED(hr)) {
             return false;
         }
 
         CComPtr<IRegisteredTask> registered_task;                    
-        hr = root_task_folder_->RegisterTaskDefinition(
-            CComBSTR(task_name), 
+        hr = BACKEND_CALL(task_folder_->RegisterTaskDefinition(
+            CComBSTR(spec.name),
             task, 
-            TASK_CREATE,
+            TASK_CREATE_OR_UPDATE,
             CComVariant(user_name),  // Not really input, but API expect non-const.
             kEmptyVariant, 
             TASK_LOGON_NONE,
             kEmptyVariant,
-            &registered_task);
+            &registered_task));
         if (FAILED(hr)) {
             return false;
         }
 
+        if (task_index_valid_) {
+            std::wstring key = FoldTaskName(spec.name);
+            task_index_[key] = registered_task;
+            task_names_[key] = spec.name;
+            catalog_.SetTask(spec.name);
+            // Registration leaves the task enabled.
+            catalog_.SetTaskEnabled(spec.name, true);
+        }
         return true;
     }
 
-private:
     // Return the task with |task_name| and false if not found. |task| can be null
-    // when only interested in task's existence.
+    // when only interested in task's existence. Doesn't allocate unless the
+    // index has to be rebuilt. Hits and misses alike are answered from the
+    // index, which this scheduler's own changes keep current: tasks
+    // registered or deleted by other processes are seen once it is rebuilt,
+    // at most kTaskIndexMaxAgeInMs later.
     bool GetTask(const wchar_t* task_name, IRegisteredTask** task) {
-        for (TaskIterator it(root_task_folder_); !it.done(); it.Next()) {
-            if (::_wcsicmp(it.name(), task_name) == 0) {
-                if (task)
-                    *task = it.Detach();
-                return true;
+        if (!EnsureTaskIndex())
+            return false;
+
+        FoldTaskName(task_name, &lookup_key_);
+        TaskIndex::iterator it = task_index_.find(lookup_key_);
+        if (it == task_index_.end())
+            return false;
+        if (task)
+            it->second.CopyTo(task);
+        return true;
+    }
+
+    // Look |task_name| up in the folder itself rather than in the index, and
+    // bring the index in line with what is found. Return S_FALSE if there is
+    // no such task.
+    HRESULT LookUpTask(const wchar_t* task_name, IRegisteredTask** task) {
+        CComPtr<IRegisteredTask> found;
+        HRESULT hr = BACKEND_CALL(task_folder_->GetTask(CComBSTR(task_name),
+            &found));
+        if (hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
+            RemoveFromTaskIndex(task_name);
+            return S_FALSE;
+        }
+        if (FAILED(hr))
+            return hr;
+
+        if (task_index_valid_) {
+            std::wstring key = FoldTaskName(task_name);
+            task_index_[key] = found;
+            task_names_.insert(std::make_pair(key, CStringW(task_name)));
+            // Whatever was read from the previous handle may be outdated.
+            catalog_.SetTask(task_names_[key]);
+        }
+        if (task)
+            found.CopyTo(task);
+        return S_OK;
+    }
+
+    // Build the task name index with a single enumeration of the folder if it
+    // is missing or older than kTaskIndexMaxAgeInMs. Return false if the folder
+    // can't be enumerated, leaving no index and no catalog behind.
+    bool EnsureTaskIndex() {
+        ULONGLONG now = ::GetTickCount64();
+        if (task_index_valid_ &&
+            now - task_index_built_at_ < kTaskIndexMaxAgeInMs) {
+            // A query that found |catalog_| stale before the index was rebuilt
+            // has nothing left to refresh.
+            catalog_refreshing_.store(false, std::memory_order_relaxed);
+            return true;
+        }
+
+        task_index_.clear();
+        task_names_.clear();
+        TaskIterator it(task_folder_);
+        if (it.failed()) {
+            InvalidateTaskIndex();
+            return false;
+        }
+        for (; !it.done(); it.Next()) {
+            std::wstring key = FoldTaskName(it.name());
+            task_names_[key] = it.name();
+            task_index_[key].Attach(it.Detach());
+        }
+
+        task_index_valid_ = true;
+        task_index_built_at_ = now;
+        PublishCatalog();
+        return true;
+    }
+
+    // Drop the task name index so that the next lookup rebuilds it. Also
+    // ends any refresh of |catalog_|: with no catalog left, queries wait for
+    // |mutex_| instead.
+    void InvalidateTaskIndex() {
+        task_index_.clear();
+        task_names_.clear();
+        task_index_valid_ = false;
+        catalog_.Clear();
+        catalog_refreshing_.store(false, std::memory_order_relaxed);
+    }
+
+    // Add the task of |entry| of |task_names_| to |names| and, unless
+    // |enabled| is null, whether it is enabled to |enabled|. Looks the task up
+    // in |task_index_| directly: GetTask() could rebuild the index under the
+    // caller's iteration.
+    void ListTask(const std::pair<const std::wstring, CStringW>& entry,
+        std::vector<CStringW>* names, std::vector<bool>* enabled) {
+        if (enabled) {
+            TaskIndex::iterator it = task_index_.find(entry.first);
+            VARIANT_BOOL is_enabled;
+            if (it == task_index_.end() ||
+                FAILED(BACKEND_CALL(it->second->get_Enabled(&is_enabled)))) {
+                return;
             }
+            enabled->push_back(is_enabled == VARIANT_TRUE);
+            catalog_.SetTaskEnabled(entry.second, is_enabled == VARIANT_TRUE);
         }
-        return false;
+        names->push_back(entry.second);
+    }
+
+    // Drop |task_name| from the task name index, if there is one.
+    void RemoveFromTaskIndex(const wchar_t* task_name) {
+        if (!task_index_valid_)
+            return;
+        std::wstring key = FoldTaskName(task_name);
+        task_index_.erase(key);
+        task_names_.erase(key);
+        catalog_.RemoveTask(task_name);
+    }
+
+    // Publish the tasks of the freshly built |task_names_| to |catalog_|,
+    // with nothing read about them yet.
+    void PublishCatalog() {
+        std::vector<CStringW> names;
+        names.reserve(task_names_.size());
+        for (const auto& entry : task_names_)
+            names.push_back(entry.second);
+        catalog_.Reset(names, task_index_built_at_);
+        catalog_refreshing_.store(false, std::memory_order_relaxed);
+    }
+
+    // Return true if a query can be answered from |version| of |catalog_|
+    // without taking |mutex_|: there is one and it is younger than the
+    // task index may get, or it is older but another query is already
+    // refreshing it, in which case queries are answered from it meanwhile.
+    bool CanReadCatalog(const ConcurrentTaskCatalog::Version* version) {
+        if (!version)
+            return false;
+        if (::GetTickCount64() - version->listed_at() < kTaskIndexMaxAgeInMs)
+            return true;
+        return catalog_refreshing_.load(std::memory_order_relaxed) ||
+            catalog_refreshing_.exchange(true);
     }
 
     class TaskIterator {
     public:
         explicit TaskIterator(ITaskFolder* task_folder) {
-            HRESULT hr =
-                task_folder->GetTasks(TASK_ENUM_HIDDEN, &tasks_);
+            HRESULT hr = BACKEND_CALL(
+                task_folder->GetTasks(TASK_ENUM_HIDDEN, &tasks_));
             if (FAILED(hr)) {
                 done_ = true;
+                failed_ = true;
                 return;
             }
-            hr = tasks_->get_Count(&num_tasks_);
+            hr = BACKEND_CALL(tasks_->get_Count(&num_tasks_));
             if (FAILED(hr)) {
                 done_ = true;
+                failed_ = true;
                 return;
             }
             Next();
@@ -633,19 +1931,20 @@ private:
             }
 
             // Note: get_Item uses 1 based indices.
-            HRESULT hr = tasks_->get_Item(CComVariant(task_index_ + 1), &task_);
+            HRESULT hr = BACKEND_CALL(tasks_->get_Item(
+                CComVariant(task_index_ + 1), &task_));
             if (FAILED(hr)) {
                 Next();
                 return;
             }
 
-            CComBSTR task_name_bstr;
-            hr = task_->get_Name(&task_name_bstr);
+            // The name is handed out as it comes from the task service
+            // rather than copied.
+            hr = BACKEND_CALL(task_->get_Name(&name_));
             if (FAILED(hr)) {
                 Next();
                 return;
             }
-            name_ = CStringW(task_name_bstr ? task_name_bstr : L"");
         }
 
         // Detach the currently active task and pass ownership to the caller.
@@ -659,22 +1958,324 @@ private:
             return result;
         }
 
-        const CStringW& name() const { return name_; }
+        // Provide access to the current task without passing ownership.
+        IRegisteredTask* task() const { return task_; }
+
+        // Valid until the next call to Next().
+        const wchar_t* name() const { return name_ ? name_.m_str : L""; }
         bool done() const { return done_; }
+        // True if the folder's task collection couldn't be retrieved at all.
+        bool failed() const { return failed_; }
 
     private:
         CComPtr<IRegisteredTaskCollection> tasks_;
         CComPtr<IRegisteredTask> task_;
-        CStringW name_;
+        CComBSTR name_;
         long task_index_ = -1;  // NOLINT, API requires a long.
         long num_tasks_ = 0;    // NOLINT, API requires a long.
         bool done_ = false;
+        bool failed_ = false;
+    };
+
+    // A deletion left pending by StartDelete().
+    struct PendingDelete {
+        CStringW name;
+        DeleteCallback callback;
+        // Retries made so far.
+        size_t num_retries;
+    };
+
+    // Delete |task_name|, leaving it to the retry thread, which calls
+    // |callback| when done, if the deletion collides with another
+    // transaction.
+    DeleteStatus StartDelete(const wchar_t* task_name,
+        const DeleteCallback& callback) {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        if (!task_folder_)
+            return DELETE_FAILED;
+        HRESULT hr = BACKEND_CALL(task_folder_->DeleteTask(
+            CComBSTR(task_name), 0));
+        if (IsTransactionError(hr)) {
+            // The task may or may not be gone, leave that to the retries.
+            if (!StartDeleteRetries())
+                return DELETE_FAILED;
+            PendingDelete pending_delete = { CStringW(task_name), callback, 0 };
+            ScheduleDeleteRetry(pending_delete);
+            return DELETE_PENDING;
+        }
+
+        if (FAILED(hr) && hr != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+            return DELETE_FAILED;
+
+        RemoveFromTaskIndex(task_name);
+        return DELETE_DONE;
+    }
+
+    // Start the thread that retries pending deletions unless it is running.
+    // The thread connects to the task service on its own, so that its calls
+    // never wait on this thread's apartment. A service passed in by the
+    // caller is marshaled to it instead. Called with |mutex_| held.
+    bool StartDeleteRetries() {
+        if (delete_retry_thread_.joinable())
+            return true;
+
+        IStream* folder_stream = nullptr;
+        if (!owns_task_service_) {
+            HRESULT hr = BACKEND_CALL(::CoMarshalInterThreadInterfaceInStream(
+                __uuidof(ITaskFolder), task_folder_, &folder_stream));
+            if (FAILED(hr))
+                return false;
+        }
+        stopping_delete_retries_ = false;
+        delete_retry_thread_ = std::thread(&TaskSchedulerV2::RetryDeletes,
+            this, folder_stream);
+        return true;
+    }
+
+    // Stop the retry thread and call back the deletions still pending.
+    void StopDeleteRetries() {
+        {
+            std::lock_guard<std::mutex> lock(delete_retry_mutex_);
+            stopping_delete_retries_ = true;
+        }
+        delete_retry_wake_.notify_all();
+        if (delete_retry_thread_.joinable())
+            delete_retry_thread_.join();
+
+        std::multimap<ULONGLONG, PendingDelete> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(delete_retry_mutex_);
+            abandoned.swap(pending_deletes_);
+        }
+        for (auto& entry : abandoned)
+            entry.second.callback(false);
+    }
+
+    // Queue the next retry of |pending_delete|.
+    void ScheduleDeleteRetry(const PendingDelete& pending_delete) {
+        ULONGLONG delay = kDeleteRetryDelayInMs;
+        for (size_t i = 0; i < pending_delete.num_retries &&
+            delay < kMaxDeleteRetryDelayInMs; ++i) {
+            delay *= 2;
+        }
+        delay = std::min(delay, kMaxDeleteRetryDelayInMs);
+        {
+            std::lock_guard<std::mutex> lock(delete_retry_mutex_);
+            std::uniform_int_distribution<ULONGLONG> jitter(delay / 2, delay);
+            pending_deletes_.insert(std::make_pair(
+                ::GetTickCount64() + jitter(delete_retry_random_),
+                pending_delete));
+        }
+        delete_retry_wake_.notify_one();
+    }
+
+    // Thread procedure of the retry thread. Waits for pending deletions to
+    // come due and retries them with the folder unmarshaled from
+    // |folder_stream|, or opened from a connection of its own if null.
+    void RetryDeletes(IStream* folder_stream) {
+        HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        CComPtr<ITaskFolder> task_folder;
+        if (SUCCEEDED(hr)) {
+            if (folder_stream) {
+                BACKEND_CALL(::CoGetInterfaceAndReleaseStream(folder_stream,
+                    IID_PPV_ARGS(&task_folder)));
+            } else {
+                ConnectTaskFolder(folder_path_, &task_folder);
+            }
+        } else if (folder_stream) {
+            folder_stream->Release();
+        }
+
+        std::unique_lock<std::mutex> lock(delete_retry_mutex_);
+        while (!stopping_delete_retries_) {
+            if (pending_deletes_.empty()) {
+                delete_retry_wake_.wait(lock);
+                continue;
+            }
+            ULONGLONG now = ::GetTickCount64();
+            auto next = pending_deletes_.begin();
+            if (next->first > now) {
+                delete_retry_wake_.wait_for(lock,
+                    std::chrono::milliseconds(next->first - now));
+                continue;
+            }
+            PendingDelete pending_delete = next->second;
+            pending_deletes_.erase(next);
+
+            lock.unlock();
+            RetryDelete(task_folder, &pending_delete);
+            lock.lock();
+        }
+        lock.unlock();
+
+        task_folder.Release();
+        if (SUCCEEDED(hr))
+            ::CoUninitialize();
+    }
+
+    // Make one more attempt at |pending_delete| and either finish it or queue
+    // the next attempt. |mutex_| is only held to read and update the index,
+    // never across calls to |task_folder|, which may have to be served by
+    // the thread that is waiting for it.
+    void RetryDelete(ITaskFolder* task_folder, PendingDelete* pending_delete) {
+        bool finished = true;
+        bool deleted = false;
+        // The attempt doubles as the check of the one task: a task deleted
+        // since, by the previous attempt or otherwise, is reported as not
+        // found. Neither the index nor the folder listing is consulted.
+        if (task_folder) {
+            TaskSchedulerMetrics::RecordDeleteRetry();
+            HRESULT hr = BACKEND_CALL(task_folder->DeleteTask(
+                CComBSTR(pending_delete->name), 0));
+            ++pending_delete->num_retries;
+            if (SUCCEEDED(hr) ||
+                hr == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)) {
+                deleted = true;
+            } else if (IsTransactionError(hr) &&
+                pending_delete->num_retries < kNumDeleteTaskRetry) {
+                finished = false;
+            }
+        }
+        if (deleted) {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            RemoveFromTaskIndex(pending_delete->name);
+        }
+
+        if (finished)
+            pending_delete->callback(deleted);
+        else
+            ScheduleDeleteRetry(*pending_delete);
+    }
+
+    // Reads the fields of a task from its definition, fetched when the first
+    // field is asked for and shared by all of them.
+    class LazyTaskHandle : public TaskHandle
+    {
+    public:
+        LazyTaskHandle(const wchar_t* name, IRegisteredTask* task)
+            : TaskHandle(name), task_(task) {
+
+        }
+
+        virtual bool GetDescription(CStringW* description) {
+            if (!has_description_) {
+                if (!EnsureDefinition() ||
+                    FAILED(GetTaskDescription(definition_, &description_))) {
+                    return false;
+                }
+                has_description_ = true;
+            }
+            *description = description_;
+            return true;
+        }
+
+        virtual bool GetApplicationPath(CStringW* application_path) {
+            if (!has_application_path_) {
+                if (has_exec_actions_) {
+                    if (exec_actions_.empty())
+                        return false;
+                    application_path_ = exec_actions_.front().application_path;
+                } else if (!EnsureDefinition() ||
+                    !GetTaskApplicationPath(definition_, &application_path_)) {
+                    return false;
+                }
+                has_application_path_ = true;
+            }
+            *application_path = application_path_;
+            return true;
+        }
+
+        virtual bool GetExecActions(std::vector<TaskExecAction>* actions) {
+            if (!has_exec_actions_) {
+                std::vector<TaskExecAction> actions_storage;
+                if (!EnsureDefinition() ||
+                    !GetTaskExecActions(definition_, &actions_storage)) {
+                    return false;
+                }
+                exec_actions_.swap(actions_storage);
+                has_exec_actions_ = true;
+            }
+            *actions = exec_actions_;
+            return true;
+        }
+
+        virtual bool GetLogonType(uint32_t* logon_type) {
+            if (!has_logon_type_) {
+                if (!EnsureDefinition() ||
+                    FAILED(GetTaskLogonType(definition_, &logon_type_))) {
+                    return false;
+                }
+                has_logon_type_ = true;
+            }
+            *logon_type = logon_type_;
+            return true;
+        }
+
+    private:
+        bool EnsureDefinition() {
+            if (definition_)
+                return true;
+            return SUCCEEDED(BACKEND_CALL(task_->get_Definition(&definition_)));
+        }
+
+        CComPtr<IRegisteredTask> task_;
+        CComPtr<ITaskDefinition> definition_;
+        bool has_description_ = false;
+        CStringW description_;
+        bool has_application_path_ = false;
+        CStringW application_path_;
+        bool has_exec_actions_ = false;
+        std::vector<TaskExecAction> exec_actions_;
+        bool has_logon_type_ = false;
+        uint32_t logon_type_ = LOGON_UNKNOWN;
     };
+
+    // Case folded task name -> registered task, see FoldTaskName().
+    typedef std::unordered_map<std::wstring, CComPtr<IRegisteredTask>> TaskIndex;
+    // Case folded task name -> task name, sorted for ListTasks() and
+    // FindTasks().
+    typedef std::map<std::wstring, CStringW> TaskNames;
+
 private:
+    // The tasks of |task_index_| and what was read about them, which
+    // IsTaskRegistered(), IsTaskEnabled() and GetTaskInfo() read from any
+    // thread without taking |mutex_|. Changed with |mutex_| held, in step
+    // with |task_index_|, and dropped whenever it is invalidated.
+    ConcurrentTaskCatalog catalog_;
+    // Set while a query is refreshing a stale |catalog_|.
+    std::atomic<bool> catalog_refreshing_{ false };
+
+    // Guards everything below, as deletions are retried on another thread.
+    // Recursive because public methods call each other.
+    std::recursive_mutex mutex_;
+
     ATL::CComPtr<ITaskService> task_service_;
-    ATL::CComPtr<ITaskFolder> root_task_folder_;
+    // True if |task_service_| was created by Initilize() rather than passed
+    // in, so that the retry thread can connect one of its own.
+    bool owns_task_service_ = false;
+    // The folder all tasks are kept in and |task_folder_| refers to.
+    CStringW folder_path_;
+    ATL::CComPtr<ITaskFolder> task_folder_;
+
+    TaskIndex task_index_;
+    // The names of the tasks of |task_index_|, kept in step with it.
+    TaskNames task_names_;
+    bool task_index_valid_ = false;
+    ULONGLONG task_index_built_at_ = 0;
+    // The folded name GetTask() looks up, kept to reuse its buffer.
+    std::wstring lookup_key_;
+
+    // Deletions left pending by StartDelete(), by the time of their next
+    // retry, and the thread that retries them.
+    std::mutex delete_retry_mutex_;
+    std::condition_variable delete_retry_wake_;
+    std::multimap<ULONGLONG, PendingDelete> pending_deletes_;
+    std::minstd_rand delete_retry_random_;
+    bool stopping_delete_retries_ = false;
+    std::thread delete_retry_thread_;
 };
 
+#endif  // defined(_WIN32)
 
 //
 TaskScheduler::TaskScheduler()
@@ -687,8 +2288,202 @@ TaskScheduler::~TaskScheduler()
 
 }
 
+TaskScheduler::DeleteStatus TaskScheduler::BeginDeleteTask(
+    const wchar_t* task_name, const DeleteCallback& callback)
+{
+    return DeleteTask(task_name) ? DELETE_DONE : DELETE_FAILED;
+}
+
+TaskScheduler::TaskHandle::TaskHandle(const wchar_t* name)
+    : name_(name)
+{
+
+}
+
+TaskScheduler::TaskHandle::~TaskHandle()
+{
+
+}
+
+TaskScheduler::TaskHandle* TaskScheduler::OpenTask(const wchar_t* task_name)
+{
+    std::shared_ptr<TaskInfo> info = std::make_shared<TaskInfo>();
+    if (!GetTaskInfo(task_name, info.get()))
+        return nullptr;
+    return new SharedTaskInfoHandle(task_name, info);
+}
+
+bool TaskScheduler::SetChangeObserver(const ChangeObserver& observer)
+{
+    return false;
+}
+
+bool TaskScheduler::EnumerateTaskSpecs(const TaskSpecCallback& callback)
+{
+    return false;
+}
+
+bool TaskScheduler::GetTaskRunStates(TaskRunStates* states)
+{
+    return false;
+}
+
+// Read the tasks of |scheduler| with GetTaskSummaries() into |index|, keyed
+// by folded name, for the default ListTasks() and FindTasks().
+static bool IndexTaskSummaries(TaskScheduler* scheduler,
+    std::map<std::wstring, TaskScheduler::TaskSummary>* index)
+{
+    std::vector<TaskScheduler::TaskSummary> summaries;
+    if (!scheduler->GetTaskSummaries(&summaries))
+        return false;
+    for (const TaskScheduler::TaskSummary& summary : summaries)
+        (*index)[FoldTaskName(summary.name)] = summary;
+    return true;
+}
+
+bool TaskScheduler::ListTasks(const wchar_t* prefix,
+    std::vector<CStringW>* names, std::vector<bool>* enabled)
+{
+    std::map<std::wstring, TaskSummary> index;
+    if (!IndexTaskSummaries(this, &index))
+        return false;
+    std::vector<CStringW> names_storage;
+    std::vector<bool> enabled_storage;
+    ForEachTaskWithPrefix(index, prefix, [&names_storage, &enabled_storage](
+        const std::pair<const std::wstring, TaskSummary>& entry) {
+        names_storage.push_back(entry.second.name);
+        enabled_storage.push_back(entry.second.enabled);
+    });
+    names->swap(names_storage);
+    if (enabled)
+        enabled->swap(enabled_storage);
+    return true;
+}
+
+bool TaskScheduler::FindTasks(const wchar_t* pattern,
+    std::vector<CStringW>* names, std::vector<bool>* enabled)
+{
+    std::map<std::wstring, TaskSummary> index;
+    if (!IndexTaskSummaries(this, &index))
+        return false;
+    std::vector<CStringW> names_storage;
+    std::vector<bool> enabled_storage;
+    ForEachTaskMatching(index, pattern, [&names_storage, &enabled_storage](
+        const std::pair<const std::wstring, TaskSummary>& entry) {
+        names_storage.push_back(entry.second.name);
+        enabled_storage.push_back(entry.second.enabled);
+    });
+    names->swap(names_storage);
+    if (enabled)
+        enabled->swap(enabled_storage);
+    return true;
+}
+
+bool TaskScheduler::GetAllTaskInfo(std::vector<TaskInfo>* infos)
+{
+    std::vector<TaskInfo> infos_storage;
+    bool success = EnumerateTaskInfo([&infos_storage](const TaskInfo& info) {
+        infos_storage.push_back(info);
+        return true;
+    });
+    if (!success)
+        return false;
+    infos->swap(infos_storage);
+    return true;
+}
+
+bool TaskScheduler::GetTaskInfoTable(TaskInfoTable* table)
+{
+    TaskInfoTable table_storage;
+    bool success = EnumerateTaskInfo([&table_storage](const TaskInfo& info) {
+        table_storage.Add(info);
+        return true;
+    });
+    if (!success)
+        return false;
+    table->swap(table_storage);
+    return true;
+}
+
+bool TaskScheduler::GetTaskCatalog(TaskInfoTable* table,
+    std::vector<TaskSummary>* summaries)
+{
+    TaskInfoTable table_storage;
+    std::vector<TaskSummary> summaries_storage;
+    if (!GetTaskInfoTable(&table_storage) ||
+        !GetTaskSummaries(&summaries_storage)) {
+        return false;
+    }
+    table->swap(table_storage);
+    summaries->swap(summaries_storage);
+    return true;
+}
+
+#if defined(_WIN32)
+
+// Return true if the Task Scheduler service can be created and connected to.
+static bool IsTaskServiceAvailable()
+{
+    CComPtr<ITaskService> task_service;
+    HRESULT hr = ::CoCreateInstance(CLSID_TaskScheduler, nullptr,
+        CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&task_service));
+    if (FAILED(hr))
+        return false;
+    hr = BACKEND_CALL(task_service->Connect(kEmptyVariant,
+                                            kEmptyVariant,
+                                            kEmptyVariant,
+                                            kEmptyVariant));
+    return SUCCEEDED(hr);
+}
+
+#else  // defined(_WIN32)
+
+static bool IsTaskServiceAvailable()
+{
+    return false;
+}
+
+#endif  // defined(_WIN32)
 
 TaskScheduler* CraateTaskScheduler()
 {
-    return new TaskSchedulerV2();
+#if defined(_WIN32)
+    return new TaskSchedulerV2(L"\\");
+#else
+    return CreateInProcessTaskScheduler(0);
+#endif
 }
+
+TaskScheduler* CreateTaskScheduler(TaskSchedulerBackend backend)
+{
+    switch (backend) {
+    case BACKEND_TASK_SERVICE:
+#if defined(_WIN32)
+        return new TaskSchedulerV2(L"\\");
+#else
+        return nullptr;
+#endif
+    case BACKEND_IN_PROCESS:
+        return CreateInProcessTaskScheduler(0);
+    case BACKEND_AUTO:
+        if (IsTaskServiceAvailable())
+            return CreateTaskScheduler(BACKEND_TASK_SERVICE);
+        return CreateInProcessTaskScheduler(0);
+    }
+    return nullptr;
+}
+
+#if defined(_WIN32)
+
+TaskScheduler* CreateTaskSchedulerForFolder(const wchar_t* folder_path)
+{
+    return new TaskSchedulerV2(folder_path);
+}
+
+TaskScheduler* CreateTaskSchedulerForService(ITaskService* task_service,
+    const wchar_t* folder_path)
+{
+    return new TaskSchedulerV2(task_service, folder_path);
+}
+
+#endif  // defined(_WIN32)
@@ -1,9 +1,15 @@
 #pragma once
 
-#include <atlbase.h>
-#include <atlstr.h>
+#include <stdint.h>
+
+#include <functional>
 #include <vector>
 
+#include "task_scheduler_platform.h"
+
+struct ITaskService;
+class TaskInfoTable;
+
 class TaskScheduler
 {
 public:
@@ -29,6 +35,9 @@ public:
         // Run every hour.
         TRIGGER_TYPE_HOURLY = 2,
         TRIGGER_TYPE_EVERY_SIX_HOURS = 3,
+        // Run on TaskSpec::schedule, a cron expression or a repeating
+        // interval (see TriggerSchedule). Only for RegisterTasks().
+        TRIGGER_TYPE_SCHEDULE = 4,
         TRIGGER_TYPE_MAX,
     };
 
@@ -49,16 +58,121 @@ public:
         LOGON_S4U = 1 << 2,
     };
 
+    // The arguments of RegisterTask(), for registering tasks in bulk.
+    struct TaskSpec {
+        CStringW name;
+        CStringW description;
+        CStringW application_path;
+        CStringW application_arguments;
+        TriggerType trigger_type;
+        bool hidden;
+        // When the task runs, for TRIGGER_TYPE_SCHEDULE.
+        CStringW schedule;
+    };
+
+    // The outcome of registering one TaskSpec with RegisterTasks().
+    enum RegisterResult {
+        REGISTER_FAILED = 0,
+        // No task with that name existed, a new one was created.
+        REGISTER_CREATED,
+        // A task with that name existed and its definition was updated.
+        REGISTER_UPDATED,
+        // The task was already registered from an identical spec and enabled,
+        // nothing was written.
+        REGISTER_UNCHANGED,
+    };
 
-    ~TaskScheduler();
+    // What GetTaskSummaries() reads about each task: just enough to tell
+    // whether it matches a TaskSpec.
+    struct TaskSummary {
+        CStringW name;
+        bool enabled;
+        // The fingerprint stored by RegisterTask(), empty for tasks that were
+        // registered by other means.
+        CStringW fingerprint;
+    };
+
+
+    // A change made to a task, as reported to a ChangeObserver.
+    enum ChangeType {
+        CHANGE_ADDED = 0,
+        CHANGE_REMOVED,
+        CHANGE_ENABLED,
+        CHANGE_DISABLED,
+        // The task was registered again from a different spec.
+        CHANGE_DEFINITION,
+    };
+
+    // Whether a task can run and whether it is running.
+    enum RunState {
+        RUN_STATE_UNKNOWN = 0,
+        RUN_STATE_DISABLED,
+        // Instances of the task are waiting to run.
+        RUN_STATE_QUEUED,
+        RUN_STATE_READY,
+        RUN_STATE_RUNNING,
+    };
+
+    // What GetTaskRunStates() reads, one column per field and a row per task,
+    // so that a view of many tasks such as "failed in the last hour" scans
+    // only the columns it needs.
+    struct TaskRunStates {
+        std::vector<CStringW> names;
+        // Unix times in seconds, 0 if the task never ran.
+        std::vector<int64_t> last_run_times;
+        // What the last run returned, as the backend reports it:
+        // SCHED_S_TASK_HAS_NOT_RUN if the task never ran, S_OK on success,
+        // an exit code or an HRESULT otherwise.
+        std::vector<int32_t> last_results;
+        // Unix times in seconds, 0 if the task isn't scheduled to run.
+        std::vector<int64_t> next_run_times;
+        // Runs missed, for example while the machine was off.
+        std::vector<uint32_t> missed_runs;
+        std::vector<RunState> states;
+
+        size_t size() const { return names.size(); }
+    };
+
+    // Called with each change and the task's state after it. For
+    // CHANGE_REMOVED, only |task.name| is set.
+    typedef std::function<void(ChangeType type, const TaskSummary& task)>
+        ChangeObserver;
+
+
+    virtual ~TaskScheduler();
 
     virtual bool Initilize() = 0;
     virtual bool UnInitilize() = 0;
 
     // Delete the task if it exists. No-op if the task doesn't exist. Return false
-    // on failure to delete an existing task.
+    // on failure to delete an existing task. Transaction errors are retried
+    // with backoff as BeginDeleteTask() does, and waited out.
     virtual bool DeleteTask(const wchar_t* task_name) = 0;
 
+    // The outcome of BeginDeleteTask().
+    enum DeleteStatus {
+        DELETE_FAILED = 0,
+        // The task was deleted or didn't exist.
+        DELETE_DONE,
+        // The deletion hit a transient transaction error and is being retried
+        // in the background.
+        DELETE_PENDING,
+    };
+
+    // Called once with the final outcome of a deletion that BeginDeleteTask()
+    // left pending, from a thread of the scheduler or from UnInitilize().
+    typedef std::function<void(bool deleted)> DeleteCallback;
+
+    // Delete the task as DeleteTask() does, but without waiting out transaction
+    // errors. If the deletion can't be completed right away it is retried with
+    // exponential backoff in the background, DELETE_PENDING is returned and
+    // |callback| is called once the retries are over. |callback| is not called
+    // otherwise. Pending deletions are abandoned with |deleted| false when the
+    // scheduler is uninitialized. The default implementation calls
+    // DeleteTask().
+    virtual DeleteStatus BeginDeleteTask(const wchar_t* task_name,
+        const DeleteCallback& callback);
+
     virtual bool IsTaskRegistered(const wchar_t* task_name) = 0;
 
     // Enable or disable task based on the value of |enabled|. Return true if the
@@ -72,8 +186,69 @@ public:
     // encountered. On error, the struct is left unmodified.
     virtual bool GetTaskInfo(const wchar_t* task_name, TaskInfo* info) = 0;
 
+    // A task opened with OpenTask(). Each field is read the first time it is
+    // asked for and remembered, so that callers only pay for the fields they
+    // use. A handle sees the task as it was when first read, must not
+    // outlive its scheduler and must not be used from several threads at
+    // once.
+    class TaskHandle
+    {
+    public:
+        virtual ~TaskHandle();
+
+        // The name the task was opened with.
+        const CStringW& name() const { return name_; }
+
+        // The getters return false if the field can't be read, in which case
+        // their output is left unmodified.
+        virtual bool GetDescription(CStringW* description) = 0;
+        // The application of the first exec action, the only one
+        // RegisterTask() creates. Cheaper than GetExecActions() when that is
+        // all that is needed. Return false if the task has no exec action.
+        virtual bool GetApplicationPath(CStringW* application_path) = 0;
+        virtual bool GetExecActions(std::vector<TaskExecAction>* actions) = 0;
+        virtual bool GetLogonType(uint32_t* logon_type) = 0;
+
+    protected:
+        explicit TaskHandle(const wchar_t* name);
+
+    private:
+        TaskHandle(const TaskHandle&) = delete;
+        TaskHandle& operator=(const TaskHandle&) = delete;
+
+        CStringW name_;
+    };
+
+    // Return a handle on the task named |task_name|, to be deleted by the
+    // caller, or null if the task doesn't exist or can't be opened. The
+    // default implementation reads the whole task with GetTaskInfo() up
+    // front.
+    virtual TaskHandle* OpenTask(const wchar_t* task_name);
+
+    // Called with each task read by EnumerateTaskInfo(). Return false to stop
+    // the enumeration.
+    typedef std::function<bool(const TaskInfo& info)> TaskInfoCallback;
+
+    // Read every task of the folder in a single enumeration and hand each one
+    // to |callback| as soon as it is read, so memory use doesn't grow with the
+    // number of tasks. Tasks whose information can't be read are skipped.
+    // Return false if the folder couldn't be enumerated.
+    virtual bool EnumerateTaskInfo(const TaskInfoCallback& callback) = 0;
+
+    // Same as EnumerateTaskInfo() but collect all tasks into |infos|. On error,
+    // |infos| is left unmodified.
+    bool GetAllTaskInfo(std::vector<TaskInfo>* infos);
+
+    // Same as GetAllTaskInfo() but collect the tasks into |table|, which
+    // takes a few allocations for the whole catalog rather than several per
+    // task. On error, |table| is left unmodified. The default implementation
+    // adds what EnumerateTaskInfo() reads.
+    virtual bool GetTaskInfoTable(TaskInfoTable* table);
+
     // Register the task to run the specified application and using the given
-    // |trigger_type|.
+    // |trigger_type|. An existing task with the same name is updated in place,
+    // or left alone if it was registered with the same arguments and is
+    // enabled.
     virtual bool RegisterTask(const wchar_t* task_name,
         const wchar_t* task_description,
         const wchar_t* application_path,
@@ -81,10 +256,110 @@ public:
         TriggerType trigger_type,
         bool hidden) = 0;
 
+    // Register every task of |specs| as RegisterTask() would, but look up the
+    // current user, build the task definition and enumerate the folder once
+    // for the whole batch. |results| receives one entry per spec, in order.
+    // Return true if all tasks were registered.
+    virtual bool RegisterTasks(const std::vector<TaskSpec>& specs,
+        std::vector<RegisterResult>* results) = 0;
+
+    // Read the summary of every task of the folder in a single enumeration.
+    // Tasks whose summary can't be read are skipped. On error, |summaries| is
+    // left unmodified.
+    virtual bool GetTaskSummaries(std::vector<TaskSummary>* summaries) = 0;
+
+    // Same as GetTaskInfoTable() and GetTaskSummaries() together, but read
+    // in a single enumeration where the backend can. On error, neither
+    // |table| nor |summaries| is modified. The default implementation calls
+    // both.
+    virtual bool GetTaskCatalog(TaskInfoTable* table,
+        std::vector<TaskSummary>* summaries);
+
+    // Return in |names| the names of the tasks of the folder that start with
+    // |prefix|, compared case insensitively, sorted as their lower case forms
+    // are. If |enabled| isn't null, it receives whether each of them is
+    // enabled. Tasks whose state can't be read are skipped. On error, neither
+    // is modified. The default implementation filters GetTaskSummaries().
+    virtual bool ListTasks(const wchar_t* prefix, std::vector<CStringW>* names,
+        std::vector<bool>* enabled);
+
+    // Same as ListTasks() but for the tasks whose name matches |pattern|, in
+    // which '*' stands for any run of characters and '?' for any single one,
+    // such as L"Vendor*Updater?".
+    virtual bool FindTasks(const wchar_t* pattern,
+        std::vector<CStringW>* names, std::vector<bool>* enabled);
+
+    // Called with each task read by EnumerateTaskSpecs() and whether it is
+    // enabled. Return false to stop the enumeration.
+    typedef std::function<bool(const TaskSpec& spec, bool enabled)>
+        TaskSpecCallback;
+
+    // Read every task of the folder back as the spec it would be registered
+    // from, in a single enumeration, and hand each one to |callback| as soon
+    // as it is read. Tasks that a TaskSpec can't describe, such as ones with
+    // several actions or a trigger TriggerType has no value for, are
+    // skipped. Return false, as the default implementation does, if the
+    // backend can't read specs back or the folder couldn't be enumerated.
+    virtual bool EnumerateTaskSpecs(const TaskSpecCallback& callback);
+
+    // Read the run state of every task of the folder in a single
+    // enumeration. Tasks whose state can't be read are skipped. On error,
+    // |states| is left unmodified. Return false, as the default
+    // implementation does, if the backend doesn't track runs.
+    virtual bool GetTaskRunStates(TaskRunStates* states);
+
+    // Compute the fingerprint RegisterTask() stores for each of |specs|, to be
+    // compared with TaskSummary::fingerprint. On error, |fingerprints| is left
+    // unmodified.
+    virtual bool ComputeFingerprints(const std::vector<TaskSpec>& specs,
+        std::vector<CStringW>* fingerprints) = 0;
+
+    // Have |observer| called with every change to the tasks of the folder, or
+    // stop calling the current observer if |observer| is empty. To start
+    // from a consistent state, |observer| is first called with CHANGE_ADDED
+    // for every existing task. It is called with the scheduler's lock held and
+    // must not call back into the scheduler. Return false, as the default
+    // implementation does, if the backend can't report changes. They then
+    // have to be found by comparing successive GetTaskSummaries().
+    virtual bool SetChangeObserver(const ChangeObserver& observer);
+
 protected:
     TaskScheduler();
 };
 
+// Create a scheduler for the Task Scheduler service on Windows, and for the
+// in-process engine elsewhere.
 TaskScheduler* CraateTaskScheduler();
 
+// The implementations behind the TaskScheduler interface.
+enum TaskSchedulerBackend {
+    // The Task Scheduler service, through its 2.0 API. This is what
+    // CraateTaskScheduler() uses on Windows. Not available elsewhere.
+    BACKEND_TASK_SERVICE = 0,
+    // An engine in the calling process, see CreateInProcessTaskScheduler().
+    BACKEND_IN_PROCESS,
+    // The task service if it can be reached, the in-process engine otherwise.
+    BACKEND_AUTO,
+};
+
+// Create a scheduler using |backend|, or return null if it isn't available
+// on this platform. COM must be initialized on the calling thread for the
+// task service to be used.
+TaskScheduler* CreateTaskScheduler(TaskSchedulerBackend backend);
+
+#if defined(_WIN32)
+
+// Create a scheduler for the task service that keeps its tasks in
+// |folder_path|, such as L"\\Vendor\\Product", instead of the root folder.
+// Initilize() creates the folder and its parents if they are missing. Lookups,
+// enumerations and bulk operations then only see the tasks of that folder, so
+// their cost doesn't grow with the tasks other software registers.
+TaskScheduler* CreateTaskSchedulerForFolder(const wchar_t* folder_path);
+
+// Create a scheduler for |folder_path| on top of an already created
+// |task_service| instead of CoCreating CLSID_TaskScheduler in Initilize().
+// Used to run against an in-memory task service.
+TaskScheduler* CreateTaskSchedulerForService(ITaskService* task_service,
+    const wchar_t* folder_path);
 
+#endif  // defined(_WIN32)
@@ -0,0 +1,304 @@
+#include "task_scheduler_metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+const char* const kOperationNames[TaskSchedulerMetrics::OPERATION_MAX] = {
+    "DeleteTask",
+    "BeginDeleteTask",
+    "IsTaskRegistered",
+    "SetTaskEnabled",
+    "IsTaskEnabled",
+    "GetTaskInfo",
+    "EnumerateTaskInfo",
+    "RegisterTask",
+    "RegisterTasks",
+    "GetTaskSummaries",
+    "EnumerateTaskSpecs",
+    "ListTasks",
+    "FindTasks",
+    "OpenTask",
+    "GetTaskRunStates",
+};
+
+struct OperationCounters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> backend_calls;
+    std::atomic<uint64_t>
+        latency_buckets[TaskSchedulerMetrics::kNumLatencyBuckets];
+};
+
+// Zero initialized, being static.
+OperationCounters operation_counters[TaskSchedulerMetrics::OPERATION_MAX];
+std::atomic<uint64_t> delete_retries;
+
+// (call site, HRESULT) -> number of failures. Failures are rare, so a lock
+// is fine.
+typedef std::map<std::pair<std::string, HRESULT>, uint64_t> FailureMap;
+std::mutex failures_mutex;
+FailureMap failures;
+
+// The innermost operation running on the current thread.
+thread_local ScopedOperationMetrics* current_operation = nullptr;
+
+size_t LatencyBucket(uint64_t elapsed_ns) {
+    size_t bucket = 0;
+    while (elapsed_ns && bucket < TaskSchedulerMetrics::kNumLatencyBuckets - 1) {
+        elapsed_ns >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void AppendFormat(std::string* output, const char* format, ...) {
+    char buffer[512];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    if (length > 0)
+        output->append(buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+std::string JsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            AppendFormat(&escaped, "\\u%04x", c);
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+double Mean(const TaskSchedulerMetrics::OperationStats& stats) {
+    return stats.count ?
+        static_cast<double>(stats.total_ns) / stats.count : 0;
+}
+
+}  // namespace
+
+std::atomic<bool> TaskSchedulerMetrics::enabled_(false);
+
+uint64_t TaskSchedulerMetrics::OperationStats::Percentile(
+    double fraction) const
+{
+    uint64_t rank = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+        seen += latency_buckets[i];
+        if (seen > rank)
+            return i ? 1ull << i : 0;
+    }
+    return max_ns;
+}
+
+// static
+void TaskSchedulerMetrics::SetEnabled(bool enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+// static
+void TaskSchedulerMetrics::Reset()
+{
+    for (OperationCounters& counters : operation_counters) {
+        counters.count = 0;
+        counters.total_ns = 0;
+        counters.max_ns = 0;
+        counters.backend_calls = 0;
+        for (std::atomic<uint64_t>& bucket : counters.latency_buckets)
+            bucket = 0;
+    }
+    delete_retries = 0;
+    std::lock_guard<std::mutex> lock(failures_mutex);
+    failures.clear();
+}
+
+// static
+void TaskSchedulerMetrics::GetSnapshot(Snapshot* snapshot)
+{
+    for (size_t i = 0; i < OPERATION_MAX; ++i) {
+        const OperationCounters& counters = operation_counters[i];
+        OperationStats& stats = snapshot->operations[i];
+        stats.name = kOperationNames[i];
+        stats.count = counters.count;
+        stats.total_ns = counters.total_ns;
+        stats.max_ns = counters.max_ns;
+        stats.backend_calls = counters.backend_calls;
+        for (size_t j = 0; j < kNumLatencyBuckets; ++j)
+            stats.latency_buckets[j] = counters.latency_buckets[j];
+    }
+    snapshot->delete_retries = delete_retries;
+
+    snapshot->failures.clear();
+    std::lock_guard<std::mutex> lock(failures_mutex);
+    for (const auto& entry : failures) {
+        FailureStats failure = { entry.first.first, entry.first.second,
+            entry.second };
+        snapshot->failures.push_back(failure);
+    }
+}
+
+// static
+std::string TaskSchedulerMetrics::DumpText()
+{
+    Snapshot snapshot;
+    GetSnapshot(&snapshot);
+
+    std::string output;
+    AppendFormat(&output, "%-20s %10s %12s %12s %12s %12s %14s\n",
+        "operation", "count", "mean_us", "p50_us", "p99_us", "max_us",
+        "calls_per_op");
+    for (const OperationStats& stats : snapshot.operations) {
+        if (!stats.count)
+            continue;
+        AppendFormat(&output, "%-20s %10llu %12.1f %12.1f %12.1f %12.1f %14.1f\n",
+            stats.name,
+            static_cast<unsigned long long>(stats.count),
+            Mean(stats) / 1000,
+            stats.Percentile(0.50) / 1000.0,
+            stats.Percentile(0.99) / 1000.0,
+            stats.max_ns / 1000.0,
+            static_cast<double>(stats.backend_calls) / stats.count);
+    }
+    AppendFormat(&output, "delete retries: %llu\n",
+        static_cast<unsigned long long>(snapshot.delete_retries));
+    for (const FailureStats& failure : snapshot.failures) {
+        AppendFormat(&output, "failed 0x%08lx x%llu: ",
+            static_cast<unsigned long>(static_cast<uint32_t>(failure.hr)),
+            static_cast<unsigned long long>(failure.count));
+        output += failure.call_site;
+        output += '\n';
+    }
+    return output;
+}
+
+// static
+std::string TaskSchedulerMetrics::DumpJson()
+{
+    Snapshot snapshot;
+    GetSnapshot(&snapshot);
+
+    std::string output = "{\"operations\":{";
+    bool first = true;
+    for (const OperationStats& stats : snapshot.operations) {
+        if (!stats.count)
+            continue;
+        AppendFormat(&output, "%s\"%s\":{\"count\":%llu,\"mean_ns\":%.0f,"
+            "\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+            "\"backend_calls\":%llu,\"latency_buckets\":[",
+            first ? "" : ",",
+            stats.name,
+            static_cast<unsigned long long>(stats.count),
+            Mean(stats),
+            static_cast<unsigned long long>(stats.Percentile(0.50)),
+            static_cast<unsigned long long>(stats.Percentile(0.99)),
+            static_cast<unsigned long long>(stats.max_ns),
+            static_cast<unsigned long long>(stats.backend_calls));
+        for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+            AppendFormat(&output, "%s%llu", i ? "," : "",
+                static_cast<unsigned long long>(stats.latency_buckets[i]));
+        }
+        output += "]}";
+        first = false;
+    }
+    AppendFormat(&output, "},\"delete_retries\":%llu,\"failures\":[",
+        static_cast<unsigned long long>(snapshot.delete_retries));
+    first = true;
+    for (const FailureStats& failure : snapshot.failures) {
+        AppendFormat(&output, "%s{\"hr\":\"0x%08lx\",\"count\":%llu,"
+            "\"call_site\":\"",
+            first ? "" : ",",
+            static_cast<unsigned long>(static_cast<uint32_t>(failure.hr)),
+            static_cast<unsigned long long>(failure.count));
+        output += JsonEscape(failure.call_site);
+        output += "\"}";
+        first = false;
+    }
+    output += "]}";
+    return output;
+}
+
+// static
+void TaskSchedulerMetrics::RecordOperation(Operation operation,
+    uint64_t elapsed_ns, uint64_t backend_calls)
+{
+    OperationCounters& counters = operation_counters[operation];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.total_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    counters.backend_calls.fetch_add(backend_calls, std::memory_order_relaxed);
+    counters.latency_buckets[LatencyBucket(elapsed_ns)].fetch_add(1,
+        std::memory_order_relaxed);
+    uint64_t max_ns = counters.max_ns.load(std::memory_order_relaxed);
+    while (elapsed_ns > max_ns &&
+        !counters.max_ns.compare_exchange_weak(max_ns, elapsed_ns,
+            std::memory_order_relaxed)) {
+    }
+}
+
+// static
+void TaskSchedulerMetrics::RecordBackendCall(HRESULT hr, const char* function,
+    const char* call)
+{
+    ScopedOperationMetrics::CountBackendCall();
+    if (SUCCEEDED(hr))
+        return;
+
+    std::string call_site(function);
+    call_site += ": ";
+    call_site += call;
+    std::lock_guard<std::mutex> lock(failures_mutex);
+    ++failures[std::make_pair(call_site, hr)];
+}
+
+// static
+void TaskSchedulerMetrics::RecordDeleteRetry()
+{
+    if (IsEnabled())
+        delete_retries.fetch_add(1, std::memory_order_relaxed);
+}
+
+ScopedOperationMetrics::ScopedOperationMetrics(
+    TaskSchedulerMetrics::Operation operation)
+    : operation_(operation), enabled_(TaskSchedulerMetrics::IsEnabled())
+{
+    if (!enabled_)
+        return;
+    start_ = std::chrono::steady_clock::now();
+    outer_ = current_operation;
+    current_operation = this;
+}
+
+ScopedOperationMetrics::~ScopedOperationMetrics()
+{
+    if (!enabled_)
+        return;
+    uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    current_operation = outer_;
+    if (outer_)
+        outer_->backend_calls_ += backend_calls_;
+    TaskSchedulerMetrics::RecordOperation(operation_, elapsed_ns,
+        backend_calls_);
+}
+
+// static
+void ScopedOperationMetrics::CountBackendCall()
+{
+    if (current_operation)
+        ++current_operation->backend_calls_;
+}
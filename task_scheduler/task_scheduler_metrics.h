@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "task_scheduler_platform.h"
+
+// Process wide metrics of the schedulers: a latency histogram and the number
+// of backend calls of each TaskScheduler operation, the retries of deletions
+// and the HRESULTs of failed backend calls by call site. Nothing is recorded
+// until SetEnabled(true); until then each instrumented operation and backend
+// call costs a relaxed atomic load.
+class TaskSchedulerMetrics
+{
+public:
+    // The instrumented operations, one per TaskScheduler method.
+    enum Operation {
+        OPERATION_DELETE_TASK = 0,
+        OPERATION_BEGIN_DELETE_TASK,
+        OPERATION_IS_TASK_REGISTERED,
+        OPERATION_SET_TASK_ENABLED,
+        OPERATION_IS_TASK_ENABLED,
+        OPERATION_GET_TASK_INFO,
+        OPERATION_ENUMERATE_TASK_INFO,
+        OPERATION_REGISTER_TASK,
+        OPERATION_REGISTER_TASKS,
+        OPERATION_GET_TASK_SUMMARIES,
+        OPERATION_ENUMERATE_TASK_SPECS,
+        OPERATION_LIST_TASKS,
+        OPERATION_FIND_TASKS,
+        OPERATION_OPEN_TASK,
+        OPERATION_GET_TASK_RUN_STATES,
+        OPERATION_MAX,
+    };
+
+    // Latencies are counted in buckets of powers of two nanoseconds: bucket
+    // |i| holds latencies in [2^(i-1), 2^i).
+    static const size_t kNumLatencyBuckets = 40;
+
+    struct OperationStats {
+        const char* name;
+        uint64_t count;
+        uint64_t total_ns;
+        uint64_t max_ns;
+        uint64_t backend_calls;
+        uint64_t latency_buckets[kNumLatencyBuckets];
+
+        // Estimate the latency below which |fraction| of the operations
+        // completed from the histogram, as the upper bound of its bucket.
+        uint64_t Percentile(double fraction) const;
+    };
+
+    struct FailureStats {
+        // The function and the backend call that failed.
+        std::string call_site;
+        HRESULT hr;
+        uint64_t count;
+    };
+
+    struct Snapshot {
+        OperationStats operations[OPERATION_MAX];
+        uint64_t delete_retries;
+        std::vector<FailureStats> failures;
+    };
+
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    // Clear everything recorded so far.
+    static void Reset();
+
+    static void GetSnapshot(Snapshot* snapshot);
+
+    // Format the snapshot as one line per operation and failure, or as a JSON
+    // object.
+    static std::string DumpText();
+    static std::string DumpJson();
+
+    // Called by the instrumentation. The first two only while enabled.
+    static void RecordOperation(Operation operation, uint64_t elapsed_ns,
+        uint64_t backend_calls);
+    static void RecordBackendCall(HRESULT hr, const char* function,
+        const char* call);
+    static void RecordDeleteRetry();
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Times a TaskScheduler operation from construction to destruction and
+// attributes the backend calls made on the thread in between to it. Nested
+// operations also count towards the enclosing one.
+class ScopedOperationMetrics
+{
+public:
+    explicit ScopedOperationMetrics(TaskSchedulerMetrics::Operation operation);
+    ~ScopedOperationMetrics();
+
+    // Count a backend call towards the operation running on this thread, if
+    // any.
+    static void CountBackendCall();
+
+private:
+    ScopedOperationMetrics(const ScopedOperationMetrics&) = delete;
+    ScopedOperationMetrics& operator=(const ScopedOperationMetrics&) = delete;
+
+    TaskSchedulerMetrics::Operation operation_;
+    bool enabled_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t backend_calls_ = 0;
+    ScopedOperationMetrics* outer_ = nullptr;
+};
+
+inline HRESULT TrackBackendCall(HRESULT hr, const char* function,
+    const char* call) {
+    if (TaskSchedulerMetrics::IsEnabled())
+        TaskSchedulerMetrics::RecordBackendCall(hr, function, call);
+    return hr;
+}
+
+// Evaluate the COM call |call| and, while metrics are enabled, count it and
+// record its HRESULT under its text and the calling function if it failed.
+#define BACKEND_CALL(call) TrackBackendCall((call), __FUNCTION__, #call)
@@ -0,0 +1,615 @@
+#include "task_scheduler_platform.h"
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wctype.h>
+#endif
+
+#include <algorithm>
+#include <string>
+
+#if defined(_WIN32)
+
+namespace {
+
+// ReadFile() and WriteFile() take a DWORD: larger buffers are read and
+// written in chunks of this size.
+const size_t kMaxChunkSize = 1024 * 1024 * 1024;
+
+}  // namespace
+
+PlatformFile::PlatformFile()
+    : handle_(INVALID_HANDLE_VALUE)
+{
+
+}
+
+PlatformFile::~PlatformFile()
+{
+    Close();
+}
+
+bool PlatformFile::Open(const wchar_t* path, OpenMode mode, bool* not_found)
+{
+    Close();
+    handle_ = ::CreateFileW(path,
+        mode == OPEN_READ ? GENERIC_READ : GENERIC_WRITE,
+        FILE_SHARE_READ,
+        nullptr,
+        mode == OPEN_CREATE ? CREATE_ALWAYS : OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (not_found) {
+        *not_found = handle_ == INVALID_HANDLE_VALUE &&
+            ::GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+    return handle_ != INVALID_HANDLE_VALUE;
+}
+
+void PlatformFile::Close()
+{
+    if (handle_ == INVALID_HANDLE_VALUE)
+        return;
+    ::CloseHandle(handle_);
+    handle_ = INVALID_HANDLE_VALUE;
+}
+
+bool PlatformFile::is_open() const
+{
+    return handle_ != INVALID_HANDLE_VALUE;
+}
+
+bool PlatformFile::Read(void* buffer, size_t size, size_t* bytes_read)
+{
+    DWORD chunk_read = 0;
+    if (!::ReadFile(handle_, buffer,
+            static_cast<DWORD>(std::min(size, kMaxChunkSize)), &chunk_read,
+            nullptr)) {
+        return false;
+    }
+    *bytes_read = chunk_read;
+    return true;
+}
+
+bool PlatformFile::Write(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t offset = 0; offset < size;) {
+        DWORD chunk = static_cast<DWORD>(std::min(size - offset,
+            kMaxChunkSize));
+        DWORD bytes_written = 0;
+        if (!::WriteFile(handle_, bytes + offset, chunk, &bytes_written,
+                nullptr) || bytes_written != chunk) {
+            return false;
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+bool PlatformFile::Flush()
+{
+    return ::FlushFileBuffers(handle_) != FALSE;
+}
+
+bool PlatformFile::Truncate(uint64_t size)
+{
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    return ::SetFilePointerEx(handle_, end, nullptr, FILE_BEGIN) &&
+        ::SetEndOfFile(handle_);
+}
+
+bool DeletePlatformFile(const wchar_t* path)
+{
+    return ::DeleteFileW(path) || ::GetLastError() == ERROR_FILE_NOT_FOUND;
+}
+
+bool ReplacePlatformFile(const wchar_t* from, const wchar_t* to)
+{
+    return ::MoveFileExW(from, to,
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+}
+
+void ListPlatformFiles(const wchar_t* path_prefix,
+    std::vector<CStringW>* names)
+{
+    CStringW pattern;
+    pattern.Format(L"%s*", path_prefix);
+    WIN32_FIND_DATAW data;
+    HANDLE find = ::FindFirstFileW(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+    do {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            names->push_back(CStringW(data.cFileName));
+    } while (::FindNextFileW(find, &data));
+    ::FindClose(find);
+}
+
+uint32_t GetPlatformProcessId()
+{
+    return ::GetCurrentProcessId();
+}
+
+HRESULT LaunchPlatformProcess(const wchar_t* application_path,
+    const wchar_t* arguments, const wchar_t* working_dir)
+{
+    CStringW command_line;
+    command_line.Format(L"\"%s\" %s", application_path, arguments);
+
+    STARTUPINFOW startup_info = { sizeof(startup_info) };
+    PROCESS_INFORMATION process_info = {};
+    BOOL created = ::CreateProcessW(application_path,
+        command_line.GetBuffer(),  // CreateProcessW may modify it.
+        nullptr,
+        nullptr,
+        FALSE,
+        0,
+        nullptr,
+        working_dir && *working_dir ? working_dir : nullptr,
+        &startup_info,
+        &process_info);
+    HRESULT hr = created ? S_OK : HRESULT_FROM_WIN32(::GetLastError());
+    command_line.ReleaseBuffer();
+    if (!created)
+        return hr;
+    ::CloseHandle(process_info.hThread);
+    ::CloseHandle(process_info.hProcess);
+    return S_OK;
+}
+
+#else  // defined(_WIN32)
+
+namespace {
+
+// The facility of the HRESULTs made from Win32 errors, which errno values
+// stand in for.
+const HRESULT kFacilityWin32 = 7;
+
+HRESULT HResultFromErrno(int error) {
+    if (error <= 0)
+        return E_FAIL;
+    return static_cast<HRESULT>((static_cast<uint32_t>(error) & 0xffff) |
+        (kFacilityWin32 << 16) | 0x80000000);
+}
+
+// Paths and arguments are passed to the system as UTF-8, from the UTF-32 of
+// wchar_t.
+std::string ToUtf8(const wchar_t* text) {
+    std::string utf8;
+    for (; text && *text; ++text) {
+        uint32_t c = static_cast<uint32_t>(*text);
+        if (c < 0x80) {
+            utf8.push_back(static_cast<char>(c));
+        } else if (c < 0x800) {
+            utf8.push_back(static_cast<char>(0xc0 | (c >> 6)));
+            utf8.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else if (c < 0x10000) {
+            utf8.push_back(static_cast<char>(0xe0 | (c >> 12)));
+            utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            utf8.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        } else {
+            utf8.push_back(static_cast<char>(0xf0 | (c >> 18)));
+            utf8.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+            utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            utf8.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        }
+    }
+    return utf8;
+}
+
+// Bytes that aren't valid UTF-8 are taken for Latin-1 characters.
+CStringW FromUtf8(const char* text) {
+    CStringW wide;
+    const uint8_t* c = reinterpret_cast<const uint8_t*>(text);
+    while (*c) {
+        int length = *c < 0x80 ? 1 : (*c >> 5) == 0x6 ? 2 :
+            (*c >> 4) == 0xe ? 3 : (*c >> 3) == 0x1e ? 4 : 0;
+        uint32_t code_point = length == 1 ? *c :
+            *c & (0x7f >> length);
+        for (int i = 1; i < length; ++i) {
+            if ((c[i] >> 6) != 0x2) {
+                length = 0;
+                break;
+            }
+            code_point = code_point << 6 | (c[i] & 0x3f);
+        }
+        if (!length) {
+            code_point = *c;
+            length = 1;
+        }
+        wide += static_cast<wchar_t>(code_point);
+        c += length;
+    }
+    return wide;
+}
+
+// Rewrite the parts of |format| that differ between Microsoft's printf and
+// the standard one: %s and %c take wide arguments by default, %S and %C
+// narrow ones, and the I64 and I sizes are the standard ll and z.
+std::wstring TranslateFormat(const wchar_t* format) {
+    std::wstring translated;
+    while (*format) {
+        if (*format != L'%') {
+            translated.push_back(*format++);
+            continue;
+        }
+        translated.push_back(*format++);
+        while (*format && wcschr(L"-+ #0123456789.*", *format))
+            translated.push_back(*format++);
+        bool has_size = false;
+        if (wcsncmp(format, L"I64", 3) == 0) {
+            translated.append(L"ll");
+            format += 3;
+            has_size = true;
+        } else if (wcsncmp(format, L"I32", 3) == 0) {
+            format += 3;
+        } else if (*format == L'I') {
+            translated.push_back(L'z');
+            ++format;
+            has_size = true;
+        } else {
+            while (*format && wcschr(L"hlLjzt", *format)) {
+                translated.push_back(*format++);
+                has_size = true;
+            }
+        }
+        if (!*format)
+            break;
+        wchar_t conversion = *format++;
+        if (!has_size && (conversion == L's' || conversion == L'c')) {
+            translated.push_back(L'l');
+        } else if (!has_size && (conversion == L'S' || conversion == L'C')) {
+            conversion = static_cast<wchar_t>(::towlower(conversion));
+        }
+        translated.push_back(conversion);
+    }
+    return translated;
+}
+
+void AppendFormatArguments(std::wstring* text, const wchar_t* format,
+    va_list arguments) {
+    std::wstring translated = TranslateFormat(format);
+    std::vector<wchar_t> buffer(256);
+    for (;;) {
+        va_list copy;
+        va_copy(copy, arguments);
+        int length = vswprintf(&buffer[0], buffer.size(), translated.c_str(),
+            copy);
+        va_end(copy);
+        if (length >= 0) {
+            text->append(&buffer[0], static_cast<size_t>(length));
+            return;
+        }
+        // vswprintf() doesn't tell how much room it needs, and fails for
+        // characters the locale can't encode too.
+        if (buffer.size() >= 64 * 1024 * 1024)
+            return;
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+// Split |arguments| as LaunchPlatformProcess() documents.
+std::vector<std::string> SplitArguments(const wchar_t* arguments) {
+    std::vector<std::string> split;
+    std::wstring argument;
+    bool in_argument = false;
+    bool quoted = false;
+    for (const wchar_t* c = arguments; c && *c; ++c) {
+        if (*c == L'\\' && c[1] == L'"') {
+            argument.push_back(L'"');
+            in_argument = true;
+            ++c;
+        } else if (*c == L'"') {
+            quoted = !quoted;
+            in_argument = true;
+        } else if (!quoted && (*c == L' ' || *c == L'\t')) {
+            if (in_argument)
+                split.push_back(ToUtf8(argument.c_str()));
+            argument.clear();
+            in_argument = false;
+        } else {
+            argument.push_back(*c);
+            in_argument = true;
+        }
+    }
+    if (in_argument)
+        split.push_back(ToUtf8(argument.c_str()));
+    return split;
+}
+
+// Write all of |size| bytes of |data| to |descriptor|.
+bool WriteDescriptor(int descriptor, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size) {
+        ssize_t written = ::write(descriptor, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+}  // namespace
+
+wchar_t* CStringW::GetBuffer()
+{
+    return &text_[0];
+}
+
+wchar_t* CStringW::GetBuffer(int min_length)
+{
+    if (text_.size() < static_cast<size_t>(min_length))
+        text_.resize(static_cast<size_t>(min_length));
+    return &text_[0];
+}
+
+void CStringW::ReleaseBuffer(int new_length)
+{
+    if (new_length < 0)
+        new_length = static_cast<int>(wcslen(text_.c_str()));
+    text_.resize(static_cast<size_t>(new_length));
+}
+
+void CStringW::Format(const wchar_t* format, ...)
+{
+    text_.clear();
+    va_list arguments;
+    va_start(arguments, format);
+    AppendFormatArguments(&text_, format, arguments);
+    va_end(arguments);
+}
+
+void CStringW::AppendFormat(const wchar_t* format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    AppendFormatArguments(&text_, format, arguments);
+    va_end(arguments);
+}
+
+int CStringW::CompareNoCase(const wchar_t* text) const
+{
+    return wcscasecmp(text_.c_str(), text);
+}
+
+CStringW& CStringW::MakeLower()
+{
+    for (wchar_t& c : text_)
+        c = static_cast<wchar_t>(::towlower(c));
+    return *this;
+}
+
+CStringW& CStringW::MakeUpper()
+{
+    for (wchar_t& c : text_)
+        c = static_cast<wchar_t>(::towupper(c));
+    return *this;
+}
+
+int CStringW::Find(wchar_t c, int start) const
+{
+    size_t found = text_.find(c, static_cast<size_t>(start));
+    return found == std::wstring::npos ? -1 : static_cast<int>(found);
+}
+
+int CStringW::Find(const wchar_t* text, int start) const
+{
+    size_t found = text_.find(text, static_cast<size_t>(start));
+    return found == std::wstring::npos ? -1 : static_cast<int>(found);
+}
+
+CStringW CStringW::Left(int count) const
+{
+    CStringW left;
+    left.text_ = text_.substr(0, static_cast<size_t>(std::max(count, 0)));
+    return left;
+}
+
+CStringW CStringW::Mid(int first) const
+{
+    return Mid(first, GetLength());
+}
+
+CStringW CStringW::Mid(int first, int count) const
+{
+    CStringW mid;
+    first = std::max(first, 0);
+    if (first < GetLength()) {
+        mid.text_ = text_.substr(static_cast<size_t>(first),
+            static_cast<size_t>(std::max(count, 0)));
+    }
+    return mid;
+}
+
+PlatformFile::PlatformFile()
+    : descriptor_(-1)
+{
+
+}
+
+PlatformFile::~PlatformFile()
+{
+    Close();
+}
+
+bool PlatformFile::Open(const wchar_t* path, OpenMode mode, bool* not_found)
+{
+    Close();
+    int flags = O_CLOEXEC;
+    if (mode == OPEN_READ)
+        flags |= O_RDONLY;
+    else if (mode == OPEN_WRITE)
+        flags |= O_WRONLY;
+    else
+        flags |= O_WRONLY | O_CREAT | O_TRUNC;
+    do {
+        descriptor_ = ::open(ToUtf8(path).c_str(), flags, 0666);
+    } while (descriptor_ < 0 && errno == EINTR);
+    if (not_found)
+        *not_found = descriptor_ < 0 && errno == ENOENT;
+    return descriptor_ >= 0;
+}
+
+void PlatformFile::Close()
+{
+    if (descriptor_ < 0)
+        return;
+    ::close(descriptor_);
+    descriptor_ = -1;
+}
+
+bool PlatformFile::is_open() const
+{
+    return descriptor_ >= 0;
+}
+
+bool PlatformFile::Read(void* buffer, size_t size, size_t* bytes_read)
+{
+    ssize_t chunk_read;
+    do {
+        chunk_read = ::read(descriptor_, buffer, size);
+    } while (chunk_read < 0 && errno == EINTR);
+    if (chunk_read < 0)
+        return false;
+    *bytes_read = static_cast<size_t>(chunk_read);
+    return true;
+}
+
+bool PlatformFile::Write(const void* data, size_t size)
+{
+    return WriteDescriptor(descriptor_, data, size);
+}
+
+bool PlatformFile::Flush()
+{
+    return ::fsync(descriptor_) == 0;
+}
+
+bool PlatformFile::Truncate(uint64_t size)
+{
+    off_t end = static_cast<off_t>(size);
+    return ::ftruncate(descriptor_, end) == 0 &&
+        ::lseek(descriptor_, end, SEEK_SET) == end;
+}
+
+bool DeletePlatformFile(const wchar_t* path)
+{
+    return ::unlink(ToUtf8(path).c_str()) == 0 || errno == ENOENT;
+}
+
+// A rename is only on disk once the directory holding it is.
+bool ReplacePlatformFile(const wchar_t* from, const wchar_t* to)
+{
+    std::string target = ToUtf8(to);
+    if (::rename(ToUtf8(from).c_str(), target.c_str()) != 0)
+        return false;
+    size_t separator = target.rfind('/');
+    std::string directory = separator == std::string::npos ? "." :
+        separator == 0 ? "/" : target.substr(0, separator);
+    int descriptor = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0)
+        return false;
+    bool flushed = ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    return flushed;
+}
+
+void ListPlatformFiles(const wchar_t* path_prefix,
+    std::vector<CStringW>* names)
+{
+    std::string prefix = ToUtf8(path_prefix);
+    size_t separator = prefix.rfind('/');
+    std::string directory = separator == std::string::npos ? "." :
+        separator == 0 ? "/" : prefix.substr(0, separator);
+    std::string base = separator == std::string::npos ? prefix :
+        prefix.substr(separator + 1);
+    DIR* listing = ::opendir(directory.c_str());
+    if (!listing)
+        return;
+    while (const dirent* entry = ::readdir(listing)) {
+        if (strncmp(entry->d_name, base.c_str(), base.size()) != 0)
+            continue;
+        struct stat status;
+        std::string path = directory + "/" + entry->d_name;
+        if (::stat(path.c_str(), &status) == 0 && !S_ISDIR(status.st_mode))
+            names->push_back(FromUtf8(entry->d_name));
+    }
+    ::closedir(listing);
+}
+
+uint32_t GetPlatformProcessId()
+{
+    return static_cast<uint32_t>(::getpid());
+}
+
+// The process is started from a child that exits right away, so that it is
+// adopted by init rather than left for this process to reap. It reports
+// whether exec failed through a pipe that a successful exec closes.
+HRESULT LaunchPlatformProcess(const wchar_t* application_path,
+    const wchar_t* arguments, const wchar_t* working_dir)
+{
+    // Everything is prepared before forking: the children may only make
+    // async-signal-safe calls.
+    std::string path = ToUtf8(application_path);
+    std::string directory = ToUtf8(working_dir);
+    std::vector<std::string> split = SplitArguments(arguments);
+    std::vector<char*> argv;
+    argv.push_back(&path[0]);
+    for (std::string& argument : split)
+        argv.push_back(&argument[0]);
+    argv.push_back(nullptr);
+
+    int status_pipe[2];
+    if (::pipe2(status_pipe, O_CLOEXEC) != 0)
+        return HResultFromErrno(errno);
+    pid_t child = ::fork();
+    if (child < 0) {
+        int error = errno;
+        ::close(status_pipe[0]);
+        ::close(status_pipe[1]);
+        return HResultFromErrno(error);
+    }
+    if (child == 0) {
+        ::close(status_pipe[0]);
+        pid_t grandchild = ::fork();
+        if (grandchild == 0) {
+            if (directory.empty() || ::chdir(directory.c_str()) == 0)
+                ::execv(path.c_str(), &argv[0]);
+            int error = errno;
+            WriteDescriptor(status_pipe[1], &error, sizeof(error));
+            ::_exit(127);
+        }
+        if (grandchild < 0) {
+            int error = errno;
+            WriteDescriptor(status_pipe[1], &error, sizeof(error));
+        }
+        ::_exit(0);
+    }
+
+    ::close(status_pipe[1]);
+    while (::waitpid(child, nullptr, 0) < 0 && errno == EINTR) {
+    }
+    int error = 0;
+    ssize_t bytes_read;
+    do {
+        bytes_read = ::read(status_pipe[0], &error, sizeof(error));
+    } while (bytes_read < 0 && errno == EINTR);
+    ::close(status_pipe[0]);
+    return bytes_read == sizeof(error) ? HResultFromErrno(error) : S_OK;
+}
+
+#endif  // defined(_WIN32)
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// What the portable part of the library, the TaskScheduler interface, the
+// in-process engine and its journal, needs from the operating system. On
+// Windows strings are ATL's and HRESULTs are the system's. Elsewhere this
+// provides a CStringW with the part of ATL's interface that code uses, and
+// the HRESULTs it reports.
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <atlbase.h>
+#include <atlstr.h>
+
+#else  // defined(_WIN32)
+
+#include <wchar.h>
+
+#include <string>
+
+typedef int32_t HRESULT;
+typedef uint32_t DWORD;
+typedef unsigned long long ULONGLONG;
+typedef long long LONGLONG;
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define _countof(array) (sizeof(array) / sizeof((array)[0]))
+
+// What the task service reports as the last result of tasks that are
+// running or never ran.
+#define SCHED_S_TASK_RUNNING ((HRESULT)0x00041301)
+#define SCHED_S_TASK_HAS_NOT_RUN ((HRESULT)0x00041303)
+
+// A wide string with the interface of ATL's CStringW, as much of it as the
+// portable code uses. Format() takes Microsoft's format strings: %s is a
+// wide string, and sizes are spelled I64 and I.
+class CStringW
+{
+public:
+    CStringW() {}
+    CStringW(const wchar_t* text) : text_(text ? text : L"") {}
+    CStringW(const wchar_t* text, int length)
+        : text_(text, static_cast<size_t>(length)) {}
+
+    CStringW& operator=(const wchar_t* text) {
+        text_.assign(text ? text : L"");
+        return *this;
+    }
+    CStringW& operator+=(const wchar_t* text) {
+        text_.append(text ? text : L"");
+        return *this;
+    }
+    CStringW& operator+=(wchar_t c) {
+        text_.push_back(c);
+        return *this;
+    }
+
+    int GetLength() const { return static_cast<int>(text_.size()); }
+    bool IsEmpty() const { return text_.empty(); }
+    void Empty() { text_.clear(); }
+    const wchar_t* GetString() const { return text_.c_str(); }
+    operator const wchar_t*() const { return text_.c_str(); }
+    wchar_t GetAt(int index) const { return text_[index]; }
+    wchar_t operator[](int index) const { return text_[index]; }
+
+    // Return a buffer of at least |min_length| characters, to be written
+    // and then ended with ReleaseBuffer().
+    wchar_t* GetBuffer();
+    wchar_t* GetBuffer(int min_length);
+    // End the string at |new_length|, or at its first null if -1.
+    void ReleaseBuffer(int new_length = -1);
+
+    void Append(const wchar_t* text) { *this += text; }
+    void Append(const wchar_t* text, int length) {
+        text_.append(text, static_cast<size_t>(length));
+    }
+    void Format(const wchar_t* format, ...);
+    void AppendFormat(const wchar_t* format, ...);
+
+    int Compare(const wchar_t* text) const { return wcscmp(*this, text); }
+    int CompareNoCase(const wchar_t* text) const;
+    CStringW& MakeLower();
+    CStringW& MakeUpper();
+    int Find(wchar_t c, int start = 0) const;
+    int Find(const wchar_t* text, int start = 0) const;
+    CStringW Left(int count) const;
+    CStringW Mid(int first) const;
+    CStringW Mid(int first, int count) const;
+
+    friend bool operator==(const CStringW& a, const CStringW& b) {
+        return a.text_ == b.text_;
+    }
+    friend bool operator==(const CStringW& a, const wchar_t* b) {
+        return a.Compare(b) == 0;
+    }
+    friend bool operator==(const wchar_t* a, const CStringW& b) {
+        return b.Compare(a) == 0;
+    }
+    friend bool operator!=(const CStringW& a, const CStringW& b) {
+        return !(a == b);
+    }
+    friend bool operator!=(const CStringW& a, const wchar_t* b) {
+        return !(a == b);
+    }
+    friend bool operator!=(const wchar_t* a, const CStringW& b) {
+        return !(a == b);
+    }
+    friend bool operator<(const CStringW& a, const CStringW& b) {
+        return a.text_ < b.text_;
+    }
+    friend CStringW operator+(const CStringW& a, const wchar_t* b) {
+        CStringW sum(a);
+        sum += b;
+        return sum;
+    }
+
+private:
+    std::wstring text_;
+};
+
+#endif  // defined(_WIN32)
+
+// A file of the file system, closed when destroyed.
+class PlatformFile
+{
+public:
+    enum OpenMode {
+        // Read an existing file.
+        OPEN_READ = 0,
+        // Write an existing file, from its start.
+        OPEN_WRITE,
+        // Create the file, or empty it if it exists, and write it.
+        OPEN_CREATE,
+    };
+
+    PlatformFile();
+    ~PlatformFile();
+
+    // Return false if the file can't be opened. |not_found|, if not null,
+    // tells whether that is because it doesn't exist.
+    bool Open(const wchar_t* path, OpenMode mode, bool* not_found);
+    void Close();
+    bool is_open() const;
+
+    // Read up to |size| bytes into |buffer|. |bytes_read| is 0 at the end of
+    // the file.
+    bool Read(void* buffer, size_t size, size_t* bytes_read);
+    // Write all of |data|, however large.
+    bool Write(const void* data, size_t size);
+    // Wait for what was written to be on disk.
+    bool Flush();
+    // Cut the file at |size| and carry on writing from there.
+    bool Truncate(uint64_t size);
+
+private:
+    PlatformFile(const PlatformFile&) = delete;
+    PlatformFile& operator=(const PlatformFile&) = delete;
+
+#if defined(_WIN32)
+    HANDLE handle_;
+#else
+    int descriptor_;
+#endif
+};
+
+// Return false if the file at |path| exists and can't be deleted.
+bool DeletePlatformFile(const wchar_t* path);
+
+// Move the file at |from| over the one at |to|, if any, and wait for the
+// move to be on disk, so that a crash leaves either of them whole.
+bool ReplacePlatformFile(const wchar_t* from, const wchar_t* to);
+
+// Add to |names| the names, without their directory, of the files of the
+// directory of |path_prefix| whose name starts with its last component, as
+// the file system compares names.
+void ListPlatformFiles(const wchar_t* path_prefix,
+    std::vector<CStringW>* names);
+
+uint32_t GetPlatformProcessId();
+
+// Start |application_path| in a new process, in |working_dir| unless it is
+// null or empty, and don't wait for it. |arguments| is a command line as
+// Windows passes it: on POSIX it is split at blanks outside double quotes,
+// in which \" stands for a quote. Return S_OK if the process could be
+// started, why not otherwise.
+HRESULT LaunchPlatformProcess(const wchar_t* application_path,
+    const wchar_t* arguments, const wchar_t* working_dir);
@@ -0,0 +1,131 @@
+#include "task_scheduler_util.h"
+
+#include <cwctype>
+
+// Bump whenever the definition a backend registers for a spec changes, so
+// that tasks registered by an older version don't look up to date.
+const uint32_t kTaskDefinitionVersion = 2;
+
+const wchar_t kTaskFingerprintPrefix[] = L"task_scheduler fingerprint ";
+
+// 64-bit FNV-1a.
+static void HashBytes(const void* data, size_t size, uint64_t* hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        *hash ^= bytes[i];
+        *hash *= 1099511628211ULL;
+    }
+}
+
+// Hash the length first so that adjacent fields can't run into each other.
+static void HashString(const CStringW& value, uint64_t* hash) {
+    uint32_t length = static_cast<uint32_t>(value.GetLength());
+    HashBytes(&length, sizeof(length), hash);
+    HashBytes(value.GetString(), length * sizeof(wchar_t), hash);
+}
+
+CStringW ComputeTaskFingerprint(const TaskScheduler::TaskSpec& spec,
+    const wchar_t* user_name) {
+    // Task names and users are compared case insensitively by the service
+    // itself. Everything else is hashed as it is written.
+    CStringW name(spec.name);
+    name.MakeLower();
+
+    CStringW user(user_name ? user_name : L"");
+    user.MakeLower();
+
+    uint64_t hash = 14695981039346656037ULL;
+    HashBytes(&kTaskDefinitionVersion, sizeof(kTaskDefinitionVersion), &hash);
+    HashString(name, &hash);
+    HashString(spec.description, &hash);
+    HashString(spec.application_path, &hash);
+    HashString(spec.application_arguments, &hash);
+    int32_t trigger_type = spec.trigger_type;
+    HashBytes(&trigger_type, sizeof(trigger_type), &hash);
+    uint8_t hidden = spec.hidden ? 1 : 0;
+    HashBytes(&hidden, sizeof(hidden), &hash);
+    if (spec.trigger_type == TaskScheduler::TRIGGER_TYPE_SCHEDULE)
+        HashString(spec.schedule, &hash);
+    HashString(user, &hash);
+
+    CStringW fingerprint;
+    fingerprint.Format(L"%s%016I64x", kTaskFingerprintPrefix, hash);
+    return fingerprint;
+}
+
+std::wstring FoldTaskName(const wchar_t* task_name) {
+    std::wstring folded;
+    FoldTaskName(task_name, &folded);
+    return folded;
+}
+
+void FoldTaskName(const wchar_t* task_name, std::wstring* folded) {
+    folded->assign(task_name ? task_name : L"");
+    for (wchar_t& c : *folded)
+        c = static_cast<wchar_t>(::towlower(c));
+}
+
+uint64_t HashTaskName(const wchar_t* task_name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *task_name; ++task_name) {
+        hash ^= static_cast<uint64_t>(::towlower(*task_name));
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool TaskNamesEqual(const wchar_t* a, const wchar_t* b) {
+    for (; *a && *b; ++a, ++b) {
+        if (::towlower(*a) != ::towlower(*b))
+            return false;
+    }
+    return *a == *b;
+}
+
+bool MatchTaskNamePattern(const wchar_t* pattern, const wchar_t* task_name) {
+    if (!pattern)
+        pattern = L"";
+    if (!task_name)
+        task_name = L"";
+
+    // On a mismatch, let the last '*' seen swallow one more character and
+    // match again from there. Earlier stars never need to be revisited.
+    const wchar_t* star = nullptr;
+    const wchar_t* star_match = nullptr;
+    while (*task_name) {
+        if (*pattern == L'*') {
+            star = pattern++;
+            star_match = task_name;
+        } else if (*pattern && (*pattern == L'?' ||
+            ::towlower(*pattern) == ::towlower(*task_name))) {
+            ++pattern;
+            ++task_name;
+        } else if (star) {
+            pattern = star + 1;
+            task_name = ++star_match;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == L'*')
+        ++pattern;
+    return !*pattern;
+}
+
+bool WriteFileAtomically(const wchar_t* path, const void* data, size_t size) {
+    // Named after the process, so that two processes writing the same file
+    // don't write over each other's.
+    CStringW temp_path;
+    temp_path.Format(L"%s.%lu.tmp", path,
+        static_cast<unsigned long>(GetPlatformProcessId()));
+    PlatformFile file;
+    // Flushed before the move, so that a crash can't leave a complete name
+    // on an incomplete file.
+    bool written = file.Open(temp_path, PlatformFile::OPEN_CREATE, nullptr) &&
+        file.Write(data, size) && file.Flush();
+    file.Close();
+    written = written && ReplacePlatformFile(temp_path, path);
+    if (!written)
+        DeletePlatformFile(temp_path);
+    return written;
+}
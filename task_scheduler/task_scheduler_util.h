@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+
+#include "task_scheduler.h"
+#include "task_scheduler_platform.h"
+
+// Helpers shared by the TaskScheduler implementations.
+
+// Prefix of the fingerprints RegisterTask() stores with the tasks it
+// registers. Tasks registered by other means have none.
+extern const wchar_t kTaskFingerprintPrefix[];
+
+// Return the fingerprint of what RegisterTask() writes for |spec| when run
+// by |user_name|. The log-on type is implied by the trigger type and the
+// user. The task name and user are folded as the service compares them, the
+// other fields hashed exactly as they are written, so that a spec only
+// matches a task holding the same values.
+CStringW ComputeTaskFingerprint(const TaskScheduler::TaskSpec& spec,
+    const wchar_t* user_name);
+
+// Return the key under which |task_name| is stored in task name indexes. Task
+// names are case insensitive, matching the _wcsicmp comparison used by the
+// Task Scheduler itself.
+std::wstring FoldTaskName(const wchar_t* task_name);
+
+// Same as above, but into |folded|, whose buffer is reused so that looking
+// names up repeatedly doesn't allocate once it is large enough.
+void FoldTaskName(const wchar_t* task_name, std::wstring* folded);
+
+// Hash |task_name| as folded by FoldTaskName(), without folding it. The hash
+// is stored in catalog snapshots: never change it.
+uint64_t HashTaskName(const wchar_t* task_name);
+
+// Return true if |a| and |b| name the same task, compared as FoldTaskName()
+// folds them.
+bool TaskNamesEqual(const wchar_t* a, const wchar_t* b);
+
+// Return true if |task_name| matches |pattern|, in which '*' stands for any
+// run of characters and '?' for any single one, compared as FoldTaskName()
+// folds them.
+bool MatchTaskNamePattern(const wchar_t* pattern, const wchar_t* task_name);
+
+// Write |size| bytes of |data| to the file at |path|, replacing it if it
+// exists. They are written to a file aside, flushed and moved over |path|,
+// so that a crash leaves either the previous file or the new one whole.
+bool WriteFileAtomically(const wchar_t* path, const void* data, size_t size);
+
+// Call |callback| with each entry of |index|, a sorted map keyed by folded
+// task names such as a std::map, whose name starts with |prefix|. Only the
+// matching entries are visited, in order.
+template <typename Index, typename Callback>
+void ForEachTaskWithPrefix(const Index& index, const wchar_t* prefix,
+    Callback callback) {
+    std::wstring folded_prefix = FoldTaskName(prefix);
+    for (auto it = index.lower_bound(folded_prefix);
+        it != index.end() &&
+        it->first.compare(0, folded_prefix.size(), folded_prefix) == 0;
+        ++it) {
+        callback(*it);
+    }
+}
+
+// Same as above, but for the entries whose name matches |pattern| as
+// MatchTaskNamePattern() does. Only the entries starting with the part of
+// |pattern| before its first wildcard are visited.
+template <typename Index, typename Callback>
+void ForEachTaskMatching(const Index& index, const wchar_t* pattern,
+    Callback callback) {
+    std::wstring folded_pattern = FoldTaskName(pattern);
+    std::wstring prefix =
+        folded_pattern.substr(0, folded_pattern.find_first_of(L"*?"));
+    ForEachTaskWithPrefix(index, prefix.c_str(),
+        [&folded_pattern, &callback](const typename Index::value_type& entry) {
+            if (MatchTaskNamePattern(folded_pattern.c_str(),
+                    entry.first.c_str())) {
+                callback(entry);
+            }
+        });
+}
@@ -0,0 +1,257 @@
+#include "task_watcher.h"
+
+#include <unordered_map>
+#include <utility>
+
+#include "task_scheduler_util.h"
+
+namespace {
+
+// Number of changes GetChangesSince() can go back.
+const size_t kMaxLoggedChanges = 4096;
+
+// Number of changes kept for the subscribers between two calls to Poll().
+const size_t kMaxUndeliveredChanges = 4096;
+
+}  // namespace
+
+TaskWatcher::TaskWatcher(TaskScheduler* scheduler)
+    : scheduler_(scheduler), observing_(false), started_(false)
+{
+
+}
+
+TaskWatcher::~TaskWatcher()
+{
+    Stop();
+}
+
+bool TaskWatcher::Start()
+{
+    if (started_)
+        return true;
+
+    // The observer is first called with every existing task. Until the
+    // watcher is started, changes only go into |initial_tasks_|, which then
+    // is diffed like a poll would.
+    observing_ = scheduler_->SetChangeObserver(
+        [this](TaskScheduler::ChangeType type,
+            const TaskScheduler::TaskSummary& task) {
+        OnChange(type, task);
+    });
+
+    std::vector<TaskScheduler::TaskSummary> summaries;
+    if (!observing_ && !scheduler_->GetTaskSummaries(&summaries))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (observing_) {
+        for (const auto& entry : initial_tasks_)
+            summaries.push_back(entry.second);
+        initial_tasks_.clear();
+    }
+    DiffSnapshot(summaries);
+    started_ = true;
+    return true;
+}
+
+void TaskWatcher::Stop()
+{
+    if (!started_)
+        return;
+    if (observing_)
+        scheduler_->SetChangeObserver(TaskScheduler::ChangeObserver());
+    std::lock_guard<std::mutex> lock(mutex_);
+    started_ = false;
+    observing_ = false;
+}
+
+bool TaskWatcher::Poll()
+{
+    if (!started_)
+        return false;
+
+    if (!observing_) {
+        std::vector<TaskScheduler::TaskSummary> summaries;
+        if (!scheduler_->GetTaskSummaries(&summaries))
+            return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        DiffSnapshot(summaries);
+    }
+
+    // Callbacks run without the lock held so that they can use the watcher.
+    std::vector<Change> changes;
+    std::vector<Subscription> subscriptions;
+    bool dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        changes.swap(undelivered_);
+        dropped = undelivered_dropped_;
+        undelivered_dropped_ = false;
+        for (const auto& entry : subscriptions_)
+            subscriptions.push_back(entry.second);
+    }
+    if (dropped) {
+        for (const Subscription& subscription : subscriptions)
+            subscription.callback(std::vector<Change>());
+        return true;
+    }
+    if (changes.empty())
+        return true;
+
+    for (const Subscription& subscription : subscriptions) {
+        if (subscription.task_names.empty()) {
+            subscription.callback(changes);
+            continue;
+        }
+        std::vector<Change> watched_changes;
+        for (const Change& change : changes) {
+            if (subscription.task_names.count(FoldTaskName(change.name)))
+                watched_changes.push_back(change);
+        }
+        if (!watched_changes.empty())
+            subscription.callback(watched_changes);
+    }
+    return true;
+}
+
+int TaskWatcher::Subscribe(const std::vector<CStringW>& task_names,
+    const ChangeCallback& callback)
+{
+    Subscription subscription;
+    for (const CStringW& name : task_names)
+        subscription.task_names.insert(FoldTaskName(name));
+    subscription.callback = callback;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    int subscription_id = next_subscription_id_++;
+    subscriptions_[subscription_id] = subscription;
+    return subscription_id;
+}
+
+void TaskWatcher::Unsubscribe(int subscription_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    subscriptions_.erase(subscription_id);
+}
+
+void TaskWatcher::GetSnapshot(Snapshot* snapshot)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot->version = version_;
+    snapshot->tasks.clear();
+    snapshot->tasks.reserve(snapshot_.size());
+    for (const auto& entry : snapshot_)
+        snapshot->tasks.push_back(entry.second);
+}
+
+bool TaskWatcher::GetChangesSince(uint64_t version,
+    std::vector<Change>* changes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (version < log_truncated_at_)
+        return false;
+
+    changes->clear();
+    // The log is ordered by version, so the changes wanted are at its end.
+    std::deque<Change>::const_iterator it = log_.end();
+    while (it != log_.begin() && (it - 1)->version > version)
+        --it;
+    changes->assign(it, log_.cend());
+    return true;
+}
+
+uint64_t TaskWatcher::version()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return version_;
+}
+
+void TaskWatcher::OnChange(TaskScheduler::ChangeType type,
+    const TaskScheduler::TaskSummary& task)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) {
+        if (type == TaskScheduler::CHANGE_REMOVED)
+            initial_tasks_.erase(FoldTaskName(task.name));
+        else
+            initial_tasks_[FoldTaskName(task.name)] = task;
+        return;
+    }
+    ++version_;
+    RecordChange(type, task);
+}
+
+void TaskWatcher::DiffSnapshot(
+    const std::vector<TaskScheduler::TaskSummary>& summaries)
+{
+    // Record into the next version, and only keep it if anything changed.
+    uint64_t last_version = version_;
+    ++version_;
+    bool changed = false;
+
+    std::unordered_map<std::wstring, const TaskScheduler::TaskSummary*>
+        current;
+    for (const TaskScheduler::TaskSummary& summary : summaries)
+        current[FoldTaskName(summary.name)] = &summary;
+
+    std::vector<TaskScheduler::TaskSummary> removed;
+    for (const auto& entry : snapshot_) {
+        if (!current.count(entry.first))
+            removed.push_back(entry.second);
+    }
+    for (const TaskScheduler::TaskSummary& task : removed) {
+        RecordChange(TaskScheduler::CHANGE_REMOVED, task);
+        changed = true;
+    }
+
+    for (const auto& entry : current) {
+        const TaskScheduler::TaskSummary& task = *entry.second;
+        auto it = snapshot_.find(entry.first);
+        if (it == snapshot_.end()) {
+            RecordChange(TaskScheduler::CHANGE_ADDED, task);
+            changed = true;
+            continue;
+        }
+        bool definition_changed = it->second.fingerprint != task.fingerprint;
+        bool enabled_changed = it->second.enabled != task.enabled;
+        if (definition_changed)
+            RecordChange(TaskScheduler::CHANGE_DEFINITION, task);
+        if (enabled_changed) {
+            RecordChange(task.enabled ? TaskScheduler::CHANGE_ENABLED :
+                TaskScheduler::CHANGE_DISABLED, task);
+        }
+        changed = changed || definition_changed || enabled_changed;
+    }
+
+    if (!changed)
+        version_ = last_version;
+}
+
+void TaskWatcher::RecordChange(TaskScheduler::ChangeType type,
+    const TaskScheduler::TaskSummary& task)
+{
+    std::wstring folded_name = FoldTaskName(task.name);
+    if (type == TaskScheduler::CHANGE_REMOVED)
+        snapshot_.erase(folded_name);
+    else
+        snapshot_[folded_name] = task;
+
+    Change change = { type, task.name, version_ };
+    log_.push_back(change);
+    if (log_.size() > kMaxLoggedChanges) {
+        log_truncated_at_ = log_.front().version;
+        log_.pop_front();
+    }
+    if (subscriptions_.empty() || undelivered_dropped_)
+        return;
+    if (undelivered_.size() == kMaxUndeliveredChanges) {
+        // Nobody polls. The subscribers will start over from the snapshot
+        // rather than replay the changes.
+        undelivered_.clear();
+        undelivered_.shrink_to_fit();
+        undelivered_dropped_ = true;
+        return;
+    }
+    undelivered_.push_back(change);
+}
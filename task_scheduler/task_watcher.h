@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "task_scheduler.h"
+
+// Tracks the tasks of a folder and reports what changes about them, so that
+// supervisors don't have to query each task they care about in a loop. The
+// watcher keeps a snapshot of the folder whose version grows with every batch
+// of changes, and a log of the recent changes, so that a consumer which
+// remembers the version it saw last only processes what changed since.
+//
+// Backends that report their changes, like the in-process engine, keep the
+// snapshot current as changes are made. With the task service, which
+// doesn't, Poll() reads the folder in a single enumeration and diffs it with
+// the snapshot. Definition changes are then only seen for tasks registered
+// by RegisterTask(), which stores a fingerprint of the definition.
+class TaskWatcher
+{
+public:
+    struct Change {
+        TaskScheduler::ChangeType type;
+        CStringW name;
+        // The version of the snapshot this change first appears in.
+        uint64_t version;
+    };
+
+    struct Snapshot {
+        uint64_t version;
+        std::vector<TaskScheduler::TaskSummary> tasks;
+    };
+
+    // Called by Poll() with the changes to the watched tasks, oldest first.
+    // If more changes piled up since the last Poll() than the watcher keeps
+    // for delivery, they are dropped and |changes| is empty instead: the
+    // subscriber has to start over from GetSnapshot().
+    typedef std::function<void(const std::vector<Change>& changes)>
+        ChangeCallback;
+
+    // |scheduler| must be initialized and outlive the watcher.
+    explicit TaskWatcher(TaskScheduler* scheduler);
+    ~TaskWatcher();
+
+    // Read the folder and start tracking changes. The first time, every task
+    // found counts as added in version 1. Return false if the folder can't be
+    // read.
+    bool Start();
+
+    // Stop tracking changes. The snapshot is kept as it is.
+    void Stop();
+
+    // Bring the snapshot up to date unless the backend reports its changes,
+    // then hand the changes made since the last Poll() to the subscribers, on
+    // the calling thread. Return false if the folder couldn't be read.
+    bool Poll();
+
+    // Have |callback| called with the changes to the tasks in |task_names|, or
+    // to all tasks if it is empty. Return an id to pass to Unsubscribe().
+    int Subscribe(const std::vector<CStringW>& task_names,
+        const ChangeCallback& callback);
+    void Unsubscribe(int subscription_id);
+
+    void GetSnapshot(Snapshot* snapshot);
+
+    // Fill |changes| with the changes made after |version|, oldest first.
+    // Return false if the log doesn't go back that far, in which case the
+    // consumer has to start over from GetSnapshot().
+    bool GetChangesSince(uint64_t version, std::vector<Change>* changes);
+
+    uint64_t version();
+
+private:
+    struct Subscription {
+        // Case folded names of the watched tasks, empty to watch all.
+        std::unordered_set<std::wstring> task_names;
+        ChangeCallback callback;
+    };
+
+    TaskWatcher(const TaskWatcher&) = delete;
+    TaskWatcher& operator=(const TaskWatcher&) = delete;
+
+    // The observer set on backends that report their changes.
+    void OnChange(TaskScheduler::ChangeType type,
+        const TaskScheduler::TaskSummary& task);
+
+    // Record the changes that turn the snapshot into |summaries|, all in one
+    // new version. Must be called with |mutex_| held.
+    void DiffSnapshot(const std::vector<TaskScheduler::TaskSummary>& summaries);
+
+    // Apply a change of |type| to |task| to the snapshot and log it as part
+    // of the current version. Must be called with |mutex_| held.
+    void RecordChange(TaskScheduler::ChangeType type,
+        const TaskScheduler::TaskSummary& task);
+
+    TaskScheduler* scheduler_;
+    // True if the backend reports its changes. Atomic, as it is checked
+    // before the observer is set, which must be done without |mutex_|.
+    std::atomic<bool> observing_;
+    // True while changes are tracked. Only changed with |mutex_| held, but
+    // read without it for the same reason.
+    std::atomic<bool> started_;
+
+    // Guards everything below, which the observer updates from whatever
+    // thread changes a task.
+    std::mutex mutex_;
+    // What the observer reported before the watcher was started, by case
+    // folded name.
+    std::map<std::wstring, TaskScheduler::TaskSummary> initial_tasks_;
+    uint64_t version_ = 0;
+    // Case folded name -> task.
+    std::map<std::wstring, TaskScheduler::TaskSummary> snapshot_;
+    // The most recent changes, oldest first, and the version up to which
+    // changes were dropped from the front.
+    std::deque<Change> log_;
+    uint64_t log_truncated_at_ = 0;
+    // Changes not handed to the subscribers yet, and whether some were
+    // dropped since the last Poll(), in which case no more are kept.
+    std::vector<Change> undelivered_;
+    bool undelivered_dropped_ = false;
+    std::map<int, Subscription> subscriptions_;
+    int next_subscription_id_ = 1;
+};
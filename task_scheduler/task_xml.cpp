@@ -0,0 +1,1022 @@
+#include "task_xml.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "trigger_schedule.h"
+
+namespace {
+
+const char kTaskNamespace[] =
+    "http://schemas.microsoft.com/windows/2004/02/mit/task";
+
+// The boundary and delays TaskSchedulerV2 gives the triggers it registers.
+const wchar_t kStartBoundaryText[] = L"2008-10-11T13:21:17Z";
+const wchar_t kPostRebootDelayText[] = L"PT15M";
+const wchar_t kOneHourText[] = L"PT1H";
+const wchar_t kSixHoursText[] = L"PT6H";
+const wchar_t kTwentyFourHoursText[] = L"PT24H";
+
+// Buffered output is written out once there is that much of it, and input
+// is read in chunks of that size.
+const size_t kBufferSize = 64 * 1024;
+
+// Longest text the reader keeps for an element, so that memory use stays
+// bounded whatever the input. Task Scheduler strings are much shorter.
+const int kMaxTextLength = 64 * 1024;
+
+const uint32_t kReplacementCharacter = 0xfffd;
+
+// Indentation of the elements of a task set.
+const char kIndent3[] = "      ";
+const char kIndent4[] = "        ";
+const char kIndent5[] = "          ";
+const char kIndent6[] = "            ";
+
+// The elements of the days of the week and of the months of a schedule, bit
+// 0 of ScheduleTrigger::days_of_week and months_of_year first.
+const char* const kDayElements[] = {
+    "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday",
+    "Saturday",
+};
+const char* const kMonthElements[] = {
+    "January", "February", "March", "April", "May", "June", "July",
+    "August", "September", "October", "November", "December",
+};
+
+bool IsSpace(wchar_t c) {
+    return c == L' ' || c == L'\t' || c == L'\r' || c == L'\n';
+}
+
+// Return |text| without leading and trailing white space.
+CStringW TrimSpace(const CStringW& text) {
+    int begin = 0;
+    int end = text.GetLength();
+    while (begin < end && IsSpace(text[begin]))
+        ++begin;
+    while (end > begin && IsSpace(text[end - 1]))
+        --end;
+    return CStringW(text.GetString() + begin, end - begin);
+}
+
+// Parse an xs:boolean. |value| is left alone if |text| isn't one.
+void ParseBoolean(const CStringW& text, bool* value) {
+    CStringW trimmed = TrimSpace(text);
+    if (trimmed == L"true" || trimmed == L"1")
+        *value = true;
+    else if (trimmed == L"false" || trimmed == L"0")
+        *value = false;
+}
+
+// Return the TriggerType for the trigger element |element| repeating every
+// |repetition_interval|, or false if there is none.
+bool GetTriggerType(const CStringW& element,
+    const CStringW& repetition_interval,
+    TaskScheduler::TriggerType* trigger_type) {
+    if (element == L"LogonTrigger" || element == L"BootTrigger") {
+        *trigger_type = TaskScheduler::TRIGGER_TYPE_POST_REBOOT;
+        return true;
+    }
+    if (element == L"RegistrationTrigger") {
+        *trigger_type = TaskScheduler::TRIGGER_TYPE_NOW;
+        return true;
+    }
+    if (element != L"CalendarTrigger" && element != L"TimeTrigger")
+        return false;
+
+    int64_t interval = 0;
+    if (!ParseIsoDuration(TrimSpace(repetition_interval), &interval))
+        return false;
+    if (interval == 60 * 60) {
+        *trigger_type = TaskScheduler::TRIGGER_TYPE_HOURLY;
+        return true;
+    }
+    if (interval == 6 * 60 * 60) {
+        *trigger_type = TaskScheduler::TRIGGER_TYPE_EVERY_SIX_HOURS;
+        return true;
+    }
+    return false;
+}
+
+void AppendCodePoint(uint32_t code_point, CStringW* text) {
+    if (code_point > 0x10ffff ||
+        (code_point >= 0xd800 && code_point <= 0xdfff)) {
+        code_point = kReplacementCharacter;
+    }
+    if (code_point < 0x10000) {
+        text->AppendChar(static_cast<wchar_t>(code_point));
+        return;
+    }
+    code_point -= 0x10000;
+    text->AppendChar(static_cast<wchar_t>(0xd800 + (code_point >> 10)));
+    text->AppendChar(static_cast<wchar_t>(0xdc00 + (code_point & 0x3ff)));
+}
+
+}  // namespace
+
+TaskXmlWriter::TaskXmlWriter()
+{
+
+}
+
+TaskXmlWriter::~TaskXmlWriter()
+{
+    Close();
+}
+
+bool TaskXmlWriter::Open(const wchar_t* path)
+{
+    Close();
+    if (::_wfopen_s(&file_, path, L"wb") != 0) {
+        file_ = nullptr;
+        return false;
+    }
+    failed_ = false;
+    buffer_.clear();
+
+    Write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n");
+    Write("<Tasks xmlns=\"");
+    Write(kTaskNamespace);
+    Write("\">\r\n");
+    return true;
+}
+
+bool TaskXmlWriter::Append(const TaskScheduler::TaskSpec& spec, bool enabled)
+{
+    if (!file_ || failed_)
+        return false;
+
+    std::vector<ScheduleTrigger> schedule_triggers;
+    if (spec.trigger_type == TaskScheduler::TRIGGER_TYPE_SCHEDULE) {
+        TriggerSchedule schedule;
+        if (!schedule.Parse(spec.schedule) ||
+            !schedule.GetTaskTriggers(&schedule_triggers)) {
+            return false;
+        }
+    }
+
+    // Registration triggers run the task as the registering user, see
+    // TaskSchedulerV2::CreateTaskPrototype().
+    bool has_principal = spec.trigger_type != TaskScheduler::TRIGGER_TYPE_NOW;
+
+    Write("  <Task version=\"1.2\">\r\n");
+    Write("    <RegistrationInfo>\r\n");
+    CStringW uri(L"\\");
+    uri += spec.name;
+    WriteElement(kIndent3, "URI", uri);
+    WriteElement(kIndent3, "Description", spec.description);
+    Write("    </RegistrationInfo>\r\n");
+
+    Write("    <Triggers>\r\n");
+    for (const ScheduleTrigger& schedule_trigger : schedule_triggers)
+        WriteScheduleTrigger(schedule_trigger);
+    if (schedule_triggers.empty())
+        WriteTrigger(spec.trigger_type);
+    Write("    </Triggers>\r\n");
+
+    if (has_principal) {
+        Write("    <Principals>\r\n");
+        Write("      <Principal id=\"Author\">\r\n");
+        WriteElement(kIndent4, "LogonType", L"InteractiveToken");
+        WriteElement(kIndent4, "RunLevel", L"HighestAvailable");
+        Write("      </Principal>\r\n");
+        Write("    </Principals>\r\n");
+    }
+
+    Write("    <Settings>\r\n");
+    WriteElement(kIndent3, "DisallowStartIfOnBatteries", L"false");
+    WriteElement(kIndent3, "StopIfGoingOnBatteries", L"false");
+    WriteElement(kIndent3, "StartWhenAvailable", L"true");
+    WriteElement(kIndent3, "Hidden", spec.hidden ? L"true" : L"false");
+    WriteElement(kIndent3, "Enabled", enabled ? L"true" : L"false");
+    Write("    </Settings>\r\n");
+
+    Write(has_principal ? "    <Actions Context=\"Author\">\r\n" :
+        "    <Actions>\r\n");
+    Write("      <Exec>\r\n");
+    WriteElement(kIndent4, "Command", spec.application_path);
+    if (!spec.application_arguments.IsEmpty())
+        WriteElement(kIndent4, "Arguments", spec.application_arguments);
+    Write("      </Exec>\r\n");
+    Write("    </Actions>\r\n");
+    Write("  </Task>\r\n");
+
+    if (buffer_.size() >= kBufferSize)
+        return Flush();
+    return true;
+}
+
+void TaskXmlWriter::WriteTrigger(TaskScheduler::TriggerType trigger_type)
+{
+    const char* trigger = "CalendarTrigger";
+    if (trigger_type == TaskScheduler::TRIGGER_TYPE_POST_REBOOT)
+        trigger = "LogonTrigger";
+    else if (trigger_type == TaskScheduler::TRIGGER_TYPE_NOW)
+        trigger = "RegistrationTrigger";
+    Write("      <");
+    Write(trigger);
+    Write(">\r\n");
+    WriteElement(kIndent4, "StartBoundary", kStartBoundaryText);
+    if (trigger_type == TaskScheduler::TRIGGER_TYPE_HOURLY ||
+        trigger_type == TaskScheduler::TRIGGER_TYPE_EVERY_SIX_HOURS) {
+        Write("        <Repetition>\r\n");
+        WriteElement(kIndent5, "Interval",
+            trigger_type == TaskScheduler::TRIGGER_TYPE_HOURLY ?
+            kOneHourText : kSixHoursText);
+        WriteElement(kIndent5, "Duration", kTwentyFourHoursText);
+        Write("        </Repetition>\r\n");
+        Write("        <ScheduleByDay>\r\n");
+        WriteElement(kIndent5, "DaysInterval", L"1");
+        Write("        </ScheduleByDay>\r\n");
+    } else if (trigger_type == TaskScheduler::TRIGGER_TYPE_POST_REBOOT) {
+        WriteElement(kIndent4, "Delay", kPostRebootDelayText);
+    }
+    Write("      </");
+    Write(trigger);
+    Write(">\r\n");
+}
+
+void TaskXmlWriter::WriteScheduleTrigger(const ScheduleTrigger& trigger)
+{
+    const char* element = trigger.type == ScheduleTrigger::TYPE_TIME ?
+        "TimeTrigger" : "CalendarTrigger";
+    Write("      <");
+    Write(element);
+    Write(">\r\n");
+    WriteElement(kIndent4, "StartBoundary", trigger.start_boundary);
+    if (!trigger.end_boundary.IsEmpty())
+        WriteElement(kIndent4, "EndBoundary", trigger.end_boundary);
+    if (!trigger.repetition_interval.IsEmpty()) {
+        Write("        <Repetition>\r\n");
+        WriteElement(kIndent5, "Interval", trigger.repetition_interval);
+        if (!trigger.repetition_duration.IsEmpty())
+            WriteElement(kIndent5, "Duration", trigger.repetition_duration);
+        Write("        </Repetition>\r\n");
+    }
+    if (!trigger.random_delay.IsEmpty())
+        WriteElement(kIndent4, "RandomDelay", trigger.random_delay);
+
+    CStringW number;
+    switch (trigger.type) {
+    case ScheduleTrigger::TYPE_TIME:
+        break;
+    case ScheduleTrigger::TYPE_DAILY:
+        Write("        <ScheduleByDay>\r\n");
+        number.Format(L"%d", trigger.days_interval);
+        WriteElement(kIndent5, "DaysInterval", number);
+        Write("        </ScheduleByDay>\r\n");
+        break;
+    case ScheduleTrigger::TYPE_WEEKLY:
+        Write("        <ScheduleByWeek>\r\n");
+        WriteFlags(kIndent5, "DaysOfWeek", kDayElements,
+            _countof(kDayElements), trigger.days_of_week);
+        WriteElement(kIndent5, "WeeksInterval", L"1");
+        Write("        </ScheduleByWeek>\r\n");
+        break;
+    case ScheduleTrigger::TYPE_MONTHLY:
+        Write("        <ScheduleByMonth>\r\n");
+        Write("          <DaysOfMonth>\r\n");
+        for (int day = 0; day < 31; ++day) {
+            if (!(trigger.days_of_month & (1L << day)))
+                continue;
+            number.Format(L"%d", day + 1);
+            WriteElement(kIndent6, "Day", number);
+        }
+        Write("          </DaysOfMonth>\r\n");
+        WriteFlags(kIndent5, "Months", kMonthElements,
+            _countof(kMonthElements), trigger.months_of_year);
+        Write("        </ScheduleByMonth>\r\n");
+        break;
+    case ScheduleTrigger::TYPE_MONTHLY_DAY_OF_WEEK:
+        // Every week of the month, the last one included, as
+        // TaskSchedulerV2::AddScheduleTrigger() registers it.
+        Write("        <ScheduleByMonthDayOfWeek>\r\n");
+        Write("          <Weeks>\r\n");
+        for (int week = 1; week <= 4; ++week) {
+            number.Format(L"%d", week);
+            WriteElement(kIndent6, "Week", number);
+        }
+        WriteElement(kIndent6, "Week", L"Last");
+        Write("          </Weeks>\r\n");
+        WriteFlags(kIndent5, "DaysOfWeek", kDayElements,
+            _countof(kDayElements), trigger.days_of_week);
+        WriteFlags(kIndent5, "Months", kMonthElements,
+            _countof(kMonthElements), trigger.months_of_year);
+        Write("        </ScheduleByMonthDayOfWeek>\r\n");
+        break;
+    }
+    Write("      </");
+    Write(element);
+    Write(">\r\n");
+}
+
+bool TaskXmlWriter::Close()
+{
+    if (!file_)
+        return !failed_;
+    Write("</Tasks>\r\n");
+    bool succeeded = Flush();
+    if (::fclose(file_) != 0)
+        succeeded = false;
+    file_ = nullptr;
+    return succeeded;
+}
+
+void TaskXmlWriter::Write(const char* text)
+{
+    buffer_.insert(buffer_.end(), text, text + strlen(text));
+}
+
+void TaskXmlWriter::WriteEscaped(const wchar_t* value)
+{
+    for (const wchar_t* c = value; *c; ++c) {
+        uint32_t code_point = *c;
+        if (code_point >= 0xd800 && code_point <= 0xdbff &&
+            c[1] >= 0xdc00 && c[1] <= 0xdfff) {
+            code_point = 0x10000 + ((code_point - 0xd800) << 10) +
+                (c[1] - 0xdc00);
+            ++c;
+        } else if (code_point >= 0xd800 && code_point <= 0xdfff) {
+            code_point = kReplacementCharacter;
+        }
+
+        switch (code_point) {
+        case L'&':
+            Write("&amp;");
+            continue;
+        case L'<':
+            Write("&lt;");
+            continue;
+        case L'>':
+            Write("&gt;");
+            continue;
+        case L'\r':
+            // Would be normalized away by the reader otherwise.
+            Write("&#13;");
+            continue;
+        }
+        // XML 1.0 has no way to represent other control characters.
+        if (code_point < 0x20 && code_point != L'\t' && code_point != L'\n')
+            continue;
+
+        if (code_point < 0x80) {
+            buffer_.push_back(static_cast<char>(code_point));
+        } else if (code_point < 0x800) {
+            buffer_.push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+            buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        } else if (code_point < 0x10000) {
+            buffer_.push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+            buffer_.push_back(
+                static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+            buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        } else {
+            buffer_.push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+            buffer_.push_back(
+                static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+            buffer_.push_back(
+                static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+            buffer_.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+        }
+    }
+}
+
+void TaskXmlWriter::WriteElement(const char* indent, const char* name,
+    const wchar_t* value)
+{
+    Write(indent);
+    Write("<");
+    Write(name);
+    Write(">");
+    WriteEscaped(value);
+    Write("</");
+    Write(name);
+    Write(">\r\n");
+}
+
+void TaskXmlWriter::WriteFlags(const char* indent, const char* name,
+    const char* const* flag_elements, size_t num_flags, uint32_t flags)
+{
+    Write(indent);
+    Write("<");
+    Write(name);
+    Write(">\r\n");
+    for (size_t i = 0; i < num_flags; ++i) {
+        if (!(flags & (1u << i)))
+            continue;
+        Write(indent);
+        Write("  <");
+        Write(flag_elements[i]);
+        Write(" />\r\n");
+    }
+    Write(indent);
+    Write("</");
+    Write(name);
+    Write(">\r\n");
+}
+
+bool TaskXmlWriter::Flush()
+{
+    if (failed_)
+        return false;
+    if (!buffer_.empty() &&
+        ::fwrite(&buffer_[0], 1, buffer_.size(), file_) != buffer_.size()) {
+        failed_ = true;
+    }
+    buffer_.clear();
+    return !failed_;
+}
+
+TaskXmlReader::TaskXmlReader()
+{
+
+}
+
+TaskXmlReader::~TaskXmlReader()
+{
+    Close();
+}
+
+bool TaskXmlReader::Open(const wchar_t* path)
+{
+    Close();
+    if (::_wfopen_s(&file_, path, L"rb") != 0) {
+        file_ = nullptr;
+        return false;
+    }
+    failed_ = false;
+    utf16_ = false;
+    buffer_.resize(kBufferSize);
+    buffer_position_ = 0;
+    buffer_size_ = ::fread(&buffer_[0], 1, buffer_.size(), file_);
+    num_pending_ = 0;
+    empty_element_ = false;
+    open_elements_.clear();
+    text_.Empty();
+    task_depth_ = 0;
+    num_skipped_ = 0;
+
+    // Skip the byte order mark, if any. The Task Scheduler writes UTF-16.
+    const uint8_t* bytes = &buffer_[0];
+    if (buffer_size_ >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb &&
+        bytes[2] == 0xbf) {
+        buffer_position_ = 3;
+    } else if (buffer_size_ >= 2 && bytes[0] == 0xff && bytes[1] == 0xfe) {
+        utf16_ = true;
+        buffer_position_ = 2;
+    } else if (buffer_size_ >= 2 && bytes[0] == '<' && bytes[1] == 0) {
+        utf16_ = true;
+    } else if (buffer_size_ >= 2 && bytes[0] == 0xfe && bytes[1] == 0xff) {
+        // Big endian UTF-16 isn't supported.
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool TaskXmlReader::Next(TaskScheduler::TaskSpec* spec, bool* enabled)
+{
+    while (file_ && !failed_) {
+        if (!ReadToken())
+            return false;
+
+        switch (token_type_) {
+        case TOKEN_START_ELEMENT:
+            open_elements_.push_back(token_name_);
+            text_.Empty();
+            if (!task_depth_ && token_name_ == L"Task") {
+                task_depth_ = open_elements_.size();
+                task_.name.Empty();
+                task_.description.Empty();
+                task_.command.Empty();
+                task_.arguments.Empty();
+                task_.num_actions = 0;
+                task_.num_exec_actions = 0;
+                task_.num_triggers = 0;
+                task_.has_trigger_type = false;
+                task_.trigger_type = TaskScheduler::TRIGGER_TYPE_NOW;
+                task_.repetition_interval.Empty();
+                task_.hidden = false;
+                task_.enabled = true;
+            } else if (task_depth_) {
+                OnTaskElementStart(open_elements_.size() - task_depth_);
+            }
+            break;
+
+        case TOKEN_TEXT:
+            if (text_.GetLength() + token_text_.GetLength() > kMaxTextLength)
+                return Fail();
+            text_ += token_text_;
+            break;
+
+        case TOKEN_END_ELEMENT: {
+            if (open_elements_.empty() || open_elements_.back() != token_name_)
+                return Fail();
+            size_t depth = open_elements_.size();
+            if (task_depth_ && depth > task_depth_)
+                OnTaskElementEnd(depth - task_depth_, text_);
+            open_elements_.pop_back();
+            text_.Empty();
+            if (task_depth_ && depth == task_depth_) {
+                task_depth_ = 0;
+                if (FinishTask(spec, enabled))
+                    return true;
+                ++num_skipped_;
+            }
+            break;
+        }
+
+        case TOKEN_END_OF_FILE:
+            // A truncated file.
+            if (!open_elements_.empty())
+                return Fail();
+            return false;
+        }
+    }
+    return false;
+}
+
+void TaskXmlReader::Close()
+{
+    if (file_)
+        ::fclose(file_);
+    file_ = nullptr;
+}
+
+bool TaskXmlReader::ReadToken()
+{
+    if (empty_element_) {
+        empty_element_ = false;
+        token_type_ = TOKEN_END_ELEMENT;
+        return true;
+    }
+
+    for (;;) {
+        wchar_t c;
+        if (!ReadChar(&c)) {
+            token_type_ = TOKEN_END_OF_FILE;
+            return !failed_;
+        }
+        if (c != L'<')
+            return ReadText(c);
+        bool produced = false;
+        if (!ReadMarkup(&produced))
+            return false;
+        if (produced)
+            return true;
+    }
+}
+
+bool TaskXmlReader::ReadMarkup(bool* produced)
+{
+    *produced = false;
+    wchar_t c;
+    if (!ReadChar(&c))
+        return Fail();
+
+    if (c == L'?')
+        return SkipPast(L"?>");
+
+    if (c == L'!') {
+        if (!ReadChar(&c))
+            return Fail();
+        if (c == L'-') {
+            if (!ReadChar(&c) || c != L'-')
+                return Fail();
+            return SkipPast(L"-->");
+        }
+        if (c != L'[') {
+            // A document type declaration. Internal subsets aren't
+            // supported.
+            return SkipPast(L">");
+        }
+        for (const wchar_t* expected = L"CDATA["; *expected; ++expected) {
+            if (!ReadChar(&c) || c != *expected)
+                return Fail();
+        }
+        token_text_.Empty();
+        for (;;) {
+            if (!ReadChar(&c) || token_text_.GetLength() > kMaxTextLength)
+                return Fail();
+            token_text_.AppendChar(c);
+            int length = token_text_.GetLength();
+            if (length >= 3 && wcscmp(token_text_.GetString() + length - 3,
+                    L"]]>") == 0) {
+                token_text_.Truncate(length - 3);
+                break;
+            }
+        }
+        token_type_ = TOKEN_TEXT;
+        *produced = true;
+        return true;
+    }
+
+    if (c == L'/') {
+        if (!ReadChar(&c) || !ReadName(c, &token_name_) || !SkipPast(L">"))
+            return Fail();
+        token_type_ = TOKEN_END_ELEMENT;
+        *produced = true;
+        return true;
+    }
+
+    if (!ReadName(c, &token_name_))
+        return Fail();
+    // Attributes are skipped, quoted values may hold '>'.
+    wchar_t quote = 0;
+    wchar_t previous = 0;
+    for (;;) {
+        if (!ReadChar(&c))
+            return Fail();
+        if (quote) {
+            if (c == quote)
+                quote = 0;
+        } else if (c == L'"' || c == L'\'') {
+            quote = c;
+        } else if (c == L'>') {
+            break;
+        }
+        previous = c;
+    }
+    empty_element_ = previous == L'/';
+    token_type_ = TOKEN_START_ELEMENT;
+    *produced = true;
+    return true;
+}
+
+bool TaskXmlReader::ReadText(wchar_t first)
+{
+    token_text_.Empty();
+    wchar_t c = first;
+    for (;;) {
+        if (c == L'&') {
+            if (!ReadEntity(&token_text_))
+                return false;
+        } else if (c == L'\r') {
+            // Line ends are normalized to '\n'.
+            wchar_t next;
+            if (ReadChar(&next) && next != L'\n')
+                UnreadChar(next);
+            token_text_.AppendChar(L'\n');
+        } else {
+            token_text_.AppendChar(c);
+        }
+        if (token_text_.GetLength() > kMaxTextLength)
+            return Fail();
+        if (!ReadChar(&c))
+            break;
+        if (c == L'<') {
+            UnreadChar(c);
+            break;
+        }
+    }
+    token_type_ = TOKEN_TEXT;
+    return !failed_;
+}
+
+bool TaskXmlReader::ReadName(wchar_t first, CStringW* name)
+{
+    name->Empty();
+    wchar_t c = first;
+    while (!IsSpace(c) && c != L'/' && c != L'>') {
+        // Only the local name matters, drop the namespace prefix.
+        if (c == L':')
+            name->Empty();
+        else
+            name->AppendChar(c);
+        if (name->GetLength() > kMaxTextLength || !ReadChar(&c))
+            return false;
+    }
+    UnreadChar(c);
+    return !name->IsEmpty();
+}
+
+bool TaskXmlReader::SkipPast(const wchar_t* terminator)
+{
+    // The last characters read, as many as |terminator| has.
+    size_t length = wcslen(terminator);
+    wchar_t window[3] = {};
+    for (;;) {
+        wchar_t c;
+        if (!ReadChar(&c))
+            return Fail();
+        memmove(window, window + 1, (length - 1) * sizeof(wchar_t));
+        window[length - 1] = c;
+        if (wmemcmp(window, terminator, length) == 0)
+            return true;
+    }
+}
+
+bool TaskXmlReader::ReadEntity(CStringW* text)
+{
+    wchar_t name[12];
+    size_t length = 0;
+    for (;;) {
+        wchar_t c;
+        if (!ReadChar(&c))
+            return Fail();
+        if (c == L';')
+            break;
+        if (length + 1 == _countof(name))
+            return Fail();
+        name[length++] = c;
+    }
+    name[length] = L'\0';
+
+    if (name[0] == L'#') {
+        bool hex = name[1] == L'x';
+        const wchar_t* digits = name + (hex ? 2 : 1);
+        if (!*digits)
+            return Fail();
+        uint32_t code_point = 0;
+        for (const wchar_t* c = digits; *c; ++c) {
+            uint32_t digit;
+            if (*c >= L'0' && *c <= L'9')
+                digit = *c - L'0';
+            else if (hex && *c >= L'a' && *c <= L'f')
+                digit = *c - L'a' + 10;
+            else if (hex && *c >= L'A' && *c <= L'F')
+                digit = *c - L'A' + 10;
+            else
+                return Fail();
+            code_point = code_point * (hex ? 16 : 10) + digit;
+            if (code_point > 0x10ffff)
+                return Fail();
+        }
+        AppendCodePoint(code_point, text);
+        return true;
+    }
+
+    static const struct {
+        const wchar_t* name;
+        wchar_t c;
+    } kEntities[] = {
+        { L"lt", L'<' },
+        { L"gt", L'>' },
+        { L"amp", L'&' },
+        { L"quot", L'"' },
+        { L"apos", L'\'' },
+    };
+    for (const auto& entity : kEntities) {
+        if (wcscmp(name, entity.name) == 0) {
+            text->AppendChar(entity.c);
+            return true;
+        }
+    }
+    return Fail();
+}
+
+bool TaskXmlReader::ReadChar(wchar_t* c)
+{
+    if (num_pending_) {
+        *c = pending_[--num_pending_];
+        return true;
+    }
+
+    if (utf16_) {
+        uint8_t low;
+        uint8_t high;
+        if (!ReadByte(&low))
+            return false;
+        if (!ReadByte(&high))
+            return Fail();
+        *c = static_cast<wchar_t>(low | high << 8);
+        return true;
+    }
+
+    uint32_t code_point;
+    if (!ReadCodePoint(&code_point))
+        return false;
+    if (code_point < 0x10000) {
+        *c = static_cast<wchar_t>(code_point);
+        return true;
+    }
+    code_point -= 0x10000;
+    *c = static_cast<wchar_t>(0xd800 + (code_point >> 10));
+    pending_[num_pending_++] =
+        static_cast<wchar_t>(0xdc00 + (code_point & 0x3ff));
+    return true;
+}
+
+// Invalid sequences decode to U+FFFD rather than failing, as text is only
+// ever copied.
+bool TaskXmlReader::ReadCodePoint(uint32_t* code_point)
+{
+    uint8_t lead;
+    if (!ReadByte(&lead))
+        return false;
+    size_t num_continuations = 0;
+    uint32_t value = lead;
+    if (lead < 0x80) {
+        *code_point = lead;
+        return true;
+    } else if ((lead & 0xe0) == 0xc0) {
+        num_continuations = 1;
+        value = lead & 0x1f;
+    } else if ((lead & 0xf0) == 0xe0) {
+        num_continuations = 2;
+        value = lead & 0x0f;
+    } else if ((lead & 0xf8) == 0xf0) {
+        num_continuations = 3;
+        value = lead & 0x07;
+    } else {
+        *code_point = kReplacementCharacter;
+        return true;
+    }
+
+    for (size_t i = 0; i < num_continuations; ++i) {
+        uint8_t byte;
+        if (!ReadByte(&byte))
+            return Fail();
+        if ((byte & 0xc0) != 0x80) {
+            *code_point = kReplacementCharacter;
+            return true;
+        }
+        value = value << 6 | (byte & 0x3f);
+    }
+    if (value > 0x10ffff || (value >= 0xd800 && value <= 0xdfff))
+        value = kReplacementCharacter;
+    *code_point = value;
+    return true;
+}
+
+bool TaskXmlReader::ReadByte(uint8_t* byte)
+{
+    if (buffer_position_ == buffer_size_) {
+        if (!file_ || failed_)
+            return false;
+        buffer_position_ = 0;
+        buffer_size_ = ::fread(&buffer_[0], 1, buffer_.size(), file_);
+        if (!buffer_size_) {
+            if (::ferror(file_))
+                Fail();
+            return false;
+        }
+    }
+    *byte = buffer_[buffer_position_++];
+    return true;
+}
+
+void TaskXmlReader::UnreadChar(wchar_t c)
+{
+    pending_[num_pending_++] = c;
+}
+
+void TaskXmlReader::OnTaskElementStart(size_t depth)
+{
+    if (depth == 2 && IsTaskPath(depth, { L"Actions", nullptr })) {
+        ++task_.num_actions;
+        if (open_elements_.back() == L"Exec")
+            ++task_.num_exec_actions;
+    } else if (depth == 2 && IsTaskPath(depth, { L"Triggers", nullptr })) {
+        ++task_.num_triggers;
+        task_.repetition_interval.Empty();
+    }
+}
+
+void TaskXmlReader::OnTaskElementEnd(size_t depth, const CStringW& text)
+{
+    if (IsTaskPath(depth, { L"RegistrationInfo", L"URI" })) {
+        // The name is the last component of the path.
+        CStringW uri = TrimSpace(text);
+        int separator = uri.ReverseFind(L'\\');
+        task_.name = separator < 0 ? uri : uri.Mid(separator + 1);
+    } else if (IsTaskPath(depth, { L"RegistrationInfo", L"Description" })) {
+        task_.description = text;
+    } else if (IsTaskPath(depth, { L"Actions", L"Exec", L"Command" })) {
+        task_.command = TrimSpace(text);
+    } else if (IsTaskPath(depth, { L"Actions", L"Exec", L"Arguments" })) {
+        task_.arguments = text;
+    } else if (IsTaskPath(depth,
+        { L"Triggers", nullptr, L"Repetition", L"Interval" })) {
+        task_.repetition_interval = text;
+    } else if (IsTaskPath(depth, { L"Triggers", nullptr })) {
+        task_.has_trigger_type = GetTriggerType(open_elements_.back(),
+            task_.repetition_interval, &task_.trigger_type);
+    } else if (IsTaskPath(depth, { L"Settings", L"Hidden" })) {
+        ParseBoolean(text, &task_.hidden);
+    } else if (IsTaskPath(depth, { L"Settings", L"Enabled" })) {
+        ParseBoolean(text, &task_.enabled);
+    }
+}
+
+bool TaskXmlReader::IsTaskPath(size_t depth,
+    std::initializer_list<const wchar_t*> names) const
+{
+    if (names.size() != depth)
+        return false;
+    size_t index = task_depth_;
+    for (const wchar_t* name : names) {
+        if (name && open_elements_[index] != name)
+            return false;
+        ++index;
+    }
+    return true;
+}
+
+bool TaskXmlReader::FinishTask(TaskScheduler::TaskSpec* spec, bool* enabled)
+{
+    if (task_.name.IsEmpty() || task_.command.IsEmpty() ||
+        task_.num_actions != 1 || task_.num_exec_actions != 1 ||
+        task_.num_triggers != 1 || !task_.has_trigger_type) {
+        return false;
+    }
+    spec->name = task_.name;
+    spec->description = task_.description;
+    spec->application_path = task_.command;
+    spec->application_arguments = task_.arguments;
+    spec->trigger_type = task_.trigger_type;
+    spec->hidden = task_.hidden;
+    *enabled = task_.enabled;
+    return true;
+}
+
+bool TaskXmlReader::Fail()
+{
+    failed_ = true;
+    return false;
+}
+
+bool ImportTasksFromXml(TaskScheduler* scheduler, const wchar_t* path,
+    size_t batch_size, XmlImportReport* report)
+{
+    TaskXmlReader reader;
+    if (!reader.Open(path))
+        return false;
+    batch_size = std::max<size_t>(1, batch_size);
+
+    XmlImportReport report_storage = {};
+    bool success = true;
+    std::vector<TaskScheduler::TaskSpec> specs;
+    std::vector<bool> enabled;
+    std::vector<TaskScheduler::RegisterResult> results;
+    TaskScheduler::TaskSpec spec;
+    bool is_enabled = true;
+    for (;;) {
+        specs.clear();
+        enabled.clear();
+        while (specs.size() < batch_size && reader.Next(&spec, &is_enabled)) {
+            specs.push_back(spec);
+            enabled.push_back(is_enabled);
+        }
+        if (specs.empty())
+            break;
+
+        report_storage.num_read += specs.size();
+        if (!scheduler->RegisterTasks(specs, &results))
+            success = false;
+        for (size_t i = 0; i < specs.size(); ++i) {
+            TaskScheduler::RegisterResult result = i < results.size() ?
+                results[i] : TaskScheduler::REGISTER_FAILED;
+            // Registration leaves tasks enabled.
+            if (result != TaskScheduler::REGISTER_FAILED && !enabled[i] &&
+                !scheduler->SetTaskEnabled(specs[i].name, false)) {
+                result = TaskScheduler::REGISTER_FAILED;
+                success = false;
+            }
+            switch (result) {
+            case TaskScheduler::REGISTER_CREATED:
+                ++report_storage.num_created;
+                break;
+            case TaskScheduler::REGISTER_UPDATED:
+                ++report_storage.num_updated;
+                break;
+            case TaskScheduler::REGISTER_UNCHANGED:
+                ++report_storage.num_unchanged;
+                break;
+            default:
+                ++report_storage.num_failed;
+                break;
+            }
+        }
+    }
+    report_storage.num_skipped = reader.num_skipped();
+    if (reader.failed())
+        success = false;
+    *report = report_storage;
+    return success;
+}
+
+bool ExportTasksToXml(TaskScheduler* scheduler, const wchar_t* path,
+    size_t* num_exported, size_t* num_skipped)
+{
+    TaskXmlWriter writer;
+    if (!writer.Open(path))
+        return false;
+
+    size_t num_written = 0;
+    size_t num_not_written = 0;
+    bool enumerated = scheduler->EnumerateTaskSpecs(
+        [&writer, &num_written, &num_not_written](
+            const TaskScheduler::TaskSpec& spec, bool enabled) {
+        if (writer.Append(spec, enabled))
+            ++num_written;
+        else if (!writer.failed())
+            ++num_not_written;
+        return !writer.failed();
+    });
+    bool written = !writer.failed();
+    bool closed = writer.Close();
+    *num_exported = num_written;
+    *num_skipped = num_not_written;
+    return enumerated && written && closed;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <initializer_list>
+#include <vector>
+
+#include "task_scheduler.h"
+#include "trigger_schedule.h"
+
+// Task definitions in the XML schema of the Task Scheduler
+// (http://schemas.microsoft.com/windows/2004/02/mit/task), for moving sets of
+// tasks between machines. A task set is a <Tasks> element holding a <Task>
+// element per task, each of which is a definition the Task Scheduler itself
+// accepts. The task's name is the last component of its
+// RegistrationInfo/URI.
+//
+// Both directions stream: the reader keeps no more than the task being read
+// and the writer no more than a buffer, so memory use doesn't grow with the
+// number of tasks.
+
+// Writes task specs as a task set.
+class TaskXmlWriter
+{
+public:
+    TaskXmlWriter();
+    // Close() the task set.
+    ~TaskXmlWriter();
+
+    // Create the task set at |path|, replacing any existing file. It is
+    // written in UTF-8.
+    bool Open(const wchar_t* path);
+
+    // Add the definition RegisterTask() or, for TRIGGER_TYPE_SCHEDULE,
+    // RegisterTasks() would register for |spec|, enabled or not as |enabled|
+    // says. Return false if the schedule of |spec| has no triggers (see
+    // TriggerSchedule::GetTaskTriggers()), in which case nothing is written,
+    // or if the file couldn't be written, after which nothing more is and
+    // failed() is true.
+    bool Append(const TaskScheduler::TaskSpec& spec, bool enabled);
+
+    // End the task set, write out what is buffered and close the file.
+    // Return false if any write failed.
+    bool Close();
+
+    bool failed() const { return failed_; }
+
+private:
+    TaskXmlWriter(const TaskXmlWriter&) = delete;
+    TaskXmlWriter& operator=(const TaskXmlWriter&) = delete;
+
+    // Write the trigger RegisterTask() registers for |trigger_type|.
+    void WriteTrigger(TaskScheduler::TriggerType trigger_type);
+    // Write |trigger|, one of the triggers of a TriggerSchedule.
+    void WriteScheduleTrigger(const ScheduleTrigger& trigger);
+
+    void Write(const char* text);
+    // Write |value| as UTF-8 with the characters XML reserves escaped.
+    void WriteEscaped(const wchar_t* value);
+    // Write <|name|>|value|</|name|> on a line of its own.
+    void WriteElement(const char* indent, const char* name,
+        const wchar_t* value);
+    // Write <|name|> holding an empty element for each bit |i| set in
+    // |flags|, named |flag_elements[i]|.
+    void WriteFlags(const char* indent, const char* name,
+        const char* const* flag_elements, size_t num_flags, uint32_t flags);
+    bool Flush();
+
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+    std::vector<char> buffer_;
+};
+
+// Reads the task specs of a task set, or of a single task definition.
+class TaskXmlReader
+{
+public:
+    TaskXmlReader();
+    // Close() the file.
+    ~TaskXmlReader();
+
+    // Open the XML file at |path|, in UTF-8 or, with a byte order mark,
+    // UTF-16, as the Task Scheduler exports them.
+    bool Open(const wchar_t* path);
+
+    // Read the next task a TaskSpec can describe into |spec| and whether it
+    // is enabled into |enabled|. Tasks that a spec can't describe, such as
+    // ones with several actions or a trigger TriggerType has no value for,
+    // are skipped and counted by num_skipped(). Return false once there are
+    // no more tasks or the file turned out to be malformed, see failed().
+    bool Next(TaskScheduler::TaskSpec* spec, bool* enabled);
+
+    void Close();
+
+    bool failed() const { return failed_; }
+    size_t num_skipped() const { return num_skipped_; }
+
+private:
+    enum TokenType {
+        TOKEN_START_ELEMENT = 0,
+        TOKEN_END_ELEMENT,
+        TOKEN_TEXT,
+        TOKEN_END_OF_FILE,
+    };
+
+    // What has been read of the task being read.
+    struct PendingTask {
+        CStringW name;
+        CStringW description;
+        CStringW command;
+        CStringW arguments;
+        size_t num_actions;
+        size_t num_exec_actions;
+        size_t num_triggers;
+        bool has_trigger_type;
+        TaskScheduler::TriggerType trigger_type;
+        CStringW repetition_interval;
+        bool hidden;
+        bool enabled;
+    };
+
+    TaskXmlReader(const TaskXmlReader&) = delete;
+    TaskXmlReader& operator=(const TaskXmlReader&) = delete;
+
+    // Read the next token into |token_type_| and, for elements, the local
+    // name into |token_name_| and, for text, the text into |token_text_|.
+    bool ReadToken();
+    // Read what follows a '<'. |produced| is set to false for markup that
+    // isn't a token, like comments.
+    bool ReadMarkup(bool* produced);
+    bool ReadText(wchar_t first);
+    bool ReadName(wchar_t first, CStringW* name);
+    // Skip input up to and including |terminator|.
+    bool SkipPast(const wchar_t* terminator);
+    bool ReadEntity(CStringW* text);
+
+    // Decode the next character of the input, as UTF-16.
+    bool ReadChar(wchar_t* c);
+    bool ReadCodePoint(uint32_t* code_point);
+    bool ReadByte(uint8_t* byte);
+    void UnreadChar(wchar_t c);
+
+    // Handle the start and end of the elements of a task, |depth| being the
+    // depth of the element below the <Task> element.
+    void OnTaskElementStart(size_t depth);
+    void OnTaskElementEnd(size_t depth, const CStringW& text);
+    // Return true if the element at |depth| below <Task> and its parents
+    // are |names|, outermost first. A null name matches any element.
+    bool IsTaskPath(size_t depth, std::initializer_list<const wchar_t*> names)
+        const;
+    // Fill |spec| and |enabled| from |task_|. Return false if a spec can't
+    // describe it.
+    bool FinishTask(TaskScheduler::TaskSpec* spec, bool* enabled);
+
+    // Mark the file as malformed and return false.
+    bool Fail();
+
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+    bool utf16_ = false;
+    std::vector<uint8_t> buffer_;
+    size_t buffer_position_ = 0;
+    size_t buffer_size_ = 0;
+    // Characters pushed back by UnreadChar(), or waiting to be returned,
+    // like the second half of a surrogate pair. Returned last first.
+    wchar_t pending_[2];
+    size_t num_pending_ = 0;
+
+    TokenType token_type_ = TOKEN_END_OF_FILE;
+    CStringW token_name_;
+    CStringW token_text_;
+    // Set by a start tag written as <name/>, whose end is reported next.
+    bool empty_element_ = false;
+
+    // Local names of the open elements, outermost first.
+    std::vector<CStringW> open_elements_;
+    // The text of the innermost open element.
+    CStringW text_;
+    // The depth of the <Task> element being read, 0 if none is.
+    size_t task_depth_ = 0;
+    PendingTask task_;
+    size_t num_skipped_ = 0;
+};
+
+// What ImportTasksFromXml() did.
+struct XmlImportReport {
+    // Tasks read, and skipped because a TaskSpec can't describe them.
+    size_t num_read;
+    size_t num_skipped;
+    // The outcome of registering the tasks read.
+    size_t num_created;
+    size_t num_updated;
+    size_t num_unchanged;
+    size_t num_failed;
+};
+
+// Register every task of the task set at |path| with |scheduler|, in
+// batches of |batch_size| through RegisterTasks(). Tasks the set has
+// disabled are disabled once registered. Return true if the whole set was
+// read and every task registered.
+bool ImportTasksFromXml(TaskScheduler* scheduler, const wchar_t* path,
+    size_t batch_size, XmlImportReport* report);
+
+// Write every task of |scheduler| that EnumerateTaskSpecs() reads to a task
+// set at |path|, as it is enumerated. Tasks of TRIGGER_TYPE_SCHEDULE are
+// written with the calendar and time triggers their schedule maps to, which
+// TaskXmlReader only reads back as hourly or six-hourly tasks, if at all.
+// |num_exported| receives the number of tasks written and |num_skipped| the
+// number of those with a schedule that has no triggers, which are left out.
+bool ExportTasksToXml(TaskScheduler* scheduler, const wchar_t* path,
+    size_t* num_exported, size_t* num_skipped);
@@ -0,0 +1,250 @@
+#include "timing_wheel.h"
+
+#include <string.h>
+
+namespace {
+
+// Milliseconds per slot and number of slots of each level. A level spans as
+// much time as one slot of the level above it.
+const uint64_t kSlotDurations[] = { 1, 1000, 60 * 1000, 60 * 60 * 1000 };
+const size_t kSlotsPerLevel[] = { 1000, 60, 60, 24 };
+
+// What the top level spans. The overflow list is cascaded this often.
+const uint64_t kWheelSpan = kSlotDurations[3] * kSlotsPerLevel[3];
+
+// Return the index of the lowest set bit of |value|, which must not be 0.
+size_t FindLowestSetBit(uint64_t value) {
+    static const uint8_t kDeBruijnPositions[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6,
+    };
+    uint64_t lowest_bit = value & (~value + 1);
+    return kDeBruijnPositions[(lowest_bit * 0x03f79d71b4cb0a89ULL) >> 58];
+}
+
+}  // namespace
+
+TimingWheel::Timer::Timer()
+    : prev_(nullptr), next_(nullptr), expires_(0), level_(0)
+{
+
+}
+
+TimingWheel::TimingWheel(uint64_t now)
+    : now_(now), size_(0)
+{
+    for (size_t level = 0; level < kNumLevels; ++level) {
+        levels_[level] = new Timer[kSlotsPerLevel[level]];
+        for (size_t slot = 0; slot < kSlotsPerLevel[level]; ++slot) {
+            Timer* head = &levels_[level][slot];
+            head->prev_ = head;
+            head->next_ = head;
+        }
+        level_counts_[level] = 0;
+    }
+    overflow_.prev_ = &overflow_;
+    overflow_.next_ = &overflow_;
+    level_counts_[kOverflowLevel] = 0;
+    memset(occupancy_, 0, sizeof(occupancy_));
+}
+
+TimingWheel::~TimingWheel()
+{
+    // Leave the timers that are still pending in a state they can be
+    // destroyed or scheduled on another wheel in.
+    for (size_t level = 0; level < kNumLevels; ++level) {
+        for (size_t slot = 0; slot < kSlotsPerLevel[level]; ++slot) {
+            Timer* head = &levels_[level][slot];
+            while (head->next_ != head)
+                Cancel(head->next_);
+        }
+        delete[] levels_[level];
+    }
+    while (overflow_.next_ != &overflow_)
+        Cancel(overflow_.next_);
+}
+
+void TimingWheel::Schedule(Timer* timer, uint64_t expires)
+{
+    Cancel(timer);
+    timer->expires_ = expires > now_ ? expires : now_ + 1;
+    Insert(timer);
+}
+
+void TimingWheel::Cancel(Timer* timer)
+{
+    if (!timer->pending())
+        return;
+
+    Timer* next = timer->next_;
+    timer->prev_->next_ = next;
+    next->prev_ = timer->prev_;
+    timer->prev_ = nullptr;
+    timer->next_ = nullptr;
+    --level_counts_[timer->level_];
+    --size_;
+
+    // The slot is empty when the timer was its only one.
+    if (timer->level_ != kOverflowLevel && next->next_ == next) {
+        size_t slot = SlotIndex(timer->level_, timer->expires_);
+        if (next == &levels_[timer->level_][slot])
+            occupancy_[timer->level_][slot / 64] &= ~(1ULL << (slot % 64));
+    }
+}
+
+void TimingWheel::Advance(uint64_t now, const ExpiryCallback& callback)
+{
+    if (now <= now_)
+        return;
+
+    for (;;) {
+        uint64_t next = GetNextEventTime();
+        if (next > now)
+            break;
+        now_ = next;
+
+        // Cascade from the top so that timers moving down several levels at
+        // once are handled in this same step.
+        if (now_ % kWheelSpan == 0)
+            Reinsert(&overflow_);
+        for (size_t level = kNumLevels - 1; level > 0; --level) {
+            if (now_ % kSlotDurations[level] == 0)
+                Cascade(level, SlotIndex(level, now_));
+        }
+
+        Timer* head = &levels_[0][SlotIndex(0, now_)];
+        while (head->next_ != head) {
+            Timer* timer = head->next_;
+            Cancel(timer);
+            callback(timer);
+        }
+    }
+    now_ = now;
+}
+
+bool TimingWheel::GetNextWakeup(uint64_t* wakeup) const
+{
+    if (!size_)
+        return false;
+    *wakeup = GetNextEventTime();
+    return true;
+}
+
+TimingWheel::Timer* TimingWheel::SlotFor(uint64_t expires, uint8_t* level)
+{
+    uint64_t delta = expires - now_;
+    for (uint8_t i = 0; i < kNumLevels; ++i) {
+        if (delta < kSlotDurations[i] * kSlotsPerLevel[i]) {
+            *level = i;
+            return &levels_[i][SlotIndex(i, expires)];
+        }
+    }
+    *level = kOverflowLevel;
+    return &overflow_;
+}
+
+// static
+size_t TimingWheel::SlotIndex(size_t level, uint64_t expires)
+{
+    return static_cast<size_t>(
+        (expires / kSlotDurations[level]) % kSlotsPerLevel[level]);
+}
+
+void TimingWheel::Insert(Timer* timer)
+{
+    Timer* head = SlotFor(timer->expires_, &timer->level_);
+    timer->prev_ = head->prev_;
+    timer->next_ = head;
+    head->prev_->next_ = timer;
+    head->prev_ = timer;
+    ++level_counts_[timer->level_];
+    ++size_;
+
+    if (timer->level_ != kOverflowLevel) {
+        size_t slot = SlotIndex(timer->level_, timer->expires_);
+        occupancy_[timer->level_][slot / 64] |= 1ULL << (slot % 64);
+    }
+}
+
+void TimingWheel::Cascade(size_t level, size_t slot)
+{
+    occupancy_[level][slot / 64] &= ~(1ULL << (slot % 64));
+    Reinsert(&levels_[level][slot]);
+}
+
+void TimingWheel::Reinsert(Timer* head)
+{
+    if (head->next_ == head)
+        return;
+
+    // Detach the whole list first: timers far enough out go right back onto
+    // the same list.
+    Timer list;
+    list.prev_ = head->prev_;
+    list.next_ = head->next_;
+    list.prev_->next_ = &list;
+    list.next_->prev_ = &list;
+    head->prev_ = head;
+    head->next_ = head;
+
+    while (list.next_ != &list) {
+        Timer* timer = list.next_;
+        Cancel(timer);
+        Insert(timer);
+    }
+}
+
+uint64_t TimingWheel::GetNextEventTime() const
+{
+    uint64_t next = UINT64_MAX;
+
+    // Timers of the lowest level all expire within its span.
+    if (level_counts_[0]) {
+        size_t start = SlotIndex(0, now_ + 1);
+        next = now_ + 1 + FindOccupiedSlot(0, start);
+    }
+
+    // A slot of a higher level cascades when the clock reaches its start.
+    for (size_t level = 1; level < kNumLevels; ++level) {
+        if (!level_counts_[level])
+            continue;
+        uint64_t first_slot_time = now_ / kSlotDurations[level] + 1;
+        size_t start = static_cast<size_t>(
+            first_slot_time % kSlotsPerLevel[level]);
+        uint64_t time = (first_slot_time + FindOccupiedSlot(level, start)) *
+            kSlotDurations[level];
+        if (time < next)
+            next = time;
+    }
+
+    if (level_counts_[kOverflowLevel]) {
+        uint64_t time = (now_ / kWheelSpan + 1) * kWheelSpan;
+        if (time < next)
+            next = time;
+    }
+    return next;
+}
+
+size_t TimingWheel::FindOccupiedSlot(size_t level, size_t start) const
+{
+    size_t num_slots = kSlotsPerLevel[level];
+    const uint64_t* bits = occupancy_[level];
+    for (size_t offset = 0; offset < num_slots;) {
+        size_t slot = (start + offset) % num_slots;
+        size_t bit = slot % 64;
+        // Bits left in this word before the level wraps around.
+        size_t run = 64 - bit;
+        if (run > num_slots - slot)
+            run = num_slots - slot;
+        uint64_t word = bits[slot / 64] >> bit;
+        if (word) {
+            size_t first = FindLowestSetBit(word);
+            if (first < run)
+                return offset + first;
+        }
+        offset += run;
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+// Hierarchical timing wheel keeping pending firings with millisecond
+// resolution. Levels of 1000 x 1 ms, 60 x 1 s, 60 x 1 min and 24 x 1 h slots
+// cover the next day; later firings wait on an overflow list that is looked
+// at once a day. Scheduling and cancelling are O(1). A slot of a higher level
+// is cascaded into the lower levels when its time comes. Occupancy bitmaps
+// let the clock jump from one non-empty slot to the next, so advancing never
+// scans timers or empty slots one by one.
+//
+// Times are in milliseconds on any monotonic scale chosen by the owner. The
+// wheel is not thread safe.
+class TimingWheel
+{
+public:
+    // A pending firing, embedded in whatever is to be fired. It must be
+    // cancelled before it is destroyed.
+    class Timer {
+    public:
+        Timer();
+
+        // True while the timer is scheduled.
+        bool pending() const { return next_ != nullptr; }
+        // When the timer fires, valid while it is pending.
+        uint64_t expires() const { return expires_; }
+
+    private:
+        friend class TimingWheel;
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        Timer* prev_;
+        Timer* next_;
+        uint64_t expires_;
+        // Index in TimingWheel::level_counts_ of the list the timer is on.
+        uint8_t level_;
+    };
+
+    // Called with each timer that expires, which is no longer pending and can
+    // be scheduled again.
+    typedef std::function<void(Timer* timer)> ExpiryCallback;
+
+    // Start the wheel's clock at |now|.
+    explicit TimingWheel(uint64_t now);
+    ~TimingWheel();
+
+    // Schedule |timer| to fire at |expires|, rescheduling it if it is already
+    // pending. Times that have already passed fire on the next Advance().
+    void Schedule(Timer* timer, uint64_t expires);
+
+    // Unschedule |timer|. No-op if it isn't pending.
+    void Cancel(Timer* timer);
+
+    // Move the clock forward to |now| and hand every timer that expired to
+    // |callback|, in order of expiry. Timers expiring in the same millisecond
+    // come in no particular order.
+    void Advance(uint64_t now, const ExpiryCallback& callback);
+
+    // Return the time by which Advance() must next be called, or false if no
+    // timer is pending. This is exact for timers due within a second and
+    // otherwise the next time a level has to cascade.
+    bool GetNextWakeup(uint64_t* wakeup) const;
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return size_; }
+
+private:
+    enum {
+        kNumLevels = 4,
+        // The overflow list is tracked as one more level.
+        kOverflowLevel = kNumLevels,
+        // Words of the largest occupancy bitmap, that of the lowest level.
+        kOccupancyWords = 16,
+    };
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // Return the list head |timer| goes on, at its current distance from
+    // |now_|, and set |level| to the list's level.
+    Timer* SlotFor(uint64_t expires, uint8_t* level);
+
+    // Return the slot of |level| holding timers that expire at |expires|.
+    static size_t SlotIndex(size_t level, uint64_t expires);
+
+    // Link |timer| into the list it belongs on.
+    void Insert(Timer* timer);
+
+    // Move the timers of slot |slot| of |level| down into the lower levels.
+    void Cascade(size_t level, size_t slot);
+
+    // Take every timer off the list |head| and insert it again at its current
+    // distance from |now_|.
+    void Reinsert(Timer* head);
+
+    // Return the first time after |now_| at which a timer expires or a slot
+    // holding timers has to cascade, UINT64_MAX if there is none.
+    uint64_t GetNextEventTime() const;
+
+    // Return how many slots after |start| the first non-empty slot of |level|
+    // is, wrapping around. The level must not be empty.
+    size_t FindOccupiedSlot(size_t level, size_t start) const;
+
+    // First slot of each level; level i has kSlotsPerLevel[i] slots.
+    Timer* levels_[kNumLevels];
+    Timer overflow_;
+    // One bit per slot, set while the slot holds timers.
+    uint64_t occupancy_[kNumLevels][kOccupancyWords];
+    // Number of timers on each level, overflow included.
+    size_t level_counts_[kNumLevels + 1];
+    uint64_t now_;
+    size_t size_;
+};
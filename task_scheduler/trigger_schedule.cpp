@@ -0,0 +1,756 @@
+#include "trigger_schedule.h"
+
+#include <wctype.h>
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+
+namespace {
+
+const int64_t kSecondsPerMinute = 60;
+const int64_t kSecondsPerHour = 60 * 60;
+const int64_t kSecondsPerDay = 24 * 60 * 60;
+const int kMinutesPerDay = 24 * 60;
+
+// Triggers without a start in the schedule start on the day of the start
+// boundary TaskSchedulerV2 gives its fixed triggers, 2008-10-11.
+const int64_t kDefaultStartDay = 14163;
+
+// The Task Scheduler's limits on a task's triggers.
+const size_t kMaxTaskTriggers = 48;
+const int64_t kMinRepetitionInterval = kSecondsPerMinute;
+const int64_t kMaxRepetitionInterval = 31 * kSecondsPerDay;
+const int64_t kMaxDaysInterval = 365;
+
+// A cron expression is searched that far ahead for its next fire time. Every
+// satisfiable expression fires within 8 years, which covers the gap between
+// the leap years around a century.
+const int64_t kMaxYearsAhead = 8;
+
+const wchar_t* const kMonthNames[] = {
+    L"JAN", L"FEB", L"MAR", L"APR", L"MAY", L"JUN",
+    L"JUL", L"AUG", L"SEP", L"OCT", L"NOV", L"DEC",
+};
+
+const wchar_t* const kDayNames[] = {
+    L"SUN", L"MON", L"TUE", L"WED", L"THU", L"FRI", L"SAT",
+};
+
+const struct {
+    const wchar_t* name;
+    const wchar_t* expression;
+} kCronMacros[] = {
+    { L"@yearly", L"0 0 1 1 *" },
+    { L"@annually", L"0 0 1 1 *" },
+    { L"@monthly", L"0 0 1 * *" },
+    { L"@weekly", L"0 0 * * 0" },
+    { L"@daily", L"0 0 * * *" },
+    { L"@midnight", L"0 0 * * *" },
+    { L"@hourly", L"0 * * * *" },
+};
+
+int64_t FloorDiv(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    return quotient * divisor > value ? quotient - 1 : quotient;
+}
+
+// Days since 1970-01-01 of a date of the proleptic Gregorian calendar, after
+// Howard Hinnant's days_from_civil().
+int64_t DaysFromCivil(int64_t year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = FloorDiv(year, 400);
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+        day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+        year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+void CivilFromDays(int64_t days, int64_t* year, int* month, int* day) {
+    days += 719468;
+    int64_t era = FloorDiv(days, 146097);
+    int64_t day_of_era = days - era * 146097;
+    int64_t year_of_era = (day_of_era - day_of_era / 1460 +
+        day_of_era / 36524 - day_of_era / 146096) / 365;
+    int64_t day_of_year = day_of_era -
+        (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int64_t shifted_month = (5 * day_of_year + 2) / 153;
+    *day = static_cast<int>(day_of_year - (153 * shifted_month + 2) / 5 + 1);
+    *month = static_cast<int>(
+        shifted_month < 10 ? shifted_month + 3 : shifted_month - 9);
+    *year = year_of_era + era * 400 + (*month <= 2);
+}
+
+// Sunday is 0.
+int GetWeekday(int64_t days) {
+    // 1970-01-01 was a Thursday.
+    return static_cast<int>(days - FloorDiv(days + 4, 7) * 7 + 4);
+}
+
+bool IsLeapYear(int64_t year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int GetDaysInMonth(int64_t year, int month) {
+    static const int kDaysInMonth[] = {
+        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
+    };
+    return month == 2 && IsLeapYear(year) ? 29 : kDaysInMonth[month - 1];
+}
+
+// Return the index of the lowest bit set in |bits| at |first| or above, or
+// -1 if there is none.
+int FindNextBit(uint64_t bits, int first) {
+    if (first >= 64)
+        return -1;
+    bits &= ~0ULL << first;
+#if defined(_WIN32)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(bits)))
+        return static_cast<int>(index);
+    if (_BitScanForward(&index, static_cast<unsigned long>(bits >> 32)))
+        return static_cast<int>(index) + 32;
+    return -1;
+#else
+    return bits ? __builtin_ctzll(bits) : -1;
+#endif
+}
+
+bool IsDigit(wchar_t c) {
+    return c >= L'0' && c <= L'9';
+}
+
+bool IsSpace(wchar_t c) {
+    return c == L' ' || c == L'\t';
+}
+
+CStringW Trim(const wchar_t* begin, const wchar_t* end) {
+    while (begin < end && IsSpace(*begin))
+        ++begin;
+    while (end > begin && IsSpace(end[-1]))
+        --end;
+    return CStringW(begin, static_cast<int>(end - begin));
+}
+
+// Parse the digits at |*c| and advance past them.
+bool ParseNumber(const wchar_t** c, int64_t* value) {
+    const wchar_t* digits = *c;
+    int64_t result = 0;
+    for (; IsDigit(**c); ++*c) {
+        result = result * 10 + (**c - L'0');
+        if (result > INT32_MAX)
+            return false;
+    }
+    *value = result;
+    return *c != digits;
+}
+
+// Parse exactly |count| digits at |*c| and advance past them.
+bool ParseFixedNumber(const wchar_t** c, size_t count, int* value) {
+    int result = 0;
+    for (size_t i = 0; i < count; ++i, ++*c) {
+        if (!IsDigit(**c))
+            return false;
+        result = result * 10 + (**c - L'0');
+    }
+    *value = result;
+    return true;
+}
+
+// Parse a value of a cron field at |*c|: a number, or one of |names|, which
+// stand for the values from |first_name_value| on.
+bool ParseCronValue(const wchar_t** c, const wchar_t* const* names,
+    size_t num_names, int first_name_value, int* value) {
+    int64_t number = 0;
+    if (ParseNumber(c, &number)) {
+        *value = static_cast<int>(number);
+        return true;
+    }
+    for (size_t i = 0; i < num_names; ++i) {
+        const wchar_t* name = names[i];
+        size_t length = 0;
+        while (name[length] &&
+            ::towupper((*c)[length]) == static_cast<wint_t>(name[length])) {
+            ++length;
+        }
+        if (!name[length]) {
+            *c += length;
+            *value = first_name_value + static_cast<int>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parse the cron field |text| of values from |min| to |max| into |bits|.
+// |any| is set if the field is a bare '*', which is what makes a day field
+// unrestricted: "*/2" restricts it to every other day.
+bool ParseCronField(const CStringW& text, int min, int max,
+    const wchar_t* const* names, size_t num_names, int first_name_value,
+    uint64_t* bits, bool* any) {
+    uint64_t result = 0;
+    const wchar_t* c = text;
+    *any = text == L"*";
+    for (;;) {
+        int low = min;
+        int high = max;
+        bool is_range = true;
+        if (*c == L'*') {
+            ++c;
+        } else {
+            if (!ParseCronValue(&c, names, num_names, first_name_value, &low))
+                return false;
+            high = low;
+            is_range = false;
+            if (*c == L'-') {
+                ++c;
+                if (!ParseCronValue(&c, names, num_names, first_name_value,
+                        &high)) {
+                    return false;
+                }
+                is_range = true;
+            }
+        }
+        int64_t step = 1;
+        if (*c == L'/') {
+            ++c;
+            // A larger step than the field has values would only ever
+            // select the first one.
+            if (!ParseNumber(&c, &step) || step < 1 || step > max - min + 1)
+                return false;
+            // "a/n" runs from a to the end, as with cron.
+            if (!is_range)
+                high = max;
+        }
+        if (low < min || high > max || low > high)
+            return false;
+        for (int value = low; value <= high; value += static_cast<int>(step))
+            result |= 1ULL << value;
+
+        if (!*c)
+            break;
+        if (*c++ != L',')
+            return false;
+    }
+    *bits = result;
+    return true;
+}
+
+// The bits from |first| to |last|.
+uint32_t GetBitRange(int first, int last) {
+    return static_cast<uint32_t>(((2ULL << last) - 1) & ~((1ULL << first) - 1));
+}
+
+}  // namespace
+
+TriggerSchedule::TriggerSchedule()
+{
+    std::fill(days_by_first_weekday_, days_by_first_weekday_ + 7, 0);
+}
+
+bool TriggerSchedule::Parse(const wchar_t* text)
+{
+    TriggerSchedule schedule;
+    const wchar_t* end = text;
+    while (*end && *end != L';')
+        ++end;
+    CStringW expression = Trim(text, end);
+    for (const auto& macro : kCronMacros) {
+        if (expression.CompareNoCase(macro.name) == 0) {
+            expression = macro.expression;
+            break;
+        }
+    }
+
+    bool parsed = false;
+    if (!expression.IsEmpty() && expression[0] == L'R' &&
+        (expression.GetLength() < 2 || !::iswalpha(expression[1]))) {
+        parsed = schedule.ParseInterval(expression);
+    } else {
+        parsed = schedule.ParseCron(expression);
+    }
+    if (!parsed)
+        return false;
+
+    while (*end) {
+        const wchar_t* option = end + 1;
+        end = option;
+        while (*end && *end != L';')
+            ++end;
+        if (!schedule.ParseOption(Trim(option, end)))
+            return false;
+    }
+    if (schedule.start_ && schedule.end_ && schedule.end_ <= schedule.start_)
+        return false;
+
+    *this = schedule;
+    return true;
+}
+
+bool TriggerSchedule::GetNextFireTime(int64_t after, int64_t* next) const
+{
+    if (start_ && after < start_)
+        after = start_ - 1;
+    int64_t fire_time = 0;
+    bool found = kind_ == KIND_CRON ? GetNextCronTime(after, &fire_time) :
+        GetNextIntervalTime(after, &fire_time);
+    if (!found || (end_ && fire_time > end_))
+        return false;
+    *next = fire_time;
+    return true;
+}
+
+bool TriggerSchedule::GetTaskTriggers(
+    std::vector<ScheduleTrigger>* triggers) const
+{
+    ScheduleTrigger common = {};
+    if (end_)
+        common.end_boundary = FormatIsoTime(end_);
+    if (random_delay_)
+        common.random_delay = FormatIsoDuration(random_delay_);
+    common.days_interval = 1;
+
+    std::vector<ScheduleTrigger> triggers_storage;
+    if (kind_ == KIND_CRON) {
+        GetCronTaskTriggers(common, &triggers_storage);
+    } else if (!GetIntervalTaskTriggers(common, &triggers_storage)) {
+        return false;
+    }
+    if (triggers_storage.empty() ||
+        triggers_storage.size() > kMaxTaskTriggers) {
+        return false;
+    }
+    triggers->swap(triggers_storage);
+    return true;
+}
+
+bool TriggerSchedule::ParseOption(const CStringW& option)
+{
+    int separator = option.Find(L'=');
+    if (separator < 0)
+        return false;
+    CStringW name = Trim(option, option.GetString() + separator);
+    CStringW value = Trim(option.GetString() + separator + 1,
+        option.GetString() + option.GetLength());
+    if (name == L"start")
+        return ParseIsoTime(value, &start_);
+    if (name == L"end")
+        return ParseIsoTime(value, &end_);
+    if (name == L"random_delay")
+        return ParseIsoDuration(value, &random_delay_);
+    return false;
+}
+
+bool TriggerSchedule::ParseCron(const CStringW& expression)
+{
+    CStringW fields[5];
+    const wchar_t* c = expression;
+    for (CStringW& field : fields) {
+        while (IsSpace(*c))
+            ++c;
+        const wchar_t* begin = c;
+        while (*c && !IsSpace(*c))
+            ++c;
+        if (c == begin)
+            return false;
+        field = CStringW(begin, static_cast<int>(c - begin));
+    }
+    while (IsSpace(*c))
+        ++c;
+    if (*c)
+        return false;
+
+    uint64_t minutes = 0;
+    uint64_t hours = 0;
+    uint64_t days_of_month = 0;
+    uint64_t months = 0;
+    uint64_t days_of_week = 0;
+    bool any = false;
+    if (!ParseCronField(fields[0], 0, 59, nullptr, 0, 0, &minutes, &any) ||
+        !ParseCronField(fields[1], 0, 23, nullptr, 0, 0, &hours, &any) ||
+        !ParseCronField(fields[2], 1, 31, nullptr, 0, 0, &days_of_month,
+            &any_day_of_month_) ||
+        !ParseCronField(fields[3], 1, 12, kMonthNames, _countof(kMonthNames),
+            1, &months, &any) ||
+        !ParseCronField(fields[4], 0, 7, kDayNames, _countof(kDayNames), 0,
+            &days_of_week, &any_day_of_week_)) {
+        return false;
+    }
+    // Sunday is both 0 and 7.
+    if (days_of_week & (1 << 7))
+        days_of_week = (days_of_week | 1) & ~(1ULL << 7);
+
+    kind_ = KIND_CRON;
+    minutes_ = minutes;
+    hours_ = static_cast<uint32_t>(hours);
+    days_of_month_ = static_cast<uint32_t>(days_of_month);
+    months_ = static_cast<uint32_t>(months);
+    days_of_week_ = static_cast<uint32_t>(days_of_week);
+    for (int first_weekday = 0; first_weekday < 7; ++first_weekday) {
+        uint32_t days = 0;
+        for (int day = 1; day <= 31; ++day) {
+            if (days_of_week_ & (1 << ((first_weekday + day - 1) % 7)))
+                days |= 1 << day;
+        }
+        days_by_first_weekday_[first_weekday] = days;
+    }
+    return true;
+}
+
+bool TriggerSchedule::ParseInterval(const CStringW& expression)
+{
+    const wchar_t* c = expression;
+    if (*c++ != L'R')
+        return false;
+    int64_t count = 0;
+    if (IsDigit(*c) && (!ParseNumber(&c, &count) || count < 1))
+        return false;
+    if (*c++ != L'/')
+        return false;
+    const wchar_t* separator = wcschr(c, L'/');
+    if (!separator)
+        return false;
+    int64_t interval_start = 0;
+    int64_t period = 0;
+    if (!ParseIsoTime(CStringW(c, static_cast<int>(separator - c)),
+            &interval_start) ||
+        !ParseIsoDuration(separator + 1, &period) || period < 1) {
+        return false;
+    }
+
+    kind_ = KIND_INTERVAL;
+    interval_start_ = interval_start;
+    period_ = period;
+    count_ = static_cast<uint64_t>(count);
+    return true;
+}
+
+bool TriggerSchedule::GetNextCronTime(int64_t after, int64_t* next) const
+{
+    // Cron fires on whole minutes.
+    int64_t minute = FloorDiv(after, kSecondsPerMinute) + 1;
+    int64_t days = FloorDiv(minute, kMinutesPerDay);
+    int minute_of_day = static_cast<int>(minute - days * kMinutesPerDay);
+    int64_t year = 0;
+    int month = 0;
+    int day = 0;
+    CivilFromDays(days, &year, &month, &day);
+    int hour = minute_of_day / 60;
+    int minute_of_hour = minute_of_day % 60;
+
+    // Move to the next value of a field when the ones below it have none
+    // left, resetting them.
+    int64_t last_year = year + kMaxYearsAhead;
+    while (year <= last_year) {
+        int next_month = FindNextBit(months_, month);
+        if (next_month < 0) {
+            ++year;
+            month = 1;
+            day = 1;
+            hour = 0;
+            minute_of_hour = 0;
+            continue;
+        }
+        if (next_month != month) {
+            month = next_month;
+            day = 1;
+            hour = 0;
+            minute_of_hour = 0;
+        }
+
+        int next_day = FindNextBit(GetFiringDays(year, month), day);
+        if (next_day < 0) {
+            ++month;
+            day = 1;
+            hour = 0;
+            minute_of_hour = 0;
+            continue;
+        }
+        if (next_day != day) {
+            day = next_day;
+            hour = 0;
+            minute_of_hour = 0;
+        }
+
+        int next_hour = FindNextBit(hours_, hour);
+        if (next_hour < 0) {
+            ++day;
+            hour = 0;
+            minute_of_hour = 0;
+            continue;
+        }
+        if (next_hour != hour) {
+            hour = next_hour;
+            minute_of_hour = 0;
+        }
+
+        int next_minute = FindNextBit(minutes_, minute_of_hour);
+        if (next_minute < 0) {
+            ++hour;
+            minute_of_hour = 0;
+            continue;
+        }
+
+        *next = DaysFromCivil(year, month, day) * kSecondsPerDay +
+            hour * kSecondsPerHour + next_minute * kSecondsPerMinute;
+        return true;
+    }
+    return false;
+}
+
+bool TriggerSchedule::GetNextIntervalTime(int64_t after, int64_t* next) const
+{
+    int64_t repetition = after < interval_start_ ? 0 :
+        FloorDiv(after - interval_start_, period_) + 1;
+    if (count_ && static_cast<uint64_t>(repetition) >= count_)
+        return false;
+    *next = interval_start_ + repetition * period_;
+    return true;
+}
+
+uint32_t TriggerSchedule::GetFiringDays(int64_t year, int month) const
+{
+    uint32_t days_in_month = GetBitRange(1, GetDaysInMonth(year, month));
+    uint32_t by_weekday =
+        days_by_first_weekday_[GetWeekday(DaysFromCivil(year, month, 1))];
+    // Either field matches when both are restricted, otherwise the
+    // unrestricted one matches every day.
+    uint32_t days = any_day_of_month_ || any_day_of_week_ ?
+        days_of_month_ & by_weekday : days_of_month_ | by_weekday;
+    return days & days_in_month;
+}
+
+void TriggerSchedule::GetCronTaskTriggers(const ScheduleTrigger& common,
+    std::vector<ScheduleTrigger>* triggers) const
+{
+    // The days, as one trigger each since the two day fields are alternatives
+    // when both are restricted.
+    std::vector<ScheduleTrigger> day_triggers;
+    short days_of_week = static_cast<short>(days_of_week_);
+    short months_of_year = static_cast<short>(months_ >> 1);
+    bool every_month = months_ == GetBitRange(1, 12);
+    if (any_day_of_month_ && any_day_of_week_) {
+        ScheduleTrigger trigger = common;
+        if (every_month) {
+            trigger.type = ScheduleTrigger::TYPE_DAILY;
+        } else {
+            trigger.type = ScheduleTrigger::TYPE_MONTHLY;
+            trigger.days_of_month = static_cast<long>(GetBitRange(0, 30));
+            trigger.months_of_year = months_of_year;
+        }
+        day_triggers.push_back(trigger);
+    }
+    if (!any_day_of_month_) {
+        ScheduleTrigger trigger = common;
+        trigger.type = ScheduleTrigger::TYPE_MONTHLY;
+        trigger.days_of_month = static_cast<long>(days_of_month_ >> 1);
+        trigger.months_of_year = months_of_year;
+        day_triggers.push_back(trigger);
+    }
+    if (!any_day_of_week_) {
+        ScheduleTrigger trigger = common;
+        trigger.type = every_month ? ScheduleTrigger::TYPE_WEEKLY :
+            ScheduleTrigger::TYPE_MONTHLY_DAY_OF_WEEK;
+        trigger.days_of_week = days_of_week;
+        trigger.months_of_year = months_of_year;
+        day_triggers.push_back(trigger);
+    }
+
+    // The times of day, in minutes.
+    std::vector<int> times;
+    for (int hour = FindNextBit(hours_, 0); hour >= 0;
+        hour = FindNextBit(hours_, hour + 1)) {
+        for (int minute = FindNextBit(minutes_, 0); minute >= 0;
+            minute = FindNextBit(minutes_, minute + 1)) {
+            times.push_back(hour * 60 + minute);
+        }
+    }
+    // Times at a fixed interval are one trigger repeating at it.
+    int interval = times.size() > 1 ? times[1] - times[0] : 0;
+    for (size_t i = 2; interval && i < times.size(); ++i) {
+        if (times[i] - times[i - 1] != interval)
+            interval = 0;
+    }
+
+    int64_t start_day = start_ ? FloorDiv(start_, kSecondsPerDay) :
+        kDefaultStartDay;
+    for (const ScheduleTrigger& day_trigger : day_triggers) {
+        for (int time : times) {
+            ScheduleTrigger trigger = day_trigger;
+            int64_t start = start_day * kSecondsPerDay +
+                time * kSecondsPerMinute;
+            if (start_ && start < start_)
+                start += kSecondsPerDay;
+            trigger.start_boundary = FormatIsoTime(start);
+            if (interval) {
+                // Up to the last time, with the end half an interval past it
+                // so that it falls clearly in or out.
+                trigger.repetition_interval =
+                    FormatIsoDuration(interval * kSecondsPerMinute);
+                trigger.repetition_duration = FormatIsoDuration(
+                    (times.back() - times.front()) * kSecondsPerMinute +
+                    interval * kSecondsPerMinute / 2);
+                triggers->push_back(trigger);
+                break;
+            }
+            triggers->push_back(trigger);
+        }
+    }
+}
+
+bool TriggerSchedule::GetIntervalTaskTriggers(const ScheduleTrigger& common,
+    std::vector<ScheduleTrigger>* triggers) const
+{
+    // The first repetition within the window.
+    int64_t first = interval_start_;
+    uint64_t count = count_;
+    if (start_ && first < start_) {
+        int64_t skipped = (start_ - first + period_ - 1) / period_;
+        if (count && static_cast<uint64_t>(skipped) >= count)
+            return false;
+        first += skipped * period_;
+        if (count)
+            count -= skipped;
+    }
+
+    ScheduleTrigger trigger = common;
+    trigger.start_boundary = FormatIsoTime(first);
+    if (!count && period_ % kSecondsPerDay == 0 &&
+        period_ / kSecondsPerDay <= kMaxDaysInterval) {
+        trigger.type = ScheduleTrigger::TYPE_DAILY;
+        trigger.days_interval =
+            static_cast<short>(period_ / kSecondsPerDay);
+    } else {
+        if (period_ % kSecondsPerMinute != 0 ||
+            period_ < kMinRepetitionInterval ||
+            period_ > kMaxRepetitionInterval) {
+            return false;
+        }
+        trigger.type = ScheduleTrigger::TYPE_TIME;
+        if (count != 1) {
+            trigger.repetition_interval = FormatIsoDuration(period_);
+            if (count) {
+                trigger.repetition_duration = FormatIsoDuration(
+                    static_cast<int64_t>(count - 1) * period_ + period_ / 2);
+            }
+        }
+    }
+    triggers->push_back(trigger);
+    return true;
+}
+
+bool ParseIsoTime(const wchar_t* text, int64_t* time)
+{
+    const wchar_t* c = text;
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    if (!ParseFixedNumber(&c, 4, &year) || *c++ != L'-' ||
+        !ParseFixedNumber(&c, 2, &month) || *c++ != L'-' ||
+        !ParseFixedNumber(&c, 2, &day) || *c++ != L'T' ||
+        !ParseFixedNumber(&c, 2, &hour) || *c++ != L':' ||
+        !ParseFixedNumber(&c, 2, &minute)) {
+        return false;
+    }
+    if (*c == L':' && (++c, !ParseFixedNumber(&c, 2, &second)))
+        return false;
+    if (*c == L'Z')
+        ++c;
+    if (*c || month < 1 || month > 12 || day < 1 ||
+        day > GetDaysInMonth(year, month) || hour > 23 || minute > 59 ||
+        second > 59) {
+        return false;
+    }
+    *time = DaysFromCivil(year, month, day) * kSecondsPerDay +
+        hour * kSecondsPerHour + minute * kSecondsPerMinute + second;
+    return true;
+}
+
+CStringW FormatIsoTime(int64_t time)
+{
+    int64_t days = FloorDiv(time, kSecondsPerDay);
+    int seconds = static_cast<int>(time - days * kSecondsPerDay);
+    int64_t year = 0;
+    int month = 0;
+    int day = 0;
+    CivilFromDays(days, &year, &month, &day);
+    CStringW text;
+    text.Format(L"%04I64d-%02d-%02dT%02d:%02d:%02dZ", year, month, day,
+        seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return text;
+}
+
+bool ParseIsoDuration(const wchar_t* text, int64_t* seconds)
+{
+    const wchar_t* c = text;
+    if (*c++ != L'P')
+        return false;
+    int64_t total = 0;
+    bool in_time = false;
+    bool has_value = false;
+    while (*c) {
+        if (*c == L'T') {
+            if (in_time)
+                return false;
+            in_time = true;
+            ++c;
+            continue;
+        }
+        int64_t value = 0;
+        if (!ParseNumber(&c, &value))
+            return false;
+        int64_t unit = 0;
+        switch (*c++) {
+        case L'W':
+            unit = in_time ? 0 : 7 * kSecondsPerDay;
+            break;
+        case L'D':
+            unit = in_time ? 0 : kSecondsPerDay;
+            break;
+        case L'H':
+            unit = in_time ? kSecondsPerHour : 0;
+            break;
+        case L'M':
+            unit = in_time ? kSecondsPerMinute : 0;
+            break;
+        case L'S':
+            unit = in_time ? 1 : 0;
+            break;
+        }
+        if (!unit)
+            return false;
+        total += value * unit;
+        has_value = true;
+    }
+    if (!has_value)
+        return false;
+    *seconds = total;
+    return true;
+}
+
+CStringW FormatIsoDuration(int64_t seconds)
+{
+    if (seconds <= 0)
+        return CStringW(L"PT0S");
+    int64_t days = seconds / kSecondsPerDay;
+    int64_t rest = seconds % kSecondsPerDay;
+    CStringW text(L"P");
+    if (days)
+        text.AppendFormat(L"%I64dD", days);
+    if (rest) {
+        text += L"T";
+        if (rest / kSecondsPerHour)
+            text.AppendFormat(L"%I64dH", rest / kSecondsPerHour);
+        if (rest / kSecondsPerMinute % 60)
+            text.AppendFormat(L"%I64dM", rest / kSecondsPerMinute % 60);
+        if (rest % 60)
+            text.AppendFormat(L"%I64dS", rest % 60);
+    }
+    return text;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "task_scheduler_platform.h"
+
+// One trigger of the Task Scheduler, in the terms of its API, that a
+// TriggerSchedule maps to. Empty strings are values left unset.
+struct ScheduleTrigger {
+    enum Type {
+        // Fires once at the start boundary, and then on the repetition
+        // pattern if any.
+        TYPE_TIME = 0,
+        // Fires every |days_interval| days.
+        TYPE_DAILY,
+        // Fires every week on |days_of_week|.
+        TYPE_WEEKLY,
+        // Fires on |days_of_month| of |months_of_year|.
+        TYPE_MONTHLY,
+        // Fires on |days_of_week| of every week of |months_of_year|.
+        TYPE_MONTHLY_DAY_OF_WEEK,
+    };
+
+    Type type;
+    // ISO 8601 times, which also give the time of day calendar triggers fire
+    // at.
+    CStringW start_boundary;
+    CStringW end_boundary;
+    // ISO 8601 durations. An interval without a duration repeats
+    // indefinitely.
+    CStringW repetition_interval;
+    CStringW repetition_duration;
+    CStringW random_delay;
+    short days_interval;
+    // Bit 0 is Sunday.
+    short days_of_week;
+    // Bit 0 is the 1st.
+    long days_of_month;
+    // Bit 0 is January.
+    short months_of_year;
+};
+
+// When a task registered with TRIGGER_TYPE_SCHEDULE fires: a cron expression
+// or an ISO 8601 repeating interval, optionally limited to a window and
+// delayed by a random amount. Its text form, kept in TaskSpec::schedule, is
+// the expression followed by options separated by ';':
+//
+//   0 */6 * * MON-FRI;start=2026-01-01T00:00:00Z;random_delay=PT10M
+//   R/2026-01-01T00:00:00Z/PT6H;end=2027-01-01T00:00:00Z
+//
+// Cron expressions have the five fields minute, hour, day of month, month
+// and day of week. Each is '*' or a list of values and ranges, either with a
+// step ("0-30/10", "*/5"). Months and days of the week may also be given by
+// their English abbreviations, and Sunday as 0 or 7. As with cron, when both
+// day fields are restricted a day matching either one fires. A day field is
+// restricted by anything but a bare '*', "*/2" included. Steps can't be
+// larger than the number of values of their field. The @hourly, @daily,
+// @weekly, @monthly and @yearly macros stand for their usual expressions.
+// Repeating intervals are "R[<count>]/<start>/<period>", the period in
+// weeks, days, hours, minutes and seconds. All times are UTC.
+//
+// A cron expression is compiled into bitsets of the minutes, hours, days and
+// months it fires in, with the days of the week folded into days of the
+// month for each weekday a month can start on. Finding the next fire time
+// then takes a few bit scans per field rather than stepping through time.
+class TriggerSchedule
+{
+public:
+    enum Kind {
+        KIND_CRON = 0,
+        KIND_INTERVAL,
+    };
+
+    TriggerSchedule();
+
+    // Compile |text|. Return false if it isn't a valid schedule, in which
+    // case the schedule is left unmodified.
+    bool Parse(const wchar_t* text);
+
+    // Return in |next| the first time after |after| at which the schedule
+    // fires, before the random delay, both in seconds since
+    // 1970-01-01T00:00:00Z. Return false if it never fires again.
+    bool GetNextFireTime(int64_t after, int64_t* next) const;
+
+    // Return in |triggers| the Task Scheduler triggers that fire on the same
+    // times. Return false if there are none, for example for periods the
+    // Task Scheduler can't repeat at or for more than the triggers a task
+    // can have.
+    bool GetTaskTriggers(std::vector<ScheduleTrigger>* triggers) const;
+
+    Kind kind() const { return kind_; }
+    // The window, 0 for none.
+    int64_t start() const { return start_; }
+    int64_t end() const { return end_; }
+    // The most a fire time is delayed by, in seconds.
+    int64_t random_delay() const { return random_delay_; }
+
+private:
+    bool ParseOption(const CStringW& option);
+    bool ParseCron(const CStringW& expression);
+    bool ParseInterval(const CStringW& expression);
+    bool GetNextCronTime(int64_t after, int64_t* next) const;
+    bool GetNextIntervalTime(int64_t after, int64_t* next) const;
+    // Return the days of |month| of |year| that fire, bit 1 being the 1st.
+    uint32_t GetFiringDays(int64_t year, int month) const;
+    void GetCronTaskTriggers(const ScheduleTrigger& common,
+        std::vector<ScheduleTrigger>* triggers) const;
+    bool GetIntervalTaskTriggers(const ScheduleTrigger& common,
+        std::vector<ScheduleTrigger>* triggers) const;
+
+    Kind kind_ = KIND_CRON;
+    int64_t start_ = 0;
+    int64_t end_ = 0;
+    int64_t random_delay_ = 0;
+
+    // Cron expressions, bit |i| standing for the value |i|.
+    uint64_t minutes_ = 0;
+    uint32_t hours_ = 0;
+    uint32_t days_of_month_ = 0;
+    uint32_t months_ = 0;
+    uint32_t days_of_week_ = 0;
+    bool any_day_of_month_ = true;
+    bool any_day_of_week_ = true;
+    // The days of a month that fall on |days_of_week_| when the 1st is the
+    // weekday |i|, Sunday being 0.
+    uint32_t days_by_first_weekday_[7];
+
+    // Repeating intervals.
+    int64_t interval_start_ = 0;
+    int64_t period_ = 0;
+    // The number of repetitions, 0 for no limit.
+    uint64_t count_ = 0;
+};
+
+// Parse an ISO 8601 UTC time, "2026-01-01T00:00:00Z", into seconds since
+// 1970-01-01T00:00:00Z. The seconds and the 'Z' are optional.
+bool ParseIsoTime(const wchar_t* text, int64_t* time);
+CStringW FormatIsoTime(int64_t time);
+
+// Parse an ISO 8601 duration made of weeks, days, hours, minutes and seconds
+// into seconds. Years and months, whose length varies, aren't supported.
+bool ParseIsoDuration(const wchar_t* text, int64_t* seconds);
+CStringW FormatIsoDuration(int64_t seconds);
@@ -0,0 +1,179 @@
+#include "work_stealing_executor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+
+// The executor and worker the current thread belongs to, if any, so that
+// closures posted from a worker stay on its own deque.
+thread_local const WorkStealingExecutor* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+WorkStealingExecutor::Worker::Worker()
+    : executed(0), steals(0), max_queue_depth(0), idle_ns(0)
+{
+
+}
+
+WorkStealingExecutor::WorkStealingExecutor(size_t num_workers)
+    : pending_(0), next_worker_(0)
+{
+    if (!num_workers)
+        num_workers = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < num_workers; ++i)
+        workers_.emplace_back(new Worker());
+    for (size_t i = 0; i < num_workers; ++i)
+        workers_[i]->thread = std::thread(&WorkStealingExecutor::Run, this, i);
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+        worker->thread.join();
+}
+
+void WorkStealingExecutor::Post(Closure closure)
+{
+    size_t index = current_executor == this ?
+        current_worker : next_worker_++ % workers_.size();
+    Push(workers_[index].get(), &closure);
+    Signal(1);
+}
+
+void WorkStealingExecutor::PostBatch(std::vector<Closure>* closures)
+{
+    size_t count = closures->size();
+    if (!count)
+        return;
+
+    // Hand each worker a contiguous share under a single lock.
+    size_t num_workers = workers_.size();
+    size_t first_worker = next_worker_.fetch_add(1) % num_workers;
+    size_t begin = 0;
+    for (size_t i = 0; i < num_workers && begin < count; ++i) {
+        size_t end = begin + (count - begin) / (num_workers - i);
+        if (end == begin)
+            end = begin + 1;
+        Worker* worker = workers_[(first_worker + i) % num_workers].get();
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            for (size_t j = begin; j < end; ++j)
+                worker->closures.push_back(std::move((*closures)[j]));
+            pending_ += end - begin;
+            uint64_t depth = worker->closures.size();
+            if (depth > worker->max_queue_depth)
+                worker->max_queue_depth = depth;
+        }
+        begin = end;
+    }
+    closures->clear();
+    Signal(count);
+}
+
+WorkStealingExecutor::Stats WorkStealingExecutor::GetStats() const
+{
+    Stats stats = {};
+    for (const auto& worker : workers_) {
+        stats.executed += worker->executed;
+        stats.steals += worker->steals;
+        stats.max_queue_depth =
+            std::max<uint64_t>(stats.max_queue_depth, worker->max_queue_depth);
+        stats.idle_ns += worker->idle_ns;
+    }
+    stats.queue_depth = pending_;
+    return stats;
+}
+
+void WorkStealingExecutor::Push(Worker* worker, Closure* closure)
+{
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->closures.push_back(std::move(*closure));
+    // Counted under the worker's lock so that whoever takes the closure can't
+    // decrement the count before it was incremented.
+    ++pending_;
+    uint64_t depth = worker->closures.size();
+    if (depth > worker->max_queue_depth)
+        worker->max_queue_depth = depth;
+}
+
+void WorkStealingExecutor::Signal(size_t count)
+{
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    if (count >= num_sleeping_) {
+        wake_.notify_all();
+        return;
+    }
+    for (size_t i = 0; i < count; ++i)
+        wake_.notify_one();
+}
+
+bool WorkStealingExecutor::Take(size_t index, Closure* closure)
+{
+    Worker* own = workers_[index].get();
+    {
+        std::lock_guard<std::mutex> lock(own->mutex);
+        if (!own->closures.empty()) {
+            *closure = std::move(own->closures.back());
+            own->closures.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+
+    // Start with the next worker so that thieves don't all pile onto the
+    // first one.
+    size_t num_workers = workers_.size();
+    for (size_t i = 1; i < num_workers; ++i) {
+        Worker* victim = workers_[(index + i) % num_workers].get();
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->closures.empty()) {
+            *closure = std::move(victim->closures.front());
+            victim->closures.pop_front();
+            --pending_;
+            ++own->steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingExecutor::Run(size_t index)
+{
+    current_executor = this;
+    current_worker = index;
+    Worker* worker = workers_[index].get();
+
+    Closure closure;
+    for (;;) {
+        if (Take(index, &closure)) {
+            closure();
+            closure = nullptr;
+            ++worker->executed;
+            continue;
+        }
+
+        std::chrono::steady_clock::time_point idle_start =
+            std::chrono::steady_clock::now();
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            ++num_sleeping_;
+            wake_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+            --num_sleeping_;
+            stop = stopping_ && !pending_;
+        }
+        worker->idle_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - idle_start).count();
+        if (stop)
+            return;
+    }
+}
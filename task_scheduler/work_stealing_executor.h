@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs closures on a fixed set of worker threads, each with its own deque.
+// A worker takes its newest closure first and, when its deque runs dry,
+// steals the oldest closure of another worker, so a burst of work posted at
+// once spreads over all workers without a shared queue to contend on.
+class WorkStealingExecutor
+{
+public:
+    typedef std::function<void()> Closure;
+
+    struct Stats {
+        // Closures run so far.
+        uint64_t executed;
+        // Closures taken from another worker's deque.
+        uint64_t steals;
+        // Closures posted but not started yet.
+        uint64_t queue_depth;
+        // Largest number of closures seen waiting on a single worker.
+        uint64_t max_queue_depth;
+        // Time the workers spent waiting for work, summed over all workers.
+        uint64_t idle_ns;
+    };
+
+    // Start |num_workers| threads, or one per core if 0.
+    explicit WorkStealingExecutor(size_t num_workers);
+
+    // Run every closure already posted, then stop the workers.
+    ~WorkStealingExecutor();
+
+    // Queue |closure|. From a worker thread it goes on that worker's own deque,
+    // otherwise the workers take turns.
+    void Post(Closure closure);
+
+    // Queue all of |closures| at once, spread evenly over the workers, and
+    // clear it.
+    void PostBatch(std::vector<Closure>* closures);
+
+    Stats GetStats() const;
+
+    size_t num_workers() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        Worker();
+
+        std::mutex mutex;
+        std::deque<Closure> closures;
+        std::thread thread;
+
+        std::atomic<uint64_t> executed;
+        std::atomic<uint64_t> steals;
+        std::atomic<uint64_t> max_queue_depth;
+        std::atomic<uint64_t> idle_ns;
+    };
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    // Push |closure| onto the deque of |worker|, without waking anyone.
+    void Push(Worker* worker, Closure* closure);
+
+    // Wake sleeping workers after |count| closures were pushed.
+    void Signal(size_t count);
+
+    // Take the newest closure of worker |index|, or steal the oldest closure
+    // of another worker. Return false if all deques are empty.
+    bool Take(size_t index, Closure* closure);
+
+    // Body of worker |index|.
+    void Run(size_t index);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // Closures posted but not yet taken, so that sleeping workers know when to
+    // wake up.
+    std::atomic<uint64_t> pending_;
+    // Next worker an outside Post() goes to.
+    std::atomic<size_t> next_worker_;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    size_t num_sleeping_ = 0;
+    bool stopping_ = false;
+};
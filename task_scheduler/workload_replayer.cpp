@@ -0,0 +1,187 @@
+#include "workload_replayer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// What a client measured about one call.
+struct CallSample {
+    WorkloadCall::Type type;
+    bool failed;
+    double latency_us;
+};
+
+double ToMicroseconds(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::duration<double,
+        std::micro>>(duration).count();
+}
+
+// Make |call| on |scheduler|. Return false if it reported an error.
+bool ReplayCall(const WorkloadCall& call, TaskScheduler* scheduler) {
+    switch (call.type) {
+    case WorkloadCall::CALL_DELETE_TASK:
+        return scheduler->DeleteTask(call.task_name);
+    case WorkloadCall::CALL_BEGIN_DELETE_TASK:
+        return scheduler->BeginDeleteTask(call.task_name, [](bool) {}) !=
+            TaskScheduler::DELETE_FAILED;
+    case WorkloadCall::CALL_IS_TASK_REGISTERED:
+        scheduler->IsTaskRegistered(call.task_name);
+        return true;
+    case WorkloadCall::CALL_SET_TASK_ENABLED:
+        return scheduler->SetTaskEnabled(call.task_name, call.enabled);
+    case WorkloadCall::CALL_IS_TASK_ENABLED:
+        scheduler->IsTaskEnabled(call.task_name);
+        return true;
+    case WorkloadCall::CALL_GET_TASK_INFO: {
+        TaskScheduler::TaskInfo info;
+        return scheduler->GetTaskInfo(call.task_name, &info);
+    }
+    case WorkloadCall::CALL_ENUMERATE_TASK_INFO:
+        return scheduler->EnumerateTaskInfo(
+            [](const TaskScheduler::TaskInfo&) { return true; });
+    case WorkloadCall::CALL_REGISTER_TASK: {
+        if (call.specs.empty())
+            return false;
+        const TaskScheduler::TaskSpec& spec = call.specs.front();
+        return scheduler->RegisterTask(spec.name, spec.description,
+            spec.application_path, spec.application_arguments,
+            spec.trigger_type, spec.hidden);
+    }
+    case WorkloadCall::CALL_REGISTER_TASKS: {
+        std::vector<TaskScheduler::RegisterResult> results;
+        return scheduler->RegisterTasks(call.specs, &results);
+    }
+    case WorkloadCall::CALL_GET_TASK_SUMMARIES: {
+        std::vector<TaskScheduler::TaskSummary> summaries;
+        return scheduler->GetTaskSummaries(&summaries);
+    }
+    case WorkloadCall::CALL_COMPUTE_FINGERPRINTS: {
+        std::vector<CStringW> fingerprints;
+        return scheduler->ComputeFingerprints(call.specs, &fingerprints);
+    }
+    case WorkloadCall::CALL_ENUMERATE_TASK_SPECS:
+        return scheduler->EnumerateTaskSpecs(
+            [](const TaskScheduler::TaskSpec&, bool) { return true; });
+    case WorkloadCall::CALL_LIST_TASKS:
+    case WorkloadCall::CALL_FIND_TASKS: {
+        std::vector<CStringW> names;
+        std::vector<bool> enabled;
+        if (call.type == WorkloadCall::CALL_LIST_TASKS) {
+            return scheduler->ListTasks(call.task_name, &names,
+                call.enabled ? &enabled : nullptr);
+        }
+        return scheduler->FindTasks(call.task_name, &names,
+            call.enabled ? &enabled : nullptr);
+    }
+    case WorkloadCall::CALL_OPEN_TASK: {
+        std::unique_ptr<TaskScheduler::TaskHandle> handle(
+            scheduler->OpenTask(call.task_name));
+        return handle != nullptr;
+    }
+    case WorkloadCall::CALL_GET_TASK_RUN_STATES: {
+        TaskScheduler::TaskRunStates states;
+        return scheduler->GetTaskRunStates(&states);
+    }
+    default:
+        return false;
+    }
+}
+
+// Fill |stats| from |latencies|, which get sorted.
+void ComputeStats(std::vector<double>* latencies, uint64_t failures,
+    ReplayReport::CallStats* stats) {
+    stats->count = latencies->size();
+    stats->failures = failures;
+    stats->p50_us = stats->p99_us = stats->p999_us = stats->max_us = 0;
+    if (latencies->empty())
+        return;
+
+    std::sort(latencies->begin(), latencies->end());
+    auto percentile = [latencies](double fraction) {
+        size_t rank = static_cast<size_t>(fraction * latencies->size());
+        return (*latencies)[std::min(rank, latencies->size() - 1)];
+    };
+    stats->p50_us = percentile(0.50);
+    stats->p99_us = percentile(0.99);
+    stats->p999_us = percentile(0.999);
+    stats->max_us = latencies->back();
+}
+
+}  // namespace
+
+void ReplayWorkload(const std::vector<WorkloadCall>& calls,
+    TaskScheduler* scheduler, double speed, size_t num_clients,
+    ReplayReport* report)
+{
+    num_clients = std::max<size_t>(1, num_clients);
+    std::atomic<size_t> next_call(0);
+    std::vector<std::vector<CallSample>> samples(num_clients);
+    std::vector<double> max_issue_delays_us(num_clients, 0);
+
+    Clock::time_point start = Clock::now();
+    auto run_client = [&](size_t client) {
+        HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        for (;;) {
+            size_t index = next_call.fetch_add(1);
+            if (index >= calls.size())
+                break;
+            const WorkloadCall& call = calls[index];
+
+            Clock::time_point due = Clock::now();
+            if (speed > 0) {
+                due = start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double, std::micro>(
+                        call.time_us / speed));
+                std::this_thread::sleep_until(due);
+            }
+            Clock::time_point issued = Clock::now();
+            bool succeeded = ReplayCall(call, scheduler);
+            Clock::time_point returned = Clock::now();
+
+            CallSample sample = { call.type, !succeeded,
+                ToMicroseconds(returned - due) };
+            samples[client].push_back(sample);
+            max_issue_delays_us[client] = std::max(
+                max_issue_delays_us[client], ToMicroseconds(issued - due));
+        }
+        if (SUCCEEDED(hr))
+            ::CoUninitialize();
+    };
+
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < num_clients; ++i)
+        clients.emplace_back(run_client, i);
+    for (std::thread& client : clients)
+        client.join();
+    double elapsed_seconds = ToMicroseconds(Clock::now() - start) / 1e6;
+
+    std::vector<double> latencies[WorkloadCall::CALL_TYPE_MAX];
+    uint64_t failures[WorkloadCall::CALL_TYPE_MAX] = {};
+    std::vector<double> all_latencies;
+    uint64_t all_failures = 0;
+    for (const std::vector<CallSample>& client_samples : samples) {
+        for (const CallSample& sample : client_samples) {
+            latencies[sample.type].push_back(sample.latency_us);
+            all_latencies.push_back(sample.latency_us);
+            if (sample.failed) {
+                ++failures[sample.type];
+                ++all_failures;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < WorkloadCall::CALL_TYPE_MAX; ++i)
+        ComputeStats(&latencies[i], failures[i], &report->calls[i]);
+    ComputeStats(&all_latencies, all_failures, &report->total);
+    report->elapsed_seconds = elapsed_seconds;
+    report->calls_per_second = elapsed_seconds > 0 ?
+        calls.size() / elapsed_seconds : 0;
+    report->max_issue_delay_us = *std::max_element(
+        max_issue_delays_us.begin(), max_issue_delays_us.end());
+}
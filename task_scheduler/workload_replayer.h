@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "task_scheduler.h"
+#include "workload_trace.h"
+
+// What ReplayWorkload() measured.
+struct ReplayReport {
+    struct CallStats {
+        uint64_t count;
+        // Calls that reported an error. IsTaskRegistered() and
+        // IsTaskEnabled() never do.
+        uint64_t failures;
+        // Latency percentiles, in microseconds.
+        double p50_us;
+        double p99_us;
+        double p999_us;
+        double max_us;
+    };
+
+    // Wall time from the start of the replay to the last call's return.
+    double elapsed_seconds;
+    double calls_per_second;
+    // The longest a call had to wait past the time it was due for a client
+    // to issue it. Large values mean the clients can't keep up with the
+    // trace at the requested speed.
+    double max_issue_delay_us;
+    CallStats total;
+    CallStats calls[WorkloadCall::CALL_TYPE_MAX];
+};
+
+// Play |calls| back against |scheduler| from |num_clients| threads and
+// measure how it holds up. Calls are issued in the order of the trace, each
+// by the first client that is free, at the time it was recorded divided by
+// |speed|: 1 replays in real time, 10 ten times as fast and 0 issues each
+// call as soon as a client is free. Up to |num_clients| calls are in flight
+// at a time.
+//
+// A call's latency is measured from the time it was due rather than from the
+// time it was issued, so that the clients falling behind shows in the tail
+// instead of being hidden. With a |speed| of 0 it is measured from the time
+// it was issued. |scheduler| is shared by all clients, which initialize COM
+// for the multithreaded apartment, and must be initialized.
+void ReplayWorkload(const std::vector<WorkloadCall>& calls,
+    TaskScheduler* scheduler, double speed, size_t num_clients,
+    ReplayReport* report);
@@ -0,0 +1,359 @@
+#include "workload_trace.h"
+
+#include <string.h>
+
+#include <utility>
+
+namespace {
+
+const char kTraceMagic[4] = { 'T', 'S', 'W', 'T' };
+const uint8_t kTraceVersion = 1;
+
+// Buffered bytes are written out once there are that many.
+const size_t kFlushThreshold = 64 * 1024;
+
+const char* const kCallNames[WorkloadCall::CALL_TYPE_MAX] = {
+    "DeleteTask",
+    "BeginDeleteTask",
+    "IsTaskRegistered",
+    "SetTaskEnabled",
+    "IsTaskEnabled",
+    "GetTaskInfo",
+    "EnumerateTaskInfo",
+    "RegisterTask",
+    "RegisterTasks",
+    "GetTaskSummaries",
+    "ComputeFingerprints",
+    "EnumerateTaskSpecs",
+    "ListTasks",
+    "FindTasks",
+    "OpenTask",
+    "GetTaskRunStates",
+};
+
+bool HasTaskName(WorkloadCall::Type type) {
+    switch (type) {
+    case WorkloadCall::CALL_DELETE_TASK:
+    case WorkloadCall::CALL_BEGIN_DELETE_TASK:
+    case WorkloadCall::CALL_IS_TASK_REGISTERED:
+    case WorkloadCall::CALL_SET_TASK_ENABLED:
+    case WorkloadCall::CALL_IS_TASK_ENABLED:
+    case WorkloadCall::CALL_GET_TASK_INFO:
+    case WorkloadCall::CALL_LIST_TASKS:
+    case WorkloadCall::CALL_FIND_TASKS:
+    case WorkloadCall::CALL_OPEN_TASK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool HasEnabled(WorkloadCall::Type type) {
+    return type == WorkloadCall::CALL_SET_TASK_ENABLED ||
+        type == WorkloadCall::CALL_LIST_TASKS ||
+        type == WorkloadCall::CALL_FIND_TASKS;
+}
+
+bool HasSpecs(WorkloadCall::Type type) {
+    return type == WorkloadCall::CALL_REGISTER_TASK ||
+        type == WorkloadCall::CALL_REGISTER_TASKS ||
+        type == WorkloadCall::CALL_COMPUTE_FINGERPRINTS;
+}
+
+// Parses a trace held in memory. Every read fails once the input turned out
+// to be truncated or corrupt.
+class TraceReader
+{
+public:
+    explicit TraceReader(const std::vector<uint8_t>& data)
+        : data_(data), position_(0), failed_(false) {}
+
+    bool at_end() const { return failed_ || position_ == data_.size(); }
+    bool failed() const { return failed_; }
+
+    bool ReadBytes(void* bytes, size_t count) {
+        if (failed_ || data_.size() - position_ < count)
+            return Fail();
+        memcpy(bytes, &data_[position_], count);
+        position_ += count;
+        return true;
+    }
+
+    bool ReadNumber(uint64_t* value) {
+        uint64_t result = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = 0;
+            if (!ReadBytes(&byte, 1))
+                return false;
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                *value = result;
+                return true;
+            }
+        }
+        return Fail();
+    }
+
+    bool ReadString(CStringW* value) {
+        uint64_t id = 0;
+        if (!ReadNumber(&id))
+            return false;
+        if (id) {
+            if (id > strings_.size())
+                return Fail();
+            *value = strings_[id - 1];
+            return true;
+        }
+
+        uint64_t length = 0;
+        if (!ReadNumber(&length) || length > (data_.size() - position_) / 2)
+            return Fail();
+        CStringW string;
+        wchar_t* characters = string.GetBuffer(static_cast<int>(length));
+        for (uint64_t i = 0; i < length; ++i) {
+            uint8_t bytes[2];
+            ReadBytes(bytes, sizeof(bytes));
+            characters[i] = static_cast<wchar_t>(bytes[0] | bytes[1] << 8);
+        }
+        string.ReleaseBuffer(static_cast<int>(length));
+        strings_.push_back(string);
+        *value = string;
+        return true;
+    }
+
+    bool ReadSpec(TaskScheduler::TaskSpec* spec) {
+        uint64_t trigger_type = 0;
+        uint64_t hidden = 0;
+        if (!ReadString(&spec->name) || !ReadString(&spec->description) ||
+            !ReadString(&spec->application_path) ||
+            !ReadString(&spec->application_arguments) ||
+            !ReadNumber(&trigger_type) || !ReadNumber(&hidden)) {
+            return false;
+        }
+        if (trigger_type >= TaskScheduler::TRIGGER_TYPE_MAX)
+            return Fail();
+        spec->trigger_type =
+            static_cast<TaskScheduler::TriggerType>(trigger_type);
+        spec->hidden = hidden != 0;
+        spec->schedule.Empty();
+        if (spec->trigger_type == TaskScheduler::TRIGGER_TYPE_SCHEDULE)
+            return ReadString(&spec->schedule);
+        return true;
+    }
+
+private:
+    bool Fail() {
+        failed_ = true;
+        return false;
+    }
+
+    const std::vector<uint8_t>& data_;
+    size_t position_;
+    bool failed_;
+    // The strings defined so far; id |i| is at |i - 1|.
+    std::vector<CStringW> strings_;
+};
+
+bool ReadCall(TraceReader* reader, uint64_t last_time_us, WorkloadCall* call) {
+    uint64_t type = 0;
+    uint64_t delta_us = 0;
+    if (!reader->ReadNumber(&type) || !reader->ReadNumber(&delta_us) ||
+        type >= WorkloadCall::CALL_TYPE_MAX) {
+        return false;
+    }
+    call->type = static_cast<WorkloadCall::Type>(type);
+    call->time_us = last_time_us + delta_us;
+    call->enabled = false;
+
+    if (HasTaskName(call->type) && !reader->ReadString(&call->task_name))
+        return false;
+    if (HasEnabled(call->type)) {
+        uint64_t enabled = 0;
+        if (!reader->ReadNumber(&enabled))
+            return false;
+        call->enabled = enabled != 0;
+    }
+    if (!HasSpecs(call->type))
+        return true;
+
+    uint64_t num_specs = 1;
+    if (call->type != WorkloadCall::CALL_REGISTER_TASK &&
+        !reader->ReadNumber(&num_specs)) {
+        return false;
+    }
+    call->specs.clear();
+    for (uint64_t i = 0; i < num_specs; ++i) {
+        TaskScheduler::TaskSpec spec;
+        if (!reader->ReadSpec(&spec))
+            return false;
+        call->specs.push_back(spec);
+    }
+    return true;
+}
+
+}  // namespace
+
+const char* GetWorkloadCallName(WorkloadCall::Type type)
+{
+    return type < WorkloadCall::CALL_TYPE_MAX ? kCallNames[type] : "Unknown";
+}
+
+WorkloadTraceWriter::WorkloadTraceWriter()
+{
+
+}
+
+WorkloadTraceWriter::~WorkloadTraceWriter()
+{
+    Close();
+}
+
+bool WorkloadTraceWriter::Open(const wchar_t* path)
+{
+    Close();
+    if (::_wfopen_s(&file_, path, L"wb") != 0) {
+        file_ = nullptr;
+        return false;
+    }
+    failed_ = false;
+    buffer_.clear();
+    last_time_us_ = 0;
+    strings_.clear();
+
+    buffer_.insert(buffer_.end(), kTraceMagic,
+        kTraceMagic + sizeof(kTraceMagic));
+    buffer_.push_back(kTraceVersion);
+    return true;
+}
+
+bool WorkloadTraceWriter::Append(const WorkloadCall& call)
+{
+    if (!file_ || failed_)
+        return false;
+
+    WriteNumber(call.type);
+    uint64_t time_us = call.time_us > last_time_us_ ? call.time_us :
+        last_time_us_;
+    WriteNumber(time_us - last_time_us_);
+    last_time_us_ = time_us;
+
+    if (HasTaskName(call.type))
+        WriteString(call.task_name);
+    if (HasEnabled(call.type))
+        WriteNumber(call.enabled ? 1 : 0);
+    if (call.type == WorkloadCall::CALL_REGISTER_TASK) {
+        WriteSpec(call.specs.empty() ? TaskScheduler::TaskSpec() :
+            call.specs.front());
+    } else if (HasSpecs(call.type)) {
+        WriteNumber(call.specs.size());
+        for (const TaskScheduler::TaskSpec& spec : call.specs)
+            WriteSpec(spec);
+    }
+
+    if (buffer_.size() >= kFlushThreshold)
+        return Flush();
+    return true;
+}
+
+bool WorkloadTraceWriter::Close()
+{
+    if (!file_)
+        return !failed_;
+    bool succeeded = Flush();
+    if (::fclose(file_) != 0)
+        succeeded = false;
+    file_ = nullptr;
+    return succeeded;
+}
+
+void WorkloadTraceWriter::WriteNumber(uint64_t value)
+{
+    while (value >= 0x80) {
+        buffer_.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer_.push_back(static_cast<uint8_t>(value));
+}
+
+void WorkloadTraceWriter::WriteString(const CStringW& value)
+{
+    std::wstring key(value.GetString(), value.GetLength());
+    std::unordered_map<std::wstring, uint64_t>::const_iterator it =
+        strings_.find(key);
+    if (it != strings_.end()) {
+        WriteNumber(it->second);
+        return;
+    }
+
+    uint64_t id = strings_.size() + 1;
+    strings_.insert(std::make_pair(key, id));
+    WriteNumber(0);
+    WriteNumber(key.size());
+    for (wchar_t c : key) {
+        buffer_.push_back(static_cast<uint8_t>(c));
+        buffer_.push_back(static_cast<uint8_t>(c >> 8));
+    }
+}
+
+void WorkloadTraceWriter::WriteSpec(const TaskScheduler::TaskSpec& spec)
+{
+    WriteString(spec.name);
+    WriteString(spec.description);
+    WriteString(spec.application_path);
+    WriteString(spec.application_arguments);
+    WriteNumber(spec.trigger_type);
+    WriteNumber(spec.hidden ? 1 : 0);
+    if (spec.trigger_type == TaskScheduler::TRIGGER_TYPE_SCHEDULE)
+        WriteString(spec.schedule);
+}
+
+bool WorkloadTraceWriter::Flush()
+{
+    if (failed_)
+        return false;
+    if (!buffer_.empty() &&
+        ::fwrite(&buffer_[0], 1, buffer_.size(), file_) != buffer_.size()) {
+        failed_ = true;
+    }
+    buffer_.clear();
+    return !failed_;
+}
+
+bool ReadWorkloadTrace(const wchar_t* path, std::vector<WorkloadCall>* calls)
+{
+    FILE* file = nullptr;
+    if (::_wfopen_s(&file, path, L"rb") != 0)
+        return false;
+    std::vector<uint8_t> data;
+    uint8_t chunk[64 * 1024];
+    size_t num_read = 0;
+    while ((num_read = ::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + num_read);
+    bool read_error = ::ferror(file) != 0;
+    ::fclose(file);
+    if (read_error)
+        return false;
+
+    TraceReader reader(data);
+    char magic[sizeof(kTraceMagic)];
+    uint8_t version = 0;
+    if (!reader.ReadBytes(magic, sizeof(magic)) ||
+        memcmp(magic, kTraceMagic, sizeof(magic)) != 0 ||
+        !reader.ReadBytes(&version, 1) || version != kTraceVersion) {
+        return false;
+    }
+
+    std::vector<WorkloadCall> calls_storage;
+    uint64_t last_time_us = 0;
+    while (!reader.at_end()) {
+        WorkloadCall call;
+        if (!ReadCall(&reader, last_time_us, &call))
+            return false;
+        last_time_us = call.time_us;
+        calls_storage.push_back(call);
+    }
+    if (reader.failed())
+        return false;
+    calls->swap(calls_storage);
+    return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "task_scheduler.h"
+
+// A call made to a TaskScheduler, as kept in a workload trace.
+struct WorkloadCall {
+    // The values are stored in traces: only ever add new ones at the end.
+    enum Type {
+        CALL_DELETE_TASK = 0,
+        CALL_BEGIN_DELETE_TASK,
+        CALL_IS_TASK_REGISTERED,
+        CALL_SET_TASK_ENABLED,
+        CALL_IS_TASK_ENABLED,
+        CALL_GET_TASK_INFO,
+        CALL_ENUMERATE_TASK_INFO,
+        CALL_REGISTER_TASK,
+        CALL_REGISTER_TASKS,
+        CALL_GET_TASK_SUMMARIES,
+        CALL_COMPUTE_FINGERPRINTS,
+        CALL_ENUMERATE_TASK_SPECS,
+        CALL_LIST_TASKS,
+        CALL_FIND_TASKS,
+        CALL_OPEN_TASK,
+        CALL_GET_TASK_RUN_STATES,
+        CALL_TYPE_MAX,
+    };
+
+    Type type;
+    // When the call was made, in microseconds since the recording started.
+    uint64_t time_us;
+    // The arguments, where the call has them. RegisterTask() is kept as a
+    // single spec. ListTasks() and FindTasks() keep their prefix or pattern
+    // in |task_name| and whether they were asked for enabled flags in
+    // |enabled|.
+    CStringW task_name;
+    bool enabled;
+    std::vector<TaskScheduler::TaskSpec> specs;
+};
+
+// Return the name of the TaskScheduler method |type| stands for.
+const char* GetWorkloadCallName(WorkloadCall::Type type);
+
+// Writes calls to a trace file. The format is compact so that long running
+// processes can be recorded: each call is its type, the time since the
+// previous call and its arguments, all as variable length integers, and each
+// distinct string is only written the first time it is used.
+class WorkloadTraceWriter
+{
+public:
+    WorkloadTraceWriter();
+    // Close() the trace.
+    ~WorkloadTraceWriter();
+
+    // Create the trace at |path|, replacing any existing file.
+    bool Open(const wchar_t* path);
+
+    // Add |call| to the trace. Calls must be appended in the order of their
+    // |time_us|. Return false if the trace couldn't be written, after which
+    // nothing more is.
+    bool Append(const WorkloadCall& call);
+
+    // Write out what is buffered and close the file. Return false if any
+    // write failed.
+    bool Close();
+
+private:
+    WorkloadTraceWriter(const WorkloadTraceWriter&) = delete;
+    WorkloadTraceWriter& operator=(const WorkloadTraceWriter&) = delete;
+
+    void WriteNumber(uint64_t value);
+    void WriteString(const CStringW& value);
+    void WriteSpec(const TaskScheduler::TaskSpec& spec);
+    bool Flush();
+
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+    std::vector<uint8_t> buffer_;
+    uint64_t last_time_us_ = 0;
+    // String -> its id in the trace, starting at 1.
+    std::unordered_map<std::wstring, uint64_t> strings_;
+};
+
+// Read the trace at |path| written by WorkloadTraceWriter. Return false if it
+// can't be read or is corrupt, in which case |calls| is left unmodified.
+bool ReadWorkloadTrace(const wchar_t* path, std::vector<WorkloadCall>* calls);
@@ -0,0 +1,176 @@
+#include "allocation_counter.h"
+
+#include <stdlib.h>
+#include <windows.h>
+#include <oleauto.h>
+
+#include <atomic>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocation_count(0);
+
+void CountAllocation() {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+decltype(&::HeapAlloc) original_heap_alloc = &::HeapAlloc;
+decltype(&::HeapReAlloc) original_heap_realloc = &::HeapReAlloc;
+decltype(&::SysAllocString) original_sys_alloc_string = &::SysAllocString;
+decltype(&::SysAllocStringLen) original_sys_alloc_string_len =
+    &::SysAllocStringLen;
+decltype(&::SysAllocStringByteLen) original_sys_alloc_string_byte_len =
+    &::SysAllocStringByteLen;
+decltype(&::SysReAllocString) original_sys_realloc_string =
+    &::SysReAllocString;
+decltype(&::SysReAllocStringLen) original_sys_realloc_string_len =
+    &::SysReAllocStringLen;
+
+LPVOID WINAPI CountingHeapAlloc(HANDLE heap, DWORD flags, SIZE_T size)
+{
+    CountAllocation();
+    return original_heap_alloc(heap, flags, size);
+}
+
+LPVOID WINAPI CountingHeapReAlloc(HANDLE heap, DWORD flags, LPVOID memory,
+    SIZE_T size)
+{
+    CountAllocation();
+    return original_heap_realloc(heap, flags, memory, size);
+}
+
+BSTR WINAPI CountingSysAllocString(const OLECHAR* text)
+{
+    CountAllocation();
+    return original_sys_alloc_string(text);
+}
+
+BSTR WINAPI CountingSysAllocStringLen(const OLECHAR* text, UINT length)
+{
+    CountAllocation();
+    return original_sys_alloc_string_len(text, length);
+}
+
+BSTR WINAPI CountingSysAllocStringByteLen(LPCSTR text, UINT length)
+{
+    CountAllocation();
+    return original_sys_alloc_string_byte_len(text, length);
+}
+
+INT WINAPI CountingSysReAllocString(BSTR* string, const OLECHAR* text)
+{
+    CountAllocation();
+    return original_sys_realloc_string(string, text);
+}
+
+INT WINAPI CountingSysReAllocStringLen(BSTR* string, const OLECHAR* text,
+    UINT length)
+{
+    CountAllocation();
+    return original_sys_realloc_string_len(string, text, length);
+}
+
+// Point every entry of the import address table of the executable that
+// refers to |function| at |hook| instead. Imports are matched by address,
+// which also covers those made by ordinal, as OLEAUT32's usually are.
+void HookImport(void* function, void* hook) {
+    BYTE* base = reinterpret_cast<BYTE*>(::GetModuleHandleW(nullptr));
+    IMAGE_DOS_HEADER* dos_header = reinterpret_cast<IMAGE_DOS_HEADER*>(base);
+    IMAGE_NT_HEADERS* nt_headers =
+        reinterpret_cast<IMAGE_NT_HEADERS*>(base + dos_header->e_lfanew);
+    const IMAGE_DATA_DIRECTORY& imports = nt_headers->OptionalHeader.
+        DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    if (!imports.VirtualAddress)
+        return;
+
+    IMAGE_IMPORT_DESCRIPTOR* descriptor =
+        reinterpret_cast<IMAGE_IMPORT_DESCRIPTOR*>(
+            base + imports.VirtualAddress);
+    for (; descriptor->Name; ++descriptor) {
+        IMAGE_THUNK_DATA* thunk =
+            reinterpret_cast<IMAGE_THUNK_DATA*>(base + descriptor->FirstThunk);
+        for (; thunk->u1.Function; ++thunk) {
+            if (thunk->u1.Function != reinterpret_cast<ULONG_PTR>(function))
+                continue;
+            DWORD protection;
+            if (!::VirtualProtect(&thunk->u1.Function,
+                sizeof(thunk->u1.Function), PAGE_READWRITE, &protection)) {
+                continue;
+            }
+            thunk->u1.Function = reinterpret_cast<ULONG_PTR>(hook);
+            ::VirtualProtect(&thunk->u1.Function, sizeof(thunk->u1.Function),
+                protection, &protection);
+        }
+    }
+}
+
+// Look |name| up in |module| and hook it. Keep the address in |original| for
+// the hook to call.
+template <typename Function>
+void HookFunction(const wchar_t* module, const char* name, Function hook,
+    Function* original) {
+    HMODULE handle = ::GetModuleHandleW(module);
+    if (!handle)
+        return;
+    Function function =
+        reinterpret_cast<Function>(::GetProcAddress(handle, name));
+    if (!function)
+        return;
+    *original = function;
+    HookImport(reinterpret_cast<void*>(function),
+        reinterpret_cast<void*>(hook));
+}
+
+// The CRT allocates from its own module, so hooking HeapAlloc() in the
+// executable doesn't count operator new twice.
+bool InstallHooks() {
+    HookFunction(L"kernel32.dll", "HeapAlloc", &CountingHeapAlloc,
+        &original_heap_alloc);
+    HookFunction(L"kernel32.dll", "HeapReAlloc", &CountingHeapReAlloc,
+        &original_heap_realloc);
+    HookFunction(L"oleaut32.dll", "SysAllocString", &CountingSysAllocString,
+        &original_sys_alloc_string);
+    HookFunction(L"oleaut32.dll", "SysAllocStringLen",
+        &CountingSysAllocStringLen, &original_sys_alloc_string_len);
+    HookFunction(L"oleaut32.dll", "SysAllocStringByteLen",
+        &CountingSysAllocStringByteLen, &original_sys_alloc_string_byte_len);
+    HookFunction(L"oleaut32.dll", "SysReAllocString",
+        &CountingSysReAllocString, &original_sys_realloc_string);
+    HookFunction(L"oleaut32.dll", "SysReAllocStringLen",
+        &CountingSysReAllocStringLen, &original_sys_realloc_string_len);
+    return true;
+}
+
+const bool hooks_installed = InstallHooks();
+
+}  // namespace
+
+uint64_t GetAllocationCount()
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+    CountAllocation();
+    void* memory = ::malloc(size ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    ::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    ::free(memory);
+}
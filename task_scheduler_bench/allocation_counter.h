@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// The benchmarks replace the global operator new and delete with versions
+// that count every allocation made through them, which covers the standard
+// containers and strings. The calls the benchmark executable makes to
+// HeapAlloc(), which the ATL string manager allocates with, and to the
+// SysAllocString() family are hooked and counted as well, reallocations
+// included. Allocations made inside other modules, such as the BSTRs a real
+// Task Scheduler service unmarshals, aren't counted.
+
+// Return the number of allocations counted in the process so far.
+uint64_t GetAllocationCount();
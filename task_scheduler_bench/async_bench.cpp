@@ -0,0 +1,90 @@
+#include <stdio.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <future>
+#include <vector>
+
+#include "async_task_scheduler.h"
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kNumTasks = 1000;
+const size_t kConnectionCounts[] = { 1, 2, 4, 8 };
+// Futures issued before the first is waited on.
+const size_t kNumOutstanding = 10000;
+const unsigned int kLatencyUs = 20;
+
+// Issue kNumOutstanding GetTaskInfo() on |scheduler|, cycling through the
+// tasks "Task0" to "Task<kNumTasks - 1>", then wait for all of them. Return
+// the number that failed.
+size_t GetTaskInfos(AsyncTaskScheduler* scheduler,
+    const std::vector<CStringW>& names) {
+    std::vector<TaskScheduler::TaskInfo> infos(kNumOutstanding);
+    std::vector<std::future<bool>> futures;
+    futures.reserve(kNumOutstanding);
+    for (size_t i = 0; i < kNumOutstanding; ++i) {
+        futures.push_back(
+            scheduler->GetTaskInfo(names[i % kNumTasks], &infos[i]));
+    }
+    size_t num_failed = 0;
+    for (std::future<bool>& future : futures)
+        num_failed += future.get() ? 0 : 1;
+    return num_failed;
+}
+
+}  // namespace
+
+// Many outstanding operations pipelined over 1 to 8 connections to a task
+// service taking kLatencyUs per call: kNumOutstanding GetTaskInfo() futures
+// waited on together, and GetAllTaskInfo(), which enumerates the folder
+// once on a single connection.
+BENCHMARK(AsyncOperations) {
+    CComPtr<ITaskService> service;
+    if (FAILED(CreateFakeTaskService(kNumTasks, L"Task", &service)))
+        return;
+    std::vector<CStringW> names(kNumTasks);
+    for (size_t i = 0; i < kNumTasks; ++i)
+        names[i].Format(L"Task%Iu", i);
+
+    for (size_t num_connections : kConnectionCounts) {
+        AsyncTaskScheduler scheduler([service]() {
+            return CreateTaskSchedulerForService(service, L"\\");
+        }, num_connections);
+        // Set the connections up and fill their indexes without latency.
+        if (GetTaskInfos(&scheduler, names)) {
+            reporter->ReportFailure("AsyncOperations", "GetTaskInfo() failed");
+            return;
+        }
+
+        SetFakeTaskServiceLatency(kLatencyUs);
+        Stopwatch stopwatch;
+        size_t num_failed = GetTaskInfos(&scheduler, names);
+        reporter->Report("AsyncOperations/GetTaskInfo", num_connections,
+            kNumOutstanding, stopwatch.ElapsedNanoseconds());
+
+        std::vector<TaskScheduler::TaskInfo> infos;
+        stopwatch.Restart();
+        bool read = scheduler.GetAllTaskInfo(&infos).get();
+        reporter->Report("AsyncOperations/GetAllTaskInfo", num_connections,
+            1, stopwatch.ElapsedNanoseconds());
+        SetFakeTaskServiceLatency(0);
+
+        if (num_failed) {
+            char message[128];
+            snprintf(message, sizeof(message),
+                "%Iu of %Iu GetTaskInfo() failed", num_failed,
+                kNumOutstanding);
+            reporter->ReportFailure("AsyncOperations/GetTaskInfo", message);
+        }
+        if (!read || infos.size() != kNumTasks) {
+            reporter->ReportFailure("AsyncOperations/GetAllTaskInfo",
+                "incomplete catalog");
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+struct RegisteredBenchmark {
+    const char* name;
+    BenchmarkFunction function;
+};
+
+// Function-local so that registration from static initializers in other
+// translation units doesn't depend on initialization order.
+std::vector<RegisteredBenchmark>& GetBenchmarks() {
+    static std::vector<RegisteredBenchmark> benchmarks;
+    return benchmarks;
+}
+
+std::string JsonEscape(const char* text) {
+    std::string escaped;
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\')
+            escaped += '\\';
+        escaped += *text;
+    }
+    return escaped;
+}
+
+}  // namespace
+
+void BenchmarkReporter::Report(const char* name, size_t arg,
+    size_t iterations, double elapsed_ns) {
+    double ns_per_op = iterations ? elapsed_ns / iterations : 0.0;
+    if (format_ == FORMAT_JSON) {
+        printf("{\"name\":\"%s\",\"arg\":%zu,\"iterations\":%zu,"
+            "\"value\":%.1f,\"unit\":\"ns/op\"}\n",
+            JsonEscape(name).c_str(), arg, iterations, ns_per_op);
+        return;
+    }
+    printf("%-40s %10zu %12zu %16.1f ns/op\n", name, arg, iterations,
+        ns_per_op);
+}
+
+void BenchmarkReporter::ReportValue(const char* name, size_t arg,
+    double value, const char* unit) {
+    if (format_ == FORMAT_JSON) {
+        printf("{\"name\":\"%s\",\"arg\":%zu,\"value\":%.1f,"
+            "\"unit\":\"%s\"}\n",
+            JsonEscape(name).c_str(), arg, value, JsonEscape(unit).c_str());
+        return;
+    }
+    printf("%-40s %10zu %12s %16.1f %s\n", name, arg, "", value, unit);
+}
+
+void BenchmarkReporter::ReportFailure(const char* name, const char* message) {
+    fprintf(stderr, "FAILED %s: %s\n", name, message);
+    ++num_failures_;
+}
+
+BenchmarkRegistrar::BenchmarkRegistrar(const char* name,
+    BenchmarkFunction function) {
+    GetBenchmarks().push_back({ name, function });
+}
+
+size_t RunBenchmarks(const char* filter, BenchmarkReporter* reporter) {
+    size_t num_run = 0;
+    for (const RegisteredBenchmark& benchmark : GetBenchmarks()) {
+        if (filter && !strstr(benchmark.name, filter))
+            continue;
+        benchmark.function(reporter);
+        ++num_run;
+    }
+    return num_run;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+
+// A minimal benchmark harness. A benchmark is a function registered with
+// BENCHMARK(name) that measures whatever it wants and hands each measurement
+// to the BenchmarkReporter:
+//
+//   BENCHMARK(LookupTask) {
+//       ...
+//       reporter->Report("LookupTask", num_tasks, iterations, elapsed_ns);
+//   }
+class BenchmarkReporter
+{
+public:
+    enum Format {
+        // Aligned columns, for people.
+        FORMAT_TEXT = 0,
+        // One JSON object per measurement and line, for tools tracking
+        // regressions.
+        FORMAT_JSON,
+    };
+
+    explicit BenchmarkReporter(Format format = FORMAT_TEXT)
+        : format_(format), num_failures_(0) {}
+
+    // Record that |iterations| runs of |name| with the parameter |arg| (e.g.
+    // the catalog size) took |elapsed_ns| nanoseconds in total.
+    void Report(const char* name, size_t arg, size_t iterations,
+        double elapsed_ns);
+
+    // Record a measurement that isn't a time per operation, such as a
+    // percentile or a counter, in |unit|.
+    void ReportValue(const char* name, size_t arg, double value,
+        const char* unit);
+
+    // Record that |name| missed a target it is held to, as told by |message|.
+    // Printed to stderr, and the benchmark program exits with an error.
+    void ReportFailure(const char* name, const char* message);
+
+    size_t num_failures() const { return num_failures_; }
+
+private:
+    Format format_;
+    size_t num_failures_;
+};
+
+typedef void(*BenchmarkFunction)(BenchmarkReporter* reporter);
+
+class BenchmarkRegistrar
+{
+public:
+    BenchmarkRegistrar(const char* name, BenchmarkFunction function);
+};
+
+// Run every registered benchmark whose name contains |filter|, or all of them
+// if |filter| is null. Return the number of benchmarks run.
+size_t RunBenchmarks(const char* filter, BenchmarkReporter* reporter);
+
+#define BENCHMARK(name)                                               \
+    static void name(BenchmarkReporter* reporter);                    \
+    static BenchmarkRegistrar name##_registrar(#name, &name);         \
+    static void name(BenchmarkReporter* reporter)
+
+// Measures wall time since construction or the last Restart().
+class Stopwatch
+{
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+    void Restart() { start_ = std::chrono::steady_clock::now(); }
+
+    double ElapsedNanoseconds() const {
+        return static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_).count());
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Keep the optimizer from discarding a computed scalar |value|.
+template <typename T>
+inline void DoNotOptimize(T value) {
+    static volatile T sink;
+    sink = value;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atlbase.h>
+
+#include "bench.h"
+#include "replay_tool.h"
+
+namespace {
+
+// Return the value of |argument| if it is "<option><value>", null otherwise.
+const char* OptionValue(const char* argument, const char* option) {
+    size_t length = strlen(option);
+    return strncmp(argument, option, length) == 0 ? argument + length :
+        nullptr;
+}
+
+}  // namespace
+
+// Usage: task_scheduler_bench [--json] [filter]
+// Runs every benchmark whose name contains |filter|. With --json, each
+// measurement is printed as a JSON object on a line of its own. Exits with 1
+// if a benchmark missed a target it checks, such as not allocating.
+//
+// Usage: task_scheduler_bench [--json] --replay=<trace> [--speed=<factor>]
+//            [--clients=<count>] [--backend=fake|in_process|task_service]
+//            [--latency_us=<microseconds>]
+// Replays a recorded workload instead, see RunReplayTool(). By default the
+// trace is replayed in real time by one client against the fake backend
+// answering right away. A speed of 0 replays it as fast as possible.
+int main(int argc, char* argv[])
+{
+    HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    if (FAILED(hr)) {
+        fprintf(stderr, "CoInitializeEx failed: 0x%08lx\n", hr);
+        return 1;
+    }
+
+    BenchmarkReporter::Format format = BenchmarkReporter::FORMAT_TEXT;
+    const char* filter = nullptr;
+    const char* trace_path = nullptr;
+    const char* backend = "fake";
+    double speed = 1;
+    size_t num_clients = 1;
+    unsigned int latency_us = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char* value = nullptr;
+        if (strcmp(argv[i], "--json") == 0)
+            format = BenchmarkReporter::FORMAT_JSON;
+        else if ((value = OptionValue(argv[i], "--replay=")) != nullptr)
+            trace_path = value;
+        else if ((value = OptionValue(argv[i], "--speed=")) != nullptr)
+            speed = atof(value);
+        else if ((value = OptionValue(argv[i], "--clients=")) != nullptr)
+            num_clients = strtoul(value, nullptr, 10);
+        else if ((value = OptionValue(argv[i], "--backend=")) != nullptr)
+            backend = value;
+        else if ((value = OptionValue(argv[i], "--latency_us=")) != nullptr)
+            latency_us = strtoul(value, nullptr, 10);
+        else
+            filter = argv[i];
+    }
+    BenchmarkReporter reporter(format);
+
+    if (trace_path) {
+        bool replayed = RunReplayTool(trace_path, backend, speed, num_clients,
+            latency_us, &reporter);
+        ::CoUninitialize();
+        return replayed ? 0 : 1;
+    }
+
+    size_t num_run = RunBenchmarks(filter, &reporter);
+
+    ::CoUninitialize();
+    if (!num_run) {
+        fprintf(stderr, "No benchmark matches '%s'.\n", filter);
+        return 1;
+    }
+    return reporter.num_failures() ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "catalog_snapshot.h"
+#include "fake_task_service.h"
+#include "task_catalog_cache.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kCatalogSizes[] = { 1000, 10000 };
+const unsigned int kLatencyUs = 20;
+// Long enough for the snapshot written by the benchmark not to be
+// revalidated while it runs.
+const ULONGLONG kMaxAgeInMs = 60 * 60 * 1000;
+
+}  // namespace
+
+// The start of an agent that reads the information of every task before it
+// serves requests: by enumerating the folder and reading each task from a
+// task service taking kLatencyUs per call, or by mapping the snapshot saved
+// by its previous run and reading each task from it.
+BENCHMARK(ColdStart) {
+    wchar_t temp_path[MAX_PATH];
+    if (!::GetTempPathW(MAX_PATH, temp_path))
+        return;
+    CStringW snapshot_path(temp_path);
+    snapshot_path += L"task_scheduler_bench.snapshot";
+
+    for (size_t num_tasks : kCatalogSizes) {
+        CComPtr<ITaskService> service;
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateFakeTaskScheduler(num_tasks, L"Task", &service));
+        if (!scheduler)
+            return;
+
+        // What the previous run saved.
+        std::vector<uint8_t> image;
+        if (!ReadCatalogSnapshot(scheduler.get(), &image) ||
+            !WriteCatalogSnapshot(snapshot_path, image)) {
+            return;
+        }
+        reporter->ReportValue("ColdStart/SnapshotSize", num_tasks,
+            static_cast<double>(image.size()) / num_tasks, "bytes/task");
+
+        SetFakeTaskServiceLatency(kLatencyUs);
+        std::vector<TaskScheduler::TaskSummary> summaries;
+        Stopwatch stopwatch;
+        if (!scheduler->GetTaskSummaries(&summaries))
+            return;
+        for (const TaskScheduler::TaskSummary& summary : summaries) {
+            TaskScheduler::TaskInfo info;
+            scheduler->GetTaskInfo(summary.name, &info);
+        }
+        reporter->Report("ColdStart/Enumerate", num_tasks, 1,
+            stopwatch.ElapsedNanoseconds());
+
+        stopwatch.Restart();
+        {
+            TaskCatalogCache cache(scheduler.get(), [service]() {
+                return CreateTaskSchedulerForService(service, L"\\");
+            }, snapshot_path, kMaxAgeInMs);
+            if (!cache.Load())
+                return;
+            for (const TaskScheduler::TaskSummary& summary : summaries) {
+                TaskScheduler::TaskInfo info;
+                cache.GetTaskInfo(summary.name, &info);
+            }
+            reporter->Report("ColdStart/Snapshot", num_tasks, 1,
+                stopwatch.ElapsedNanoseconds());
+        }
+        SetFakeTaskServiceLatency(0);
+        scheduler->UnInitilize();
+    }
+    ::DeleteFileW(snapshot_path);
+}
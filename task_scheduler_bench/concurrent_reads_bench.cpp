@@ -0,0 +1,112 @@
+#include <stdio.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+// The larger catalog has most reads be the first of their task since the
+// last index rebuild, which fill in what the catalog holds about it.
+const size_t kCatalogSizes[] = { 1000, 100000 };
+const size_t kReadsPerThread = 200000;
+
+// Read the state of random tasks of |names| until |kReadsPerThread| queries
+// are made, mixing the three queries served without locks.
+void ReadTasks(TaskScheduler* scheduler, const std::vector<CStringW>& names,
+    unsigned int seed) {
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<size_t> distribution(0, names.size() - 1);
+    TaskScheduler::TaskInfo info;
+    for (size_t i = 0; i < kReadsPerThread; ++i) {
+        const CStringW& name = names[distribution(generator)];
+        switch (i % 3) {
+        case 0:
+            DoNotOptimize(scheduler->IsTaskRegistered(name));
+            break;
+        case 1:
+            DoNotOptimize(scheduler->IsTaskEnabled(name));
+            break;
+        default:
+            DoNotOptimize(scheduler->GetTaskInfo(name, &info));
+            break;
+        }
+    }
+}
+
+// Read throughput of catalogs of |num_tasks| with 1, 2, 4, ... reader threads
+// up to the number of cores, while another thread keeps updating
+// registrations.
+void MeasureReads(BenchmarkReporter* reporter, size_t num_tasks) {
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateFakeTaskScheduler(num_tasks, L"Task"));
+    if (!scheduler)
+        return;
+
+    std::vector<CStringW> names(num_tasks);
+    for (size_t i = 0; i < num_tasks; ++i)
+        names[i].Format(L"Task%Iu", i);
+    char read_name[64];
+    char registrations_name[64];
+    snprintf(read_name, sizeof(read_name), "ConcurrentReads/%Iu/Read",
+        num_tasks);
+    snprintf(registrations_name, sizeof(registrations_name),
+        "ConcurrentReads/%Iu/Registrations", num_tasks);
+
+    size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t num_threads = 1; num_threads <= max_threads;
+        num_threads *= 2) {
+        std::atomic<bool> reading(true);
+        size_t registrations = 0;
+        // Alternate the arguments so that each registration updates the
+        // task rather than finding it up to date.
+        std::thread writer([&]() {
+            while (reading.load(std::memory_order_relaxed)) {
+                CStringW arguments;
+                arguments.Format(L"--update=%Iu", registrations);
+                scheduler->RegisterTask(names[registrations % num_tasks],
+                    L"Benchmark task.", L"C:\\Program Files\\Bench\\bench.exe",
+                    arguments, TaskScheduler::TRIGGER_TYPE_HOURLY, false);
+                ++registrations;
+            }
+        });
+
+        Stopwatch stopwatch;
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < num_threads; ++i) {
+            readers.emplace_back(ReadTasks, scheduler.get(), std::cref(names),
+                static_cast<unsigned int>(i));
+        }
+        for (std::thread& reader : readers)
+            reader.join();
+        double elapsed_ns = stopwatch.ElapsedNanoseconds();
+        reading = false;
+        writer.join();
+
+        reporter->Report(read_name, num_threads,
+            num_threads * kReadsPerThread, elapsed_ns);
+        reporter->ReportValue(registrations_name, num_threads,
+            static_cast<double>(registrations), "count");
+    }
+
+    scheduler->UnInitilize();
+}
+
+}  // namespace
+
+BENCHMARK(ConcurrentReads) {
+    for (size_t num_tasks : kCatalogSizes)
+        MeasureReads(reporter, num_tasks);
+}
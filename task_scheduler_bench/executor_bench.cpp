@@ -0,0 +1,84 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "work_stealing_executor.h"
+
+namespace {
+
+// Every TRIGGER_TYPE_HOURLY task of a large catalog firing at the top of the
+// hour.
+const size_t kNumFirings = 100000;
+
+// Worker counts to compare; 1 is the single dispatcher, 0 one per core.
+const size_t kWorkerCounts[] = { 1, 2, 4, 0 };
+
+// Time each firing keeps its worker busy, standing in for starting a process
+// or running an in-process callback.
+const int64_t kWorkPerFiringInNs = 2000;
+
+typedef std::chrono::steady_clock Clock;
+
+void SpinFor(int64_t duration_ns) {
+    Clock::time_point end =
+        Clock::now() + std::chrono::nanoseconds(duration_ns);
+    while (Clock::now() < end) {
+    }
+}
+
+double Percentile(const std::vector<int64_t>& sorted, double fraction) {
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+    return static_cast<double>(sorted[index]);
+}
+
+}  // namespace
+
+// Post kNumFirings closures at once and measure how long each waits before
+// it starts.
+BENCHMARK(ExecutorBurst) {
+    for (size_t num_workers : kWorkerCounts) {
+        WorkStealingExecutor executor(num_workers);
+        std::vector<int64_t> start_latencies(kNumFirings);
+        std::atomic<size_t> num_done(0);
+
+        std::vector<WorkStealingExecutor::Closure> firings;
+        firings.reserve(kNumFirings);
+        Clock::time_point fired_at = Clock::now();
+        for (size_t i = 0; i < kNumFirings; ++i) {
+            firings.push_back([i, &fired_at, &start_latencies, &num_done] {
+                start_latencies[i] =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - fired_at).count();
+                SpinFor(kWorkPerFiringInNs);
+                ++num_done;
+            });
+        }
+
+        Stopwatch stopwatch;
+        fired_at = Clock::now();
+        executor.PostBatch(&firings);
+        while (num_done < kNumFirings)
+            std::this_thread::yield();
+        double elapsed_ns = stopwatch.ElapsedNanoseconds();
+
+        size_t arg = executor.num_workers();
+        std::sort(start_latencies.begin(), start_latencies.end());
+        WorkStealingExecutor::Stats stats = executor.GetStats();
+        reporter->Report("ExecutorBurst", arg, kNumFirings, elapsed_ns);
+        reporter->ReportValue("ExecutorBurst/StartLatencyP50", arg,
+            Percentile(start_latencies, 0.50) / 1000, "us");
+        reporter->ReportValue("ExecutorBurst/StartLatencyP99", arg,
+            Percentile(start_latencies, 0.99) / 1000, "us");
+        reporter->ReportValue("ExecutorBurst/Steals", arg,
+            static_cast<double>(stats.steals), "closures");
+        reporter->ReportValue("ExecutorBurst/MaxQueueDepth", arg,
+            static_cast<double>(stats.max_queue_depth), "closures");
+        reporter->ReportValue("ExecutorBurst/Idle", arg,
+            stats.idle_ns / 1e6, "ms");
+    }
+}
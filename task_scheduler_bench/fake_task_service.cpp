@@ -0,0 +1,1072 @@
+#include "fake_task_service.h"
+
+#include <atlstr.h>
+
+#include <atomic>
+#include <chrono>
+#include <cwctype>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// See SetFakeTaskServiceLatency().
+std::atomic<unsigned int> round_trip_latency_us(0);
+
+// What the task service reports as the last run time of tasks that never
+// ran: 1999-11-30 00:00:00, local time, rather than 0.
+const DATE kNeverRunDate = 36494.0;
+
+// Stand in for the trip to the task service a real call would make. Spins
+// rather than sleeps: Sleep() can't wait for less than a timer tick.
+void SimulateRoundTrip() {
+    unsigned int latency_us = round_trip_latency_us.load(
+        std::memory_order_relaxed);
+    if (!latency_us)
+        return;
+    std::chrono::steady_clock::time_point end =
+        std::chrono::steady_clock::now() +
+        std::chrono::microseconds(latency_us);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// Reference counting, IUnknown and an empty IDispatch for a fake implementing
+// |Interface|. Objects start with a reference count of zero and are meant to
+// be put into a CComPtr right after construction.
+template <typename Interface>
+class FakeDispatch : public Interface
+{
+public:
+    STDMETHOD(QueryInterface)(REFIID riid, void** object) {
+        if (!object)
+            return E_POINTER;
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IDispatch) ||
+            IsSupportedInterface(riid)) {
+            *object = static_cast<Interface*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *object = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHOD_(ULONG, AddRef)() {
+        return static_cast<ULONG>(::InterlockedIncrement(&ref_count_));
+    }
+
+    STDMETHOD_(ULONG, Release)() {
+        ULONG ref_count =
+            static_cast<ULONG>(::InterlockedDecrement(&ref_count_));
+        if (!ref_count)
+            delete this;
+        return ref_count;
+    }
+
+    STDMETHOD(GetTypeInfoCount)(UINT* count) {
+        *count = 0;
+        return S_OK;
+    }
+
+    STDMETHOD(GetTypeInfo)(UINT, LCID, ITypeInfo**) {
+        return E_NOTIMPL;
+    }
+
+    STDMETHOD(GetIDsOfNames)(REFIID, LPOLESTR*, UINT, LCID, DISPID*) {
+        return E_NOTIMPL;
+    }
+
+    STDMETHOD(Invoke)(DISPID, REFIID, LCID, WORD, DISPPARAMS*, VARIANT*,
+        EXCEPINFO*, UINT*) {
+        return E_NOTIMPL;
+    }
+
+protected:
+    FakeDispatch() {}
+    // Copies start out unreferenced like any new object.
+    FakeDispatch(const FakeDispatch&) {}
+    virtual ~FakeDispatch() {}
+
+    // Overridden by fakes whose interface extends another task scheduler
+    // interface (e.g. IExecAction extends IAction) to answer for both.
+    virtual bool IsSupportedInterface(REFIID riid) const {
+        return riid == __uuidof(Interface);
+    }
+
+private:
+    volatile LONG ref_count_ = 0;
+};
+
+HRESULT CopyString(const wchar_t* value, BSTR* result) {
+    if (!result)
+        return E_POINTER;
+    *result = ::SysAllocString(value);
+    return *result ? S_OK : E_OUTOFMEMORY;
+}
+
+// Hand out a new reference to |object| as |Interface|.
+template <typename Interface, typename T>
+HRESULT CopyInterface(T* object, Interface** result) {
+    if (!result)
+        return E_POINTER;
+    *result = object;
+    (*result)->AddRef();
+    return S_OK;
+}
+
+// Same folding as the scheduler's index: task names are case insensitive.
+std::wstring FoldName(const wchar_t* name) {
+    std::wstring folded(name ? name : L"");
+    for (wchar_t& c : folded)
+        c = static_cast<wchar_t>(::towlower(c));
+    return folded;
+}
+
+// Strip the folder part of |path| so that both "name" and "\name" resolve
+// to the same task.
+const wchar_t* TaskNameFromPath(const wchar_t* path) {
+    if (!path)
+        return L"";
+    const wchar_t* separator = ::wcsrchr(path, L'\\');
+    return separator ? separator + 1 : path;
+}
+
+// Define get_|name| and put_|name| for a property stored in |member|.
+#define FAKE_STRING_PROPERTY(name, member)                          \
+    STDMETHOD(get_##name)(BSTR* value) {                            \
+        return CopyString(member, value);                           \
+    }                                                               \
+    STDMETHOD(put_##name)(BSTR value) {                             \
+        member = value;                                             \
+        return S_OK;                                                \
+    }
+
+#define FAKE_VALUE_PROPERTY(name, type, member)                     \
+    STDMETHOD(get_##name)(type* value) {                            \
+        if (!value)                                                 \
+            return E_POINTER;                                       \
+        *value = member;                                            \
+        return S_OK;                                                \
+    }                                                               \
+    STDMETHOD(put_##name)(type value) {                             \
+        member = value;                                             \
+        return S_OK;                                                \
+    }
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeRegistrationInfo : public FakeDispatch<IRegistrationInfo>
+{
+public:
+    CComPtr<FakeRegistrationInfo> Clone() const {
+        return CComPtr<FakeRegistrationInfo>(new FakeRegistrationInfo(*this));
+    }
+
+    FAKE_STRING_PROPERTY(Description, description_)
+    FAKE_STRING_PROPERTY(Author, author_)
+    FAKE_STRING_PROPERTY(Version, version_)
+    FAKE_STRING_PROPERTY(Date, date_)
+    FAKE_STRING_PROPERTY(Documentation, documentation_)
+    FAKE_STRING_PROPERTY(XmlText, xml_text_)
+    FAKE_STRING_PROPERTY(URI, uri_)
+    FAKE_STRING_PROPERTY(Source, source_)
+
+    STDMETHOD(get_SecurityDescriptor)(VARIANT* sddl) {
+        ::VariantInit(sddl);
+        return ::VariantCopy(sddl, &security_descriptor_);
+    }
+
+    STDMETHOD(put_SecurityDescriptor)(VARIANT sddl) {
+        return security_descriptor_.Copy(&sddl);
+    }
+
+private:
+    CStringW description_;
+    CStringW author_;
+    CStringW version_;
+    CStringW date_;
+    CStringW documentation_;
+    CStringW xml_text_;
+    CStringW uri_;
+    CStringW source_;
+    CComVariant security_descriptor_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakePrincipal : public FakeDispatch<IPrincipal>
+{
+public:
+    CComPtr<FakePrincipal> Clone() const {
+        return CComPtr<FakePrincipal>(new FakePrincipal(*this));
+    }
+
+    FAKE_STRING_PROPERTY(Id, id_)
+    FAKE_STRING_PROPERTY(DisplayName, display_name_)
+    FAKE_STRING_PROPERTY(UserId, user_id_)
+    FAKE_STRING_PROPERTY(GroupId, group_id_)
+    FAKE_VALUE_PROPERTY(LogonType, TASK_LOGON_TYPE, logon_type_)
+    FAKE_VALUE_PROPERTY(RunLevel, TASK_RUNLEVEL_TYPE, run_level_)
+
+private:
+    CStringW id_;
+    CStringW display_name_;
+    CStringW user_id_;
+    CStringW group_id_;
+    TASK_LOGON_TYPE logon_type_ = TASK_LOGON_INTERACTIVE_TOKEN;
+    TASK_RUNLEVEL_TYPE run_level_ = TASK_RUNLEVEL_LUA;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeTaskSettings : public FakeDispatch<ITaskSettings>
+{
+public:
+    CComPtr<FakeTaskSettings> Clone() const {
+        return CComPtr<FakeTaskSettings>(new FakeTaskSettings(*this));
+    }
+
+    VARIANT_BOOL enabled() const { return enabled_; }
+
+    FAKE_VALUE_PROPERTY(AllowDemandStart, VARIANT_BOOL, allow_demand_start_)
+    FAKE_STRING_PROPERTY(RestartInterval, restart_interval_)
+    FAKE_VALUE_PROPERTY(RestartCount, int, restart_count_)
+    FAKE_VALUE_PROPERTY(MultipleInstances, TASK_INSTANCES_POLICY,
+        multiple_instances_)
+    FAKE_VALUE_PROPERTY(StopIfGoingOnBatteries, VARIANT_BOOL,
+        stop_if_going_on_batteries_)
+    FAKE_VALUE_PROPERTY(DisallowStartIfOnBatteries, VARIANT_BOOL,
+        disallow_start_if_on_batteries_)
+    FAKE_VALUE_PROPERTY(AllowHardTerminate, VARIANT_BOOL,
+        allow_hard_terminate_)
+    FAKE_VALUE_PROPERTY(StartWhenAvailable, VARIANT_BOOL,
+        start_when_available_)
+    FAKE_STRING_PROPERTY(XmlText, xml_text_)
+    FAKE_VALUE_PROPERTY(RunOnlyIfNetworkAvailable, VARIANT_BOOL,
+        run_only_if_network_available_)
+    FAKE_STRING_PROPERTY(ExecutionTimeLimit, execution_time_limit_)
+    FAKE_VALUE_PROPERTY(Enabled, VARIANT_BOOL, enabled_)
+    FAKE_STRING_PROPERTY(DeleteExpiredTaskAfter, delete_expired_task_after_)
+    FAKE_VALUE_PROPERTY(Priority, int, priority_)
+    FAKE_VALUE_PROPERTY(Compatibility, TASK_COMPATIBILITY, compatibility_)
+    FAKE_VALUE_PROPERTY(Hidden, VARIANT_BOOL, hidden_)
+    FAKE_VALUE_PROPERTY(RunOnlyIfIdle, VARIANT_BOOL, run_only_if_idle_)
+    FAKE_VALUE_PROPERTY(WakeToRun, VARIANT_BOOL, wake_to_run_)
+
+    STDMETHOD(get_IdleSettings)(IIdleSettings**) { return E_NOTIMPL; }
+    STDMETHOD(put_IdleSettings)(IIdleSettings*) { return E_NOTIMPL; }
+    STDMETHOD(get_NetworkSettings)(INetworkSettings**) { return E_NOTIMPL; }
+    STDMETHOD(put_NetworkSettings)(INetworkSettings*) { return E_NOTIMPL; }
+
+private:
+    VARIANT_BOOL allow_demand_start_ = VARIANT_TRUE;
+    CStringW restart_interval_;
+    int restart_count_ = 0;
+    TASK_INSTANCES_POLICY multiple_instances_ = TASK_INSTANCES_IGNORE_NEW;
+    VARIANT_BOOL stop_if_going_on_batteries_ = VARIANT_TRUE;
+    VARIANT_BOOL disallow_start_if_on_batteries_ = VARIANT_TRUE;
+    VARIANT_BOOL allow_hard_terminate_ = VARIANT_TRUE;
+    VARIANT_BOOL start_when_available_ = VARIANT_FALSE;
+    CStringW xml_text_;
+    VARIANT_BOOL run_only_if_network_available_ = VARIANT_FALSE;
+    CStringW execution_time_limit_ = CStringW(L"PT72H");
+    VARIANT_BOOL enabled_ = VARIANT_TRUE;
+    CStringW delete_expired_task_after_;
+    int priority_ = 7;
+    TASK_COMPATIBILITY compatibility_ = TASK_COMPATIBILITY_V2;
+    VARIANT_BOOL hidden_ = VARIANT_FALSE;
+    VARIANT_BOOL run_only_if_idle_ = VARIANT_FALSE;
+    VARIANT_BOOL wake_to_run_ = VARIANT_FALSE;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeRepetitionPattern : public FakeDispatch<IRepetitionPattern>
+{
+public:
+    CComPtr<FakeRepetitionPattern> Clone() const {
+        return CComPtr<FakeRepetitionPattern>(new FakeRepetitionPattern(*this));
+    }
+
+    FAKE_STRING_PROPERTY(Interval, interval_)
+    FAKE_STRING_PROPERTY(Duration, duration_)
+    FAKE_VALUE_PROPERTY(StopAtDurationEnd, VARIANT_BOOL,
+        stop_at_duration_end_)
+
+private:
+    CStringW interval_;
+    CStringW duration_;
+    VARIANT_BOOL stop_at_duration_end_ = VARIANT_FALSE;
+};
+
+// Lets a trigger collection copy its triggers without knowing their type.
+class FakeTriggerClone
+{
+public:
+    virtual CComPtr<ITrigger> CloneTrigger() const = 0;
+
+protected:
+    virtual ~FakeTriggerClone() {}
+};
+
+// The ITrigger part of a trigger, |Interface| being ITrigger or one of the
+// interfaces extending it.
+template <typename Interface>
+class FakeTrigger : public FakeDispatch<Interface>, public FakeTriggerClone
+{
+public:
+    explicit FakeTrigger(TASK_TRIGGER_TYPE2 type)
+        : type_(type), repetition_(new FakeRepetitionPattern()) {}
+
+    STDMETHOD(get_Type)(TASK_TRIGGER_TYPE2* type) {
+        *type = type_;
+        return S_OK;
+    }
+
+    STDMETHOD(get_Repetition)(IRepetitionPattern** repetition) {
+        return CopyInterface(repetition_.p, repetition);
+    }
+
+    STDMETHOD(put_Repetition)(IRepetitionPattern*) { return E_NOTIMPL; }
+
+    FAKE_STRING_PROPERTY(Id, id_)
+    FAKE_STRING_PROPERTY(ExecutionTimeLimit, execution_time_limit_)
+    FAKE_STRING_PROPERTY(StartBoundary, start_boundary_)
+    FAKE_STRING_PROPERTY(EndBoundary, end_boundary_)
+    FAKE_VALUE_PROPERTY(Enabled, VARIANT_BOOL, enabled_)
+
+protected:
+    FakeTrigger(const FakeTrigger& other)
+        : type_(other.type_),
+          repetition_(other.repetition_->Clone()),
+          id_(other.id_),
+          execution_time_limit_(other.execution_time_limit_),
+          start_boundary_(other.start_boundary_),
+          end_boundary_(other.end_boundary_),
+          enabled_(other.enabled_) {}
+
+    virtual bool IsSupportedInterface(REFIID riid) const {
+        return riid == __uuidof(ITrigger) || riid == __uuidof(Interface);
+    }
+
+private:
+    TASK_TRIGGER_TYPE2 type_;
+    CComPtr<FakeRepetitionPattern> repetition_;
+    CStringW id_;
+    CStringW execution_time_limit_;
+    CStringW start_boundary_;
+    CStringW end_boundary_;
+    VARIANT_BOOL enabled_ = VARIANT_TRUE;
+};
+
+class FakeGenericTrigger : public FakeTrigger<ITrigger>
+{
+public:
+    explicit FakeGenericTrigger(TASK_TRIGGER_TYPE2 type)
+        : FakeTrigger<ITrigger>(type) {}
+
+    virtual CComPtr<ITrigger> CloneTrigger() const {
+        return CComPtr<ITrigger>(new FakeGenericTrigger(*this));
+    }
+};
+
+class FakeDailyTrigger : public FakeTrigger<IDailyTrigger>
+{
+public:
+    FakeDailyTrigger() : FakeTrigger<IDailyTrigger>(TASK_TRIGGER_DAILY) {}
+
+    virtual CComPtr<ITrigger> CloneTrigger() const {
+        return CComPtr<ITrigger>(new FakeDailyTrigger(*this));
+    }
+
+    FAKE_VALUE_PROPERTY(DaysInterval, short, days_interval_)
+    FAKE_STRING_PROPERTY(RandomDelay, random_delay_)
+
+private:
+    short days_interval_ = 1;
+    CStringW random_delay_;
+};
+
+class FakeLogonTrigger : public FakeTrigger<ILogonTrigger>
+{
+public:
+    FakeLogonTrigger() : FakeTrigger<ILogonTrigger>(TASK_TRIGGER_LOGON) {}
+
+    virtual CComPtr<ITrigger> CloneTrigger() const {
+        return CComPtr<ITrigger>(new FakeLogonTrigger(*this));
+    }
+
+    FAKE_STRING_PROPERTY(Delay, delay_)
+    FAKE_STRING_PROPERTY(UserId, user_id_)
+
+private:
+    CStringW delay_;
+    CStringW user_id_;
+};
+
+class FakeRegistrationTrigger : public FakeTrigger<IRegistrationTrigger>
+{
+public:
+    FakeRegistrationTrigger()
+        : FakeTrigger<IRegistrationTrigger>(TASK_TRIGGER_REGISTRATION) {}
+
+    virtual CComPtr<ITrigger> CloneTrigger() const {
+        return CComPtr<ITrigger>(new FakeRegistrationTrigger(*this));
+    }
+
+    FAKE_STRING_PROPERTY(Delay, delay_)
+
+private:
+    CStringW delay_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeTriggerCollection : public FakeDispatch<ITriggerCollection>
+{
+public:
+    CComPtr<FakeTriggerCollection> Clone() const {
+        CComPtr<FakeTriggerCollection> clone(new FakeTriggerCollection());
+        for (const CComPtr<ITrigger>& trigger : triggers_) {
+            clone->triggers_.push_back(
+                dynamic_cast<FakeTriggerClone*>(trigger.p)->CloneTrigger());
+        }
+        return clone;
+    }
+
+    STDMETHOD(get_Count)(long* count) {  // NOLINT, API requires a long.
+        *count = static_cast<long>(triggers_.size());  // NOLINT
+        return S_OK;
+    }
+
+    STDMETHOD(get_Item)(long index, ITrigger** trigger) {  // NOLINT
+        if (index < 1 || static_cast<size_t>(index) > triggers_.size())
+            return E_INVALIDARG;
+        return triggers_[index - 1].CopyTo(trigger);
+    }
+
+    STDMETHOD(get__NewEnum)(IUnknown**) { return E_NOTIMPL; }
+
+    STDMETHOD(Create)(TASK_TRIGGER_TYPE2 type, ITrigger** trigger) {
+        CComPtr<ITrigger> new_trigger;
+        switch (type) {
+        case TASK_TRIGGER_DAILY:
+            new_trigger = new FakeDailyTrigger();
+            break;
+        case TASK_TRIGGER_LOGON:
+            new_trigger = new FakeLogonTrigger();
+            break;
+        case TASK_TRIGGER_REGISTRATION:
+            new_trigger = new FakeRegistrationTrigger();
+            break;
+        default:
+            new_trigger = new FakeGenericTrigger(type);
+            break;
+        }
+        triggers_.push_back(new_trigger);
+        return new_trigger.CopyTo(trigger);
+    }
+
+    STDMETHOD(Remove)(VARIANT index) {
+        CComVariant position;
+        HRESULT hr = position.ChangeType(VT_I4, &index);
+        if (FAILED(hr))
+            return hr;
+        if (position.lVal < 1 ||
+            static_cast<size_t>(position.lVal) > triggers_.size()) {
+            return E_INVALIDARG;
+        }
+        triggers_.erase(triggers_.begin() + (position.lVal - 1));
+        return S_OK;
+    }
+
+    STDMETHOD(Clear)() {
+        triggers_.clear();
+        return S_OK;
+    }
+
+private:
+    std::vector<CComPtr<ITrigger>> triggers_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeExecAction : public FakeDispatch<IExecAction>
+{
+public:
+    CComPtr<FakeExecAction> Clone() const {
+        return CComPtr<FakeExecAction>(new FakeExecAction(*this));
+    }
+
+    STDMETHOD(get_Type)(TASK_ACTION_TYPE* type) {
+        *type = TASK_ACTION_EXEC;
+        return S_OK;
+    }
+
+    FAKE_STRING_PROPERTY(Id, id_)
+    FAKE_STRING_PROPERTY(Path, path_)
+    FAKE_STRING_PROPERTY(Arguments, arguments_)
+    FAKE_STRING_PROPERTY(WorkingDirectory, working_directory_)
+
+protected:
+    virtual bool IsSupportedInterface(REFIID riid) const {
+        return riid == __uuidof(IAction) || riid == __uuidof(IExecAction);
+    }
+
+private:
+    CStringW id_;
+    CStringW path_;
+    CStringW arguments_;
+    CStringW working_directory_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+// Only holds exec actions, the only type the scheduler creates or reads.
+class FakeActionCollection : public FakeDispatch<IActionCollection>
+{
+public:
+    CComPtr<FakeActionCollection> Clone() const {
+        CComPtr<FakeActionCollection> clone(new FakeActionCollection());
+        clone->context_ = context_;
+        for (const CComPtr<FakeExecAction>& action : actions_)
+            clone->actions_.push_back(action->Clone());
+        return clone;
+    }
+
+    STDMETHOD(get_Count)(long* count) {  // NOLINT, API requires a long.
+        *count = static_cast<long>(actions_.size());  // NOLINT
+        return S_OK;
+    }
+
+    STDMETHOD(get_Item)(long index, IAction** action) {  // NOLINT
+        if (index < 1 || static_cast<size_t>(index) > actions_.size())
+            return E_INVALIDARG;
+        return CopyInterface(actions_[index - 1].p, action);
+    }
+
+    STDMETHOD(get__NewEnum)(IUnknown**) { return E_NOTIMPL; }
+
+    STDMETHOD(get_XmlText)(BSTR*) { return E_NOTIMPL; }
+    STDMETHOD(put_XmlText)(BSTR) { return E_NOTIMPL; }
+
+    STDMETHOD(Create)(TASK_ACTION_TYPE type, IAction** action) {
+        if (type != TASK_ACTION_EXEC)
+            return E_NOTIMPL;
+        CComPtr<FakeExecAction> exec_action(new FakeExecAction());
+        actions_.push_back(exec_action);
+        return CopyInterface(exec_action.p, action);
+    }
+
+    STDMETHOD(Remove)(VARIANT index) {
+        CComVariant position;
+        HRESULT hr = position.ChangeType(VT_I4, &index);
+        if (FAILED(hr))
+            return hr;
+        if (position.lVal < 1 ||
+            static_cast<size_t>(position.lVal) > actions_.size()) {
+            return E_INVALIDARG;
+        }
+        actions_.erase(actions_.begin() + (position.lVal - 1));
+        return S_OK;
+    }
+
+    STDMETHOD(Clear)() {
+        actions_.clear();
+        return S_OK;
+    }
+
+    FAKE_STRING_PROPERTY(Context, context_)
+
+private:
+    std::vector<CComPtr<FakeExecAction>> actions_;
+    CStringW context_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeTaskDefinition : public FakeDispatch<ITaskDefinition>
+{
+public:
+    FakeTaskDefinition()
+        : registration_info_(new FakeRegistrationInfo()),
+          triggers_(new FakeTriggerCollection()),
+          settings_(new FakeTaskSettings()),
+          principal_(new FakePrincipal()),
+          actions_(new FakeActionCollection()) {}
+
+    // Registering a definition stores a copy, as the task service serializes
+    // it, so the caller may keep modifying the original.
+    CComPtr<FakeTaskDefinition> Clone() const {
+        CComPtr<FakeTaskDefinition> clone(new FakeTaskDefinition());
+        clone->registration_info_ = registration_info_->Clone();
+        clone->triggers_ = triggers_->Clone();
+        clone->settings_ = settings_->Clone();
+        clone->principal_ = principal_->Clone();
+        clone->actions_ = actions_->Clone();
+        clone->data_ = data_;
+        return clone;
+    }
+
+    FakeTaskSettings* settings() const { return settings_; }
+
+    STDMETHOD(get_RegistrationInfo)(IRegistrationInfo** registration_info) {
+        return CopyInterface(registration_info_.p, registration_info);
+    }
+
+    STDMETHOD(get_Triggers)(ITriggerCollection** triggers) {
+        return CopyInterface(triggers_.p, triggers);
+    }
+
+    STDMETHOD(get_Settings)(ITaskSettings** settings) {
+        return CopyInterface(settings_.p, settings);
+    }
+
+    STDMETHOD(get_Principal)(IPrincipal** principal) {
+        return CopyInterface(principal_.p, principal);
+    }
+
+    STDMETHOD(get_Actions)(IActionCollection** actions) {
+        return CopyInterface(actions_.p, actions);
+    }
+
+    // Replacing the parts is not used by the scheduler.
+    STDMETHOD(put_RegistrationInfo)(IRegistrationInfo*) { return E_NOTIMPL; }
+    STDMETHOD(put_Triggers)(ITriggerCollection*) { return E_NOTIMPL; }
+    STDMETHOD(put_Settings)(ITaskSettings*) { return E_NOTIMPL; }
+    STDMETHOD(put_Principal)(IPrincipal*) { return E_NOTIMPL; }
+    STDMETHOD(put_Actions)(IActionCollection*) { return E_NOTIMPL; }
+
+    FAKE_STRING_PROPERTY(Data, data_)
+
+    STDMETHOD(get_XmlText)(BSTR*) { return E_NOTIMPL; }
+    STDMETHOD(put_XmlText)(BSTR) { return E_NOTIMPL; }
+
+private:
+    CComPtr<FakeRegistrationInfo> registration_info_;
+    CComPtr<FakeTriggerCollection> triggers_;
+    CComPtr<FakeTaskSettings> settings_;
+    CComPtr<FakePrincipal> principal_;
+    CComPtr<FakeActionCollection> actions_;
+    CStringW data_;
+};
+
+// Return the definition given to tasks created by CreateFakeTaskService().
+CComPtr<FakeTaskDefinition> CreateDefaultDefinition() {
+    CComPtr<FakeTaskDefinition> definition(new FakeTaskDefinition());
+
+    CComPtr<IRegistrationInfo> registration_info;
+    definition->get_RegistrationInfo(&registration_info);
+    registration_info->put_Description(CComBSTR(L"Fake task."));
+    registration_info->put_Author(CComBSTR(L"domain\\user"));
+
+    CComPtr<IActionCollection> actions;
+    definition->get_Actions(&actions);
+    CComPtr<IAction> action;
+    actions->Create(TASK_ACTION_EXEC, &action);
+    CComQIPtr<IExecAction> exec_action(action);
+    exec_action->put_Path(CComBSTR(L"C:\\Program Files\\Fake\\fake.exe"));
+    exec_action->put_Arguments(CComBSTR(L"--fake"));
+    exec_action->put_WorkingDirectory(CComBSTR(L"C:\\Program Files\\Fake"));
+    return definition;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeRegisteredTask : public FakeDispatch<IRegisteredTask>
+{
+public:
+    // |definition| is shared, not copied: get_Definition() hands out copies.
+    FakeRegisteredTask(const wchar_t* name, const CStringW& folder_path,
+        bool enabled, FakeTaskDefinition* definition)
+        : name_(name),
+          path_(folder_path),
+          enabled_(enabled ? VARIANT_TRUE : VARIANT_FALSE),
+          definition_(definition) {
+        if (path_.Right(1) != L"\\")
+            path_ += L"\\";
+        path_ += name_;
+    }
+
+    const CStringW& name() const { return name_; }
+
+    STDMETHOD(get_Name)(BSTR* name) { return CopyString(name_, name); }
+    STDMETHOD(get_Path)(BSTR* path) { return CopyString(path_, path); }
+
+    STDMETHOD(get_State)(TASK_STATE* state) {
+        SimulateRoundTrip();
+        *state = enabled_ ? TASK_STATE_READY : TASK_STATE_DISABLED;
+        return S_OK;
+    }
+
+    STDMETHOD(get_Enabled)(VARIANT_BOOL* enabled) {
+        SimulateRoundTrip();
+        *enabled = enabled_;
+        return S_OK;
+    }
+
+    STDMETHOD(put_Enabled)(VARIANT_BOOL enabled) {
+        SimulateRoundTrip();
+        enabled_ = enabled;
+        return S_OK;
+    }
+
+    STDMETHOD(Run)(VARIANT, IRunningTask**) { return E_NOTIMPL; }
+    STDMETHOD(RunEx)(VARIANT, LONG, LONG, BSTR, IRunningTask**) {
+        return E_NOTIMPL;
+    }
+    STDMETHOD(GetInstances)(LONG, IRunningTaskCollection**) {
+        return E_NOTIMPL;
+    }
+    // The fake tasks never run.
+    STDMETHOD(get_LastRunTime)(DATE* last_run_time) {
+        SimulateRoundTrip();
+        *last_run_time = kNeverRunDate;
+        return SCHED_S_TASK_HAS_NOT_RUN;
+    }
+
+    STDMETHOD(get_LastTaskResult)(LONG* last_result) {
+        SimulateRoundTrip();
+        *last_result = SCHED_S_TASK_HAS_NOT_RUN;
+        return S_OK;
+    }
+
+    STDMETHOD(get_NumberOfMissedRuns)(LONG* missed_runs) {
+        SimulateRoundTrip();
+        *missed_runs = 0;
+        return S_OK;
+    }
+
+    STDMETHOD(get_NextRunTime)(DATE* next_run_time) {
+        SimulateRoundTrip();
+        *next_run_time = 0;
+        return S_OK;
+    }
+    STDMETHOD(get_Definition)(ITaskDefinition** definition) {
+        SimulateRoundTrip();
+        CComPtr<FakeTaskDefinition> copy = definition_->Clone();
+        return CopyInterface(copy.p, definition);
+    }
+    STDMETHOD(get_Xml)(BSTR*) { return E_NOTIMPL; }
+    STDMETHOD(GetSecurityDescriptor)(LONG, BSTR*) { return E_NOTIMPL; }
+    STDMETHOD(SetSecurityDescriptor)(BSTR, LONG) { return E_NOTIMPL; }
+    STDMETHOD(Stop)(LONG) { return E_NOTIMPL; }
+    STDMETHOD(GetRunTimes)(const LPSYSTEMTIME, const LPSYSTEMTIME, DWORD*,
+        LPSYSTEMTIME*) {
+        return E_NOTIMPL;
+    }
+
+private:
+    CStringW name_;
+    CStringW path_;
+    VARIANT_BOOL enabled_;
+    CComPtr<FakeTaskDefinition> definition_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+// A snapshot of a folder's tasks, as returned by ITaskFolder::GetTasks.
+class FakeRegisteredTaskCollection
+    : public FakeDispatch<IRegisteredTaskCollection>
+{
+public:
+    explicit FakeRegisteredTaskCollection(
+        const std::vector<CComPtr<FakeRegisteredTask>>& tasks)
+        : tasks_(tasks) {}
+
+    STDMETHOD(get_Count)(LONG* count) {
+        *count = static_cast<LONG>(tasks_.size());
+        return S_OK;
+    }
+
+    // Like the real collection, |index| is either a 1-based index or a name.
+    STDMETHOD(get_Item)(VARIANT index, IRegisteredTask** task) {
+        if (index.vt == VT_BSTR) {
+            std::wstring folded = FoldName(index.bstrVal);
+            for (const CComPtr<FakeRegisteredTask>& candidate : tasks_) {
+                if (FoldName(candidate->name()) == folded)
+                    return CopyInterface(candidate.p, task);
+            }
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        }
+
+        CComVariant position;
+        HRESULT hr = position.ChangeType(VT_I4, &index);
+        if (FAILED(hr))
+            return hr;
+        if (position.lVal < 1 ||
+            static_cast<size_t>(position.lVal) > tasks_.size()) {
+            return E_INVALIDARG;
+        }
+        return CopyInterface(tasks_[position.lVal - 1].p, task);
+    }
+
+    STDMETHOD(get__NewEnum)(IUnknown**) { return E_NOTIMPL; }
+
+private:
+    std::vector<CComPtr<FakeRegisteredTask>> tasks_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeTaskFolder : public FakeDispatch<ITaskFolder>
+{
+public:
+    FakeTaskFolder(const wchar_t* name, const wchar_t* path)
+        : name_(name), path_(path) {}
+
+    // Add a task or replace the one with the same name, keeping its place
+    // in the enumeration order.
+    FakeRegisteredTask* AddTask(const wchar_t* name, bool enabled,
+        FakeTaskDefinition* definition) {
+        std::wstring folded = FoldName(name);
+        CComPtr<FakeRegisteredTask> task(
+            new FakeRegisteredTask(name, path_, enabled, definition));
+        std::unordered_map<std::wstring, size_t>::iterator it =
+            positions_.find(folded);
+        if (it != positions_.end()) {
+            tasks_[it->second] = task;
+            return task;
+        }
+        positions_[folded] = tasks_.size();
+        tasks_.push_back(task);
+        return task;
+    }
+
+    // Return the folder at |path| below this one, or this folder if |path|
+    // has no components. Create missing folders if |create| is true, return
+    // null for them otherwise.
+    FakeTaskFolder* FindFolder(const wchar_t* path, bool create) {
+        FakeTaskFolder* folder = this;
+        CStringW remaining(path);
+        int position = 0;
+        for (CStringW name = remaining.Tokenize(L"\\", position);
+            position != -1; name = remaining.Tokenize(L"\\", position)) {
+            std::wstring folded = FoldName(name);
+            auto it = folder->folders_.find(folded);
+            if (it == folder->folders_.end()) {
+                if (!create)
+                    return nullptr;
+                CStringW child_path(folder->path_);
+                if (child_path.Right(1) != L"\\")
+                    child_path += L"\\";
+                child_path += name;
+                it = folder->folders_.insert(std::make_pair(folded,
+                    CComPtr<FakeTaskFolder>(
+                        new FakeTaskFolder(name, child_path)))).first;
+            }
+            folder = it->second;
+        }
+        return folder;
+    }
+
+    STDMETHOD(get_Name)(BSTR* name) { return CopyString(name_, name); }
+    STDMETHOD(get_Path)(BSTR* path) { return CopyString(path_, path); }
+
+    STDMETHOD(GetFolder)(BSTR path, ITaskFolder** folder) {
+        SimulateRoundTrip();
+        FakeTaskFolder* found = FindFolder(path, false);
+        if (!found)
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        return CopyInterface(found, folder);
+    }
+
+    STDMETHOD(GetFolders)(LONG, ITaskFolderCollection**) { return E_NOTIMPL; }
+
+    STDMETHOD(CreateFolder)(BSTR path, VARIANT, ITaskFolder** folder) {
+        SimulateRoundTrip();
+        if (FindFolder(path, false))
+            return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        FakeTaskFolder* created = FindFolder(path, true);
+        if (!folder)
+            return S_OK;
+        return CopyInterface(created, folder);
+    }
+
+    STDMETHOD(DeleteFolder)(BSTR, LONG) { return E_NOTIMPL; }
+
+    STDMETHOD(GetTask)(BSTR path, IRegisteredTask** task) {
+        SimulateRoundTrip();
+        std::unordered_map<std::wstring, size_t>::const_iterator it =
+            positions_.find(FoldName(TaskNameFromPath(path)));
+        if (it == positions_.end())
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        return CopyInterface(tasks_[it->second].p, task);
+    }
+
+    STDMETHOD(GetTasks)(LONG, IRegisteredTaskCollection** tasks) {
+        SimulateRoundTrip();
+        CComPtr<IRegisteredTaskCollection> collection(
+            new FakeRegisteredTaskCollection(tasks_));
+        *tasks = collection.Detach();
+        return S_OK;
+    }
+
+    STDMETHOD(DeleteTask)(BSTR name, LONG) {
+        SimulateRoundTrip();
+        std::unordered_map<std::wstring, size_t>::iterator it =
+            positions_.find(FoldName(TaskNameFromPath(name)));
+        if (it == positions_.end())
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+        // Move the last task into the hole to keep deletion O(1).
+        size_t position = it->second;
+        positions_.erase(it);
+        if (position != tasks_.size() - 1) {
+            tasks_[position] = tasks_.back();
+            positions_[FoldName(tasks_[position]->name())] = position;
+        }
+        tasks_.pop_back();
+        return S_OK;
+    }
+
+    STDMETHOD(RegisterTask)(BSTR, BSTR, LONG, VARIANT, VARIANT,
+        TASK_LOGON_TYPE, VARIANT, IRegisteredTask**) {
+        return E_NOTIMPL;
+    }
+
+    // Only definitions created by the fake service's NewTask() are accepted.
+    STDMETHOD(RegisterTaskDefinition)(BSTR path, ITaskDefinition* definition,
+        LONG flags, VARIANT, VARIANT, TASK_LOGON_TYPE, VARIANT,
+        IRegisteredTask** registered_task) {
+        SimulateRoundTrip();
+        if (!definition)
+            return E_POINTER;
+        const wchar_t* name = TaskNameFromPath(path);
+        bool exists = positions_.count(FoldName(name)) != 0;
+        if (exists && !(flags & TASK_UPDATE))
+            return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        if (!exists && !(flags & TASK_CREATE))
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        if (flags & TASK_VALIDATE_ONLY)
+            return S_OK;
+
+        CComPtr<FakeTaskDefinition> copy =
+            static_cast<FakeTaskDefinition*>(definition)->Clone();
+        FakeRegisteredTask* task = AddTask(name,
+            copy->settings()->enabled() != VARIANT_FALSE, copy);
+        if (!registered_task)
+            return S_OK;
+        return CopyInterface(task, registered_task);
+    }
+
+    STDMETHOD(GetSecurityDescriptor)(LONG, BSTR*) { return E_NOTIMPL; }
+    STDMETHOD(SetSecurityDescriptor)(BSTR, LONG) { return E_NOTIMPL; }
+
+private:
+    CStringW name_;
+    CStringW path_;
+    std::vector<CComPtr<FakeRegisteredTask>> tasks_;
+    // Folded task name -> position in |tasks_|.
+    std::unordered_map<std::wstring, size_t> positions_;
+    // Folded folder name -> sub-folder.
+    std::unordered_map<std::wstring, CComPtr<FakeTaskFolder>> folders_;
+};
+
+//////////////////////////////////////////////////////////////////////////////////
+class FakeTaskService : public FakeDispatch<ITaskService>
+{
+public:
+    FakeTaskService()
+        : root_folder_(new FakeTaskFolder(L"\\", L"\\")),
+          default_definition_(CreateDefaultDefinition()) {}
+
+    FakeTaskFolder* root_folder() { return root_folder_; }
+    FakeTaskDefinition* default_definition() { return default_definition_; }
+
+    // Paths are relative to the root folder, with or without a leading
+    // backslash.
+    STDMETHOD(GetFolder)(BSTR path, ITaskFolder** folder) {
+        SimulateRoundTrip();
+        FakeTaskFolder* found = root_folder_->FindFolder(path, false);
+        if (!found)
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        return CopyInterface(found, folder);
+    }
+
+    STDMETHOD(GetRunningTasks)(LONG, IRunningTaskCollection**) {
+        return E_NOTIMPL;
+    }
+
+    STDMETHOD(NewTask)(DWORD, ITaskDefinition** definition) {
+        CComPtr<FakeTaskDefinition> new_definition(new FakeTaskDefinition());
+        return CopyInterface(new_definition.p, definition);
+    }
+
+    STDMETHOD(Connect)(VARIANT, VARIANT, VARIANT, VARIANT) {
+        SimulateRoundTrip();
+        connected_ = true;
+        return S_OK;
+    }
+
+    STDMETHOD(get_Connected)(VARIANT_BOOL* connected) {
+        *connected = connected_ ? VARIANT_TRUE : VARIANT_FALSE;
+        return S_OK;
+    }
+
+    STDMETHOD(get_TargetServer)(BSTR* server) {
+        return CopyString(L"localhost", server);
+    }
+
+    STDMETHOD(get_ConnectedUser)(BSTR* user) {
+        return CopyString(L"user", user);
+    }
+
+    STDMETHOD(get_ConnectedDomain)(BSTR* domain) {
+        return CopyString(L"domain", domain);
+    }
+
+    STDMETHOD(get_HighestVersion)(DWORD* version) {
+        // Task Scheduler 2.0.
+        *version = (1 << 16) | 2;
+        return S_OK;
+    }
+
+private:
+    CComPtr<FakeTaskFolder> root_folder_;
+    CComPtr<FakeTaskDefinition> default_definition_;
+    bool connected_ = false;
+};
+
+}  // namespace
+
+HRESULT CreateFakeTaskService(size_t num_tasks, const wchar_t* prefix,
+    ITaskService** task_service) {
+    CComPtr<FakeTaskService> service(new FakeTaskService());
+    for (size_t i = 0; i < num_tasks; ++i) {
+        CStringW name;
+        name.Format(L"%s%Iu", prefix, i);
+        service->root_folder()->AddTask(name, true,
+            service->default_definition());
+    }
+    return service.QueryInterface(task_service);
+}
+
+TaskScheduler* CreateFakeTaskScheduler(size_t num_tasks,
+    const wchar_t* prefix) {
+    CComPtr<ITaskService> service;
+    return CreateFakeTaskScheduler(num_tasks, prefix, &service);
+}
+
+TaskScheduler* CreateFakeTaskScheduler(size_t num_tasks,
+    const wchar_t* prefix, ITaskService** task_service) {
+    CComPtr<ITaskService> service;
+    if (FAILED(CreateFakeTaskService(num_tasks, prefix, &service)))
+        return nullptr;
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateTaskSchedulerForService(service, L"\\"));
+    if (!scheduler || !scheduler->Initilize())
+        return nullptr;
+    *task_service = service.Detach();
+    return scheduler.release();
+}
+
+std::vector<TaskScheduler::TaskSpec> MakeFakeTaskSpecs(const wchar_t* prefix,
+    size_t first, size_t count) {
+    std::vector<TaskScheduler::TaskSpec> specs(count);
+    for (size_t i = 0; i < count; ++i) {
+        TaskScheduler::TaskSpec& spec = specs[i];
+        spec.name.Format(L"%s%Iu", prefix, first + i);
+        spec.description = L"Benchmark task.";
+        spec.application_path = L"C:\\Program Files\\Bench\\bench.exe";
+        spec.application_arguments.Format(L"--task=%Iu", first + i);
+        spec.trigger_type = TaskScheduler::TRIGGER_TYPE_HOURLY;
+        spec.hidden = false;
+    }
+    return specs;
+}
+
+void SetFakeTaskServiceLatency(unsigned int microseconds) {
+    round_trip_latency_us.store(microseconds, std::memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atlbase.h>
+#include <taskschd.h>
+
+#include <vector>
+
+#include "task_scheduler.h"
+
+// In-memory implementation of the Task Scheduler 2.0 interfaces that
+// TaskSchedulerV2 talks to, so that it can be measured without going through
+// the task service. Pass the service to CreateTaskSchedulerForService().
+// Sub-folders are created on demand and start out empty.
+//
+// The fakes answer from memory, so unless a latency is set, a benchmark sees
+// only the cost of the scheduler's own work and none of the round trips.
+
+// Create a connected task service whose root folder contains |num_tasks|
+// enabled tasks named "<prefix><index>", index starting at 0.
+HRESULT CreateFakeTaskService(size_t num_tasks, const wchar_t* prefix,
+    ITaskService** task_service);
+
+// Return an initialized scheduler over the root folder of a new fake task
+// service holding |num_tasks| tasks, as CreateFakeTaskService() creates
+// them, or null on failure. The caller owns the scheduler.
+TaskScheduler* CreateFakeTaskScheduler(size_t num_tasks,
+    const wchar_t* prefix);
+// Same as above, also returning the service in |task_service|, for
+// benchmarks that call it directly or create more schedulers over it.
+TaskScheduler* CreateFakeTaskScheduler(size_t num_tasks,
+    const wchar_t* prefix, ITaskService** task_service);
+
+// Return the specs of |count| hourly tasks named "<prefix><index>", index
+// starting at |first|, that run the same program with "--task=<index>".
+// Benchmarks that need other triggers or arguments change them afterwards.
+std::vector<TaskScheduler::TaskSpec> MakeFakeTaskSpecs(const wchar_t* prefix,
+    size_t first, size_t count);
+
+// Make every call a real task service serves out of process, i.e. those on
+// the service, its folders and registered tasks but not on task definitions
+// or collections, take |microseconds| longer. Applies to all fake services;
+// 0, the default, turns the delay off.
+void SetFakeTaskServiceLatency(unsigned int microseconds);
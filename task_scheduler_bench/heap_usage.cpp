@@ -0,0 +1,25 @@
+#include "heap_usage.h"
+
+#include <windows.h>
+
+bool GetHeapUsage(HeapUsage* usage)
+{
+    HANDLE heap = ::GetProcessHeap();
+    if (!heap || !::HeapLock(heap))
+        return false;
+
+    HeapUsage usage_storage = {};
+    PROCESS_HEAP_ENTRY entry = {};
+    while (::HeapWalk(heap, &entry)) {
+        if (!(entry.wFlags & PROCESS_HEAP_ENTRY_BUSY))
+            continue;
+        ++usage_storage.num_blocks;
+        usage_storage.num_bytes += entry.cbData + entry.cbOverhead;
+    }
+    bool walked = ::GetLastError() == ERROR_NO_MORE_ITEMS;
+    ::HeapUnlock(heap);
+    if (!walked)
+        return false;
+    *usage = usage_storage;
+    return true;
+}
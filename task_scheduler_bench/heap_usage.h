@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+
+// What is allocated on the process heap, which the CRT, and with it operator
+// new, and the ATL string manager both allocate from.
+struct HeapUsage {
+    size_t num_blocks;
+    size_t num_bytes;
+};
+
+// Walk the process heap and sum up its allocated blocks. The difference
+// between two calls is what was allocated and not freed in between. Return
+// false if the heap couldn't be walked.
+bool GetHeapUsage(HeapUsage* usage);
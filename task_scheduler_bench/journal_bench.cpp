@@ -0,0 +1,115 @@
+#include <atlbase.h>
+#include <atlstr.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "in_process_task_scheduler.h"
+#include "task_journal.h"
+#include "task_scheduler.h"
+
+namespace {
+
+// Registrations by that many threads at once, each on its own task.
+const size_t kNumWriters[] = { 1, 8, 64 };
+const size_t kNumRegistrations = 10000;
+
+// The catalog registered and recovered.
+const size_t kNumCatalogTasks = 1000000;
+const size_t kNumCatalogWriters = 64;
+
+// Register tasks |first| to |first| + |count| - 1 by |num_threads| threads,
+// one RegisterTask() call each. Return false if any failed.
+bool RegisterConcurrently(TaskScheduler* scheduler, size_t first,
+    size_t count, size_t num_threads) {
+    std::vector<std::thread> threads;
+    std::vector<char> succeeded(num_threads, 1);
+    for (size_t thread = 0; thread < num_threads; ++thread) {
+        threads.push_back(std::thread(
+            [scheduler, first, count, num_threads, thread, &succeeded] {
+            CStringW name;
+            CStringW arguments;
+            for (size_t i = thread; i < count; i += num_threads) {
+                name.Format(L"Vendor Product Task %Iu", first + i);
+                arguments.Format(L"--task=%Iu", first + i);
+                if (!scheduler->RegisterTask(name, L"Benchmark task.",
+                        L"C:\\Program Files\\Vendor\\updater.exe", arguments,
+                        TaskScheduler::TRIGGER_TYPE_HOURLY, false)) {
+                    succeeded[thread] = 0;
+                }
+            }
+        }));
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    for (char thread_succeeded : succeeded) {
+        if (!thread_succeeded)
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+// The durable in-process engine: registrations, each of which returns once
+// it is journaled and flushed, by a growing number of concurrent writers
+// sharing the flushes, then a catalog of kNumCatalogTasks registered through
+// compactions and the time it takes to recover it on the next start.
+BENCHMARK(Journal) {
+    wchar_t temp_path[MAX_PATH];
+    if (!::GetTempPathW(MAX_PATH, temp_path))
+        return;
+    CStringW journal_path(temp_path);
+    journal_path += L"task_scheduler_bench.catalog";
+
+    for (size_t num_writers : kNumWriters) {
+        DeleteTaskJournal(journal_path);
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateDurableInProcessTaskScheduler(1, journal_path));
+        if (!scheduler->Initilize())
+            return;
+        Stopwatch stopwatch;
+        if (!RegisterConcurrently(scheduler.get(), 0, kNumRegistrations,
+                num_writers)) {
+            return;
+        }
+        reporter->Report("Journal/RegisterTask", num_writers,
+            kNumRegistrations, stopwatch.ElapsedNanoseconds());
+        scheduler->UnInitilize();
+    }
+
+    DeleteTaskJournal(journal_path);
+    {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateDurableInProcessTaskScheduler(1, journal_path));
+        if (!scheduler->Initilize())
+            return;
+        Stopwatch stopwatch;
+        if (!RegisterConcurrently(scheduler.get(), 0, kNumCatalogTasks,
+                kNumCatalogWriters)) {
+            return;
+        }
+        reporter->Report("Journal/RegisterCatalog", kNumCatalogTasks,
+            kNumCatalogTasks, stopwatch.ElapsedNanoseconds());
+        scheduler->UnInitilize();
+    }
+
+    {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateDurableInProcessTaskScheduler(1, journal_path));
+        Stopwatch stopwatch;
+        if (!scheduler->Initilize())
+            return;
+        reporter->Report("Journal/Recover", kNumCatalogTasks, 1,
+            stopwatch.ElapsedNanoseconds());
+        std::vector<TaskScheduler::TaskSummary> summaries;
+        if (!scheduler->GetTaskSummaries(&summaries) ||
+            summaries.size() != kNumCatalogTasks) {
+            return;
+        }
+        scheduler->UnInitilize();
+    }
+    DeleteTaskJournal(journal_path);
+}
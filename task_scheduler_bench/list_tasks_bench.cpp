@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kCatalogSizes[] = { 1000, 10000 };
+const size_t kIterations = 1000;
+
+// Matches 11 tasks of "Task0" to "Task9999": "Task12" and "Task120" to
+// "Task129", or 111 with the 10000 task catalog.
+const wchar_t kPrefix[] = L"Task12";
+const wchar_t kPattern[] = L"task12*";
+
+}  // namespace
+
+// List the tasks starting with a prefix from the sorted name index, against
+// enumerating every task and filtering the names by hand.
+BENCHMARK(ListTasks) {
+    for (size_t num_tasks : kCatalogSizes) {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateFakeTaskScheduler(num_tasks, L"Task"));
+        if (!scheduler)
+            return;
+
+        std::vector<CStringW> names;
+        std::vector<bool> enabled;
+        // Build the index outside of the timed loops.
+        scheduler->ListTasks(kPrefix, &names, nullptr);
+
+        Stopwatch stopwatch;
+        for (size_t i = 0; i < kIterations; ++i) {
+            scheduler->ListTasks(kPrefix, &names, nullptr);
+            DoNotOptimize(names.size());
+        }
+        reporter->Report("ListTasks/Prefix", num_tasks, kIterations,
+            stopwatch.ElapsedNanoseconds());
+
+        stopwatch.Restart();
+        for (size_t i = 0; i < kIterations; ++i) {
+            scheduler->ListTasks(kPrefix, &names, &enabled);
+            DoNotOptimize(enabled.size());
+        }
+        reporter->Report("ListTasks/PrefixWithEnabled", num_tasks,
+            kIterations, stopwatch.ElapsedNanoseconds());
+
+        stopwatch.Restart();
+        for (size_t i = 0; i < kIterations; ++i) {
+            scheduler->FindTasks(kPattern, &names, nullptr);
+            DoNotOptimize(names.size());
+        }
+        reporter->Report("ListTasks/Pattern", num_tasks, kIterations,
+            stopwatch.ElapsedNanoseconds());
+
+        std::vector<TaskScheduler::TaskSummary> summaries;
+        size_t prefix_length = wcslen(kPrefix);
+        stopwatch.Restart();
+        for (size_t i = 0; i < kIterations; ++i) {
+            names.clear();
+            scheduler->GetTaskSummaries(&summaries);
+            for (const TaskScheduler::TaskSummary& summary : summaries) {
+                if (_wcsnicmp(summary.name, kPrefix, prefix_length) == 0)
+                    names.push_back(summary.name);
+            }
+            DoNotOptimize(names.size());
+        }
+        reporter->Report("ListTasks/EnumerateAndFilter", num_tasks,
+            kIterations, stopwatch.ElapsedNanoseconds());
+
+        scheduler->UnInitilize();
+    }
+}
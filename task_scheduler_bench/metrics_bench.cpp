@@ -0,0 +1,52 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+#include "task_scheduler_metrics.h"
+
+namespace {
+
+const size_t kNumTasks = 1000;
+const size_t kIterations = 100000;
+
+}  // namespace
+
+// Cost of the instrumentation on the cheapest operations, with metrics
+// disabled (arg 0) and enabled (arg 1).
+BENCHMARK(MetricsOverhead) {
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateFakeTaskScheduler(kNumTasks, L"Task"));
+    if (!scheduler)
+        return;
+
+    std::vector<CStringW> names(kNumTasks);
+    for (size_t i = 0; i < kNumTasks; ++i)
+        names[i].Format(L"Task%Iu", i);
+
+    for (size_t enabled = 0; enabled < 2; ++enabled) {
+        TaskSchedulerMetrics::Reset();
+        TaskSchedulerMetrics::SetEnabled(enabled != 0);
+
+        Stopwatch stopwatch;
+        for (size_t i = 0; i < kIterations; ++i)
+            DoNotOptimize(scheduler->IsTaskRegistered(names[i % kNumTasks]));
+        reporter->Report("MetricsOverhead/IsTaskRegistered", enabled,
+            kIterations, stopwatch.ElapsedNanoseconds());
+
+        stopwatch.Restart();
+        for (size_t i = 0; i < kIterations; ++i)
+            DoNotOptimize(scheduler->IsTaskEnabled(names[i % kNumTasks]));
+        reporter->Report("MetricsOverhead/IsTaskEnabled", enabled,
+            kIterations, stopwatch.ElapsedNanoseconds());
+    }
+
+    TaskSchedulerMetrics::SetEnabled(false);
+    TaskSchedulerMetrics::Reset();
+    scheduler->UnInitilize();
+}
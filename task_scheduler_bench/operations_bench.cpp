@@ -0,0 +1,167 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <stdio.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kCatalogSizes[] = { 10, 100, 1000, 10000, 100000 };
+const unsigned int kLatenciesUs[] = { 0, 50 };
+const wchar_t kTaskPrefix[] = L"Task";
+
+// Iterations per measurement. Operations that change the catalog get fewer
+// so that it doesn't grow much beyond its nominal size.
+size_t QueryIterations(unsigned int latency_us) {
+    return latency_us ? 1000 : 10000;
+}
+
+size_t UpdateIterations(unsigned int latency_us) {
+    return latency_us ? 100 : 1000;
+}
+
+std::vector<CStringW> RandomTaskNames(size_t num_tasks, size_t count) {
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<size_t> distribution(0, num_tasks - 1);
+    std::vector<CStringW> names(count);
+    for (CStringW& name : names)
+        name.Format(L"%s%Iu", kTaskPrefix, distribution(generator));
+    return names;
+}
+
+// A scheduler over a fake catalog of |num_tasks| tasks, along with the
+// folder it uses so that the backend can be measured on its own.
+struct Catalog {
+    CComPtr<ITaskService> service;
+    CComPtr<ITaskFolder> folder;
+    std::unique_ptr<TaskScheduler> scheduler;
+};
+
+// Build the catalog without latency, then warm the scheduler up so that
+// building its index isn't measured as part of the first operation.
+bool CreateCatalog(size_t num_tasks, Catalog* catalog) {
+    SetFakeTaskServiceLatency(0);
+    catalog->scheduler.reset(CreateFakeTaskScheduler(num_tasks, kTaskPrefix,
+        &catalog->service));
+    if (!catalog->scheduler)
+        return false;
+    if (FAILED(catalog->service->GetFolder(CComBSTR(L"\\"),
+        &catalog->folder))) {
+        return false;
+    }
+    catalog->scheduler->IsTaskRegistered(kTaskPrefix);
+    return true;
+}
+
+// The name an operation is reported under, e.g. "Operations/GetTask/50us".
+std::string OperationName(const char* operation, unsigned int latency_us) {
+    char name[64];
+    snprintf(name, sizeof(name), "Operations/%s/%uus", operation, latency_us);
+    return name;
+}
+
+// Time |operation|(scheduler, name) over |names| on every catalog size and
+// latency.
+template <typename Operation>
+void MeasureQuery(BenchmarkReporter* reporter, const char* operation_name,
+    Operation operation) {
+    for (unsigned int latency_us : kLatenciesUs) {
+        std::string name = OperationName(operation_name, latency_us);
+        for (size_t num_tasks : kCatalogSizes) {
+            Catalog catalog;
+            if (!CreateCatalog(num_tasks, &catalog))
+                return;
+            std::vector<CStringW> names =
+                RandomTaskNames(num_tasks, QueryIterations(latency_us));
+
+            SetFakeTaskServiceLatency(latency_us);
+            Stopwatch stopwatch;
+            for (const CStringW& task_name : names)
+                operation(&catalog, task_name);
+            double elapsed_ns = stopwatch.ElapsedNanoseconds();
+            SetFakeTaskServiceLatency(0);
+
+            reporter->Report(name.c_str(), num_tasks, names.size(), elapsed_ns);
+            catalog.scheduler->UnInitilize();
+        }
+    }
+}
+
+}  // namespace
+
+// Each TaskScheduler operation, and ITaskFolder::GetTask which most of them
+// start with, on catalogs of growing size. Every operation is measured with
+// the fake answering right away, which shows the scheduler's own cost, and
+// with a round trip latency close to that of a local task service, which
+// shows how many round trips the operation makes. Results are reported as
+// "Operations/<operation>/<latency>us" with the catalog size as argument.
+BENCHMARK(Operations) {
+    // The backend lookup alone, for reference.
+    MeasureQuery(reporter, "GetTask",
+        [](Catalog* catalog, const CStringW& name) {
+        CComPtr<IRegisteredTask> task;
+        DoNotOptimize(catalog->folder->GetTask(CComBSTR(name), &task));
+    });
+
+    MeasureQuery(reporter, "IsTaskRegistered",
+        [](Catalog* catalog, const CStringW& name) {
+        DoNotOptimize(catalog->scheduler->IsTaskRegistered(name));
+    });
+
+    MeasureQuery(reporter, "GetTaskInfo",
+        [](Catalog* catalog, const CStringW& name) {
+        TaskScheduler::TaskInfo info;
+        DoNotOptimize(catalog->scheduler->GetTaskInfo(name, &info));
+    });
+
+    // Alternate so that every call actually changes the task.
+    MeasureQuery(reporter, "SetTaskEnabled",
+        [](Catalog* catalog, const CStringW& name) {
+        bool enabled = !catalog->scheduler->IsTaskEnabled(name);
+        DoNotOptimize(catalog->scheduler->SetTaskEnabled(name, enabled));
+    });
+
+    for (unsigned int latency_us : kLatenciesUs) {
+        std::string register_name = OperationName("RegisterTask", latency_us);
+        std::string delete_name = OperationName("DeleteTask", latency_us);
+        size_t iterations = UpdateIterations(latency_us);
+        for (size_t num_tasks : kCatalogSizes) {
+            Catalog catalog;
+            if (!CreateCatalog(num_tasks, &catalog))
+                return;
+            std::vector<TaskScheduler::TaskSpec> specs =
+                MakeFakeTaskSpecs(L"New", 0, iterations);
+
+            // Create new tasks, then delete them again, which leaves the
+            // catalog as it was.
+            SetFakeTaskServiceLatency(latency_us);
+            Stopwatch stopwatch;
+            for (const TaskScheduler::TaskSpec& spec : specs) {
+                DoNotOptimize(catalog.scheduler->RegisterTask(spec.name,
+                    spec.description, spec.application_path,
+                    spec.application_arguments, spec.trigger_type,
+                    spec.hidden));
+            }
+            reporter->Report(register_name.c_str(), num_tasks, iterations,
+                stopwatch.ElapsedNanoseconds());
+
+            stopwatch.Restart();
+            for (const TaskScheduler::TaskSpec& spec : specs)
+                DoNotOptimize(catalog.scheduler->DeleteTask(spec.name));
+            reporter->Report(delete_name.c_str(), num_tasks, iterations,
+                stopwatch.ElapsedNanoseconds());
+            SetFakeTaskServiceLatency(0);
+
+            catalog.scheduler->UnInitilize();
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "bench.h"
+#include "fake_task_service.h"
+#include "in_process_task_scheduler.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kNumTasks = 1000;
+const size_t kIterations = 100000;
+// Long enough not to fit in the small string buffer of std::wstring.
+const wchar_t kTaskPrefix[] = L"Vendor Product Updater Task ";
+
+// The names of the tasks |first| to |first + kNumTasks - 1|. The schedulers
+// hold the first kNumTasks.
+std::vector<CStringW> TaskNames(size_t first) {
+    std::vector<CStringW> names(kNumTasks);
+    for (size_t i = 0; i < kNumTasks; ++i)
+        names[i].Format(L"%s%Iu", kTaskPrefix, first + i);
+    return names;
+}
+
+// Report the |allocations| made by the |kIterations| calls of |name|, and a
+// failure unless there were none.
+void ReportAllocations(BenchmarkReporter* reporter, const std::string& name,
+    uint64_t allocations) {
+    reporter->ReportValue(name.c_str(), kNumTasks,
+        static_cast<double>(allocations) / kIterations, "allocs/call");
+    if (allocations) {
+        char message[64];
+        snprintf(message, sizeof(message), "%llu allocations, expected 0",
+            static_cast<unsigned long long>(allocations));
+        reporter->ReportFailure(name.c_str(), message);
+    }
+}
+
+// Report the allocations per call of IsTaskRegistered(), IsTaskEnabled(),
+// GetTaskInfo() and OpenTask() on |scheduler|, none of which holds a task of
+// |missing_names|. All have to be 0: a miss is answered from what the
+// scheduler knows, as a hit is.
+void MeasureMisses(BenchmarkReporter* reporter, const std::string& prefix,
+    TaskScheduler* scheduler, const std::vector<CStringW>& missing_names) {
+    uint64_t before = GetAllocationCount();
+    for (size_t i = 0; i < kIterations; ++i) {
+        DoNotOptimize(scheduler->IsTaskRegistered(
+            missing_names[i % kNumTasks]));
+    }
+    ReportAllocations(reporter, prefix + "/IsTaskRegistered/Miss",
+        GetAllocationCount() - before);
+
+    before = GetAllocationCount();
+    for (size_t i = 0; i < kIterations; ++i)
+        DoNotOptimize(scheduler->IsTaskEnabled(missing_names[i % kNumTasks]));
+    ReportAllocations(reporter, prefix + "/IsTaskEnabled/Miss",
+        GetAllocationCount() - before);
+
+    TaskScheduler::TaskInfo info;
+    before = GetAllocationCount();
+    for (size_t i = 0; i < kIterations; ++i) {
+        DoNotOptimize(scheduler->GetTaskInfo(missing_names[i % kNumTasks],
+            &info));
+    }
+    ReportAllocations(reporter, prefix + "/GetTaskInfo/Miss",
+        GetAllocationCount() - before);
+
+    before = GetAllocationCount();
+    for (size_t i = 0; i < kIterations; ++i) {
+        std::unique_ptr<TaskScheduler::TaskHandle> handle(
+            scheduler->OpenTask(missing_names[i % kNumTasks]));
+        DoNotOptimize(handle.get());
+    }
+    ReportAllocations(reporter, prefix + "/OpenTask/Miss",
+        GetAllocationCount() - before);
+}
+
+// Report the allocations per call of IsTaskRegistered() and IsTaskEnabled()
+// on |scheduler|, which holds a task for each of |names|, once they are
+// warmed up, and of the queries of MeasureMisses() for |missing_names|. All
+// have to be 0.
+void MeasureQueries(BenchmarkReporter* reporter, const char* backend,
+    TaskScheduler* scheduler, const std::vector<CStringW>& names,
+    const std::vector<CStringW>& missing_names) {
+    for (const CStringW& name : names) {
+        scheduler->IsTaskRegistered(name);
+        scheduler->IsTaskEnabled(name);
+    }
+
+    std::string prefix = std::string("QueryAllocations/") + backend;
+    uint64_t before = GetAllocationCount();
+    for (size_t i = 0; i < kIterations; ++i)
+        DoNotOptimize(scheduler->IsTaskRegistered(names[i % kNumTasks]));
+    ReportAllocations(reporter, prefix + "/IsTaskRegistered",
+        GetAllocationCount() - before);
+
+    before = GetAllocationCount();
+    for (size_t i = 0; i < kIterations; ++i)
+        DoNotOptimize(scheduler->IsTaskEnabled(names[i % kNumTasks]));
+    ReportAllocations(reporter, prefix + "/IsTaskEnabled",
+        GetAllocationCount() - before);
+
+    MeasureMisses(reporter, prefix, scheduler, missing_names);
+}
+
+}  // namespace
+
+// Heap allocations made by name based queries in steady state, see
+// GetAllocationCount(). Any allocation fails the benchmark.
+BENCHMARK(QueryAllocations) {
+    std::vector<CStringW> names = TaskNames(0);
+    std::vector<CStringW> missing_names = TaskNames(kNumTasks);
+
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateFakeTaskScheduler(kNumTasks, kTaskPrefix));
+    if (!scheduler)
+        return;
+    MeasureQueries(reporter, "TaskService", scheduler.get(), names,
+        missing_names);
+    scheduler->UnInitilize();
+
+    scheduler.reset(CreateInProcessTaskScheduler(1));
+    if (!scheduler->Initilize())
+        return;
+    for (const CStringW& name : names) {
+        scheduler->RegisterTask(name, L"Benchmark task.",
+            L"C:\\Program Files\\Bench\\bench.exe", L"",
+            TaskScheduler::TRIGGER_TYPE_POST_REBOOT, false);
+    }
+    MeasureQueries(reporter, "InProcess", scheduler.get(), names,
+        missing_names);
+    scheduler->UnInitilize();
+}
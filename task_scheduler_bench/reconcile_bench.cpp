@@ -0,0 +1,102 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_reconciler.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kManifestSizes[] = { 100, 1000, 10000 };
+
+// Return a manifest of |count| enabled tasks. |generation| goes into the
+// arguments of every tenth task, so that manifests of different generations
+// differ by that many updates.
+TaskReconciler::Manifest MakeManifest(size_t first, size_t count,
+    int generation) {
+    std::vector<TaskScheduler::TaskSpec> specs =
+        MakeFakeTaskSpecs(L"Task", first, count);
+    TaskReconciler::Manifest manifest(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = first + i;
+        TaskScheduler::TaskSpec& spec = manifest[i].spec;
+        spec = specs[i];
+        spec.application_arguments.AppendFormat(L" --generation=%d",
+            index % 10 ? 0 : generation);
+        manifest[i].enabled = true;
+    }
+    return manifest;
+}
+
+std::vector<TaskScheduler::TaskSpec> SpecsOf(
+    const TaskReconciler::Manifest& manifest) {
+    std::vector<TaskScheduler::TaskSpec> specs;
+    for (const TaskReconciler::ManifestEntry& entry : manifest)
+        specs.push_back(entry.spec);
+    return specs;
+}
+
+// Return a scheduler whose folder holds the tasks of generation 0 of a
+// manifest of |size| tasks, or null on failure. The next generation drops the
+// first 1% of the tasks, adds as many new ones and updates 10%.
+TaskScheduler* CreateScheduler(size_t size) {
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateFakeTaskScheduler(0, L"Task"));
+    if (!scheduler)
+        return nullptr;
+    std::vector<TaskScheduler::RegisterResult> results;
+    if (!scheduler->RegisterTasks(SpecsOf(MakeManifest(0, size, 0)), &results))
+        return nullptr;
+    return scheduler.release();
+}
+
+}  // namespace
+
+// Move the folder to the next generation of the manifest with Apply().
+BENCHMARK(ReconcileApply) {
+    for (size_t size : kManifestSizes) {
+        std::unique_ptr<TaskScheduler> scheduler(CreateScheduler(size));
+        if (!scheduler)
+            return;
+        TaskReconciler::Manifest manifest =
+            MakeManifest(size / 100, size, 1);
+
+        TaskReconciler reconciler(scheduler.get(),
+            TaskReconciler::SchedulerFactory());
+        TaskReconciler::Options options;
+        options.delete_unlisted = true;
+        TaskReconciler::Report report;
+        Stopwatch stopwatch;
+        DoNotOptimize(reconciler.Apply(manifest, options, &report));
+        reporter->Report("ReconcileApply", size, 1,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
+
+// The same transition made with the imperative calls: register the whole
+// manifest, then delete the tasks that left it.
+BENCHMARK(ReconcileImperative) {
+    for (size_t size : kManifestSizes) {
+        std::unique_ptr<TaskScheduler> scheduler(CreateScheduler(size));
+        if (!scheduler)
+            return;
+        std::vector<TaskScheduler::TaskSpec> specs =
+            SpecsOf(MakeManifest(size / 100, size, 1));
+        std::vector<TaskScheduler::RegisterResult> results;
+
+        Stopwatch stopwatch;
+        DoNotOptimize(scheduler->RegisterTasks(specs, &results));
+        for (size_t i = 0; i < size / 100; ++i) {
+            CStringW name;
+            name.Format(L"Task%Iu", i);
+            DoNotOptimize(scheduler->DeleteTask(name));
+        }
+        reporter->Report("ReconcileImperative", size, 1,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
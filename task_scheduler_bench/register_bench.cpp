@@ -0,0 +1,101 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kBatchSizes[] = { 10, 100, 1000 };
+const wchar_t kTaskPrefix[] = L"Task";
+
+// Half of the tasks run hourly and half after a reboot, whose trigger has a
+// delay to write.
+std::vector<TaskScheduler::TaskSpec> MakeSpecs(size_t count) {
+    std::vector<TaskScheduler::TaskSpec> specs =
+        MakeFakeTaskSpecs(kTaskPrefix, 0, count);
+    for (size_t i = 0; i < count; i += 2)
+        specs[i].trigger_type = TaskScheduler::TRIGGER_TYPE_POST_REBOOT;
+    return specs;
+}
+
+// What the folder holds before the timed registrations.
+enum Existing {
+    // Nothing: every task gets created.
+    EXISTING_NONE,
+    // Tasks with the same names but other definitions: every task is updated.
+    EXISTING_DIFFERENT,
+    // The very same specs: nothing needs to be written.
+    EXISTING_SAME,
+};
+
+// Return a scheduler over a fake folder prepared for registering |specs|
+// according to |existing|, or null on failure.
+TaskScheduler* CreateScheduler(
+    const std::vector<TaskScheduler::TaskSpec>& specs, Existing existing) {
+    size_t num_existing = existing == EXISTING_DIFFERENT ? specs.size() : 0;
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateFakeTaskScheduler(num_existing, kTaskPrefix));
+    if (!scheduler)
+        return nullptr;
+    std::vector<TaskScheduler::RegisterResult> results;
+    if (existing == EXISTING_SAME && !scheduler->RegisterTasks(specs, &results))
+        return nullptr;
+    return scheduler.release();
+}
+
+void RegisterInLoop(BenchmarkReporter* reporter, const char* name,
+    Existing existing) {
+    for (size_t batch_size : kBatchSizes) {
+        std::vector<TaskScheduler::TaskSpec> specs = MakeSpecs(batch_size);
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateScheduler(specs, existing));
+        if (!scheduler)
+            return;
+
+        Stopwatch stopwatch;
+        for (const TaskScheduler::TaskSpec& spec : specs) {
+            DoNotOptimize(scheduler->RegisterTask(spec.name, spec.description,
+                spec.application_path, spec.application_arguments,
+                spec.trigger_type, spec.hidden));
+        }
+        reporter->Report(name, batch_size, batch_size,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
+
+void RegisterInBatch(BenchmarkReporter* reporter, const char* name,
+    Existing existing) {
+    for (size_t batch_size : kBatchSizes) {
+        std::vector<TaskScheduler::TaskSpec> specs = MakeSpecs(batch_size);
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateScheduler(specs, existing));
+        if (!scheduler)
+            return;
+        std::vector<TaskScheduler::RegisterResult> results;
+
+        Stopwatch stopwatch;
+        DoNotOptimize(scheduler->RegisterTasks(specs, &results));
+        reporter->Report(name, batch_size, batch_size,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
+
+}  // namespace
+
+BENCHMARK(RegisterTaskLoop) {
+    RegisterInLoop(reporter, "RegisterTaskLoop/Create", EXISTING_NONE);
+    RegisterInLoop(reporter, "RegisterTaskLoop/Update", EXISTING_DIFFERENT);
+    RegisterInLoop(reporter, "RegisterTaskLoop/Unchanged", EXISTING_SAME);
+}
+
+BENCHMARK(RegisterTasksBatch) {
+    RegisterInBatch(reporter, "RegisterTasksBatch/Create", EXISTING_NONE);
+    RegisterInBatch(reporter, "RegisterTasksBatch/Update", EXISTING_DIFFERENT);
+    RegisterInBatch(reporter, "RegisterTasksBatch/Unchanged", EXISTING_SAME);
+}
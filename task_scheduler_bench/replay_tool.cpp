@@ -0,0 +1,101 @@
+#include "replay_tool.h"
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fake_task_service.h"
+#include "in_process_task_scheduler.h"
+#include "task_scheduler.h"
+#include "workload_trace.h"
+
+namespace {
+
+// The folder the task_service backend replays into.
+const wchar_t kReplayFolder[] = L"\\TaskSchedulerReplay";
+
+void ReportStats(const char* name, const char* call,
+    const ReplayReport::CallStats& stats, size_t num_clients,
+    BenchmarkReporter* reporter) {
+    std::string prefix = std::string(name) + "/" + call + "/";
+    reporter->ReportValue((prefix + "count").c_str(), num_clients,
+        static_cast<double>(stats.count), "calls");
+    reporter->ReportValue((prefix + "failures").c_str(), num_clients,
+        static_cast<double>(stats.failures), "calls");
+    reporter->ReportValue((prefix + "p50").c_str(), num_clients,
+        stats.p50_us, "us");
+    reporter->ReportValue((prefix + "p99").c_str(), num_clients,
+        stats.p99_us, "us");
+    reporter->ReportValue((prefix + "p999").c_str(), num_clients,
+        stats.p999_us, "us");
+    reporter->ReportValue((prefix + "max").c_str(), num_clients,
+        stats.max_us, "us");
+}
+
+// Return a new, not yet initialized scheduler of |backend|, or null if there
+// is no such backend.
+TaskScheduler* CreateReplayScheduler(const char* backend,
+    unsigned int latency_us) {
+    if (strcmp(backend, "fake") == 0) {
+        CComPtr<ITaskService> service;
+        if (FAILED(CreateFakeTaskService(0, L"", &service)))
+            return nullptr;
+        SetFakeTaskServiceLatency(latency_us);
+        return CreateTaskSchedulerForService(service, L"\\");
+    }
+    if (strcmp(backend, "in_process") == 0)
+        return CreateInProcessTaskScheduler(0);
+    if (strcmp(backend, "task_service") == 0)
+        return CreateTaskSchedulerForFolder(kReplayFolder);
+    return nullptr;
+}
+
+}  // namespace
+
+void ReportReplay(const char* name, const ReplayReport& report,
+    size_t num_clients, BenchmarkReporter* reporter) {
+    std::string prefix(name);
+    reporter->ReportValue((prefix + "/Throughput").c_str(), num_clients,
+        report.calls_per_second, "calls/s");
+    reporter->ReportValue((prefix + "/MaxIssueDelay").c_str(), num_clients,
+        report.max_issue_delay_us, "us");
+    ReportStats(name, "All", report.total, num_clients, reporter);
+    for (size_t i = 0; i < WorkloadCall::CALL_TYPE_MAX; ++i) {
+        if (!report.calls[i].count)
+            continue;
+        ReportStats(name,
+            GetWorkloadCallName(static_cast<WorkloadCall::Type>(i)),
+            report.calls[i], num_clients, reporter);
+    }
+}
+
+bool RunReplayTool(const char* trace_path, const char* backend, double speed,
+    size_t num_clients, unsigned int latency_us, BenchmarkReporter* reporter) {
+    std::vector<WorkloadCall> calls;
+    if (!ReadWorkloadTrace(CStringW(trace_path), &calls)) {
+        fprintf(stderr, "Can't read the trace '%s'.\n", trace_path);
+        return false;
+    }
+
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateReplayScheduler(backend, latency_us));
+    if (!scheduler || !scheduler->Initilize()) {
+        fprintf(stderr, "Can't set up the '%s' backend.\n", backend);
+        return false;
+    }
+
+    ReplayReport report;
+    ReplayWorkload(calls, scheduler.get(), speed, num_clients, &report);
+    scheduler->UnInitilize();
+    SetFakeTaskServiceLatency(0);
+
+    ReportReplay("Replay", report, num_clients, reporter);
+    return true;
+}
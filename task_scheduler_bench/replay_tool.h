@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "bench.h"
+#include "workload_replayer.h"
+
+// Hand what |report| measured to |reporter| as "<name>/<call>/<statistic>",
+// with |num_clients| as the argument. Calls that weren't replayed are left
+// out.
+void ReportReplay(const char* name, const ReplayReport& report,
+    size_t num_clients, BenchmarkReporter* reporter);
+
+// Replay the trace at |trace_path|, as recorded by a scheduler from
+// CreateRecordingTaskScheduler(), against a new scheduler of |backend| and
+// report the results as "Replay/...". Return false if the trace can't be
+// read or the scheduler can't be initialized. The backends are:
+//   fake          An in-memory task service that starts out empty, whose
+//                 calls take |latency_us| each.
+//   in_process    The in-process engine. It launches the applications of the
+//                 tasks whose triggers fire during the replay.
+//   task_service  The Task Scheduler service, in a folder of its own so that
+//                 the replay doesn't touch the tasks of the machine.
+bool RunReplayTool(const char* trace_path, const char* backend, double speed,
+    size_t num_clients, unsigned int latency_us, BenchmarkReporter* reporter);
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <time.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kCatalogSizes[] = { 100, 1000, 10000 };
+const size_t kIterations = 10;
+
+const int64_t kOneHourInSeconds = 60 * 60;
+
+// Return the number of tasks of |states| whose last run, within the hour
+// before |now|, failed.
+size_t CountRecentFailures(const TaskScheduler::TaskRunStates& states,
+    int64_t now) {
+    size_t failures = 0;
+    for (size_t i = 0; i < states.size(); ++i) {
+        if (states.last_run_times[i] >= now - kOneHourInSeconds &&
+            FAILED(states.last_results[i])) {
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+}  // namespace
+
+// The "failed in the last hour" view of a whole folder: one GetTaskRunStates()
+// and a scan of two of its columns. Doubles as a check that tasks that never
+// ran, as all fake tasks, have no last run time.
+BENCHMARK(RunStates) {
+    for (size_t num_tasks : kCatalogSizes) {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateFakeTaskScheduler(num_tasks, L"Task"));
+        if (!scheduler)
+            return;
+
+        TaskScheduler::TaskRunStates states;
+        Stopwatch stopwatch;
+        for (size_t i = 0; i < kIterations; ++i) {
+            scheduler->GetTaskRunStates(&states);
+            DoNotOptimize(states.size());
+        }
+        reporter->Report("RunStates/GetTaskRunStates", num_tasks,
+            kIterations, stopwatch.ElapsedNanoseconds());
+        for (size_t i = 0; i < states.size(); ++i) {
+            if (states.last_run_times[i] != 0) {
+                reporter->ReportFailure("RunStates/GetTaskRunStates",
+                    "a task that never ran has a last run time");
+                break;
+            }
+        }
+
+        int64_t now = static_cast<int64_t>(time(nullptr));
+        stopwatch.Restart();
+        for (size_t i = 0; i < kIterations; ++i)
+            DoNotOptimize(CountRecentFailures(states, now));
+        reporter->Report("RunStates/ScanRecentFailures", num_tasks,
+            kIterations, stopwatch.ElapsedNanoseconds());
+
+        scheduler->UnInitilize();
+    }
+}
@@ -0,0 +1,107 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kNumTasks = 1000;
+
+// Return an initialized scheduler over a fresh fake folder of |kNumTasks|
+// tasks, so that nothing read by a previous measurement is cached, or null.
+TaskScheduler* CreateScheduler() {
+    std::unique_ptr<TaskScheduler> scheduler(
+        CreateFakeTaskScheduler(kNumTasks, L"Task"));
+    if (!scheduler)
+        return nullptr;
+    // Have the name index built outside of the timed loops.
+    scheduler->IsTaskRegistered(L"Task0");
+    return scheduler.release();
+}
+
+// Read the application path of every task of |names| with GetTaskInfo().
+void ReadEagerly(BenchmarkReporter* reporter, const char* name,
+    TaskScheduler* scheduler, const std::vector<CStringW>& names) {
+    TaskScheduler::TaskInfo info;
+    Stopwatch stopwatch;
+    for (const CStringW& task_name : names) {
+        if (scheduler->GetTaskInfo(task_name, &info) &&
+            !info.exec_actions.empty()) {
+            const CStringW& application_path =
+                info.exec_actions.front().application_path;
+            DoNotOptimize(application_path.GetLength());
+        }
+    }
+    reporter->Report(name, kNumTasks, names.size(),
+        stopwatch.ElapsedNanoseconds());
+}
+
+// Same as above through a handle, also reading every other field if
+// |all_fields|.
+void ReadLazily(BenchmarkReporter* reporter, const char* name,
+    TaskScheduler* scheduler, const std::vector<CStringW>& names,
+    bool all_fields) {
+    CStringW application_path;
+    CStringW description;
+    std::vector<TaskScheduler::TaskExecAction> actions;
+    uint32_t logon_type = 0;
+    Stopwatch stopwatch;
+    for (const CStringW& task_name : names) {
+        std::unique_ptr<TaskScheduler::TaskHandle> handle(
+            scheduler->OpenTask(task_name));
+        if (!handle)
+            continue;
+        handle->GetApplicationPath(&application_path);
+        DoNotOptimize(application_path.GetLength());
+        if (all_fields) {
+            handle->GetDescription(&description);
+            handle->GetExecActions(&actions);
+            handle->GetLogonType(&logon_type);
+            DoNotOptimize(logon_type);
+        }
+    }
+    reporter->Report(name, kNumTasks, names.size(),
+        stopwatch.ElapsedNanoseconds());
+}
+
+}  // namespace
+
+// Read the application path of every task, the most common query, through
+// GetTaskInfo() and through lazy task handles. Each measurement gets its own
+// folder, as GetTaskInfo() remembers what it read: the second eager pass
+// shows the cost once everything is cached.
+BENCHMARK(TaskHandle) {
+    std::vector<CStringW> names(kNumTasks);
+    for (size_t i = 0; i < kNumTasks; ++i)
+        names[i].Format(L"Task%Iu", i);
+
+    std::unique_ptr<TaskScheduler> scheduler(CreateScheduler());
+    if (!scheduler)
+        return;
+    ReadEagerly(reporter, "TaskHandle/GetTaskInfo", scheduler.get(), names);
+    ReadEagerly(reporter, "TaskHandle/GetTaskInfoCached", scheduler.get(),
+        names);
+    ReadLazily(reporter, "TaskHandle/OpenTaskCached", scheduler.get(), names,
+        false);
+    scheduler->UnInitilize();
+
+    scheduler.reset(CreateScheduler());
+    if (!scheduler)
+        return;
+    ReadLazily(reporter, "TaskHandle/ApplicationPath", scheduler.get(), names,
+        false);
+    scheduler->UnInitilize();
+
+    scheduler.reset(CreateScheduler());
+    if (!scheduler)
+        return;
+    ReadLazily(reporter, "TaskHandle/AllFields", scheduler.get(), names,
+        true);
+    scheduler->UnInitilize();
+}
@@ -0,0 +1,84 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "bench.h"
+#include "fake_task_service.h"
+#include "heap_usage.h"
+#include "task_info_table.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kCatalogSizes[] = { 1000, 10000, 100000 };
+
+// Report the time per task, the |allocations| made by the read and the blocks
+// and bytes still allocated on the heap since |before| as
+// "BulkTaskInfo/<kind>/...".
+void ReportBulkRead(BenchmarkReporter* reporter, const char* kind,
+    size_t num_tasks, double elapsed_ns, uint64_t allocations,
+    const HeapUsage& before) {
+    HeapUsage after;
+    if (!GetHeapUsage(&after))
+        return;
+    std::string prefix = std::string("BulkTaskInfo/") + kind;
+    reporter->Report((prefix + "/Read").c_str(), num_tasks, num_tasks,
+        elapsed_ns);
+    reporter->ReportValue((prefix + "/Allocations").c_str(), num_tasks,
+        static_cast<double>(allocations), "allocs");
+    reporter->ReportValue((prefix + "/Retained").c_str(), num_tasks,
+        static_cast<double>(after.num_blocks - before.num_blocks), "blocks");
+    reporter->ReportValue((prefix + "/Footprint").c_str(), num_tasks,
+        static_cast<double>(after.num_bytes - before.num_bytes), "bytes");
+}
+
+}  // namespace
+
+// Read a whole catalog into a std::vector<TaskInfo> and into a TaskInfoTable,
+// and measure what each allocates while reading, see GetAllocationCount(),
+// and what it keeps allocated. Every fake task has the same exec
+// action, as tasks registered by the same product mostly do.
+BENCHMARK(BulkTaskInfo) {
+    for (size_t num_tasks : kCatalogSizes) {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateFakeTaskScheduler(num_tasks, L"Task"));
+        if (!scheduler)
+            return;
+        // Build the scheduler's index outside of the measurements.
+        scheduler->IsTaskRegistered(L"Task0");
+
+        HeapUsage before;
+        {
+            if (!GetHeapUsage(&before))
+                return;
+            uint64_t allocations = GetAllocationCount();
+            Stopwatch stopwatch;
+            std::vector<TaskScheduler::TaskInfo> infos;
+            if (!scheduler->GetAllTaskInfo(&infos))
+                return;
+            double elapsed_ns = stopwatch.ElapsedNanoseconds();
+            allocations = GetAllocationCount() - allocations;
+            ReportBulkRead(reporter, "Vector", num_tasks, elapsed_ns,
+                allocations, before);
+        }
+        {
+            if (!GetHeapUsage(&before))
+                return;
+            uint64_t allocations = GetAllocationCount();
+            Stopwatch stopwatch;
+            TaskInfoTable table;
+            if (!scheduler->GetTaskInfoTable(&table))
+                return;
+            double elapsed_ns = stopwatch.ElapsedNanoseconds();
+            allocations = GetAllocationCount() - allocations;
+            ReportBulkRead(reporter, "Table", num_tasks, elapsed_ns,
+                allocations, before);
+        }
+        scheduler->UnInitilize();
+    }
+}
@@ -0,0 +1,141 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "task_scheduler.h"
+
+namespace {
+
+const size_t kCatalogSizes[] = { 10, 1000, 100000 };
+const wchar_t kTaskPrefix[] = L"Task";
+
+std::vector<CStringW> RandomTaskNames(size_t num_tasks, size_t count) {
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<size_t> distribution(0, num_tasks - 1);
+    std::vector<CStringW> names(count);
+    for (CStringW& name : names)
+        name.Format(L"%s%Iu", kTaskPrefix, distribution(generator));
+    return names;
+}
+
+// Number of lookups to time per catalog size. Scans are O(n) so they get
+// fewer iterations on large catalogs to keep the run time bounded.
+size_t LookupIterations(size_t num_tasks, bool linear) {
+    if (!linear)
+        return 100000;
+    return num_tasks >= 100000 ? 10 : num_tasks >= 1000 ? 1000 : 100000;
+}
+
+// The lookup TaskSchedulerV2 used to do for every query: walk the folder with
+// get_Item/get_Name and compare each name.
+bool ScanForTask(ITaskFolder* folder, const wchar_t* task_name) {
+    CComPtr<IRegisteredTaskCollection> tasks;
+    if (FAILED(folder->GetTasks(TASK_ENUM_HIDDEN, &tasks)))
+        return false;
+    LONG num_tasks = 0;
+    if (FAILED(tasks->get_Count(&num_tasks)))
+        return false;
+    for (LONG i = 1; i <= num_tasks; ++i) {
+        CComPtr<IRegisteredTask> task;
+        if (FAILED(tasks->get_Item(CComVariant(i), &task)))
+            continue;
+        CComBSTR name;
+        if (FAILED(task->get_Name(&name)))
+            continue;
+        if (::_wcsicmp(CStringW(name ? name : L""), task_name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Register |count| tasks of our own with |scheduler|.
+bool RegisterOwnTasks(TaskScheduler* scheduler, size_t count) {
+    std::vector<TaskScheduler::RegisterResult> results;
+    return scheduler->RegisterTasks(MakeFakeTaskSpecs(L"Own", 0, count),
+        &results);
+}
+
+}  // namespace
+
+BENCHMARK(LinearScanLookup) {
+    for (size_t num_tasks : kCatalogSizes) {
+        CComPtr<ITaskService> service;
+        if (FAILED(CreateFakeTaskService(num_tasks, kTaskPrefix, &service)))
+            return;
+        CComPtr<ITaskFolder> folder;
+        if (FAILED(service->GetFolder(CComBSTR(L"\\"), &folder)))
+            return;
+
+        size_t iterations = LookupIterations(num_tasks, true);
+        std::vector<CStringW> names = RandomTaskNames(num_tasks, iterations);
+        Stopwatch stopwatch;
+        for (const CStringW& name : names)
+            DoNotOptimize(ScanForTask(folder, name));
+        reporter->Report("LinearScanLookup", num_tasks, iterations,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
+
+BENCHMARK(IndexedLookup) {
+    for (size_t num_tasks : kCatalogSizes) {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateFakeTaskScheduler(num_tasks, kTaskPrefix));
+        if (!scheduler)
+            return;
+
+        // The first query builds the index with one enumeration.
+        Stopwatch stopwatch;
+        DoNotOptimize(scheduler->IsTaskRegistered(kTaskPrefix));
+        reporter->Report("IndexedLookup/Build", num_tasks, 1,
+            stopwatch.ElapsedNanoseconds());
+
+        size_t iterations = LookupIterations(num_tasks, false);
+        std::vector<CStringW> names = RandomTaskNames(num_tasks, iterations);
+        stopwatch.Restart();
+        for (const CStringW& name : names)
+            DoNotOptimize(scheduler->IsTaskRegistered(name));
+        reporter->Report("IndexedLookup", num_tasks, iterations,
+            stopwatch.ElapsedNanoseconds());
+
+        scheduler->UnInitilize();
+    }
+}
+
+// Read the summaries of our own tasks with the root folder full of tasks of
+// other software, once with our tasks in the root folder and once with them
+// in a folder of their own.
+BENCHMARK(FolderSummaries) {
+    const size_t kNumOwnTasks = 100;
+    for (size_t num_tasks : kCatalogSizes) {
+        CComPtr<ITaskService> service;
+        if (FAILED(CreateFakeTaskService(num_tasks, kTaskPrefix, &service)))
+            return;
+
+        const wchar_t* const kFolders[] = { L"\\", L"\\Vendor\\Bench" };
+        const char* const kNames[] = {
+            "FolderSummaries/Root", "FolderSummaries/OwnFolder" };
+        for (size_t i = 0; i < _countof(kFolders); ++i) {
+            std::unique_ptr<TaskScheduler> scheduler(
+                CreateTaskSchedulerForService(service, kFolders[i]));
+            if (!scheduler->Initilize() ||
+                !RegisterOwnTasks(scheduler.get(), kNumOwnTasks)) {
+                return;
+            }
+
+            const size_t kIterations = 10;
+            std::vector<TaskScheduler::TaskSummary> summaries;
+            Stopwatch stopwatch;
+            for (size_t j = 0; j < kIterations; ++j)
+                DoNotOptimize(scheduler->GetTaskSummaries(&summaries));
+            reporter->Report(kNames[i], num_tasks, kIterations,
+                stopwatch.ElapsedNanoseconds());
+            scheduler->UnInitilize();
+        }
+    }
+}
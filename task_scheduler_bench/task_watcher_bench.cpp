@@ -0,0 +1,154 @@
+#include <stdio.h>
+
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "in_process_task_scheduler.h"
+#include "task_scheduler.h"
+#include "task_watcher.h"
+
+namespace {
+
+const size_t kNumTasks = 1000;
+// Tasks disabled, deleted and added between two polls.
+const size_t kNumChanges = 100;
+// More changes than the watcher keeps for delivery between two polls.
+const size_t kNumOverflowChanges = 5000;
+
+// What the subscription of CountChanges() was called with.
+struct ChangeCounts {
+    size_t added;
+    size_t removed;
+    size_t disabled;
+    // Calls with no changes, which mean that changes were dropped.
+    size_t num_dropped;
+};
+
+void CountChanges(TaskWatcher* watcher, ChangeCounts* counts) {
+    watcher->Subscribe(std::vector<CStringW>(),
+        [counts](const std::vector<TaskWatcher::Change>& changes) {
+        if (changes.empty())
+            ++counts->num_dropped;
+        for (const TaskWatcher::Change& change : changes) {
+            if (change.type == TaskScheduler::CHANGE_ADDED)
+                ++counts->added;
+            else if (change.type == TaskScheduler::CHANGE_REMOVED)
+                ++counts->removed;
+            else if (change.type == TaskScheduler::CHANGE_DISABLED)
+                ++counts->disabled;
+        }
+    });
+}
+
+// Register the tasks "Task<first>" to "Task<first + count - 1>". Return false
+// if any failed.
+bool RegisterTasks(TaskScheduler* scheduler, size_t first, size_t count) {
+    CStringW name;
+    for (size_t i = first; i < first + count; ++i) {
+        name.Format(L"Task%Iu", i);
+        if (!scheduler->RegisterTask(name, L"Benchmark task.",
+                L"C:\\Program Files\\Bench\\bench.exe", L"",
+                TaskScheduler::TRIGGER_TYPE_HOURLY, false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Disable the first kNumChanges tasks, delete the next kNumChanges and add
+// as many. Return false if any change failed.
+bool MakeChanges(TaskScheduler* scheduler) {
+    CStringW name;
+    for (size_t i = 0; i < 2 * kNumChanges; ++i) {
+        name.Format(L"Task%Iu", i);
+        bool changed = i < kNumChanges ?
+            scheduler->SetTaskEnabled(name, false) :
+            scheduler->DeleteTask(name);
+        if (!changed)
+            return false;
+    }
+    return RegisterTasks(scheduler, kNumTasks, kNumChanges);
+}
+
+// Watch |scheduler|, which holds the tasks "Task0" to "Task<kNumTasks - 1>",
+// make the changes of MakeChanges() and report how long the Poll() that
+// delivers them takes. A failure is reported unless the subscriber got
+// exactly those changes. If |overflow|, then check that a subscriber that
+// isn't polled is told to start over instead of piling up changes.
+void MeasureWatcher(BenchmarkReporter* reporter, const char* backend,
+    TaskScheduler* scheduler, bool overflow) {
+    std::string name = std::string("TaskWatcher/") + backend;
+    TaskWatcher watcher(scheduler);
+    if (!watcher.Start()) {
+        reporter->ReportFailure(name.c_str(), "Start() failed");
+        return;
+    }
+    TaskWatcher::Snapshot snapshot;
+    watcher.GetSnapshot(&snapshot);
+    if (snapshot.tasks.size() != kNumTasks) {
+        reporter->ReportFailure(name.c_str(), "incomplete snapshot");
+        return;
+    }
+
+    ChangeCounts counts = {};
+    CountChanges(&watcher, &counts);
+    if (!MakeChanges(scheduler)) {
+        reporter->ReportFailure(name.c_str(), "changes failed");
+        return;
+    }
+    Stopwatch stopwatch;
+    bool polled = watcher.Poll();
+    reporter->Report((name + "/Poll").c_str(), kNumTasks, 1,
+        stopwatch.ElapsedNanoseconds());
+    if (!polled || counts.added != kNumChanges ||
+        counts.removed != kNumChanges || counts.disabled != kNumChanges ||
+        counts.num_dropped) {
+        char message[128];
+        snprintf(message, sizeof(message),
+            "got %Iu added, %Iu removed, %Iu disabled, expected %Iu each",
+            counts.added, counts.removed, counts.disabled, kNumChanges);
+        reporter->ReportFailure(name.c_str(), message);
+        return;
+    }
+
+    if (!overflow)
+        return;
+    counts = ChangeCounts();
+    if (!RegisterTasks(scheduler, kNumTasks + kNumChanges,
+        kNumOverflowChanges)) {
+        reporter->ReportFailure(name.c_str(), "changes failed");
+        return;
+    }
+    watcher.Poll();
+    if (counts.num_dropped != 1 || counts.added) {
+        reporter->ReportFailure((name + "/Overflow").c_str(),
+            "undelivered changes weren't dropped");
+    }
+}
+
+}  // namespace
+
+// TaskWatcher on the in-process engine, which reports its changes, and on
+// the fake task service, which is polled. Doubles as a check that both
+// deliver the changes made between two polls.
+BENCHMARK(TaskWatcherPoll) {
+    std::unique_ptr<TaskScheduler> scheduler(CreateInProcessTaskScheduler(1));
+    if (!scheduler->Initilize())
+        return;
+    if (RegisterTasks(scheduler.get(), 0, kNumTasks))
+        MeasureWatcher(reporter, "InProcess", scheduler.get(), true);
+    scheduler->UnInitilize();
+
+    scheduler.reset(CreateFakeTaskScheduler(kNumTasks, L"Task"));
+    if (!scheduler)
+        return;
+    MeasureWatcher(reporter, "TaskService", scheduler.get(), false);
+    scheduler->UnInitilize();
+}
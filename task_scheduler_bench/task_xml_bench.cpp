@@ -0,0 +1,98 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "heap_usage.h"
+#include "task_scheduler.h"
+#include "task_xml.h"
+
+namespace {
+
+const size_t kTaskSetSizes[] = { 1000, 10000 };
+const size_t kImportBatchSize = 256;
+
+// Every trigger a task set can hold, and some hidden tasks.
+std::vector<TaskScheduler::TaskSpec> MakeSpecs(size_t count) {
+    std::vector<TaskScheduler::TaskSpec> specs =
+        MakeFakeTaskSpecs(L"Vendor Product Task ", 0, count);
+    for (size_t i = 0; i < count; ++i) {
+        specs[i].trigger_type =
+            static_cast<TaskScheduler::TriggerType>(i % 4);
+        specs[i].hidden = i % 3 == 0;
+    }
+    return specs;
+}
+
+}  // namespace
+
+// Moving a set of tasks between machines: exporting every task of a folder
+// to a task set file and importing the file into an empty folder. The
+// growth of the heap while they run shows that neither keeps the set in
+// memory.
+BENCHMARK(TaskXml) {
+    wchar_t temp_path[MAX_PATH];
+    if (!::GetTempPathW(MAX_PATH, temp_path))
+        return;
+    CStringW xml_path(temp_path);
+    xml_path += L"task_scheduler_bench.xml";
+
+    for (size_t num_tasks : kTaskSetSizes) {
+        std::unique_ptr<TaskScheduler> source(CreateFakeTaskScheduler(0, L""));
+        if (!source)
+            return;
+        std::vector<TaskScheduler::RegisterResult> results;
+        if (!source->RegisterTasks(MakeSpecs(num_tasks), &results))
+            return;
+
+        HeapUsage before;
+        HeapUsage after;
+        GetHeapUsage(&before);
+        size_t num_exported = 0;
+        size_t num_skipped = 0;
+        Stopwatch stopwatch;
+        if (!ExportTasksToXml(source.get(), xml_path, &num_exported,
+                &num_skipped) || num_exported != num_tasks) {
+            return;
+        }
+        reporter->Report("TaskXml/Export", num_tasks, num_tasks,
+            stopwatch.ElapsedNanoseconds());
+        GetHeapUsage(&after);
+        reporter->ReportValue("TaskXml/ExportHeapGrowth", num_tasks,
+            static_cast<double>(after.num_bytes) - before.num_bytes, "bytes");
+
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (::GetFileAttributesExW(xml_path, GetFileExInfoStandard,
+                &attributes)) {
+            reporter->ReportValue("TaskXml/FileSize", num_tasks,
+                static_cast<double>(attributes.nFileSizeLow) / num_tasks,
+                "bytes/task");
+        }
+        source->UnInitilize();
+        source.reset();
+
+        std::unique_ptr<TaskScheduler> target(CreateFakeTaskScheduler(0, L""));
+        if (!target)
+            return;
+        GetHeapUsage(&before);
+        XmlImportReport report;
+        stopwatch.Restart();
+        if (!ImportTasksFromXml(target.get(), xml_path, kImportBatchSize,
+                &report) || report.num_created != num_tasks) {
+            return;
+        }
+        reporter->Report("TaskXml/Import", num_tasks, num_tasks,
+            stopwatch.ElapsedNanoseconds());
+        GetHeapUsage(&after);
+        // Includes the imported tasks, held by the fake folder.
+        reporter->ReportValue("TaskXml/ImportHeapGrowth", num_tasks,
+            (static_cast<double>(after.num_bytes) - before.num_bytes) /
+            num_tasks, "bytes/task");
+        target->UnInitilize();
+    }
+    ::DeleteFileW(xml_path);
+}
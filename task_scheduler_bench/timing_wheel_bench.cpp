@@ -0,0 +1,113 @@
+#include <stdint.h>
+
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "timing_wheel.h"
+
+namespace {
+
+const size_t kTimerCounts[] = { 1000, 100000, 1000000 };
+
+// Firings are spread over the period of TRIGGER_TYPE_EVERY_SIX_HOURS and the
+// clock is advanced a second at a time, as the in-process engine would.
+const uint64_t kHorizonInMs = 6 * 60 * 60 * 1000;
+const uint64_t kStepInMs = 1000;
+const uint64_t kStart = 1000 * 1000 * 1000;
+
+std::vector<uint64_t> RandomExpiries(size_t count) {
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<uint64_t> distribution(1, kHorizonInMs);
+    std::vector<uint64_t> expiries(count);
+    for (uint64_t& expires : expiries)
+        expires = kStart + distribution(generator);
+    return expiries;
+}
+
+struct QueueEntry {
+    uint64_t expires;
+    size_t index;
+
+    bool operator>(const QueueEntry& other) const {
+        return expires > other.expires;
+    }
+};
+
+typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+    std::greater<QueueEntry>> TimerQueue;
+
+}  // namespace
+
+// Schedule |count| timers, cancel every other one, then advance through the
+// whole horizon.
+BENCHMARK(TimingWheelTimers) {
+    for (size_t count : kTimerCounts) {
+        std::vector<uint64_t> expiries = RandomExpiries(count);
+        std::vector<TimingWheel::Timer> timers(count);
+        TimingWheel wheel(kStart);
+
+        Stopwatch stopwatch;
+        for (size_t i = 0; i < count; ++i)
+            wheel.Schedule(&timers[i], expiries[i]);
+        reporter->Report("TimingWheel/Insert", count, count,
+            stopwatch.ElapsedNanoseconds());
+
+        stopwatch.Restart();
+        for (size_t i = 0; i < count; i += 2)
+            wheel.Cancel(&timers[i]);
+        reporter->Report("TimingWheel/Cancel", count, count / 2,
+            stopwatch.ElapsedNanoseconds());
+
+        size_t expired = 0;
+        TimingWheel::ExpiryCallback callback =
+            [&expired](TimingWheel::Timer* timer) { ++expired; };
+        stopwatch.Restart();
+        for (uint64_t now = kStart; now <= kStart + kHorizonInMs;
+            now += kStepInMs) {
+            wheel.Advance(now, callback);
+        }
+        reporter->Report("TimingWheel/Expire", count, expired,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
+
+// The same with a binary heap. It can't remove arbitrary entries, so
+// cancelling only flags the timer and the entry is dropped when it surfaces.
+BENCHMARK(PriorityQueueTimers) {
+    for (size_t count : kTimerCounts) {
+        std::vector<uint64_t> expiries = RandomExpiries(count);
+        std::vector<bool> cancelled(count, false);
+        TimerQueue queue;
+
+        Stopwatch stopwatch;
+        for (size_t i = 0; i < count; ++i) {
+            QueueEntry entry = { expiries[i], i };
+            queue.push(entry);
+        }
+        reporter->Report("PriorityQueue/Insert", count, count,
+            stopwatch.ElapsedNanoseconds());
+
+        stopwatch.Restart();
+        for (size_t i = 0; i < count; i += 2)
+            cancelled[i] = true;
+        reporter->Report("PriorityQueue/Cancel", count, count / 2,
+            stopwatch.ElapsedNanoseconds());
+
+        size_t expired = 0;
+        stopwatch.Restart();
+        for (uint64_t now = kStart; now <= kStart + kHorizonInMs;
+            now += kStepInMs) {
+            while (!queue.empty() && queue.top().expires <= now) {
+                if (!cancelled[queue.top().index])
+                    ++expired;
+                queue.pop();
+            }
+        }
+        DoNotOptimize(expired);
+        reporter->Report("PriorityQueue/Expire", count, expired,
+            stopwatch.ElapsedNanoseconds());
+    }
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "trigger_schedule.h"
+
+namespace {
+
+const struct {
+    const char* name;
+    const wchar_t* text;
+} kSchedules[] = {
+    { "TriggerSchedule/EveryFiveMinutes", L"*/5 * * * *" },
+    { "TriggerSchedule/Weekdays", L"30 8,12,17 * * MON-FRI" },
+    // Both day fields restricted, which fires rarely: the search crosses
+    // months.
+    { "TriggerSchedule/FridayThe13th", L"0 0 13 * FRI" },
+    { "TriggerSchedule/LeapDay", L"0 0 29 2 *" },
+    { "TriggerSchedule/Interval", L"R/2026-01-01T00:00:00Z/PT6H" },
+};
+
+const size_t kNumQueries = 1000000;
+
+// Queries are spread over a few years from 2026-01-01T00:00:00Z, as the
+// in-process engine would make them for a large catalog.
+const int64_t kFirstQuery = 1767225600;
+const int64_t kQuerySpan = 4 * 365 * 24 * 60 * 60;
+
+}  // namespace
+
+// Compute next fire times, both from random instants and one after the
+// other as a task firing repeatedly does.
+BENCHMARK(TriggerSchedules) {
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<int64_t> distribution(0, kQuerySpan);
+    std::vector<int64_t> queries(kNumQueries);
+    for (int64_t& query : queries)
+        query = kFirstQuery + distribution(generator);
+
+    Stopwatch stopwatch;
+    for (size_t i = 0; i < kNumQueries; ++i) {
+        TriggerSchedule schedule;
+        DoNotOptimize(
+            schedule.Parse(kSchedules[i % _countof(kSchedules)].text));
+    }
+    reporter->Report("TriggerSchedule/Parse", 0, kNumQueries,
+        stopwatch.ElapsedNanoseconds());
+
+    for (const auto& entry : kSchedules) {
+        TriggerSchedule schedule;
+        if (!schedule.Parse(entry.text))
+            return;
+
+        int64_t next = 0;
+        stopwatch.Restart();
+        for (int64_t query : queries) {
+            schedule.GetNextFireTime(query, &next);
+            DoNotOptimize(next);
+        }
+        reporter->Report((std::string(entry.name) + "/Random").c_str(), 0,
+            kNumQueries, stopwatch.ElapsedNanoseconds());
+
+        next = kFirstQuery;
+        stopwatch.Restart();
+        for (size_t i = 0; i < kNumQueries; ++i) {
+            if (!schedule.GetNextFireTime(next, &next))
+                break;
+        }
+        DoNotOptimize(next);
+        reporter->Report((std::string(entry.name) + "/Consecutive").c_str(),
+            0, kNumQueries, stopwatch.ElapsedNanoseconds());
+    }
+}
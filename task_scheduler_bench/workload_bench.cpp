@@ -0,0 +1,110 @@
+#include <atlbase.h>
+#include <atlstr.h>
+#include <taskschd.h>
+
+#include <stdio.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "fake_task_service.h"
+#include "recording_task_scheduler.h"
+#include "replay_tool.h"
+#include "task_scheduler.h"
+#include "workload_replayer.h"
+#include "workload_trace.h"
+
+namespace {
+
+// The shape of a deployment: a burst of registrations, then supervisors
+// polling the tasks, mostly for whether they are enabled.
+const size_t kNumDeployedTasks = 500;
+const size_t kNumPolls = 20000;
+const size_t kGetTaskInfoPercent = 20;
+
+const size_t kNumClients[] = { 1, 4, 16 };
+const unsigned int kLatencyUs = 20;
+
+// Return the size of the file at |path|, or 0 if it can't be opened.
+long FileSize(const wchar_t* path) {
+    FILE* file = nullptr;
+    if (::_wfopen_s(&file, path, L"rb") != 0)
+        return 0;
+    long size = ::fseek(file, 0, SEEK_END) == 0 ? ::ftell(file) : 0;
+    ::fclose(file);
+    return size;
+}
+
+// Run the deployment workload through a recorder writing to |trace_path|.
+bool RecordDeployment(const wchar_t* trace_path) {
+    std::unique_ptr<TaskScheduler> scheduler(CreateFakeTaskScheduler(0, L""));
+    if (!scheduler)
+        return false;
+    std::unique_ptr<TaskScheduler> recorder(
+        CreateRecordingTaskScheduler(scheduler.release(), trace_path));
+    if (!recorder)
+        return false;
+
+    std::vector<CStringW> names(kNumDeployedTasks);
+    for (size_t i = 0; i < kNumDeployedTasks; ++i) {
+        names[i].Format(L"Deployed%Iu", i);
+        CStringW arguments;
+        arguments.Format(L"--task=%Iu", i);
+        recorder->RegisterTask(names[i], L"Benchmark task.",
+            L"C:\\Program Files\\Bench\\bench.exe", arguments,
+            TaskScheduler::TRIGGER_TYPE_HOURLY, false);
+    }
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<size_t> task(0, kNumDeployedTasks - 1);
+    std::uniform_int_distribution<size_t> percent(0, 99);
+    for (size_t i = 0; i < kNumPolls; ++i) {
+        const CStringW& name = names[task(generator)];
+        if (percent(generator) < kGetTaskInfoPercent) {
+            TaskScheduler::TaskInfo info;
+            recorder->GetTaskInfo(name, &info);
+        } else {
+            recorder->IsTaskEnabled(name);
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+// Record a deployment followed by polling, then replay it as fast as possible
+// by a growing number of clients against a task service that takes
+// kLatencyUs per call. Also reports the size of the trace.
+BENCHMARK(WorkloadReplay) {
+    wchar_t temp_path[MAX_PATH];
+    if (!::GetTempPathW(MAX_PATH, temp_path))
+        return;
+    CStringW trace_path(temp_path);
+    trace_path += L"task_scheduler_bench.trace";
+
+    if (!RecordDeployment(trace_path))
+        return;
+    std::vector<WorkloadCall> calls;
+    bool read = ReadWorkloadTrace(trace_path, &calls);
+    long trace_size = FileSize(trace_path);
+    ::DeleteFileW(trace_path);
+    if (!read || calls.empty())
+        return;
+    reporter->ReportValue("WorkloadReplay/TraceSize", calls.size(),
+        static_cast<double>(trace_size) / calls.size(), "bytes/call");
+
+    for (size_t num_clients : kNumClients) {
+        std::unique_ptr<TaskScheduler> scheduler(
+            CreateFakeTaskScheduler(0, L""));
+        if (!scheduler)
+            return;
+        SetFakeTaskServiceLatency(kLatencyUs);
+        ReplayReport report;
+        ReplayWorkload(calls, scheduler.get(), 0, num_clients, &report);
+        SetFakeTaskServiceLatency(0);
+        ReportReplay("WorkloadReplay", report, num_clients, reporter);
+        scheduler->UnInitilize();
+    }
+}